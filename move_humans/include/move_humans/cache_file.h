@@ -0,0 +1,136 @@
+#ifndef MOVE_HUMANS_CACHE_FILE_
+#define MOVE_HUMANS_CACHE_FILE_
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <boost/shared_ptr.hpp>
+
+namespace move_humans {
+// files of the caches of move_humans and its plugins, named after the hashes
+// of the map and parameters their contents were computed from and starting
+// with a common header, files are read through read-only mappings and written
+// next to their path and renamed over it, so that mappings of the old file,
+// also by other processes, stay valid
+class CacheFile {
+public:
+  // first member of the file header of each cache
+  struct Header {
+    uint32_t magic, version;
+    uint64_t map_hash, params_hash;
+  };
+
+  class Mapping {
+  public:
+    Mapping(void *data, size_t size) : data_(data), size_(size) {}
+    ~Mapping() { munmap(data_, size_); }
+
+    const char *data() const { return (const char *)data_; }
+    size_t size() const { return size_; }
+    const Header &header() const { return *(const Header *)data_; }
+
+    bool matches(uint32_t magic, uint32_t version) const {
+      return header().magic == magic && header().version == version;
+    }
+    bool matches(uint32_t magic, uint32_t version, uint64_t map_hash,
+                 uint64_t params_hash) const {
+      return matches(magic, version) && header().map_hash == map_hash &&
+             header().params_hash == params_hash;
+    }
+
+  private:
+    void *data_;
+    size_t size_;
+  };
+  typedef boost::shared_ptr<const Mapping> MappingConstPtr;
+
+  // bytes written one after another
+  typedef std::vector<std::pair<const void *, size_t>> Parts;
+
+  // FNV-1a hash of bytes, chained through hash
+  static uint64_t hash(const void *bytes, size_t size,
+                       uint64_t hash = 14695981039346656037ULL) {
+    auto data = (const unsigned char *)bytes;
+    for (size_t i = 0; i < size; i++) {
+      hash = (hash ^ data[i]) * 1099511628211ULL;
+    }
+    return hash;
+  }
+  template <typename T>
+  static uint64_t hashValue(const T &value, uint64_t hash) {
+    return CacheFile::hash(&value, sizeof(value), hash);
+  }
+
+  // name of the file of the hashes inside a cache directory
+  static std::string name(uint64_t map_hash, uint64_t params_hash,
+                          const char *suffix) {
+    char name[40];
+    snprintf(name, sizeof(name), "%016llx_%016llx",
+             (unsigned long long)map_hash, (unsigned long long)params_hash);
+    return name + std::string(suffix);
+  }
+
+  // create directory if it does not exist, returns false with errno set if it
+  // can not be created
+  static bool makeDirectory(const std::string &directory) {
+    return mkdir(directory.c_str(), 0755) == 0 || errno == EEXIST;
+  }
+
+  // map the whole file at path, returns NULL with errno set if it can not be
+  // mapped, ENOENT if it does not exist and EINVAL if it is too short for a
+  // header, whose fields are left to be checked
+  static MappingConstPtr map(const std::string &path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return MappingConstPtr();
+    }
+    struct stat file_stat;
+    void *data = MAP_FAILED;
+    int error = EINVAL;
+    if (fstat(fd, &file_stat) != 0) {
+      error = errno;
+    } else if ((size_t)file_stat.st_size >= sizeof(Header)) {
+      data = mmap(NULL, file_stat.st_size, PROT_READ, MAP_SHARED, fd, 0);
+      error = errno;
+    }
+    ::close(fd);
+    if (data == MAP_FAILED) {
+      errno = error;
+      return MappingConstPtr();
+    }
+    return MappingConstPtr(new Mapping(data, file_stat.st_size));
+  }
+
+  // write parts to a file next to path and rename it over path, returns false
+  // with errno set if either failed
+  static bool write(const std::string &path, const Parts &parts) {
+    auto tmp_path = path + ".tmp" + std::to_string(getpid());
+    FILE *file = fopen(tmp_path.c_str(), "wb");
+    if (!file) {
+      return false;
+    }
+    bool written = true;
+    for (size_t i = 0; written && i < parts.size(); i++) {
+      written = parts[i].second == 0 ||
+                fwrite(parts[i].first, parts[i].second, 1, file) == 1;
+    }
+    written = (fclose(file) == 0) && written;
+    written = written && rename(tmp_path.c_str(), path.c_str()) == 0;
+    if (!written) {
+      int error = errno;
+      unlink(tmp_path.c_str());
+      errno = error;
+    }
+    return written;
+  }
+};
+}; // namespace move_humans
+
+#endif // MOVE_HUMANS_CACHE_FILE_
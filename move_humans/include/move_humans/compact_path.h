@@ -0,0 +1,182 @@
+#ifndef MOVE_HUMANS_COMPACT_PATH_
+#define MOVE_HUMANS_COMPACT_PATH_
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+#include <boost/function.hpp>
+#include <ros/ros.h>
+#include <tf/transform_datatypes.h>
+
+#include "move_humans/types.h"
+
+namespace move_humans {
+// path with one frame and stamp for all of its points and the points packed
+// as floats, about a tenth of the size of a pose_vector, for keeping and
+// copying paths inside a planner or controller, poses are only made when the
+// path leaves it
+class CompactPath {
+public:
+  // whether the straight segment from point first to point last may replace
+  // the points between them
+  typedef boost::function<bool(const CompactPath &path, size_t first,
+                               size_t last)>
+      SegmentCheck;
+
+  std::string frame_id;
+  ros::Time stamp;
+
+  size_t size() const { return x_.size(); }
+  bool empty() const { return x_.empty(); }
+  void clear() {
+    x_.clear();
+    y_.clear();
+    yaw_.clear();
+  }
+  void reserve(size_t size) {
+    x_.reserve(size);
+    y_.reserve(size);
+    yaw_.reserve(size);
+  }
+  void push_back(double x, double y, double yaw = 0.0) {
+    x_.push_back(x);
+    y_.push_back(y);
+    yaw_.push_back(yaw);
+  }
+  void swap(CompactPath &other) {
+    frame_id.swap(other.frame_id);
+    std::swap(stamp, other.stamp);
+    x_.swap(other.x_);
+    y_.swap(other.y_);
+    yaw_.swap(other.yaw_);
+  }
+
+  double x(size_t i) const { return x_[i]; }
+  double y(size_t i) const { return y_[i]; }
+  double yaw(size_t i) const { return yaw_[i]; }
+
+  // approximate heap memory of the points
+  size_t memoryUsage() const { return 3 * x_.capacity() * sizeof(float); }
+
+  // frame and stamp are taken from the first pose
+  void assign(const move_humans::pose_vector &poses) {
+    clear();
+    if (!poses.empty()) {
+      frame_id = poses.front().header.frame_id;
+      stamp = poses.front().header.stamp;
+    }
+    reserve(poses.size());
+    for (auto &pose : poses) {
+      push_back(pose.pose.position.x, pose.pose.position.y,
+                tf::getYaw(pose.pose.orientation));
+    }
+  }
+
+  // points of other are added as they are, whatever their frame
+  void append(const CompactPath &other) {
+    x_.insert(x_.end(), other.x_.begin(), other.x_.end());
+    y_.insert(y_.end(), other.y_.begin(), other.y_.end());
+    yaw_.insert(yaw_.end(), other.yaw_.begin(), other.yaw_.end());
+  }
+
+  // append the points as poses to poses, all with the frame and stamp of the
+  // path
+  void appendPoses(move_humans::pose_vector &poses) const {
+    geometry_msgs::PoseStamped pose;
+    pose.header.frame_id = frame_id;
+    pose.header.stamp = stamp;
+    poses.reserve(poses.size() + size());
+    for (size_t i = 0; i < size(); i++) {
+      pose.pose.position.x = x_[i];
+      pose.pose.position.y = y_[i];
+      pose.pose.orientation.z = std::sin(yaw_[i] / 2.0);
+      pose.pose.orientation.w = std::cos(yaw_[i] / 2.0);
+      poses.push_back(pose);
+    }
+  }
+  void toPoses(move_humans::pose_vector &poses) const {
+    poses.clear();
+    appendPoses(poses);
+  }
+
+  // Douglas-Peucker simplification, drops points closer than tolerance to
+  // the straight segment between the points kept around them, and only if
+  // segment_free accepts that segment, first and last points are always
+  // kept, returns the number of dropped points
+  size_t simplify(double tolerance,
+                  const SegmentCheck &segment_free = SegmentCheck()) {
+    if (size() < 3 || tolerance <= 0.0) {
+      return 0;
+    }
+    std::vector<char> keep(size(), false);
+    keep.front() = keep.back() = true;
+    std::vector<std::pair<size_t, size_t>> ranges(1, {0, size() - 1});
+    double sq_tolerance = tolerance * tolerance;
+    while (!ranges.empty()) {
+      auto range = ranges.back();
+      ranges.pop_back();
+      if (range.second - range.first < 2) {
+        continue;
+      }
+      size_t farthest = range.first + 1;
+      double max_sq_dist = -1.0;
+      for (size_t i = range.first + 1; i < range.second; i++) {
+        double sq_dist = sqSegmentDist(i, range.first, range.second);
+        if (sq_dist > max_sq_dist) {
+          max_sq_dist = sq_dist;
+          farthest = i;
+        }
+      }
+      if (max_sq_dist <= sq_tolerance) {
+        if (!segment_free || segment_free(*this, range.first, range.second)) {
+          continue;
+        }
+        // rejected only by segment_free, halving is quicker than splitting
+        // at points that may all be on the segment
+        farthest = (range.first + range.second) / 2;
+      }
+      keep[farthest] = true;
+      ranges.push_back({range.first, farthest});
+      ranges.push_back({farthest, range.second});
+    }
+
+    size_t kept = 0;
+    for (size_t i = 0; i < size(); i++) {
+      if (keep[i]) {
+        x_[kept] = x_[i];
+        y_[kept] = y_[i];
+        yaw_[kept] = yaw_[i];
+        kept++;
+      }
+    }
+    size_t dropped = size() - kept;
+    x_.resize(kept);
+    y_.resize(kept);
+    yaw_.resize(kept);
+    return dropped;
+  }
+
+private:
+  std::vector<float> x_, y_, yaw_;
+
+  // squared distance of point i to the segment from point a to point b
+  double sqSegmentDist(size_t i, size_t a, size_t b) const {
+    double dx = x_[b] - x_[a], dy = y_[b] - y_[a];
+    double px = x_[i] - x_[a], py = y_[i] - y_[a];
+    double sq_length = dx * dx + dy * dy;
+    if (sq_length > 0.0) {
+      double t = std::max(0.0, std::min(1.0, (px * dx + py * dy) / sq_length));
+      px -= t * dx;
+      py -= t * dy;
+    }
+    return px * px + py * py;
+  }
+};
+
+using map_compact_path = std::map<uint64_t, CompactPath>;
+}; // namespace move_humans
+
+#endif // MOVE_HUMANS_COMPACT_PATH_
@@ -0,0 +1,136 @@
+#ifndef MOVE_HUMANS_CONTROL_SCHEDULER_
+#define MOVE_HUMANS_CONTROL_SCHEDULER_
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+namespace move_humans {
+// fixed-rate scheduler for the control loop, ticks are due at absolute
+// deadlines on the monotonic clock so that time spent in a tick does not
+// shift later ticks, when ticks are missed the catch-up policy decides
+// whether they are dropped or run as additional fixed-dt steps
+class ControlScheduler {
+public:
+  enum CatchUpPolicy { SKIP_TICKS = 0, FIXED_DT_SUBSTEPS = 1 };
+
+  struct Statistics {
+    uint64_t ticks, overruns, skipped_ticks, substeps;
+    double max_latency, p50_latency, p90_latency, p99_latency; // seconds
+  };
+
+  ControlScheduler(size_t latency_window = 1024)
+      : period_(0.1), policy_(SKIP_TICKS), max_substeps_(1),
+        latency_window_(std::max(latency_window, (size_t)1)) {
+    reset(period_);
+  }
+
+  // start ticking with period from now, clears statistics
+  void reset(double period) {
+    setPeriod(period);
+    next_deadline_ = clock::now() + period_duration_;
+    ticks_ = overruns_ = skipped_ticks_ = substeps_ = 0;
+    max_latency_ = 0.0;
+    latencies_.clear();
+    latency_index_ = 0;
+  }
+
+  // change the period without resetting, next deadline is kept
+  void setPeriod(double period) {
+    period_ = period > 0.0 ? period : 0.1;
+    period_duration_ = std::chrono::duration_cast<clock::duration>(
+        std::chrono::duration<double>(period_));
+  }
+
+  void setPolicy(CatchUpPolicy policy, size_t max_substeps) {
+    policy_ = policy;
+    max_substeps_ = std::max(max_substeps, (size_t)1);
+  }
+
+  double period() const { return period_; }
+
+  // sleep until the next deadline, returns the number of fixed-dt steps of
+  // period length the caller should run for this tick
+  size_t wait() {
+    auto now = clock::now();
+    if (now > next_deadline_) {
+      overruns_++;
+    } else {
+      std::this_thread::sleep_until(next_deadline_);
+      now = clock::now();
+    }
+
+    double latency =
+        std::chrono::duration<double>(now - next_deadline_).count();
+    recordLatency(latency);
+    ticks_++;
+
+    // deadlines that passed entirely while the last tick was running
+    size_t missed = (size_t)std::floor(latency / period_);
+    next_deadline_ += period_duration_ * (missed + 1);
+
+    size_t steps = 1;
+    if (missed > 0) {
+      if (policy_ == FIXED_DT_SUBSTEPS) {
+        steps = std::min(missed + 1, max_substeps_);
+        substeps_ += steps - 1;
+        skipped_ticks_ += missed + 1 - steps;
+      } else {
+        skipped_ticks_ += missed;
+      }
+    }
+    return steps;
+  }
+
+  Statistics statistics() const {
+    Statistics statistics;
+    statistics.ticks = ticks_;
+    statistics.overruns = overruns_;
+    statistics.skipped_ticks = skipped_ticks_;
+    statistics.substeps = substeps_;
+    statistics.max_latency = max_latency_;
+    auto latencies = latencies_;
+    statistics.p50_latency = percentile(latencies, 0.5);
+    statistics.p90_latency = percentile(latencies, 0.9);
+    statistics.p99_latency = percentile(latencies, 0.99);
+    return statistics;
+  }
+
+private:
+  typedef std::chrono::steady_clock clock;
+
+  double period_;
+  clock::duration period_duration_;
+  clock::time_point next_deadline_;
+  CatchUpPolicy policy_;
+  size_t max_substeps_;
+
+  uint64_t ticks_, overruns_, skipped_ticks_, substeps_;
+  double max_latency_;
+  size_t latency_window_, latency_index_;
+  std::vector<double> latencies_;
+
+  void recordLatency(double latency) {
+    max_latency_ = std::max(max_latency_, latency);
+    if (latencies_.size() < latency_window_) {
+      latencies_.push_back(latency);
+    } else {
+      latencies_[latency_index_] = latency;
+      latency_index_ = (latency_index_ + 1) % latency_window_;
+    }
+  }
+
+  static double percentile(std::vector<double> &values, double fraction) {
+    if (values.empty()) {
+      return 0.0;
+    }
+    auto nth = values.begin() + (size_t)(fraction * (values.size() - 1));
+    std::nth_element(values.begin(), nth, values.end());
+    return *nth;
+  }
+};
+}; // namespace move_humans
+
+#endif // MOVE_HUMANS_CONTROL_SCHEDULER_
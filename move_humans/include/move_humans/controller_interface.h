@@ -5,6 +5,7 @@
 #include <tf/transform_listener.h>
 
 #include "move_humans/types.h"
+#include "move_humans/spatial_index.h"
 
 namespace move_humans {
 class ControllerInterface {
@@ -20,8 +21,29 @@ public:
 
   virtual bool computeHumansStates(move_humans::map_traj_point &humans) = 0;
 
+  // advance humans by a fixed time step of dt seconds instead of the time
+  // elapsed since the last call, controllers that do not support fixed steps
+  // fall back to elapsed time
+  virtual bool computeHumansStates(move_humans::map_traj_point &humans,
+                                   double dt) {
+    return computeHumansStates(humans);
+  }
+
   virtual bool areGoalsReached(move_humans::id_vector &reached_humans) = 0;
 
+  // forget the given humans, e.g. after they were removed from the running
+  // goal, returns false if the controller can not remove single humans
+  virtual bool removeHumans(const move_humans::id_vector &human_ids) {
+    return false;
+  }
+
+  // index over the human states of the last control cycle, a new one is
+  // given before every computeHumansStates call and a given index is never
+  // changed, controllers can use it for neighbour queries instead of
+  // scanning all humans
+  virtual void setHumansIndex(const move_humans::SpatialIndexConstPtr &index) {
+  }
+
 protected:
   ControllerInterface() {}
 };
@@ -0,0 +1,181 @@
+#ifndef MOVE_HUMANS_COSTMAP_CHANGES_
+#define MOVE_HUMANS_COSTMAP_CHANGES_
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include <map_msgs/OccupancyGridUpdate.h>
+#include <nav_msgs/OccupancyGrid.h>
+
+#include "move_humans/types.h"
+
+namespace move_humans {
+// world frame box around changed cells of a costmap
+struct ChangedBox {
+  double min_x, min_y, max_x, max_y;
+
+  ChangedBox inflated(double margin) const {
+    return {min_x - margin, min_y - margin, max_x + margin, max_y + margin};
+  }
+  void merge(const ChangedBox &box) {
+    min_x = std::min(min_x, box.min_x);
+    min_y = std::min(min_y, box.min_y);
+    max_x = std::max(max_x, box.max_x);
+    max_y = std::max(max_y, box.max_y);
+  }
+
+  bool contains(double x, double y) const {
+    return x >= min_x && x <= max_x && y >= min_y && y <= max_y;
+  }
+
+  // whether the straight segment from (x0, y0) to (x1, y1) touches the box
+  bool intersects(double x0, double y0, double x1, double y1) const {
+    double t0 = 0.0, t1 = 1.0;
+    return clip(x1 - x0, min_x - x0, max_x - x0, t0, t1) &&
+           clip(y1 - y0, min_y - y0, max_y - y0, t0, t1);
+  }
+
+private:
+  // narrow [t0, t1] to where the segment with direction d is between the
+  // slab bounds lo and hi, relative to the segment start
+  static bool clip(double d, double lo, double hi, double &t0, double &t1) {
+    if (d == 0.0) {
+      return lo <= 0.0 && hi >= 0.0;
+    }
+    double ta = lo / d, tb = hi / d;
+    if (ta > tb) {
+      std::swap(ta, tb);
+    }
+    t0 = std::max(t0, ta);
+    t1 = std::min(t1, tb);
+    return t0 <= t1;
+  }
+};
+typedef std::vector<ChangedBox> ChangedBoxes;
+
+// copy of a published costmap that turns updates into boxes around the cells
+// whose values actually changed, costmaps republish whole update bounds even
+// if most of their cells did not change, changed cells are grouped by tiles so
+// that distant changes of one update do not merge into one large box
+class CostmapChangeTracker {
+public:
+  CostmapChangeTracker(unsigned int tile_size = 16)
+      : tile_size_(std::max(tile_size, 1u)), width_(0), height_(0),
+        resolution_(0.0), origin_x_(0.0), origin_y_(0.0) {}
+
+  bool hasGrid() const { return width_ > 0 && height_ > 0; }
+  void reset() { width_ = height_ = 0; }
+
+  // a full costmap, compared with the last one if it has the same geometry,
+  // otherwise it only replaces the copy, returns false if nothing changed
+  bool update(const nav_msgs::OccupancyGrid &grid, ChangedBoxes &changed) {
+    changed.clear();
+    auto &info = grid.info;
+    if (!hasGrid() || info.width != width_ || info.height != height_ ||
+        info.resolution != resolution_ ||
+        info.origin.position.x != origin_x_ ||
+        info.origin.position.y != origin_y_ ||
+        grid.data.size() != (size_t)info.width * info.height) {
+      width_ = info.width;
+      height_ = info.height;
+      resolution_ = info.resolution;
+      origin_x_ = info.origin.position.x;
+      origin_y_ = info.origin.position.y;
+      cells_ = grid.data;
+      if (cells_.size() != (size_t)width_ * height_) {
+        reset();
+      }
+      return false;
+    }
+    return apply(0, 0, width_, height_, grid.data.data(), changed);
+  }
+
+  // cells of a window of the last full costmap, ignored until a full costmap
+  // was received
+  bool update(const map_msgs::OccupancyGridUpdate &update,
+              ChangedBoxes &changed) {
+    changed.clear();
+    if (!hasGrid() || update.x < 0 || update.y < 0 ||
+        update.x + update.width > width_ ||
+        update.y + update.height > height_ ||
+        update.data.size() != (size_t)update.width * update.height) {
+      return false;
+    }
+    return apply(update.x, update.y, update.width, update.height,
+                 update.data.data(), changed);
+  }
+
+private:
+  unsigned int tile_size_;
+  unsigned int width_, height_;
+  double resolution_, origin_x_, origin_y_;
+  std::vector<int8_t> cells_;
+
+  bool apply(unsigned int x0, unsigned int y0, unsigned int width,
+             unsigned int height, const int8_t *data, ChangedBoxes &changed) {
+    unsigned int tiles_x = (width + tile_size_ - 1) / tile_size_;
+    unsigned int tiles_y = (height + tile_size_ - 1) / tile_size_;
+    // changed cell bounds per tile, min > max for tiles without changes
+    std::vector<unsigned int> bounds((size_t)tiles_x * tiles_y * 4);
+    for (size_t t = 0; t < (size_t)tiles_x * tiles_y; t++) {
+      bounds[4 * t] = bounds[4 * t + 1] = UINT32_MAX;
+      bounds[4 * t + 2] = bounds[4 * t + 3] = 0;
+    }
+    bool any = false;
+    for (unsigned int y = 0; y < height; y++) {
+      auto row = &cells_[(size_t)(y0 + y) * width_ + x0];
+      auto update_row = data + (size_t)y * width;
+      for (unsigned int x = 0; x < width; x++) {
+        if (row[x] == update_row[x]) {
+          continue;
+        }
+        row[x] = update_row[x];
+        auto tile = &bounds[4 * ((size_t)(y / tile_size_) * tiles_x +
+                                 x / tile_size_)];
+        tile[0] = std::min(tile[0], x0 + x);
+        tile[1] = std::min(tile[1], y0 + y);
+        tile[2] = std::max(tile[2], x0 + x);
+        tile[3] = std::max(tile[3], y0 + y);
+        any = true;
+      }
+    }
+    if (!any) {
+      return false;
+    }
+    for (size_t t = 0; t < (size_t)tiles_x * tiles_y; t++) {
+      auto tile = &bounds[4 * t];
+      if (tile[0] <= tile[2]) {
+        changed.push_back({origin_x_ + tile[0] * resolution_,
+                           origin_y_ + tile[1] * resolution_,
+                           origin_x_ + (tile[2] + 1) * resolution_,
+                           origin_y_ + (tile[3] + 1) * resolution_});
+      }
+    }
+    return true;
+  }
+};
+
+// whether any segment of plans from the one at first crosses a box, boxes
+// are expected to be inflated by the footprint of the human already
+inline bool plansCross(const move_humans::pose_vectors &plans, size_t first,
+                       const ChangedBoxes &boxes, const ChangedBox &bounds) {
+  for (size_t s = first; s < plans.size(); s++) {
+    auto &plan = plans[s];
+    for (size_t i = 0; i < plan.size(); i++) {
+      auto &p1 = plan[i].pose.position;
+      auto &p0 = plan[i > 0 ? i - 1 : i].pose.position;
+      if (!bounds.intersects(p0.x, p0.y, p1.x, p1.y)) {
+        continue;
+      }
+      for (auto &box : boxes) {
+        if (box.intersects(p0.x, p0.y, p1.x, p1.y)) {
+          return true;
+        }
+      }
+    }
+  }
+  return false;
+}
+}; // namespace move_humans
+
+#endif // MOVE_HUMANS_COSTMAP_CHANGES_
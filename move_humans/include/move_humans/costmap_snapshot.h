@@ -0,0 +1,151 @@
+#ifndef MOVE_HUMANS_COSTMAP_SNAPSHOT_
+#define MOVE_HUMANS_COSTMAP_SNAPSHOT_
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <costmap_2d/costmap_2d.h>
+
+#include "move_humans/profiler.h"
+
+namespace move_humans {
+// immutable copy of the cells and geometry of a costmap, with the getters of
+// costmap_2d::Costmap2D used by planners
+class CostmapSnapshot {
+public:
+  CostmapSnapshot(uint64_t version, const costmap_2d::Costmap2D &costmap)
+      : version_(version), size_x_(costmap.getSizeInCellsX()),
+        size_y_(costmap.getSizeInCellsY()), origin_x_(costmap.getOriginX()),
+        origin_y_(costmap.getOriginY()),
+        resolution_(costmap.getResolution()),
+        costs_(costmap.getCharMap(),
+               costmap.getCharMap() + (size_t)size_x_ * size_y_) {}
+
+  // increases every time the costmap changes
+  uint64_t getVersion() const { return version_; }
+
+  unsigned int getSizeInCellsX() const { return size_x_; }
+  unsigned int getSizeInCellsY() const { return size_y_; }
+  double getOriginX() const { return origin_x_; }
+  double getOriginY() const { return origin_y_; }
+  double getResolution() const { return resolution_; }
+  const unsigned char *getCharMap() const { return costs_.data(); }
+
+  void mapToWorld(unsigned int mx, unsigned int my, double &wx,
+                  double &wy) const {
+    wx = origin_x_ + (mx + 0.5) * resolution_;
+    wy = origin_y_ + (my + 0.5) * resolution_;
+  }
+
+  // whether the costmap still has the same geometry and cells, apart from
+  // the border cells when skip_border is set
+  bool sameAs(const costmap_2d::Costmap2D &costmap, bool skip_border) const {
+    if (costmap.getSizeInCellsX() != size_x_ ||
+        costmap.getSizeInCellsY() != size_y_ ||
+        costmap.getOriginX() != origin_x_ ||
+        costmap.getOriginY() != origin_y_ ||
+        costmap.getResolution() != resolution_) {
+      return false;
+    }
+    if (!skip_border) {
+      return std::memcmp(costmap.getCharMap(), costs_.data(), costs_.size()) ==
+             0;
+    }
+    for (unsigned int y = 1; y + 1 < size_y_; y++) {
+      size_t row = (size_t)y * size_x_ + 1;
+      if (std::memcmp(costmap.getCharMap() + row, costs_.data() + row,
+                      size_x_ - 2) != 0) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // set the border cells to value
+  void outline(unsigned char value) {
+    if (size_x_ == 0 || size_y_ == 0) {
+      return;
+    }
+    std::memset(costs_.data(), value, size_x_);
+    std::memset(costs_.data() + (size_t)(size_y_ - 1) * size_x_, value,
+                size_x_);
+    for (unsigned int y = 0; y < size_y_; y++) {
+      costs_[(size_t)y * size_x_] = value;
+      costs_[(size_t)y * size_x_ + size_x_ - 1] = value;
+    }
+  }
+
+private:
+  uint64_t version_;
+  unsigned int size_x_, size_y_;
+  double origin_x_, origin_y_, resolution_;
+  std::vector<unsigned char> costs_;
+};
+typedef boost::shared_ptr<const CostmapSnapshot> CostmapSnapshotConstPtr;
+
+// copy-on-write snapshots of a costmap, the costmap is locked only to compare
+// it against the latest snapshot and copy it when it changed, snapshots that
+// are still used by someone stay valid after newer ones are taken
+class CostmapSnapshotter {
+public:
+  CostmapSnapshotter()
+      : costmap_(NULL), outline_(false),
+        outline_value_(costmap_2d::LETHAL_OBSTACLE), version_(0) {}
+
+  // with outline set the border cells of snapshots are set to
+  // outline_value, as required by the expanders of global_planner
+  void setCostmap(costmap_2d::Costmap2D *costmap, bool outline = false,
+                  unsigned char outline_value = costmap_2d::LETHAL_OBSTACLE) {
+    boost::mutex::scoped_lock lock(mutex_);
+    costmap_ = costmap;
+    outline_ = outline;
+    outline_value_ = outline_value;
+    snapshot_.reset();
+  }
+
+  // latest snapshot, taking a new one if the costmap changed
+  CostmapSnapshotConstPtr update() {
+    boost::mutex::scoped_lock lock(mutex_);
+    if (costmap_ == NULL) {
+      return snapshot_;
+    }
+    boost::unique_lock<costmap_2d::Costmap2D::mutex_t> costmap_lock(
+        *(costmap_->getMutex()), boost::defer_lock);
+    {
+      MOVE_HUMANS_PROFILE_SCOPE("costmap_snapshot/costmap_lock_wait");
+      costmap_lock.lock();
+    }
+    if (snapshot_ && snapshot_->sameAs(*costmap_, outline_)) {
+      return snapshot_;
+    }
+    MOVE_HUMANS_PROFILE_SCOPE("costmap_snapshot/copy");
+    boost::shared_ptr<CostmapSnapshot> snapshot(
+        new CostmapSnapshot(++version_, *costmap_));
+    costmap_lock.unlock();
+
+    if (outline_) {
+      snapshot->outline(outline_value_);
+    }
+    snapshot_ = snapshot;
+    return snapshot_;
+  }
+
+  // latest snapshot without looking at the costmap, may be empty
+  CostmapSnapshotConstPtr get() {
+    boost::mutex::scoped_lock lock(mutex_);
+    return snapshot_;
+  }
+
+private:
+  costmap_2d::Costmap2D *costmap_;
+  bool outline_;
+  unsigned char outline_value_;
+  uint64_t version_;
+  boost::mutex mutex_;
+  CostmapSnapshotConstPtr snapshot_;
+};
+}; // namespace move_humans
+
+#endif // MOVE_HUMANS_COSTMAP_SNAPSHOT_
@@ -0,0 +1,49 @@
+#ifndef MOVE_HUMANS_HUMAN_STATE_ENCODER_H_
+#define MOVE_HUMANS_HUMAN_STATE_ENCODER_H_
+
+#include <ros/ros.h>
+
+#include "move_humans/types.h"
+#include <move_humans/HumanStateStream.h>
+
+namespace move_humans {
+// encodes human states into a HumanStateStream, deltas are taken against the
+// last sent quantized state so that quantization errors do not accumulate on
+// the receiver
+class HumanStateEncoder {
+public:
+  HumanStateEncoder();
+
+  void setParams(double position_resolution, double yaw_resolution,
+                 double delta_threshold, double yaw_delta_threshold,
+                 double keyframe_period);
+
+  // make the next message a keyframe, e.g. for a new subscriber
+  void reset();
+
+  // fill stream with a keyframe or a delta of human_pts, returns false if
+  // there is nothing to send
+  bool encode(const move_humans::map_traj_point &human_pts,
+              const ros::Time &now, move_humans::HumanStateStream &stream);
+
+private:
+  struct QuantizedState {
+    int32_t x, y, yaw;
+  };
+
+  double position_resolution_, yaw_resolution_, keyframe_period_;
+  int32_t delta_threshold_, yaw_delta_threshold_;
+  std::map<uint64_t, QuantizedState> sent_states_;
+  std::vector<std::pair<uint64_t, QuantizedState>> quantized_;
+  ros::Time last_keyframe_time_;
+  uint32_t sequence_;
+  bool keyframe_due_;
+
+  void quantize(const move_humans::map_traj_point &human_pts);
+  bool needsKeyframe(const ros::Time &now);
+  void writeKeyframe(move_humans::HumanStateStream &stream);
+  void writeDelta(move_humans::HumanStateStream &stream);
+};
+}; // namespace move_humans
+
+#endif // MOVE_HUMANS_HUMAN_STATE_ENCODER_H_
@@ -1,36 +1,67 @@
 #ifndef MOVE_HUMANS_H_
 #define MOVE_HUMANS_H_
 
+#include <set>
 #include <ros/ros.h>
 #include <pluginlib/class_loader.h>
 #include <actionlib/server/simple_action_server.h>
 #include <costmap_2d/costmap_2d_ros.h>
 #include <std_srvs/Empty.h>
 #include <std_srvs/SetBool.h>
+#include <std_srvs/Trigger.h>
 #include <dynamic_reconfigure/server.h>
 #include <hanp_msgs/HumanTrajectoryArray.h>
+#include <hanp_msgs/TrackedHumans.h>
+#include <visualization_msgs/MarkerArray.h>
 
 #include "move_humans/types.h"
 #include "move_humans/planner_interface.h"
 #include "move_humans/controller_interface.h"
+#include "move_humans/plan_set.h"
+#include "move_humans/planning_queue.h"
+#include "move_humans/control_scheduler.h"
+#include "move_humans/costmap_changes.h"
+#include "move_humans/human_state_encoder.h"
+#include "move_humans/profiler.h"
+#include "move_humans/publish_throttle.h"
+#include "move_humans/shard_partition.h"
+#include "move_humans/spatial_index.h"
 #include <move_humans/MoveHumansConfig.h>
+#include <move_humans/HumanGoalUpdate.h>
 #include <move_humans/HumanPose.h>
+#include <move_humans/ShardHandoff.h>
+#include <move_humans/UpdateHumans.h>
 #include <move_humans/MoveHumansAction.h>
 
 namespace move_humans {
 enum MoveHumansState { PLANNING, CONTROLLING, IDLE };
+enum ControlSchedulerType { ROS_RATE_SCHEDULER = 0, DEADLINE_SCHEDULER = 1 };
 
 typedef actionlib::SimpleActionServer<move_humans::MoveHumansAction>
     MoveHumansActionServer;
 
 class MoveHumans {
 public:
-  MoveHumans(tf::TransformListener &tf);
+  // in fast-forward mode there is no action server and no planner thread,
+  // and costmaps are only updated until they have their data
+  MoveHumans(tf::TransformListener &tf, bool fast_forward = false);
   virtual ~MoveHumans();
 
   bool executeCycle(move_humans::map_pose &goals,
                     move_humans::map_pose_vector &global_plans);
 
+  // run the scenarios given in the scenarios parameter, or the humans
+  // parameter as single scenario, stepping the controller with a fixed dt in
+  // simulated time as fast as possible, only for fast-forward mode
+  bool runFastForward();
+
+  // positions of the humans after the last control cycle, the returned
+  // index is not changed by later cycles
+  move_humans::SpatialIndexConstPtr humansIndex() const {
+    boost::mutex::scoped_lock lock(humans_index_mutex_);
+    return humans_index_;
+  }
+
 private:
   tf::TransformListener &tf_;
 
@@ -39,6 +70,13 @@ private:
 
   costmap_2d::Costmap2DROS *planner_costmap_ros_, *controller_costmap_ros_;
   ros::ServiceServer clear_costmaps_srv_;
+  // with lazy_init_ costmaps and plugins are created by the first goal or
+  // prewarm request instead of at startup, both under configuration_mutex_,
+  // the plugins of the current configuration are loaded without names
+  bool lazy_init_, components_initialized_;
+  bool initializeComponents(const std::string &planner_name,
+                            const std::string &controller_name);
+  bool initializeComponents();
 
   boost::shared_ptr<move_humans::PlannerInterface> planner_;
   boost::shared_ptr<move_humans::ControllerInterface> controller_;
@@ -57,6 +95,78 @@ private:
   bool followExternalPaths(std_srvs::SetBool::Request &req,
                            std_srvs::SetBool::Response &res);
 
+  // add, change or remove single humans of the running goal, updates are
+  // queued by the service and applied by the control loop
+  ros::ServiceServer update_humans_srv_;
+  bool updateHumansService(move_humans::UpdateHumans::Request &req,
+                           move_humans::UpdateHumans::Response &res);
+  boost::mutex updates_mutex_;
+  std::vector<move_humans::HumanGoalUpdate> pending_updates_;
+  // returns true if any update was applied
+  bool applyHumanUpdates(move_humans::map_pose &starts,
+                         move_humans::map_pose_vector &sub_goals,
+                         move_humans::map_pose &goals);
+  void publishGoals(const move_humans::map_pose &goals);
+  // queue plan requests for humans with changed_goals and drop the ones of
+  // removed humans
+  void queuePlanRequests(const move_humans::map_pose &starts,
+                         const move_humans::map_pose_vector &sub_goals,
+                         const move_humans::map_pose &changed_goals,
+                         const std::set<uint64_t> &removed);
+
+  // cells of the published planner costmap that changed since the last
+  // control cycle, humans whose remaining plans cross them are replanned
+  ros::Subscriber costmap_sub_, costmap_updates_sub_;
+  void costmapCB(const nav_msgs::OccupancyGridConstPtr &grid);
+  void costmapUpdateCB(const map_msgs::OccupancyGridUpdateConstPtr &update);
+  boost::mutex costmap_changes_mutex_;
+  move_humans::CostmapChangeTracker costmap_changes_;
+  move_humans::ChangedBoxes changed_boxes_;
+  uint64_t costmap_replans_;
+  // returns true if any human is replanned
+  bool replanChangedHumans(move_humans::map_pose &starts,
+                           move_humans::map_pose_vector &sub_goals,
+                           const move_humans::map_pose &goals);
+  // positions of humans after the last control cycle in the global frame
+  move_humans::map_pose
+  currentPoses(const move_humans::id_vector &human_ids);
+  // drop the sub-goals a human already passed, as counted by its plans
+  void dropPassedSubGoals(uint64_t human_id,
+                          move_humans::map_pose_vector &sub_goals);
+  void removeHumans(const std::set<uint64_t> &removed,
+                    move_humans::map_pose &starts,
+                    move_humans::map_pose_vector &sub_goals,
+                    move_humans::map_pose &goals);
+  // let the planner forget humans of the previous goal that are not part of
+  // goals, called with planner_mutex_ held before planner_goals_ is replaced
+  void forgetReplacedHumans(const move_humans::map_pose &goals);
+
+  // humans can be split between several move_humans nodes by their id or by
+  // map regions, goals and updates of humans of other shards are ignored,
+  // humans walking out of the region of this shard are handed to the shard
+  // of their new region on the handoff topic all shards share, they are
+  // controlled by this shard until the other one accepts them and handoffs
+  // without answer are sent again after a timeout
+  move_humans::ShardPartition shard_partition_;
+  ros::Publisher shard_handoff_pub_;
+  ros::Subscriber shard_handoff_sub_;
+  boost::mutex shard_mutex_;
+  std::map<uint64_t, ros::Time> shard_handoffs_sent_;
+  std::set<uint64_t> shard_handoffs_accepted_;
+  uint64_t shard_handoffs_out_, shard_handoffs_in_;
+  void shardHandoffCB(const move_humans::ShardHandoffConstPtr &handoff);
+  void clearShardHandoffs();
+  // pose is in the global frame
+  bool ownsHuman(uint64_t human_id, const geometry_msgs::PoseStamped &pose);
+  void updateShardBounds();
+  void filterShardHumans(move_humans::map_pose &starts,
+                         move_humans::map_pose_vector &sub_goals,
+                         move_humans::map_pose &goals);
+  // returns true if any human was handed off
+  bool handOffHumans(move_humans::map_pose &starts,
+                     move_humans::map_pose_vector &sub_goals,
+                     move_humans::map_pose &goals);
+
   dynamic_reconfigure::Server<move_humans::MoveHumansConfig> *dsrv_;
   move_humans::MoveHumansConfig last_config_;
   move_humans::MoveHumansConfig default_config_;
@@ -66,26 +176,84 @@ private:
   pluginlib::ClassLoader<move_humans::PlannerInterface> planner_loader_;
   pluginlib::ClassLoader<move_humans::ControllerInterface> controller_loader_;
 
-  move_humans::map_pose_vectors *planner_plans_, *controller_plans_,
-      *latest_plans_;
-  move_humans::map_pose_vector current_controller_plans_,
-      current_planner_plans_;
-  move_humans::map_size cp_indices_;
+  // plans are published by the planner thread and picked up by the control
+  // loop when the epoch changed, current segments are tracked with cursors
+  // instead of modifying the shared plans
+  move_humans::PlanSetHandoff plan_handoff_;
+  // controller_plans_ are the latest full plans, humans updated since then
+  // hold plans of partial sets, plans_pending_ is set while the chunks of
+  // streamed full plans are still coming in, humans of later chunks keep
+  // their previous plans until their chunk arrives, streamed_humans_ got
+  // plans of the current full pass and reset_humans_ start over on them in
+  // the next control cycle
+  move_humans::PlanSetConstPtr controller_plans_;
+  uint64_t controller_plans_epoch_;
+  bool plans_pending_;
+  move_humans::map_human_plans human_plans_;
+  std::set<uint64_t> streamed_humans_, reset_humans_;
+  // states published in the last control cycle
+  move_humans::map_traj_point last_human_pts_;
+  // drop plans of humans the finished full pass has no plans for
+  void dropUnstreamedPlans();
+  std::vector<move_humans::PlanSetConstPtr> partial_plans_;
+  move_humans::map_pose_vector current_controller_plans_;
   move_humans::map_trajectory current_controller_trajectories_;
 
   MoveHumansState state_;
-  bool setup_, shutdown_costmaps_, new_global_plans_, reset_controller_plans_,
-      publish_feedback_;
+  bool fast_forward_;
+  ros::Publisher clock_pub_;
+  bool waitForCostmaps(double timeout);
+  bool setup_, shutdown_costmaps_, publish_feedback_;
   double human_radius_;
 
   double planner_frequency_, controller_frequency_;
   bool p_freq_change_, c_freq_change_;
 
+  // with the deadline scheduler the controller is stepped control_steps_
+  // times by control_dt_ per cycle, control_dt_ is 0 for elapsed time
+  move_humans::ControlScheduler control_scheduler_;
+  size_t control_steps_;
+  double control_dt_;
+  ros::Publisher diagnostics_pub_;
+  ros::WallTime last_diagnostics_time_;
+  uint64_t last_diagnostics_overruns_;
+  void publishControlDiagnostics();
+
+  // profiler timings are reported with the diagnostics period, traces are
+  // written on request and when the node stops
+  ros::WallTime last_profile_time_;
+  void setProfilingConfig(const move_humans::MoveHumansConfig &config);
+  void publishProfileDiagnostics();
+  ros::ServiceServer write_profile_trace_srv_;
+  bool writeProfileTraceService(std_srvs::Trigger::Request &req,
+                                std_srvs::Trigger::Response &res);
+
+  // built from the controller output every control cycle into the spare
+  // index, which is then swapped with the current one, so that indexes that
+  // were handed out are never rebuilt, the spare is reused once it is
+  // released by the controller
+  mutable boost::mutex humans_index_mutex_;
+  move_humans::SpatialIndexPtr humans_index_, spare_humans_index_;
+  void updateHumansIndex(const move_humans::map_traj_point &human_pts);
+
   bool run_planner_;
   boost::mutex planner_mutex_, external_trajs_mutex_;
   boost::condition_variable planner_cond_;
   move_humans::map_pose planner_starts_, planner_goals_;
   move_humans::map_pose_vector planner_sub_goals_;
+  // humans changed by updates that still need plans, planned in batches of
+  // the most urgent ones
+  move_humans::PlanningQueue planning_queue_;
+  size_t planning_batch_size_;
+  double plan_request_timeout_;
+  void setPlanningQueueConfig(const move_humans::MoveHumansConfig &config);
+  // requests of humans without plans are urgent, the others are ordered by
+  // their distance to robot_frame_ if set
+  std::string robot_frame_;
+  bool getRobotPosition(double &x, double &y);
+  void planPartial(const move_humans::map_pose &starts,
+                   const move_humans::map_pose_vector &sub_goals,
+                   const move_humans::map_pose &goals);
   boost::thread *planner_thread_;
 
   void planThread();
@@ -93,6 +261,17 @@ private:
 
   bool clearCostmapsService(std_srvs::Empty::Request &req,
                             std_srvs::Empty::Response &resp);
+
+  // plan all scenarios once without moving any human, so that a planner
+  // keeping plans between runs has them ready, the planner is called from the
+  // service thread and has to serialize this with the planner thread
+  ros::ServiceServer prewarm_plans_srv_;
+  bool prewarmPlansService(std_srvs::Trigger::Request &req,
+                           std_srvs::Trigger::Response &res);
+  // scenarios of the scenarios parameter, or the humans parameter as single
+  // scenario, returns false if there are none
+  bool readScenarios(std::vector<std::string> &scenario_names,
+                     std::vector<XmlRpc::XmlRpcValue> &scenario_humans);
   void resetState();
 
   template <typename T>
@@ -108,7 +287,23 @@ private:
                      move_humans::map_pose &starts,
                      move_humans::map_pose_vector &sub_goals,
                      move_humans::map_pose &goals);
-  void publishHumans(const move_humans::map_traj_point &human_pts);
+  // publish at the configured rates, force publishes immediately
+  void publishHumans(const move_humans::map_traj_point &human_pts,
+                     bool force = false);
+  void publishFeedback(const move_humans::map_traj_point &human_pts);
+  void publishHumanStream(const move_humans::map_traj_point &human_pts,
+                          bool force, const ros::Time &now,
+                          const std::string &frame_id);
+  move_humans::PublishThrottle humans_throttle_, markers_throttle_,
+      feedback_throttle_;
+  hanp_msgs::TrackedHumans humans_msg_;
+  visualization_msgs::MarkerArray humans_markers_msg_;
+  move_humans::MoveHumansFeedback feedback_msg_;
+  ros::Publisher human_stream_pub_;
+  move_humans::PublishThrottle stream_throttle_;
+  move_humans::HumanStateEncoder human_state_encoder_;
+  move_humans::HumanStateStream human_stream_msg_;
+  uint32_t human_stream_subscribers_;
 };
 }; // namespace move_humans
 
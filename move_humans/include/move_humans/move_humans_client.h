@@ -8,7 +8,9 @@
 #include <boost/thread.hpp>
 
 #include "move_humans/types.h"
+#include <move_humans/HumanGoalUpdate.h>
 #include <move_humans/HumanUpdate.h>
+#include <move_humans/UpdateHumans.h>
 #include <move_humans/MoveHumansAction.h>
 
 namespace move_humans {
@@ -20,6 +22,13 @@ public:
   MoveHumansClient(tf::TransformListener &tf);
   virtual ~MoveHumansClient();
 
+  // read start and goal poses from a list of {id, start, end} entries, as
+  // given in humans.yaml
+  static bool parseHumans(XmlRpc::XmlRpcValue &humans,
+                          const std::string &frame_id,
+                          move_humans::map_pose &starts,
+                          move_humans::map_pose &goals);
+
 private:
   tf::TransformListener &tf_;
 
@@ -57,6 +66,13 @@ private:
   move_humans::map_pose_vector sub_goals_;
   move_humans::id_vector reached_goals_;
 
+  // humans changed since the last goal or update was sent, with the
+  // HumanGoalUpdate operation for them, a reset needs a new goal instead
+  std::map<uint64_t, uint8_t> changed_humans_;
+  bool send_full_goal_;
+  ros::ServiceClient update_humans_client_;
+  void getUpdates(std::vector<move_humans::HumanGoalUpdate> &updates);
+
   bool getHumansGoals(ros::NodeHandle &nh, move_humans::map_pose &starts,
                       move_humans::map_pose &goals);
 };
@@ -0,0 +1,172 @@
+#ifndef MOVE_HUMANS_PLAN_SET_
+#define MOVE_HUMANS_PLAN_SET_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include "move_humans/types.h"
+
+namespace move_humans {
+// plans of one planning pass, never modified once handed over, a partial
+// plan set only holds the humans that were replanned after an update, a pass
+// handed over in chunks while it runs is a full set followed by partial sets
+// with the epoch of the full set as stream_epoch, all chunks but the last
+// have more_pending set
+struct PlanSet {
+  PlanSet() : epoch(0), partial(false), stream_epoch(0), more_pending(false) {}
+
+  uint64_t epoch;
+  bool partial;
+  uint64_t stream_epoch;
+  bool more_pending;
+  move_humans::map_pose_vectors plans;
+};
+typedef boost::shared_ptr<PlanSet> PlanSetPtr;
+typedef boost::shared_ptr<const PlanSet> PlanSetConstPtr;
+
+// plans of one human inside the plan set holding them, with the segment the
+// human is on, so that humans can take their plans from different sets
+struct HumanPlans {
+  HumanPlans() : segments(NULL), cursor(0) {}
+  HumanPlans(const PlanSetConstPtr &owner,
+             const move_humans::pose_vectors &segments)
+      : owner(owner), segments(&segments), cursor(0) {}
+
+  PlanSetConstPtr owner;
+  const move_humans::pose_vectors *segments;
+  size_t cursor;
+};
+using map_human_plans = std::map<uint64_t, HumanPlans>;
+
+// hands the latest plan set from the planner to the controller without
+// locking either side, readers keep a plan set alive for as long as they
+// hold it, a new epoch tells them that newer plans are available, plans must
+// be published from a single thread, partial sets are queued instead as
+// every one of them has to be applied
+class PlanSetHandoff {
+public:
+  PlanSetHandoff() : epoch_(0) {}
+
+  // stamp plans with the next epoch and make them the latest ones, the plans
+  // are stored before the epoch so that readers seeing the new epoch always
+  // get plans at least as new
+  uint64_t publish(const PlanSetPtr &plans) {
+    plans->epoch = epoch_.load() + 1;
+    boost::atomic_store(&latest_, PlanSetConstPtr(plans));
+    epoch_.store(plans->epoch);
+    return plans->epoch;
+  }
+
+  // queue a partial plan set, stamped with the next epoch so that readers
+  // can tell whether it is newer than the latest full plans
+  uint64_t publishPartial(const PlanSetPtr &plans) {
+    boost::mutex::scoped_lock lock(partial_mutex_);
+    plans->partial = true;
+    plans->epoch = epoch_.load() + 1;
+    partial_.push_back(plans);
+    epoch_.store(plans->epoch);
+    return plans->epoch;
+  }
+
+  // take the queued partial plan sets in epoch order, sets older than
+  // after_epoch are superseded by full plans and dropped
+  void takePartial(uint64_t after_epoch,
+                   std::vector<PlanSetConstPtr> &partial) {
+    partial.clear();
+    boost::mutex::scoped_lock lock(partial_mutex_);
+    for (auto &plans : partial_) {
+      if (plans->epoch > after_epoch) {
+        partial.push_back(plans);
+      }
+    }
+    partial_.clear();
+  }
+
+  // drop the latest plans
+  void clear() {
+    boost::atomic_store(&latest_, PlanSetConstPtr());
+    boost::mutex::scoped_lock lock(partial_mutex_);
+    partial_.clear();
+  }
+
+  PlanSetConstPtr latest() const { return boost::atomic_load(&latest_); }
+
+  uint64_t epoch() const { return epoch_.load(); }
+
+private:
+  PlanSetConstPtr latest_;
+  std::atomic<uint64_t> epoch_;
+  boost::mutex partial_mutex_;
+  std::deque<PlanSetConstPtr> partial_;
+};
+
+// hands the plans of a full planning pass over while humans are still being
+// planned, the first human is handed over immediately as a full plan set, the
+// ones finishing later are collected and handed over as partial sets at most
+// every flush period, plans can be added from several planning threads as
+// they are handed over one at a time under the lock of the stream
+class PlanStream {
+public:
+  PlanStream(PlanSetHandoff &handoff, double flush_period)
+      : handoff_(handoff), flush_period_(flush_period), stream_epoch_(0),
+        count_(0), pending_(new PlanSet()) {}
+
+  // returns true if the plans were handed over as the first chunk
+  bool add(uint64_t human_id, const move_humans::pose_vectors &plans) {
+    boost::mutex::scoped_lock lock(mutex_);
+    pending_->plans[human_id] = plans;
+    count_++;
+    bool first = stream_epoch_ == 0;
+    if (first || std::chrono::duration<double>(clock::now() - last_flush_)
+                         .count() >= flush_period_) {
+      flush(true);
+    }
+    return first;
+  }
+
+  // hand over the remaining plans as the last chunk, nothing is handed over
+  // if no human got plans
+  void finish() {
+    boost::mutex::scoped_lock lock(mutex_);
+    if (stream_epoch_ != 0) {
+      flush(false);
+    }
+  }
+
+  // number of humans that got plans
+  size_t size() const {
+    boost::mutex::scoped_lock lock(mutex_);
+    return count_;
+  }
+
+private:
+  typedef std::chrono::steady_clock clock;
+
+  PlanSetHandoff &handoff_;
+  double flush_period_;
+  uint64_t stream_epoch_;
+  size_t count_;
+  PlanSetPtr pending_;
+  clock::time_point last_flush_;
+  mutable boost::mutex mutex_;
+
+  void flush(bool more_pending) {
+    pending_->more_pending = more_pending;
+    if (stream_epoch_ == 0) {
+      pending_->stream_epoch = handoff_.epoch() + 1;
+      stream_epoch_ = handoff_.publish(pending_);
+    } else if (!pending_->plans.empty() || !more_pending) {
+      pending_->stream_epoch = stream_epoch_;
+      handoff_.publishPartial(pending_);
+    }
+    pending_.reset(new PlanSet());
+    last_flush_ = clock::now();
+  }
+};
+}; // namespace move_humans
+
+#endif // MOVE_HUMANS_PLAN_SET_
@@ -3,6 +3,7 @@
 
 #include <costmap_2d/costmap_2d_ros.h>
 #include <tf/transform_listener.h>
+#include <boost/function.hpp>
 
 #include "move_humans/types.h"
 
@@ -15,6 +16,9 @@ public:
   virtual void initialize(std::string name, tf::TransformListener *tf,
                           costmap_2d::Costmap2DROS *costmap_ros) = 0;
 
+  // makePlans is called without holding the costmap mutex, planners must
+  // lock it while reading the costmap, preferably only for taking a
+  // move_humans::CostmapSnapshot to plan on
   virtual bool makePlans(const move_humans::map_pose &starts,
                          const move_humans::map_pose &goals,
                          move_humans::map_pose_vectors &plans) = 0;
@@ -24,6 +28,38 @@ public:
                          const move_humans::map_pose &goals,
                          move_humans::map_pose_vectors &plans) = 0;
 
+  // called with the plans of a human as soon as they are found, possibly
+  // from several planning threads at once, humans without plans are skipped
+  typedef boost::function<void(uint64_t human_id,
+                               const move_humans::pose_vectors &plans)>
+      PlansCallback;
+
+  // plan as makePlans, but give the plans of every human to plans_cb as soon
+  // as they are found instead of once all humans are planned, returns when
+  // all humans are planned, planners that can not hand over single humans
+  // give all of them once makePlans returns
+  virtual bool submitPlans(const move_humans::map_pose &starts,
+                           const move_humans::map_pose_vector &sub_goals,
+                           const move_humans::map_pose &goals,
+                           const PlansCallback &plans_cb) {
+    move_humans::map_pose_vectors plans;
+    bool planned = sub_goals.empty()
+                       ? makePlans(starts, goals, plans)
+                       : makePlans(starts, sub_goals, goals, plans);
+    for (auto &plans_kv : plans) {
+      plans_cb(plans_kv.first, plans_kv.second);
+    }
+    return planned;
+  }
+
+  // forget state kept between calls for the given humans, e.g. after they
+  // were removed from the running goal, humans left out of a call keep it as
+  // calls may plan only some of the humans, returns false if the planner
+  // keeps no state per human
+  virtual bool removeHumans(const move_humans::id_vector &human_ids) {
+    return false;
+  }
+
 protected:
   PlannerInterface() {}
 };
@@ -0,0 +1,109 @@
+#ifndef MOVE_HUMANS_PLANNING_QUEUE_
+#define MOVE_HUMANS_PLANNING_QUEUE_
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <vector>
+#include <ros/ros.h>
+
+#include "move_humans/types.h"
+
+namespace move_humans {
+// humans waiting for plans, a human has at most one request queued as a new
+// request supersedes the queued one, requests are taken most urgent first and
+// requests past their deadline are no longer urgent, so that they wait for
+// requests that are still useful without being lost if no full planning
+// comes
+class PlanningQueue {
+public:
+  struct Request {
+    Request() : human_id(0), urgent(false), priority(0.0) {}
+
+    uint64_t human_id;
+    geometry_msgs::PoseStamped start, goal;
+    move_humans::pose_vector sub_goals;
+    // urgent requests go before all others, then lower priority values
+    bool urgent;
+    double priority;
+    // zero for no deadline
+    ros::Time deadline;
+  };
+
+  PlanningQueue() : sequence_(0), superseded_(0), expired_(0) {}
+
+  void push(const Request &request) {
+    auto &entry = entries_[request.human_id];
+    if (entry.sequence != 0) {
+      superseded_++;
+    }
+    entry.request = request;
+    entry.sequence = ++sequence_;
+  }
+
+  void remove(uint64_t human_id) { entries_.erase(human_id); }
+  void clear() { entries_.clear(); }
+
+  bool empty() const { return entries_.empty(); }
+  size_t size() const { return entries_.size(); }
+
+  // move at most max_requests (0 for all) of the most urgent requests into
+  // requests, requests with a deadline before now lose their urgency and
+  // deadline first, returns the number of such expired requests
+  size_t take(const ros::Time &now, size_t max_requests,
+              std::vector<Request> &requests) {
+    requests.clear();
+    size_t expired = 0;
+    order_.clear();
+    for (auto &entry_kv : entries_) {
+      auto &request = entry_kv.second.request;
+      if (!request.deadline.isZero() && request.deadline < now) {
+        request.urgent = false;
+        request.deadline = ros::Time();
+        expired++;
+      }
+      order_.push_back(&entry_kv);
+    }
+    expired_ += expired;
+
+    size_t count = max_requests > 0 ? std::min(max_requests, order_.size())
+                                    : order_.size();
+    std::partial_sort(order_.begin(), order_.begin() + count, order_.end(),
+                      [](const EntryRef a, const EntryRef b) {
+                        auto &ra = a->second.request, &rb = b->second.request;
+                        if (ra.urgent != rb.urgent) {
+                          return ra.urgent;
+                        }
+                        if (ra.priority != rb.priority) {
+                          return ra.priority < rb.priority;
+                        }
+                        return a->second.sequence < b->second.sequence;
+                      });
+    requests.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+      requests.push_back(order_[i]->second.request);
+      entries_.erase(order_[i]->first);
+    }
+    return expired;
+  }
+
+  // requests replaced by newer ones and past their deadline so far
+  uint64_t superseded() const { return superseded_; }
+  uint64_t expired() const { return expired_; }
+
+private:
+  struct Entry {
+    Entry() : sequence(0) {}
+
+    Request request;
+    uint64_t sequence;
+  };
+  typedef std::map<uint64_t, Entry>::value_type *EntryRef;
+
+  std::map<uint64_t, Entry> entries_;
+  std::vector<EntryRef> order_;
+  uint64_t sequence_, superseded_, expired_;
+};
+}; // namespace move_humans
+
+#endif // MOVE_HUMANS_PLANNING_QUEUE_
@@ -0,0 +1,284 @@
+#ifndef MOVE_HUMANS_PROFILER_
+#define MOVE_HUMANS_PROFILER_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include <boost/thread/mutex.hpp>
+
+#define MOVE_HUMANS_PROFILE_CONCAT_(a, b) a##b
+#define MOVE_HUMANS_PROFILE_CONCAT(a, b) MOVE_HUMANS_PROFILE_CONCAT_(a, b)
+
+// time the rest of the enclosing scope under name
+#define MOVE_HUMANS_PROFILE_SCOPE(name)                                       \
+  static move_humans::Profiler::Probe &MOVE_HUMANS_PROFILE_CONCAT(            \
+      profile_probe_, __LINE__) = move_humans::Profiler::instance().timer(   \
+      name);                                                                  \
+  move_humans::ScopedTimer MOVE_HUMANS_PROFILE_CONCAT(profile_timer_,         \
+                                                      __LINE__)(              \
+      MOVE_HUMANS_PROFILE_CONCAT(profile_probe_, __LINE__))
+
+// add count to the counter name
+#define MOVE_HUMANS_PROFILE_COUNT(name, count)                                \
+  do {                                                                        \
+    static move_humans::Profiler::Probe &profile_counter =                    \
+        move_humans::Profiler::instance().counter(name);                      \
+    if (move_humans::Profiler::enabled()) {                                   \
+      profile_counter.add(count);                                             \
+    }                                                                         \
+  } while (0)
+
+namespace move_humans {
+// timers and counters of hot paths, shared by move_humans and its plugins,
+// probes are created once per call site and recorded from any thread without
+// locking, nothing is recorded unless profiling is enabled, and every timed
+// scope is kept as trace event only while tracing, so that a bad run can be
+// written as Chrome trace and looked at in chrome://tracing or Perfetto
+class Profiler {
+public:
+  typedef std::chrono::steady_clock clock;
+
+  // microsecond histogram with four buckets per octave, up to about 30 s
+  static const size_t BUCKETS = 100;
+
+  struct Stats {
+    std::string name;
+    bool timed;
+    uint64_t count;
+    double mean, p50, p90, p99, max; // s
+  };
+
+  class Probe {
+  public:
+    Probe(const std::string &name, bool timed)
+        : name_(name), timed_(timed), count_(0), sum_(0), max_(0) {
+      for (auto &bucket : buckets_) {
+        bucket.store(0);
+      }
+    }
+
+    const std::string &name() const { return name_; }
+    bool timed() const { return timed_; }
+
+    void add(uint64_t count = 1) {
+      count_.fetch_add(count, std::memory_order_relaxed);
+    }
+    void record(uint64_t ns) {
+      count_.fetch_add(1, std::memory_order_relaxed);
+      sum_.fetch_add(ns, std::memory_order_relaxed);
+      buckets_[bucket(ns)].fetch_add(1, std::memory_order_relaxed);
+      auto max = max_.load(std::memory_order_relaxed);
+      while (ns > max &&
+             !max_.compare_exchange_weak(max, ns, std::memory_order_relaxed)) {
+      }
+    }
+
+    // statistics since the last call, records made meanwhile go to either
+    // interval
+    Stats take() {
+      Stats stats;
+      stats.name = name_;
+      stats.timed = timed_;
+      stats.count = count_.exchange(0, std::memory_order_relaxed);
+      double sum = sum_.exchange(0, std::memory_order_relaxed) * 1e-9;
+      stats.max = max_.exchange(0, std::memory_order_relaxed) * 1e-9;
+      stats.mean = stats.count > 0 ? sum / stats.count : 0.0;
+      uint64_t counts[BUCKETS], total = 0;
+      for (size_t b = 0; b < BUCKETS; b++) {
+        counts[b] = buckets_[b].exchange(0, std::memory_order_relaxed);
+        total += counts[b];
+      }
+      stats.p50 = percentile(counts, total, 0.5, stats.max);
+      stats.p90 = percentile(counts, total, 0.9, stats.max);
+      stats.p99 = percentile(counts, total, 0.99, stats.max);
+      return stats;
+    }
+
+  private:
+    std::string name_;
+    bool timed_;
+    std::atomic<uint64_t> count_, sum_, max_;
+    std::atomic<uint64_t> buckets_[BUCKETS];
+
+    static size_t bucket(uint64_t ns) {
+      uint64_t us = ns / 1000;
+      if (us < 4) {
+        return us;
+      }
+      int octave = 63 - __builtin_clzll(us);
+      size_t b = 4 * (octave - 1) + ((us >> (octave - 2)) & 3);
+      return b < BUCKETS ? b : BUCKETS - 1;
+    }
+    // upper bound of bucket b in seconds
+    static double bucketEnd(size_t b) {
+      if (b < 4) {
+        return (b + 1) * 1e-6;
+      }
+      return (double)((4 + b % 4 + 1) << (b / 4 - 1)) * 1e-6;
+    }
+    static double percentile(const uint64_t *counts, uint64_t total,
+                             double fraction, double max) {
+      uint64_t rank = (uint64_t)(fraction * total), seen = 0;
+      for (size_t b = 0; b < BUCKETS && total > 0; b++) {
+        seen += counts[b];
+        if (seen > rank) {
+          return std::min(bucketEnd(b), max);
+        }
+      }
+      return 0.0;
+    }
+  };
+
+  // the one profiler of the process, also when used from plugins
+  static Profiler &instance() {
+    static Profiler profiler;
+    return profiler;
+  }
+
+  static bool enabled() {
+    return instance().enabled_.load(std::memory_order_relaxed);
+  }
+  void setEnabled(bool enabled) { enabled_.store(enabled); }
+
+  // tracing keeps at most max_events events, starting a new trace drops the
+  // events of the last one
+  bool tracing() const { return tracing_.load(std::memory_order_relaxed); }
+  void setTracing(bool tracing, size_t max_events = 1000000) {
+    boost::mutex::scoped_lock lock(mutex_);
+    if (tracing && !tracing_) {
+      events_.clear();
+      events_.reserve(max_events);
+      max_events_ = max_events;
+      dropped_events_ = 0;
+      trace_start_ = clock::now();
+    }
+    tracing_.store(tracing);
+  }
+
+  // probes with the same name are the same probe
+  Probe &timer(const std::string &name) { return probe(name, true); }
+  Probe &counter(const std::string &name) { return probe(name, false); }
+
+  void record(Probe &probe, clock::time_point start, clock::time_point end) {
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start)
+                  .count();
+    probe.record(ns > 0 ? ns : 0);
+    if (tracing()) {
+      boost::mutex::scoped_lock lock(mutex_);
+      if (events_.size() >= max_events_) {
+        dropped_events_++;
+        return;
+      }
+      events_.push_back({&probe, threadIndex(), start, end});
+    }
+  }
+
+  // statistics of all probes since the last call
+  void take(std::vector<Stats> &stats) {
+    boost::mutex::scoped_lock lock(mutex_);
+    stats.clear();
+    for (auto &probe : probes_) {
+      stats.push_back(probe.take());
+    }
+  }
+
+  // write the events of the current or last trace as Chrome trace event
+  // JSON, returns the number of written events or -1 if writing failed
+  long writeChromeTrace(const std::string &path) {
+    boost::mutex::scoped_lock lock(mutex_);
+    FILE *file = fopen(path.c_str(), "w");
+    if (!file) {
+      return -1;
+    }
+    auto us = [this](clock::time_point time) {
+      return std::chrono::duration<double, std::micro>(time - trace_start_)
+          .count();
+    };
+    int pid = getpid();
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    for (size_t i = 0; i < events_.size(); i++) {
+      auto &event = events_[i];
+      fprintf(file,
+              "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%u,"
+              "\"ts\":%.3f,\"dur\":%.3f}\n",
+              i > 0 ? "," : "", event.probe->name().c_str(), pid, event.thread,
+              us(event.start), us(event.end) - us(event.start));
+    }
+    fprintf(file, "],\"otherData\":{\"dropped_events\":\"%lu\"}}\n",
+            (unsigned long)dropped_events_);
+    bool written = !ferror(file);
+    written = (fclose(file) == 0) && written;
+    return written ? (long)events_.size() : -1;
+  }
+
+private:
+  struct Event {
+    const Probe *probe;
+    unsigned int thread;
+    clock::time_point start, end;
+  };
+
+  Profiler()
+      : enabled_(false), tracing_(false), max_events_(0), dropped_events_(0),
+        threads_(0) {}
+
+  std::atomic<bool> enabled_, tracing_;
+  boost::mutex mutex_;
+  // deque keeps references to probes valid while new ones are added
+  std::deque<Probe> probes_;
+  std::vector<Event> events_;
+  size_t max_events_;
+  uint64_t dropped_events_;
+  clock::time_point trace_start_;
+  std::atomic<unsigned int> threads_;
+
+  Probe &probe(const std::string &name, bool timed) {
+    boost::mutex::scoped_lock lock(mutex_);
+    for (auto &probe : probes_) {
+      if (probe.name() == name) {
+        return probe;
+      }
+    }
+    probes_.emplace_back(name, timed);
+    return probes_.back();
+  }
+
+  // small ids for trace viewers, numbered by first use
+  unsigned int threadIndex() {
+    static thread_local unsigned int index = ++threads_;
+    return index;
+  }
+};
+
+// records the time from its construction to stop or its destruction, does
+// nothing if profiling was disabled at construction
+class ScopedTimer {
+public:
+  explicit ScopedTimer(Profiler::Probe &probe)
+      : probe_(Profiler::enabled() ? &probe : NULL) {
+    if (probe_) {
+      start_ = Profiler::clock::now();
+    }
+  }
+  ~ScopedTimer() { stop(); }
+
+  void stop() {
+    if (probe_) {
+      Profiler::instance().record(*probe_, start_, Profiler::clock::now());
+      probe_ = NULL;
+    }
+  }
+
+private:
+  Profiler::Probe *probe_;
+  Profiler::clock::time_point start_;
+};
+}; // namespace move_humans
+
+#endif // MOVE_HUMANS_PROFILER_
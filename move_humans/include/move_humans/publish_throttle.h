@@ -0,0 +1,34 @@
+#ifndef MOVE_HUMANS_PUBLISH_THROTTLE_
+#define MOVE_HUMANS_PUBLISH_THROTTLE_
+
+#include <ros/ros.h>
+
+namespace move_humans {
+// decides whether a message is due on a publisher, so that messages are only
+// built for the configured rate and when someone listens, a time jump back
+// (e.g. a new simulation) makes a message due immediately
+class PublishThrottle {
+public:
+  // rate in Hz, 0 for every call, a due message counts as published
+  bool due(double rate, const ros::Time &now) {
+    if (rate > 0.0 && !last_.isZero() && now >= last_ &&
+        (now - last_).toSec() < 1.0 / rate) {
+      return false;
+    }
+    last_ = now;
+    return true;
+  }
+
+  bool due(const ros::Publisher &publisher, double rate,
+           const ros::Time &now) {
+    return publisher.getNumSubscribers() > 0 && due(rate, now);
+  }
+
+  void reset() { last_ = ros::Time(); }
+
+private:
+  ros::Time last_;
+};
+}; // namespace move_humans
+
+#endif // MOVE_HUMANS_PUBLISH_THROTTLE_
@@ -0,0 +1,45 @@
+#ifndef SHARD_AGGREGATOR_H_
+#define SHARD_AGGREGATOR_H_
+
+#include <map>
+#include <string>
+#include <vector>
+#include <ros/ros.h>
+#include <boost/thread.hpp>
+#include <hanp_msgs/TrackedHumans.h>
+
+namespace move_humans {
+// merges the humans published by several move_humans shards into one stream,
+// all humans are moved to the stamp of the merged message with their
+// velocities, humans are kept for a while after their shard stopped
+// publishing them, so that they do not disappear while they are handed to
+// another shard
+class ShardAggregator {
+public:
+  ShardAggregator();
+
+private:
+  struct Track {
+    hanp_msgs::TrackedHuman human;
+    ros::Time stamp;
+    size_t shard;
+  };
+
+  std::vector<ros::Subscriber> shard_subs_;
+  void shardHumansCB(const hanp_msgs::TrackedHumansConstPtr &humans,
+                     size_t shard);
+
+  // latest state of every human, from the shard that published it last
+  boost::mutex tracks_mutex_;
+  std::map<uint64_t, Track> tracks_;
+  std::string frame_id_;
+  double hold_time_;
+
+  ros::Publisher humans_pub_;
+  ros::Timer publish_timer_;
+  hanp_msgs::TrackedHumans humans_msg_;
+  void publishHumans(const ros::TimerEvent &event);
+};
+}; // namespace move_humans
+
+#endif // SHARD_AGGREGATOR_H_
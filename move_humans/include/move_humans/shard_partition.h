@@ -0,0 +1,99 @@
+#ifndef MOVE_HUMANS_SHARD_PARTITION_
+#define MOVE_HUMANS_SHARD_PARTITION_
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace move_humans {
+// which of several move_humans shards owns a human, humans are split by
+// their id or by their position in stripes of the map along x, shard i owns
+// values from boundary i - 1 up to boundary i, without boundaries ids are
+// split by their remainder and stripes evenly between the map bounds
+class ShardPartition {
+public:
+  enum Mode { NONE = 0, ID_RANGE = 1, REGION = 2 };
+
+  ShardPartition() : mode_(NONE), index_(0), count_(1), even_(false) {}
+
+  // returns false if index is not a shard of count shards, or if there are
+  // not count - 1 boundaries
+  bool configure(Mode mode, size_t index, size_t count,
+                 std::vector<double> boundaries) {
+    if (count == 0 || index >= count ||
+        (!boundaries.empty() && boundaries.size() != count - 1)) {
+      return false;
+    }
+    std::sort(boundaries.begin(), boundaries.end());
+    mode_ = mode;
+    index_ = index;
+    count_ = count;
+    boundaries_.swap(boundaries);
+    even_ = mode_ == REGION && boundaries_.empty();
+    return true;
+  }
+
+  // spread the stripes of regions without boundaries between min_x and
+  // max_x, until then the first shard owns all positions
+  void setMapBounds(double min_x, double max_x) {
+    if (!even_) {
+      return;
+    }
+    boundaries_.clear();
+    for (size_t i = 1; i < count_; i++) {
+      boundaries_.push_back(min_x + (max_x - min_x) * i / count_);
+    }
+  }
+
+  Mode mode() const { return mode_; }
+  size_t index() const { return index_; }
+  size_t count() const { return count_; }
+  bool sharded() const { return mode_ != NONE && count_ > 1; }
+  // only humans of regions leave their shard when they move
+  bool handsOff() const { return mode_ == REGION && count_ > 1; }
+
+  size_t owner(uint64_t human_id, double x) const {
+    switch (mode_) {
+    case ID_RANGE:
+      return boundaries_.empty() ? human_id % count_ : stripe(human_id);
+    case REGION:
+      return stripe(x);
+    default:
+      return 0;
+    }
+  }
+  bool owns(uint64_t human_id, double x) const {
+    return !sharded() || owner(human_id, x) == index_;
+  }
+
+  // shard of a human at x owned by shard current, humans change their shard
+  // only once they are margin past the boundary, so that humans walking
+  // along a boundary are not handed back and forth
+  size_t regionOwner(double x, size_t current, double margin) const {
+    size_t owner = stripe(x);
+    if (owner == current || current >= count_ || boundaries_.empty()) {
+      return owner;
+    }
+    double low = current > 0 ? boundaries_[current - 1]
+                             : -std::numeric_limits<double>::infinity();
+    double high = current + 1 < count_
+                      ? boundaries_[current]
+                      : std::numeric_limits<double>::infinity();
+    return (x > low - margin && x < high + margin) ? current : owner;
+  }
+
+private:
+  Mode mode_;
+  size_t index_, count_;
+  std::vector<double> boundaries_;
+  bool even_;
+
+  size_t stripe(double value) const {
+    return std::upper_bound(boundaries_.begin(), boundaries_.end(), value) -
+           boundaries_.begin();
+  }
+};
+}; // namespace move_humans
+
+#endif // MOVE_HUMANS_SHARD_PARTITION_
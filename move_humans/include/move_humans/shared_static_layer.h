@@ -0,0 +1,66 @@
+#ifndef SHARED_STATIC_LAYER_H_
+#define SHARED_STATIC_LAYER_H_
+
+#include <string>
+#include <vector>
+#include <ros/ros.h>
+#include <boost/thread/mutex.hpp>
+#include <costmap_2d/layer.h>
+#include <costmap_2d/layered_costmap.h>
+#include <nav_msgs/OccupancyGrid.h>
+
+#include "move_humans/static_costmap_cache.h"
+
+namespace move_humans {
+// static map layer with the inflation of its obstacles, replacing a
+// costmap_2d::StaticLayer followed by a costmap_2d::InflationLayer for maps
+// without other obstacles, the costs are cached per map and parameters and
+// shared read-only by all costmaps using them, so that costmaps neither hold
+// copies of the map nor inflate it again when they start, only costmaps that
+// are not rolling are supported
+class SharedStaticLayer : public costmap_2d::Layer {
+public:
+  SharedStaticLayer();
+
+  virtual void onInitialize();
+  virtual void activate();
+  virtual void deactivate();
+  virtual void reset();
+
+  virtual void updateBounds(double robot_x, double robot_y, double robot_yaw,
+                            double *min_x, double *min_y, double *max_x,
+                            double *max_y);
+  virtual void updateCosts(costmap_2d::Costmap2D &master_grid, int min_i,
+                           int min_j, int max_i, int max_j);
+
+  virtual bool isDiscretized() { return true; }
+
+private:
+  std::string map_topic_, cache_dir_;
+  ros::Subscriber map_sub_;
+  void mapCB(const nav_msgs::OccupancyGridConstPtr &map);
+
+  // cost parameters as in costmap_2d::StaticLayer and InflationLayer
+  bool track_unknown_space_, trinary_costmap_, use_maximum_,
+      inflate_unknown_;
+  unsigned char lethal_threshold_, unknown_cost_value_;
+  double inflation_radius_, cost_scaling_factor_;
+
+  // the map is only kept until its costs are loaded, it is subscribed again
+  // if the costs have to be computed for another footprint
+  boost::mutex mutex_;
+  nav_msgs::OccupancyGridConstPtr map_;
+  move_humans::StaticCostmapCache::CostsConstPtr costs_;
+  unsigned int width_, height_;
+  double resolution_, origin_x_, origin_y_, inscribed_radius_;
+  bool has_updated_data_;
+
+  bool loadCosts(double inscribed_radius);
+  unsigned char interpretValue(unsigned char value) const;
+  void computeCosts(const nav_msgs::OccupancyGrid &map,
+                    double inscribed_radius,
+                    std::vector<unsigned char> &costs) const;
+};
+}; // namespace move_humans
+
+#endif // SHARED_STATIC_LAYER_H_
@@ -0,0 +1,197 @@
+#ifndef MOVE_HUMANS_SPATIAL_INDEX_
+#define MOVE_HUMANS_SPATIAL_INDEX_
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+
+#include "move_humans/types.h"
+
+namespace move_humans {
+// uniform grid over human positions, cells are hashed into a table sized to
+// the number of humans and entries are stored sorted by bucket, so that a
+// rebuild is two linear passes and a query only visits the buckets of the
+// cells it overlaps, queries can run concurrently
+class SpatialIndex {
+public:
+  struct Entry {
+    uint64_t id;
+    double x, y;
+  };
+
+  // (distance, human id) pairs, nearest first
+  typedef std::vector<std::pair<double, uint64_t>> Neighbors;
+
+  SpatialIndex(double cell_size = 0.5) { setCellSize(cell_size); }
+
+  // cells should be about the size of the usual query radius
+  void setCellSize(double cell_size) {
+    cell_size_ = cell_size > 0.0 ? cell_size : 0.5;
+  }
+
+  double cellSize() const { return cell_size_; }
+  size_t size() const { return entries_.size(); }
+  const std::vector<Entry> &entries() const { return entries_; }
+
+  void rebuild(const move_humans::map_traj_point &humans) {
+    points_.clear();
+    points_.reserve(humans.size());
+    for (auto &human_kv : humans) {
+      auto &translation = human_kv.second.transform.translation;
+      points_.push_back({human_kv.first, translation.x, translation.y});
+    }
+    build();
+  }
+
+  void rebuild(const std::vector<Entry> &points) {
+    points_ = points;
+    build();
+  }
+
+  // humans within radius of (x, y), sorted nearest first
+  void radiusSearch(double x, double y, double radius,
+                    Neighbors &neighbors) const {
+    neighbors.clear();
+    if (entries_.empty() || radius < 0.0) {
+      return;
+    }
+    long min_cx = cell(x - radius), max_cx = cell(x + radius);
+    long min_cy = cell(y - radius), max_cy = cell(y + radius);
+    static thread_local std::vector<size_t> buckets;
+    collectBuckets(min_cx, max_cx, min_cy, max_cy, buckets);
+    double sq_radius = radius * radius;
+    for (auto bucket : buckets) {
+      for (size_t i = bucket_starts_[bucket]; i < bucket_starts_[bucket + 1];
+           i++) {
+        auto &entry = entries_[i];
+        double sq_dist = sqDist(entry, x, y);
+        if (sq_dist <= sq_radius) {
+          neighbors.emplace_back(sq_dist, entry.id);
+        }
+      }
+    }
+    finish(neighbors);
+  }
+
+  // the k humans nearest to (x, y), sorted nearest first, rings of cells
+  // around the query cell are searched until no closer human can be found
+  void nearest(double x, double y, size_t k, Neighbors &neighbors) const {
+    neighbors.clear();
+    if (entries_.empty() || k == 0) {
+      return;
+    }
+    k = std::min(k, entries_.size());
+    long cx = cell(x), cy = cell(y);
+    // distance from the query to the border of its cell
+    double inner = std::min(std::min(x - cx * cell_size_,
+                                     (cx + 1) * cell_size_ - x),
+                            std::min(y - cy * cell_size_,
+                                     (cy + 1) * cell_size_ - y));
+    static thread_local std::vector<size_t> buckets;
+    for (long ring = 0;; ring++) {
+      collectBuckets(cx - ring, cx + ring, cy - ring, cy + ring, buckets);
+      neighbors.clear();
+      for (auto bucket : buckets) {
+        for (size_t i = bucket_starts_[bucket];
+             i < bucket_starts_[bucket + 1]; i++) {
+          neighbors.emplace_back(sqDist(entries_[i], x, y), entries_[i].id);
+        }
+      }
+      // humans outside the searched cells are at least this far
+      double covered = inner + ring * cell_size_;
+      if (neighbors.size() >= k) {
+        std::nth_element(neighbors.begin(), neighbors.begin() + (k - 1),
+                         neighbors.end());
+        if (neighbors[k - 1].first <= covered * covered ||
+            buckets.size() == bucket_starts_.size() - 1) {
+          neighbors.resize(k);
+          finish(neighbors);
+          return;
+        }
+      } else if (buckets.size() == bucket_starts_.size() - 1) {
+        // all buckets were visited
+        finish(neighbors);
+        return;
+      }
+    }
+  }
+
+private:
+  double cell_size_;
+  std::vector<Entry> points_, entries_;
+  std::vector<size_t> bucket_starts_, point_buckets_;
+
+  long cell(double coordinate) const {
+    return (long)std::floor(coordinate / cell_size_);
+  }
+
+  size_t bucket(long cx, long cy) const {
+    uint64_t hash =
+        ((uint64_t)cx * 73856093ULL) ^ ((uint64_t)cy * 19349663ULL);
+    return hash & (bucket_starts_.size() - 2);
+  }
+
+  static double sqDist(const Entry &entry, double x, double y) {
+    double dx = entry.x - x, dy = entry.y - y;
+    return dx * dx + dy * dy;
+  }
+
+  // counting sort of the points by bucket
+  void build() {
+    size_t bucket_count = 1;
+    while (bucket_count < 2 * points_.size()) {
+      bucket_count <<= 1;
+    }
+    bucket_starts_.assign(bucket_count + 1, 0);
+    point_buckets_.resize(points_.size());
+    for (size_t i = 0; i < points_.size(); i++) {
+      point_buckets_[i] = bucket(cell(points_[i].x), cell(points_[i].y));
+      bucket_starts_[point_buckets_[i] + 1]++;
+    }
+    for (size_t b = 0; b < bucket_count; b++) {
+      bucket_starts_[b + 1] += bucket_starts_[b];
+    }
+    entries_.resize(points_.size());
+    auto fill = bucket_starts_;
+    for (size_t i = 0; i < points_.size(); i++) {
+      entries_[fill[point_buckets_[i]]++] = points_[i];
+    }
+  }
+
+  // distinct buckets of a cell range, cells of a large range may share
+  // buckets, in which case all buckets are visited once
+  void collectBuckets(long min_cx, long max_cx, long min_cy, long max_cy,
+                      std::vector<size_t> &buckets) const {
+    buckets.clear();
+    size_t bucket_count = bucket_starts_.size() - 1;
+    double cells = (double)(max_cx - min_cx + 1) * (max_cy - min_cy + 1);
+    if (cells >= bucket_count) {
+      for (size_t b = 0; b < bucket_count; b++) {
+        buckets.push_back(b);
+      }
+      return;
+    }
+    for (long cx = min_cx; cx <= max_cx; cx++) {
+      for (long cy = min_cy; cy <= max_cy; cy++) {
+        buckets.push_back(bucket(cx, cy));
+      }
+    }
+    std::sort(buckets.begin(), buckets.end());
+    buckets.erase(std::unique(buckets.begin(), buckets.end()), buckets.end());
+  }
+
+  static void finish(Neighbors &neighbors) {
+    std::sort(neighbors.begin(), neighbors.end());
+    for (auto &neighbor : neighbors) {
+      neighbor.first = std::sqrt(neighbor.first);
+    }
+  }
+};
+typedef boost::shared_ptr<SpatialIndex> SpatialIndexPtr;
+typedef boost::shared_ptr<const SpatialIndex> SpatialIndexConstPtr;
+}; // namespace move_humans
+
+#endif // MOVE_HUMANS_SPATIAL_INDEX_
@@ -0,0 +1,68 @@
+#ifndef STATIC_COSTMAP_CACHE_H_
+#define STATIC_COSTMAP_CACHE_H_
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/weak_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include "move_humans/cache_file.h"
+
+namespace move_humans {
+// costs of static maps, computed once per map and cost parameters and kept in
+// memory-mapped files of a cache directory named after their hashes, costs
+// are read-only and shared by all costmaps of the process that use the same
+// map and parameters, and by all processes through the page cache
+class StaticCostmapCache {
+public:
+  typedef boost::function<void(std::vector<unsigned char> &costs)>
+      ComputeCosts;
+
+  class Costs {
+  public:
+    Costs() : width(0), height(0), data_(NULL) {}
+
+    unsigned int width, height;
+    const unsigned char *data() const { return data_; }
+
+  private:
+    friend class StaticCostmapCache;
+    const unsigned char *data_;
+    // costs are either mapped from a file or owned if there is no directory
+    CacheFile::MappingConstPtr mapping_;
+    std::vector<unsigned char> owned_;
+  };
+  typedef boost::shared_ptr<const Costs> CostsConstPtr;
+
+  // costs of the map and parameters with these hashes, mapped from their
+  // file of directory, or computed with compute and written there first,
+  // without directory costs are only shared within the process, returns
+  // NULL if the costs could not be computed
+  static CostsConstPtr get(const std::string &directory, uint64_t map_hash,
+                           uint64_t params_hash, unsigned int width,
+                           unsigned int height, const ComputeCosts &compute);
+
+private:
+  struct FileHeader;
+  typedef std::pair<uint64_t, uint64_t> costs_key;
+
+  // costs in use by costmaps of this process
+  static boost::mutex &registryMutex();
+  static std::map<costs_key, boost::weak_ptr<const Costs>> &registry();
+
+  static boost::shared_ptr<Costs> mapFile(const std::string &path,
+                                          const costs_key &key,
+                                          unsigned int width,
+                                          unsigned int height);
+  static bool writeFile(const std::string &path, const costs_key &key,
+                        unsigned int width, unsigned int height,
+                        const std::vector<unsigned char> &costs);
+};
+}; // namespace move_humans
+
+#endif // STATIC_COSTMAP_CACHE_H_
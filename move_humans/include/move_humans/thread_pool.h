@@ -0,0 +1,130 @@
+#ifndef MOVE_HUMANS_THREAD_POOL_
+#define MOVE_HUMANS_THREAD_POOL_
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+
+namespace move_humans {
+// fixed-size pool of threads for data-parallel loops, every range is run with
+// the index of the worker running it so that callers can keep per-worker
+// scratch state, worker 0 is always the calling thread
+class ThreadPool {
+public:
+  typedef boost::function<void(size_t begin, size_t end, size_t worker)>
+      RangeFunction;
+
+  ThreadPool(size_t num_workers = 1)
+      : num_workers_(0), generation_(0), shutdown_(false), job_(NULL),
+        job_count_(0), job_grain_(1), active_workers_(0), next_index_(0) {
+    resize(num_workers);
+  }
+
+  ~ThreadPool() { stopThreads(); }
+
+  size_t size() const { return num_workers_; }
+
+  // set number of workers, 0 means one worker per hardware thread
+  void resize(size_t num_workers) {
+    boost::mutex::scoped_lock run_lock(run_mutex_);
+    if (num_workers == 0) {
+      num_workers = std::max(boost::thread::hardware_concurrency(), 1u);
+    }
+    if (num_workers == num_workers_) {
+      return;
+    }
+    stopThreads();
+    num_workers_ = num_workers;
+    shutdown_ = false;
+    for (size_t i = 1; i < num_workers_; i++) {
+      threads_.push_back(boost::shared_ptr<boost::thread>(new boost::thread(
+          boost::bind(&ThreadPool::workerLoop, this, i, generation_))));
+    }
+  }
+
+  // call fn on consecutive ranges of at most grain indices covering
+  // [0, count), blocks until all ranges are processed, fn must not throw
+  void parallelFor(size_t count, size_t grain, const RangeFunction &fn) {
+    if (count == 0) {
+      return;
+    }
+    grain = std::max(grain, (size_t)1);
+    boost::mutex::scoped_lock run_lock(run_mutex_);
+    if (num_workers_ <= 1 || count <= grain) {
+      fn(0, count, 0);
+      return;
+    }
+
+    boost::unique_lock<boost::mutex> lock(mutex_);
+    job_ = &fn;
+    job_count_ = count;
+    job_grain_ = grain;
+    next_index_ = 0;
+    active_workers_ = num_workers_ - 1;
+    generation_++;
+    lock.unlock();
+    work_cond_.notify_all();
+
+    runJob(0);
+
+    lock.lock();
+    while (active_workers_ > 0) {
+      done_cond_.wait(lock);
+    }
+    job_ = NULL;
+  }
+
+private:
+  size_t num_workers_, generation_;
+  bool shutdown_;
+  std::vector<boost::shared_ptr<boost::thread>> threads_;
+  boost::mutex mutex_, run_mutex_;
+  boost::condition_variable work_cond_, done_cond_;
+
+  const RangeFunction *job_;
+  size_t job_count_, job_grain_, active_workers_;
+  std::atomic<size_t> next_index_;
+
+  void runJob(size_t worker) {
+    size_t begin;
+    while ((begin = next_index_.fetch_add(job_grain_)) < job_count_) {
+      (*job_)(begin, std::min(begin + job_grain_, job_count_), worker);
+    }
+  }
+
+  void workerLoop(size_t worker, size_t generation) {
+    boost::unique_lock<boost::mutex> lock(mutex_);
+    while (true) {
+      while (!shutdown_ && generation_ == generation) {
+        work_cond_.wait(lock);
+      }
+      if (shutdown_) {
+        return;
+      }
+      generation = generation_;
+      lock.unlock();
+      runJob(worker);
+      lock.lock();
+      if (--active_workers_ == 0) {
+        done_cond_.notify_one();
+      }
+    }
+  }
+
+  void stopThreads() {
+    boost::unique_lock<boost::mutex> lock(mutex_);
+    shutdown_ = true;
+    lock.unlock();
+    work_cond_.notify_all();
+    for (auto &thread : threads_) {
+      thread->join();
+    }
+    threads_.clear();
+  }
+};
+}; // namespace move_humans
+
+#endif // MOVE_HUMANS_THREAD_POOL_
@@ -0,0 +1,163 @@
+#define KEYFRAME_RECORD_SIZE 14 // bytes
+#define DELTA_RECORD_SIZE 10    // bytes
+#define MIN_YAW_RESOLUTION 0.0002 // rad, full turn must fit in int16
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <tf/transform_datatypes.h>
+
+#include "move_humans/human_state_encoder.h"
+
+namespace move_humans {
+namespace {
+inline void put32(std::vector<uint8_t> &data, size_t &offset, uint32_t value) {
+  data[offset++] = value & 0xFF;
+  data[offset++] = (value >> 8) & 0xFF;
+  data[offset++] = (value >> 16) & 0xFF;
+  data[offset++] = (value >> 24) & 0xFF;
+}
+
+inline void put16(std::vector<uint8_t> &data, size_t &offset, int32_t value) {
+  auto bits = (uint16_t)(int16_t)value;
+  data[offset++] = bits & 0xFF;
+  data[offset++] = (bits >> 8) & 0xFF;
+}
+
+inline bool fits16(int32_t value) {
+  return value >= std::numeric_limits<int16_t>::min() &&
+         value <= std::numeric_limits<int16_t>::max();
+}
+}; // namespace
+
+HumanStateEncoder::HumanStateEncoder()
+    : position_resolution_(0.0), yaw_resolution_(0.0), sequence_(0),
+      keyframe_due_(true) {
+  setParams(0.01, 0.01, 0.02, 0.02, 1.0);
+}
+
+void HumanStateEncoder::setParams(double position_resolution,
+                                  double yaw_resolution,
+                                  double delta_threshold,
+                                  double yaw_delta_threshold,
+                                  double keyframe_period) {
+  position_resolution = std::max(position_resolution, 1e-4);
+  yaw_resolution = std::max(yaw_resolution, MIN_YAW_RESOLUTION);
+  if (position_resolution != position_resolution_ ||
+      yaw_resolution != yaw_resolution_) {
+    // receivers can not mix states of different resolutions
+    keyframe_due_ = true;
+  }
+  position_resolution_ = position_resolution;
+  yaw_resolution_ = yaw_resolution;
+  // at least one quantum, so that humans that did not move are never sent
+  delta_threshold_ = std::max(
+      (int32_t)std::round(delta_threshold / position_resolution), 1);
+  yaw_delta_threshold_ = std::max(
+      (int32_t)std::round(yaw_delta_threshold / yaw_resolution), 1);
+  keyframe_period_ = keyframe_period;
+}
+
+void HumanStateEncoder::reset() { keyframe_due_ = true; }
+
+bool HumanStateEncoder::encode(const move_humans::map_traj_point &human_pts,
+                               const ros::Time &now,
+                               move_humans::HumanStateStream &stream) {
+  quantize(human_pts);
+  if (needsKeyframe(now)) {
+    writeKeyframe(stream);
+    last_keyframe_time_ = now;
+    keyframe_due_ = false;
+  } else {
+    writeDelta(stream);
+    if (stream.count == 0) {
+      return false;
+    }
+  }
+  stream.sequence = sequence_++;
+  stream.position_resolution = position_resolution_;
+  stream.yaw_resolution = yaw_resolution_;
+  return true;
+}
+
+void HumanStateEncoder::quantize(
+    const move_humans::map_traj_point &human_pts) {
+  quantized_.resize(human_pts.size());
+  size_t i = 0;
+  for (auto &human_pt_kv : human_pts) {
+    auto &transform = human_pt_kv.second.transform;
+    auto &state = quantized_[i++];
+    state.first = human_pt_kv.first;
+    state.second.x =
+        (int32_t)std::round(transform.translation.x / position_resolution_);
+    state.second.y =
+        (int32_t)std::round(transform.translation.y / position_resolution_);
+    state.second.yaw =
+        (int32_t)std::round(tf::getYaw(transform.rotation) / yaw_resolution_);
+  }
+}
+
+bool HumanStateEncoder::needsKeyframe(const ros::Time &now) {
+  if (keyframe_due_ || last_keyframe_time_.isZero() ||
+      now < last_keyframe_time_ ||
+      (keyframe_period_ > 0.0 &&
+       (now - last_keyframe_time_).toSec() >= keyframe_period_)) {
+    return true;
+  }
+
+  // humans added or removed, or a move that does not fit into a delta
+  if (quantized_.size() != sent_states_.size()) {
+    return true;
+  }
+  for (auto &state : quantized_) {
+    auto sent_it = sent_states_.find(state.first);
+    if (sent_it == sent_states_.end() ||
+        state.first > std::numeric_limits<uint32_t>::max() ||
+        !fits16(state.second.x - sent_it->second.x) ||
+        !fits16(state.second.y - sent_it->second.y) ||
+        !fits16(state.second.yaw - sent_it->second.yaw)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void HumanStateEncoder::writeKeyframe(move_humans::HumanStateStream &stream) {
+  stream.type = move_humans::HumanStateStream::KEYFRAME;
+  stream.data.resize(quantized_.size() * KEYFRAME_RECORD_SIZE);
+  sent_states_.clear();
+  size_t offset = 0;
+  for (auto &state : quantized_) {
+    put32(stream.data, offset, (uint32_t)state.first);
+    put32(stream.data, offset, (uint32_t)state.second.x);
+    put32(stream.data, offset, (uint32_t)state.second.y);
+    put16(stream.data, offset, state.second.yaw);
+    sent_states_.emplace_hint(sent_states_.end(), state.first, state.second);
+  }
+  stream.count = quantized_.size();
+}
+
+void HumanStateEncoder::writeDelta(move_humans::HumanStateStream &stream) {
+  stream.type = move_humans::HumanStateStream::DELTA;
+  stream.data.resize(quantized_.size() * DELTA_RECORD_SIZE);
+  size_t offset = 0, count = 0;
+  for (auto &state : quantized_) {
+    auto &sent = sent_states_[state.first];
+    int32_t dx = state.second.x - sent.x;
+    int32_t dy = state.second.y - sent.y;
+    int32_t dyaw = state.second.yaw - sent.yaw;
+    if (std::abs(dx) < delta_threshold_ && std::abs(dy) < delta_threshold_ &&
+        std::abs(dyaw) < yaw_delta_threshold_) {
+      continue;
+    }
+    put32(stream.data, offset, (uint32_t)state.first);
+    put16(stream.data, offset, dx);
+    put16(stream.data, offset, dy);
+    put16(stream.data, offset, dyaw);
+    sent = state.second;
+    count++;
+  }
+  stream.data.resize(offset);
+  stream.count = count;
+}
+}; // namespace move_humans
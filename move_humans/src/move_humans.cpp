@@ -1,9 +1,17 @@
 #define NODE_NAME "move_humans"
 #define CLEARA_COSTMAPS_SERVICE_NAME "clear_costmaps"
 #define FOLLOW_EXTERNAL_PATHS_SERVICE_NAME "follow_external_paths"
+#define UPDATE_HUMANS_SERVICE_NAME "update_humans"
+#define PREWARM_PLANS_SERVICE_NAME "prewarm_plans"
+#define WRITE_PROFILE_TRACE_SERVICE_NAME "write_profile_trace"
 #define CONTROLLER_TRAJS_SUB_TOPIC "external_human_plans"
+#define PLANNER_COSTMAP_SUB_TOPIC "planner_costmap/costmap"
+#define PLANNER_COSTMAP_UPDATES_SUB_TOPIC "planner_costmap/costmap_updates"
+#define COSTMAP_UPDATES_QUEUE_SIZE 10
 #define HUMANS_PUB_TOPIC "humans"
 #define HUMANS_MARKERS_PUB_TOPIC "human_markers"
+#define HUMAN_STREAM_PUB_TOPIC "human_stream"
+#define HUMAN_STREAM_QUEUE_SIZE 10
 #define DEFAUTL_SEGMENT_TYPE hanp_msgs::TrackedSegmentType::TORSO
 #define HUMANS_ARROWS_ID_OFFSET 100
 #define HUMANS_CYLINDERS_HEIGHT 1.5
@@ -12,32 +20,54 @@
 #define HUMAN_COLOR_B 0.0
 #define MARKER_LIFETIME 4.0
 #define HUMAN_RADIUS 0.25 // m
+#define SPATIAL_INDEX_CELL_RADII 4.0 // default index cell size in human radii
+#define DIAGNOSTICS_PUB_TOPIC "/diagnostics"
+#define DIAGNOSTICS_PERIOD 1.0 // s
+#define CLOCK_PUB_TOPIC "/clock"
+#define SHARD_HANDOFF_TOPIC "/move_humans_shards/handoff"
+#define SHARD_HANDOFF_QUEUE_SIZE 100
+#define SHARD_HANDOFF_TIMEOUT 2.0 // s, before an unanswered handoff is resent
+#define SCENARIO_FRAME_ID "map"
+#define FAST_FORWARD_MAX_TIME 300.0 // s, simulated
+#define FAST_FORWARD_COSTMAP_TIMEOUT 30.0 // s
 // #define EXTERNAL_PATH_DIST_THRESHOLD 0.2
 
+#include <set>
 #include <boost/thread.hpp>
+#include <diagnostic_msgs/DiagnosticArray.h>
 #include <geometry_msgs/PoseArray.h>
 #include <hanp_msgs/TrackedHumans.h>
 #include <hanp_msgs/TrackedSegmentType.h>
+#include <rosgraph_msgs/Clock.h>
 #include <visualization_msgs/MarkerArray.h>
 
 #include "move_humans/move_humans.h"
+#include "move_humans/move_humans_client.h"
 
 namespace move_humans {
 
-MoveHumans::MoveHumans(tf::TransformListener &tf)
+MoveHumans::MoveHumans(tf::TransformListener &tf, bool fast_forward)
     : tf_(tf), mhas_(NULL), planner_costmap_ros_(NULL),
-      controller_costmap_ros_(NULL),
+      controller_costmap_ros_(NULL), lazy_init_(false),
+      components_initialized_(false),
       planner_loader_("move_humans", "move_humans::PlannerInterface"),
       controller_loader_("move_humans", "move_humans::ControllerInterface"),
-      planner_plans_(NULL), latest_plans_(NULL), controller_plans_(NULL),
-      run_planner_(false), setup_(false), new_global_plans_(false),
-      publish_feedback_(false), p_freq_change_(false), c_freq_change_(false),
+      controller_plans_epoch_(0), plans_pending_(false),
+      planning_batch_size_(0), plan_request_timeout_(0.0), run_planner_(false),
+      setup_(false), publish_feedback_(false), p_freq_change_(false),
+      c_freq_change_(false),
+      control_steps_(1), control_dt_(0.0), last_diagnostics_overruns_(0),
+      humans_index_(new move_humans::SpatialIndex()), costmap_replans_(0),
+      shard_handoffs_out_(0), shard_handoffs_in_(0),
+      fast_forward_(fast_forward), planner_thread_(NULL),
       use_external_trajs_(false), new_external_controller_trajs_(false) {
   ros::NodeHandle private_nh("~");
 
-  mhas_ = new MoveHumansActionServer(
-      private_nh, "action_server", boost::bind(&MoveHumans::actionCB, this, _1),
-      false);
+  if (!fast_forward_) {
+    mhas_ = new MoveHumansActionServer(
+        private_nh, "action_server",
+        boost::bind(&MoveHumans::actionCB, this, _1), false);
+  }
 
   std::string planner_name, controller_name;
   private_nh.param("planner", planner_name,
@@ -49,6 +79,38 @@ MoveHumans::MoveHumans(tf::TransformListener &tf)
   private_nh.param("shutdown_costmaps", shutdown_costmaps_, false);
   private_nh.param("publish_feedback", publish_feedback_, true);
   private_nh.param("human_radius", human_radius_, HUMAN_RADIUS);
+  private_nh.param("robot_frame", robot_frame_, std::string(""));
+  // scenarios of fast-forward mode start right away
+  private_nh.param("lazy_init", lazy_init_, false);
+  lazy_init_ = lazy_init_ && !fast_forward_;
+
+  // shards are fixed for the lifetime of the node
+  std::string shard_mode;
+  int shard_index, shard_count;
+  std::vector<double> shard_boundaries;
+  private_nh.param("shard_mode", shard_mode, std::string(""));
+  private_nh.param("shard_index", shard_index, 0);
+  private_nh.param("shard_count", shard_count, 1);
+  private_nh.param("shard_boundaries", shard_boundaries,
+                   std::vector<double>());
+  auto partition_mode = move_humans::ShardPartition::NONE;
+  if (shard_mode == "id") {
+    partition_mode = move_humans::ShardPartition::ID_RANGE;
+  } else if (shard_mode == "region") {
+    partition_mode = move_humans::ShardPartition::REGION;
+  } else if (!shard_mode.empty()) {
+    ROS_FATAL_NAMED(NODE_NAME, "Unknown shard mode %s, use id or region",
+                    shard_mode.c_str());
+    exit(1);
+  }
+  if (shard_index < 0 || shard_count < 1 ||
+      !shard_partition_.configure(partition_mode, shard_index, shard_count,
+                                  shard_boundaries)) {
+    ROS_FATAL_NAMED(NODE_NAME, "Invalid shard %d of %d shards with %lu "
+                               "boundaries",
+                    shard_index, shard_count, shard_boundaries.size());
+    exit(1);
+  }
 
   current_goals_pub_ =
       private_nh.advertise<geometry_msgs::PoseArray>("current_goals", 0);
@@ -56,6 +118,13 @@ MoveHumans::MoveHumans(tf::TransformListener &tf)
       private_nh.advertise<hanp_msgs::TrackedHumans>(HUMANS_PUB_TOPIC, 1);
   humans_markers_pub_ = private_nh.advertise<visualization_msgs::MarkerArray>(
       HUMANS_MARKERS_PUB_TOPIC, 1);
+  // deltas depend on all previous messages, so they are queued, not dropped
+  human_stream_pub_ = private_nh.advertise<move_humans::HumanStateStream>(
+      HUMAN_STREAM_PUB_TOPIC, HUMAN_STREAM_QUEUE_SIZE);
+  human_stream_subscribers_ = 0;
+  diagnostics_pub_ =
+      ros::NodeHandle().advertise<diagnostic_msgs::DiagnosticArray>(
+          DIAGNOSTICS_PUB_TOPIC, 1);
 
   controller_trajs_sub_ = private_nh.subscribe(
       CONTROLLER_TRAJS_SUB_TOPIC, 1, &MoveHumans::controllerPathsCB, this);
@@ -65,32 +134,38 @@ MoveHumans::MoveHumans(tf::TransformListener &tf)
   follow_external_path_srv_ =
       private_nh.advertiseService(FOLLOW_EXTERNAL_PATHS_SERVICE_NAME,
                                   &MoveHumans::followExternalPaths, this);
-
-  planner_plans_ = new move_humans::map_pose_vectors();
-  latest_plans_ = new move_humans::map_pose_vectors();
-  controller_plans_ = new move_humans::map_pose_vectors();
-
-  planner_costmap_ros_ = new costmap_2d::Costmap2DROS("planner_costmap", tf_);
-  planner_costmap_ros_->pause();
-  if (!loadPlugin(planner_name, planner_, planner_loader_,
-                  planner_costmap_ros_)) {
-    exit(1);
+  update_humans_srv_ = private_nh.advertiseService(
+      UPDATE_HUMANS_SERVICE_NAME, &MoveHumans::updateHumansService, this);
+  // changes of an update are lost if it is dropped, so updates are queued
+  costmap_sub_ = private_nh.subscribe(PLANNER_COSTMAP_SUB_TOPIC, 1,
+                                      &MoveHumans::costmapCB, this);
+  costmap_updates_sub_ = private_nh.subscribe(
+      PLANNER_COSTMAP_UPDATES_SUB_TOPIC, COSTMAP_UPDATES_QUEUE_SIZE,
+      &MoveHumans::costmapUpdateCB, this);
+  prewarm_plans_srv_ = private_nh.advertiseService(
+      PREWARM_PLANS_SERVICE_NAME, &MoveHumans::prewarmPlansService, this);
+  if (shard_partition_.handsOff()) {
+    // all shards publish and receive handoffs and their answers on the same
+    // topic, handoffs are queued so that few have to be sent again
+    std::string handoff_topic;
+    private_nh.param("shard_handoff_topic", handoff_topic,
+                     std::string(SHARD_HANDOFF_TOPIC));
+    ros::NodeHandle nh;
+    shard_handoff_pub_ = nh.advertise<move_humans::ShardHandoff>(
+        handoff_topic, SHARD_HANDOFF_QUEUE_SIZE);
+    shard_handoff_sub_ = nh.subscribe(handoff_topic, SHARD_HANDOFF_QUEUE_SIZE,
+                                      &MoveHumans::shardHandoffCB, this);
   }
-  controller_costmap_ros_ =
-      new costmap_2d::Costmap2DROS("controller_costmap", tf_);
-  controller_costmap_ros_->pause();
-  if (!loadPlugin(controller_name, controller_, controller_loader_,
-                  controller_costmap_ros_)) {
+  write_profile_trace_srv_ =
+      private_nh.advertiseService(WRITE_PROFILE_TRACE_SERVICE_NAME,
+                                  &MoveHumans::writeProfileTraceService, this);
+
+  if (lazy_init_) {
+    ROS_INFO_NAMED(NODE_NAME, "Costmaps and plugins are initialized with the "
+                              "first request");
+  } else if (!initializeComponents(planner_name, controller_name)) {
     exit(1);
   }
-  planner_costmap_ros_->start();
-  controller_costmap_ros_->start();
-
-  if (shutdown_costmaps_) {
-    ROS_DEBUG_NAMED(NODE_NAME, "Stopping costmaps initially");
-    planner_costmap_ros_->stop();
-    controller_costmap_ros_->stop();
-  }
 
   dsrv_ = new dynamic_reconfigure::Server<move_humans::MoveHumansConfig>(
       ros::NodeHandle("~"));
@@ -98,17 +173,81 @@ MoveHumans::MoveHumans(tf::TransformListener &tf)
       boost::bind(&MoveHumans::reconfigureCB, this, _1, _2);
   dsrv_->setCallback(cb);
 
-  planner_thread_ =
-      new boost::thread(boost::bind(&MoveHumans::planThread, this));
+  if (fast_forward_) {
+    clock_pub_ =
+        ros::NodeHandle().advertise<rosgraph_msgs::Clock>(CLOCK_PUB_TOPIC, 1);
+    ROS_INFO_NAMED(NODE_NAME, "move_humans started in fast-forward mode");
+  } else {
+    planner_thread_ =
+        new boost::thread(boost::bind(&MoveHumans::planThread, this));
 
-  mhas_->start();
-  ROS_INFO_NAMED(NODE_NAME, "move_humans server started");
+    mhas_->start();
+    ROS_INFO_NAMED(NODE_NAME, "move_humans server started");
+  }
+  if (shard_partition_.sharded()) {
+    ROS_INFO_NAMED(NODE_NAME, "move_humans is shard %lu of %lu, humans are "
+                              "split by %s",
+                   shard_partition_.index(), shard_partition_.count(),
+                   shard_mode.c_str());
+  }
 
   state_ = move_humans::MoveHumansState::IDLE;
 
   clear_human_markers_ = false;
 }
 
+bool MoveHumans::initializeComponents(const std::string &planner_name,
+                                      const std::string &controller_name) {
+  boost::recursive_mutex::scoped_lock lock(configuration_mutex_);
+  if (components_initialized_) {
+    return true;
+  }
+  auto start = ros::WallTime::now();
+
+  // both costmaps exist before plugins are loaded, as loading resets the
+  // state, parts created before a failure are kept for the next attempt
+  if (planner_costmap_ros_ == NULL) {
+    planner_costmap_ros_ =
+        new costmap_2d::Costmap2DROS("planner_costmap", tf_);
+    planner_costmap_ros_->pause();
+  }
+  if (controller_costmap_ros_ == NULL) {
+    controller_costmap_ros_ =
+        new costmap_2d::Costmap2DROS("controller_costmap", tf_);
+    controller_costmap_ros_->pause();
+  }
+  if (!planner_ && !loadPlugin(planner_name, planner_, planner_loader_,
+                               planner_costmap_ros_)) {
+    return false;
+  }
+  if (!controller_ &&
+      !loadPlugin(controller_name, controller_, controller_loader_,
+                  controller_costmap_ros_)) {
+    return false;
+  }
+  // costmaps stay paused in fast-forward mode, they are only updated when
+  // a scenario starts
+  if (!fast_forward_) {
+    planner_costmap_ros_->start();
+    controller_costmap_ros_->start();
+
+    if (shutdown_costmaps_) {
+      ROS_DEBUG_NAMED(NODE_NAME, "Stopping costmaps initially");
+      planner_costmap_ros_->stop();
+      controller_costmap_ros_->stop();
+    }
+  }
+  components_initialized_ = true;
+  ROS_INFO_NAMED(NODE_NAME, "Initialized costmaps and plugins in %.3f s",
+                 (ros::WallTime::now() - start).toSec());
+  return true;
+}
+
+bool MoveHumans::initializeComponents() {
+  boost::recursive_mutex::scoped_lock lock(configuration_mutex_);
+  return initializeComponents(last_config_.planner, last_config_.controller);
+}
+
 MoveHumans::~MoveHumans() {
   delete dsrv_;
 
@@ -124,16 +263,20 @@ MoveHumans::~MoveHumans() {
     delete controller_costmap_ros_;
   }
 
-  planner_thread_->interrupt();
-  planner_thread_->join();
-  delete planner_thread_;
-
-  delete planner_plans_;
-  delete latest_plans_;
-  delete controller_plans_;
+  if (planner_thread_ != NULL) {
+    planner_thread_->interrupt();
+    planner_thread_->join();
+    delete planner_thread_;
+  }
 
   planner_.reset();
   controller_.reset();
+
+  // traces of runs that end with the node are not lost
+  auto &profiler = move_humans::Profiler::instance();
+  if (profiler.tracing() && !last_config_.profile_trace_file.empty()) {
+    profiler.writeChromeTrace(last_config_.profile_trace_file);
+  }
 }
 
 void MoveHumans::reconfigureCB(move_humans::MoveHumansConfig &config,
@@ -143,6 +286,8 @@ void MoveHumans::reconfigureCB(move_humans::MoveHumansConfig &config,
   if (!setup_) {
     last_config_ = config;
     default_config_ = config;
+    setPlanningQueueConfig(config);
+    setProfilingConfig(config);
     setup_ = true;
     return;
   }
@@ -157,19 +302,24 @@ void MoveHumans::reconfigureCB(move_humans::MoveHumansConfig &config,
     p_freq_change_ = true;
   }
 
+  setPlanningQueueConfig(config);
+  setProfilingConfig(config);
+
   if (controller_frequency_ != config.controller_frequency) {
     controller_frequency_ = config.controller_frequency;
     c_freq_change_ = true;
   }
 
-  if (config.planner != last_config_.planner) {
+  // without components the plugins of the configuration are loaded later
+  if (components_initialized_ && config.planner != last_config_.planner) {
     if (!loadPlugin<move_humans::PlannerInterface>(
             config.planner, planner_, planner_loader_, planner_costmap_ros_)) {
       config.planner = last_config_.planner;
     }
   }
 
-  if (config.controller != last_config_.controller) {
+  if (components_initialized_ &&
+      config.controller != last_config_.controller) {
     if (!loadPlugin<move_humans::ControllerInterface>(
             config.controller, controller_, controller_loader_,
             planner_costmap_ros_)) {
@@ -184,6 +334,24 @@ void MoveHumans::reconfigureCB(move_humans::MoveHumansConfig &config,
   last_config_ = config;
 }
 
+void MoveHumans::setPlanningQueueConfig(
+    const move_humans::MoveHumansConfig &config) {
+  boost::unique_lock<boost::mutex> lock(planner_mutex_);
+  planning_batch_size_ = config.planning_batch_size;
+  plan_request_timeout_ = config.plan_request_timeout;
+}
+
+void MoveHumans::setProfilingConfig(
+    const move_humans::MoveHumansConfig &config) {
+  auto &profiler = move_humans::Profiler::instance();
+  profiler.setEnabled(config.profiling);
+  if (config.profile_trace != profiler.tracing()) {
+    profiler.setTracing(config.profile_trace);
+    ROS_INFO_NAMED(NODE_NAME, "%s profile trace",
+                   config.profile_trace ? "Started" : "Stopped");
+  }
+}
+
 void MoveHumans::planThread() {
   ROS_DEBUG_NAMED(NODE_NAME "_plan_thread", "Starting planner thread");
   ros::NodeHandle nh;
@@ -191,35 +359,100 @@ void MoveHumans::planThread() {
   bool wait_for_wake = false;
   boost::unique_lock<boost::mutex> lock(planner_mutex_);
   while (nh.ok()) {
-    while (wait_for_wake || !run_planner_) {
-      ROS_DEBUG_NAMED(NODE_NAME "_plan_thread", "Planner thread is suspending");
-      planner_cond_.wait(lock);
-      wait_for_wake = false;
+    if ((wait_for_wake || !run_planner_) && planning_queue_.empty()) {
+      MOVE_HUMANS_PROFILE_SCOPE("plan_thread/queue_wait");
+      while ((wait_for_wake || !run_planner_) && planning_queue_.empty()) {
+        ROS_DEBUG_NAMED(NODE_NAME "_plan_thread",
+                        "Planner thread is suspending");
+        planner_cond_.wait(lock);
+        if (planning_queue_.empty()) {
+          wait_for_wake = false;
+        }
+      }
     }
+
+    // when no full planning is due only the most urgent humans changed by
+    // updates are planned, the others keep their plans
+    if (wait_for_wake || !run_planner_) {
+      std::vector<move_humans::PlanningQueue::Request> requests;
+      auto expired = planning_queue_.take(ros::Time::now(),
+                                          planning_batch_size_, requests);
+      lock.unlock();
+      if (expired > 0) {
+        ROS_WARN_NAMED(NODE_NAME "_plan_thread",
+                       "%lu plan requests past their deadline are no longer "
+                       "urgent",
+                       expired);
+      }
+      if (!requests.empty()) {
+        move_humans::map_pose partial_starts, partial_goals;
+        move_humans::map_pose_vector partial_sub_goals;
+        for (auto &request : requests) {
+          partial_starts[request.human_id] = request.start;
+          partial_goals[request.human_id] = request.goal;
+          if (!request.sub_goals.empty()) {
+            partial_sub_goals[request.human_id] = request.sub_goals;
+          }
+        }
+        planPartial(partial_starts, partial_sub_goals, partial_goals);
+      }
+      lock.lock();
+      continue;
+    }
+
+    // full plans include all updates received so far
+    planning_queue_.clear();
     ros::Time start_time = ros::Time::now();
     auto planner_starts = planner_starts_;
     auto planner_goals = planner_goals_;
     auto planner_sub_goals = planner_sub_goals_;
     lock.unlock();
 
+    bool stream_plans;
+    double plan_stream_period;
+    {
+      boost::recursive_mutex::scoped_lock ecl(configuration_mutex_);
+      stream_plans = last_config_.stream_plans;
+      plan_stream_period = last_config_.plan_stream_period;
+    }
+
     ROS_DEBUG_NAMED(NODE_NAME "_plan_thread", "Planning");
-    planner_plans_->clear();
+    static move_humans::Profiler::Probe &plan_probe =
+        move_humans::Profiler::instance().timer("plan_thread/plan");
+    move_humans::ScopedTimer plan_timer(plan_probe);
+    move_humans::PlanSetPtr planner_plans(new move_humans::PlanSet());
+    move_humans::PlanStream plan_stream(plan_handoff_, plan_stream_period);
+    size_t planned_humans = 0;
     if (nh.ok()) {
-      boost::unique_lock<costmap_2d::Costmap2D::mutex_t> costmap_lock(
-          *(planner_costmap_ros_->getCostmap()->getMutex()));
-
+      // planners lock the costmap themselves only while they copy it, so
+      // that layers can be updated while planning
       if (planner_costmap_ros_ == NULL) {
         ROS_ERROR_NAMED(NODE_NAME "_plan_thread",
                         "Planner costmap NULL, unable to create plan");
       } else {
         bool planning_success = false;
-        if (planner_sub_goals_.size() > 0) {
+        if (stream_plans) {
+          // humans start moving as soon as the first of them is planned
+          planning_success = planner_->submitPlans(
+              planner_starts, planner_sub_goals, planner_goals,
+              [this, &plan_stream](uint64_t human_id,
+                                   const move_humans::pose_vectors &plans) {
+                if (plan_stream.add(human_id, plans)) {
+                  boost::unique_lock<boost::mutex> lock(planner_mutex_);
+                  if (run_planner_) {
+                    state_ = move_humans::MoveHumansState::CONTROLLING;
+                  }
+                }
+              });
+          plan_stream.finish();
+          planned_humans = plan_stream.size();
+        } else if (planner_sub_goals.size() > 0) {
           planning_success =
-              planner_->makePlans(planner_starts, planner_sub_goals_,
-                                  planner_goals, *planner_plans_);
+              planner_->makePlans(planner_starts, planner_sub_goals,
+                                  planner_goals, planner_plans->plans);
         } else {
           planning_success = planner_->makePlans(planner_starts, planner_goals,
-                                                 *planner_plans_);
+                                                 planner_plans->plans);
         }
         if (!planning_success) {
           ROS_DEBUG_NAMED(NODE_NAME "_plan_thread",
@@ -228,16 +461,24 @@ void MoveHumans::planThread() {
       }
     }
 
-    lock.lock();
+    plan_timer.stop();
+
+    // publishing does not wait for the control loop
+    if (planner_plans->plans.size() > 0) {
+      planned_humans = planner_plans->plans.size();
+      auto epoch = plan_handoff_.publish(planner_plans);
+      ROS_DEBUG_NAMED(NODE_NAME "_plan_thread",
+                      "Got %lu new plans, epoch %lu",
+                      planner_plans->plans.size(), epoch);
+    } else if (planned_humans > 0) {
+      ROS_DEBUG_NAMED(NODE_NAME "_plan_thread",
+                      "Got %lu new plans, epoch %lu", planned_humans,
+                      plan_handoff_.epoch());
+    }
 
-    if (planner_plans_->size() > 0) {
-      ROS_DEBUG_NAMED(NODE_NAME "_plan_thread", "Got %lu new plans",
-                      planner_plans_->size());
-      auto planner_plans = planner_plans_;
-      planner_plans_ = latest_plans_;
-      latest_plans_ = planner_plans;
-      new_global_plans_ = true;
+    lock.lock();
 
+    if (planned_humans > 0) {
       if (run_planner_) {
         state_ = move_humans::MoveHumansState::CONTROLLING;
         ROS_DEBUG_NAMED(NODE_NAME, "Changing to CONTROLLING state");
@@ -267,6 +508,40 @@ void MoveHumans::planThread() {
   lock.unlock();
 }
 
+void MoveHumans::planPartial(const move_humans::map_pose &starts,
+                             const move_humans::map_pose_vector &sub_goals,
+                             const move_humans::map_pose &goals) {
+  ROS_DEBUG_NAMED(NODE_NAME "_plan_thread", "Planning for %lu updated humans",
+                  goals.size());
+  MOVE_HUMANS_PROFILE_SCOPE("plan_thread/plan_partial");
+  move_humans::PlanSetPtr partial_plans(new move_humans::PlanSet());
+  if (planner_costmap_ros_ == NULL) {
+    ROS_ERROR_NAMED(NODE_NAME "_plan_thread",
+                    "Planner costmap NULL, unable to create plan");
+    return;
+  }
+
+  bool planning_success = false;
+  if (sub_goals.size() > 0) {
+    planning_success =
+        planner_->makePlans(starts, sub_goals, goals, partial_plans->plans);
+  } else {
+    planning_success =
+        planner_->makePlans(starts, goals, partial_plans->plans);
+  }
+  if (!planning_success) {
+    ROS_DEBUG_NAMED(NODE_NAME "_plan_thread",
+                    "Planner plugin failed to find plans for updated humans");
+  }
+
+  if (partial_plans->plans.size() > 0) {
+    auto epoch = plan_handoff_.publishPartial(partial_plans);
+    ROS_DEBUG_NAMED(NODE_NAME "_plan_thread",
+                    "Got %lu new plans for updated humans, epoch %lu",
+                    partial_plans->plans.size(), epoch);
+  }
+}
+
 void MoveHumans::wakePlanner(const ros::TimerEvent &event) {
   planner_cond_.notify_one();
 }
@@ -274,6 +549,12 @@ void MoveHumans::wakePlanner(const ros::TimerEvent &event) {
 void MoveHumans::actionCB(
     const move_humans::MoveHumansGoalConstPtr &move_humans_goal) {
   ROS_DEBUG_NAMED(NODE_NAME, "Received new planning request");
+  if (!initializeComponents()) {
+    mhas_->setAborted(move_humans::MoveHumansResult(),
+                      "Aborting as plugins could not be loaded");
+    ROS_ERROR_NAMED(NODE_NAME, "Aborting as plugins could not be loaded");
+    return;
+  }
   move_humans::map_pose starts, goals;
   move_humans::map_pose_vector sub_goals;
   if (!validateGoals(*move_humans_goal, starts, sub_goals, goals)) {
@@ -285,17 +566,14 @@ void MoveHumans::actionCB(
   starts = toGlobaolFrame(starts);
   goals = toGlobaolFrame(goals);
   sub_goals = toGlobaolFrame(sub_goals);
+  filterShardHumans(starts, sub_goals, goals);
+  publishGoals(goals);
 
-  if (last_config_.publish_human_goals) {
-    geometry_msgs::PoseArray current_goals;
-    if (goals.size() > 0) {
-      current_goals.header.frame_id = goals.begin()->second.header.frame_id;
-      for (auto &goal_kv : goals) {
-        current_goals.poses.push_back(goal_kv.second.pose);
-      }
-      current_goals_pub_.publish(current_goals);
-    }
-  }
+  // updates sent for a previous goal do not apply to this one
+  boost::unique_lock<boost::mutex> updates_lock(updates_mutex_);
+  pending_updates_.clear();
+  updates_lock.unlock();
+  clearShardHandoffs();
 
   if (shutdown_costmaps_) {
     ROS_DEBUG_NAMED(NODE_NAME,
@@ -304,18 +582,24 @@ void MoveHumans::actionCB(
     controller_costmap_ros_->start();
   }
 
+  // shards without humans of their own wait for humans handed to them
   boost::unique_lock<boost::mutex> lock(planner_mutex_);
+  forgetReplacedHumans(goals);
   planner_starts_ = starts;
   planner_goals_ = goals;
   planner_sub_goals_ = sub_goals;
-  state_ = move_humans::MoveHumansState::PLANNING;
+  state_ = goals.empty() ? move_humans::MoveHumansState::CONTROLLING
+                         : move_humans::MoveHumansState::PLANNING;
   ROS_DEBUG_NAMED(NODE_NAME, "Changed to  PLANNING state");
-  run_planner_ = true;
+  run_planner_ = !goals.empty();
   planner_cond_.notify_one();
   lock.unlock();
 
   ros::NodeHandle nh;
   ros::Rate r(controller_frequency_);
+  bool deadline_scheduling = false;
+  control_steps_ = 1;
+  control_dt_ = 0.0;
   move_humans::map_pose_vector global_plans;
   while (nh.ok()) {
     if ((mhas_->isPreemptRequested())) {
@@ -334,14 +618,23 @@ void MoveHumans::actionCB(
         starts = toGlobaolFrame(start_poses);
         goals = toGlobaolFrame(goal_poses);
         sub_goals = toGlobaolFrame(sub_goal_poses);
+        filterShardHumans(starts, sub_goals, goals);
+        publishGoals(goals);
+
+        updates_lock.lock();
+        pending_updates_.clear();
+        updates_lock.unlock();
+        clearShardHandoffs();
 
         lock.lock();
+        forgetReplacedHumans(goals);
         planner_starts_ = starts;
         planner_goals_ = goals;
         planner_sub_goals_ = sub_goals;
-        state_ = move_humans::MoveHumansState::PLANNING;
+        state_ = goals.empty() ? move_humans::MoveHumansState::CONTROLLING
+                               : move_humans::MoveHumansState::PLANNING;
         ROS_DEBUG_NAMED(NODE_NAME, "Changed to  PLANNING state");
-        run_planner_ = true;
+        run_planner_ = !goals.empty();
         planner_cond_.notify_one();
         lock.unlock();
       } else {
@@ -352,15 +645,39 @@ void MoveHumans::actionCB(
       }
     }
 
+    applyHumanUpdates(starts, sub_goals, goals);
+    replanChangedHumans(starts, sub_goals, goals);
+    handOffHumans(starts, sub_goals, goals);
+
     if (c_freq_change_) {
       ROS_INFO_NAMED(NODE_NAME, "Setting controller frequency to %.2f",
                      controller_frequency_);
       r = ros::Rate(controller_frequency_);
+      control_scheduler_.setPeriod(1.0 / controller_frequency_);
       c_freq_change_ = false;
     }
 
-    if (goals.begin()->second.header.frame_id !=
-        planner_costmap_ros_->getGlobalFrameID()) {
+    // deadlines start from the first cycle run with the deadline scheduler
+    if (last_config_.control_scheduler == DEADLINE_SCHEDULER) {
+      if (!deadline_scheduling) {
+        control_scheduler_.reset(1.0 / controller_frequency_);
+        last_diagnostics_overruns_ = 0;
+        control_steps_ = 1;
+        control_dt_ = control_scheduler_.period();
+        deadline_scheduling = true;
+      }
+      control_scheduler_.setPolicy(
+          (move_humans::ControlScheduler::CatchUpPolicy)
+              last_config_.catch_up_policy,
+          last_config_.max_substeps);
+    } else {
+      deadline_scheduling = false;
+      control_steps_ = 1;
+      control_dt_ = 0.0;
+    }
+
+    if (!goals.empty() && goals.begin()->second.header.frame_id !=
+                              planner_costmap_ros_->getGlobalFrameID()) {
       starts = toGlobaolFrame(starts);
       goals = toGlobaolFrame(goals);
       sub_goals = toGlobaolFrame(sub_goals);
@@ -379,40 +696,97 @@ void MoveHumans::actionCB(
       lock.unlock();
     }
 
-    if (new_global_plans_) {
-      auto controller_plans = controller_plans_;
-      boost::unique_lock<boost::mutex> lock(planner_mutex_);
-      new_global_plans_ = false;
-      controller_plans_ = latest_plans_;
-      latest_plans_ = controller_plans;
-      reset_controller_plans_ = true;
-      lock.unlock();
-
-      current_controller_plans_.clear();
-      for (auto plan_vector_kv : *controller_plans_) {
-        auto human_id = plan_vector_kv.first;
-        auto plan_vector = plan_vector_kv.second;
-        // ROS_INFO_NAMED(NODE_NAME, "Got %ld plans for %ld human",
-        //                plan_vector.size(), human_id);
-        if (plan_vector.size() > 0) {
-          current_controller_plans_[human_id] = plan_vector.front();
-
-          move_humans::pose_vector current_plan;
-          for (auto &plan : plan_vector) {
-            current_plan.insert(current_plan.end(), plan.begin(), plan.end());
+    if (plan_handoff_.epoch() != controller_plans_epoch_) {
+      controller_plans_epoch_ = plan_handoff_.epoch();
+
+      // full plans replace the plans of all humans, humans removed while
+      // they were planned are left out
+      auto controller_plans = plan_handoff_.latest();
+      if (controller_plans != controller_plans_) {
+        controller_plans_ = controller_plans;
+        plans_pending_ = controller_plans_ && controller_plans_->more_pending;
+
+        current_controller_plans_.clear();
+        streamed_humans_.clear();
+        if (controller_plans_) {
+          for (auto &plan_vector_kv : controller_plans_->plans) {
+            auto &human_id = plan_vector_kv.first;
+            auto &plan_vector = plan_vector_kv.second;
+            if (goals.find(human_id) == goals.end()) {
+              continue;
+            }
+            human_plans_[human_id] =
+                move_humans::HumanPlans(controller_plans_, plan_vector);
+            streamed_humans_.insert(human_id);
+            reset_humans_.insert(human_id);
+            if (plan_vector.size() > 0) {
+              current_controller_plans_[human_id] = plan_vector.front();
+            }
+          }
+          if (!plans_pending_) {
+            dropUnstreamedPlans();
           }
-          current_planner_plans_[human_id] = current_plan;
-          cp_indices_[human_id] = 0;
+        } else {
+          human_plans_.clear();
+          reset_humans_.clear();
+        }
+
+        if (!controller_->setPlans(current_controller_plans_)) {
+          ROS_ERROR_NAMED(
+              NODE_NAME, "Failed to pass the plans to the controller, aborting");
+          mhas_->setAborted(move_humans::MoveHumansResult(),
+                            "Failed to pass the plans to the controller");
+          resetState();
+          return;
         }
       }
 
-      if (!controller_->setPlans(current_controller_plans_)) {
-        ROS_ERROR_NAMED(NODE_NAME,
-                        "Failed to pass the plans to the controller, aborting");
-        mhas_->setAborted(move_humans::MoveHumansResult(),
-                          "Failed to pass the plans to the controller");
-        resetState();
-        return;
+      // partial plans only replace the plans of the humans they hold, the
+      // others keep their plans and controller state
+      plan_handoff_.takePartial(controller_plans_ ? controller_plans_->epoch
+                                                  : 0,
+                                partial_plans_);
+      if (!partial_plans_.empty()) {
+        current_controller_plans_.clear();
+        for (auto &partial_plans : partial_plans_) {
+          // chunks of the full plans reset their humans like the first one
+          bool streamed =
+              controller_plans_ &&
+              partial_plans->stream_epoch == controller_plans_->epoch;
+          for (auto &plan_vector_kv : partial_plans->plans) {
+            auto &human_id = plan_vector_kv.first;
+            auto &plan_vector = plan_vector_kv.second;
+            if (goals.find(human_id) == goals.end()) {
+              continue;
+            }
+            human_plans_[human_id] =
+                move_humans::HumanPlans(partial_plans, plan_vector);
+            if (streamed) {
+              streamed_humans_.insert(human_id);
+              reset_humans_.insert(human_id);
+            }
+            if (plan_vector.size() > 0) {
+              current_controller_plans_[human_id] = plan_vector.front();
+            } else {
+              current_controller_plans_.erase(human_id);
+            }
+          }
+          if (streamed && !partial_plans->more_pending && plans_pending_) {
+            plans_pending_ = false;
+            dropUnstreamedPlans();
+          }
+        }
+        partial_plans_.clear();
+
+        if (current_controller_plans_.size() > 0 &&
+            !controller_->setPlans(current_controller_plans_)) {
+          ROS_ERROR_NAMED(
+              NODE_NAME, "Failed to pass the plans to the controller, aborting");
+          mhas_->setAborted(move_humans::MoveHumansResult(),
+                            "Failed to pass the plans to the controller");
+          resetState();
+          return;
+        }
       }
     }
 
@@ -426,12 +800,19 @@ void MoveHumans::actionCB(
     ROS_DEBUG_NAMED(NODE_NAME, "Full control cycle time: %.9f\n",
                     t_diff.toSec());
 
-    r.sleep();
-    if (r.cycleTime() > ros::Duration(1 / controller_frequency_) &&
-        state_ == move_humans::MoveHumansState::CONTROLLING) {
-      ROS_WARN_NAMED(NODE_NAME, "Control loop missed its desired rate of "
-                                "%.4fHz, the loop actually took %.4f seconds",
-                     controller_frequency_, r.cycleTime().toSec());
+    publishProfileDiagnostics();
+    if (deadline_scheduling) {
+      control_steps_ = control_scheduler_.wait();
+      control_dt_ = control_scheduler_.period();
+      publishControlDiagnostics();
+    } else {
+      r.sleep();
+      if (r.cycleTime() > ros::Duration(1 / controller_frequency_) &&
+          state_ == move_humans::MoveHumansState::CONTROLLING) {
+        ROS_WARN_NAMED(NODE_NAME, "Control loop missed its desired rate of "
+                                  "%.4fHz, the loop actually took %.4f seconds",
+                       controller_frequency_, r.cycleTime().toSec());
+      }
     }
   }
 
@@ -448,6 +829,7 @@ void MoveHumans::actionCB(
 
 bool MoveHumans::executeCycle(move_humans::map_pose &goals,
                               move_humans::map_pose_vector &global_plans) {
+  MOVE_HUMANS_PROFILE_SCOPE("control/cycle");
   boost::recursive_mutex::scoped_lock ecl(configuration_mutex_);
 
   switch (state_) {
@@ -468,13 +850,32 @@ bool MoveHumans::executeCycle(move_humans::map_pose &goals,
     current_controller_plans_.clear();
     current_controller_trajectories_.clear();
 
-    if (reset_controller_plans_) {
-      reset_controller_plans_ = false;
+    // humans handed to a shard are controlled before it has full plans,
+    // shards of regions wait for humans if they have none
+    if (!controller_plans_ && human_plans_.empty() &&
+        (!goals.empty() || shard_partition_.handsOff())) {
+      ROS_DEBUG_NAMED(NODE_NAME, "No plans to control humans on");
+      break;
+    }
+
+    if (!reset_humans_.empty()) {
+      // humans with new full plans start over on them, the others are
+      // published where they are, so that the reset holds all humans
       new_external_controller_trajs_ = false;
       move_humans::map_traj_point new_human_pts;
-      for (auto &controller_plan_kv : *controller_plans_) {
-        auto &human_id = controller_plan_kv.first;
-        auto &controller_plan_vector = controller_plan_kv.second;
+      for (auto &human_plans_kv : human_plans_) {
+        auto &human_id = human_plans_kv.first;
+        if (reset_humans_.count(human_id) == 0) {
+          auto human_pt_it = last_human_pts_.find(human_id);
+          if (human_pt_it != last_human_pts_.end()) {
+            new_human_pts[human_id] = human_pt_it->second;
+          }
+          continue;
+        }
+        auto &controller_plan_vector = *human_plans_kv.second.segments;
+        if (controller_plan_vector.empty()) {
+          continue;
+        }
         current_controller_plans_[human_id] = controller_plan_vector.front();
         if (!controller_plan_vector.front().empty()) {
           auto &start_pose = controller_plan_vector.front().front().pose;
@@ -485,41 +886,46 @@ bool MoveHumans::executeCycle(move_humans::map_pose &goals,
           new_human_pts[human_id] = human_start_point;
         }
       }
-      publishHumans(new_human_pts);
-    } else {
-      if (reached_humans.size() > 0) {
-        for (auto &human_id : reached_humans) {
-          auto plan_vector_it = controller_plans_->find(human_id);
-          if (plan_vector_it != controller_plans_->end()) {
-            auto &plan_vector = plan_vector_it->second;
-            if (plan_vector.size() > 0) {
-              plan_vector.erase(plan_vector.begin());
-              if (plan_vector.size() > 0) {
-                current_controller_plans_[human_id] = plan_vector.front();
-              }
+      publishHumans(new_human_pts, true);
+    }
+    if (reached_humans.size() > 0) {
+      for (auto &human_id : reached_humans) {
+        if (reset_humans_.count(human_id) > 0) {
+          continue;
+        }
+        auto human_plans_it = human_plans_.find(human_id);
+        if (human_plans_it != human_plans_.end()) {
+          auto &plan_vector = *human_plans_it->second.segments;
+          auto &cursor = human_plans_it->second.cursor;
+          if (cursor < plan_vector.size()) {
+            cursor++;
+            if (cursor < plan_vector.size()) {
+              current_controller_plans_[human_id] = plan_vector[cursor];
             }
           }
         }
       }
+    }
 
-      boost::unique_lock<boost::mutex> lock(external_trajs_mutex_);
-      if (use_external_trajs_ && new_external_controller_trajs_) {
-        new_external_controller_trajs_ = false;
-        for (auto &human_trajectory :
-             external_controller_trajs_->trajectories) {
-          current_controller_trajectories_[human_trajectory.id] =
-              human_trajectory.trajectory;
-          // reached_humans.erase(std::remove(reached_humans.begin(),
-          //                                  reached_humans.end(),
-          //                                  human_trajectory.id),
-          //                      reached_humans.end());
-        }
+    reset_humans_.clear();
+
+    boost::unique_lock<boost::mutex> lock(external_trajs_mutex_);
+    if (use_external_trajs_ && new_external_controller_trajs_) {
+      new_external_controller_trajs_ = false;
+    for (auto &human_trajectory : external_controller_trajs_->trajectories) {
+        current_controller_trajectories_[human_trajectory.id] =
+            human_trajectory.trajectory;
+        // reached_humans.erase(std::remove(reached_humans.begin(),
+        //                                  reached_humans.end(),
+        //                                  human_trajectory.id),
+        //                      reached_humans.end());
       }
-      lock.unlock();
     }
+    lock.unlock();
 
     if (current_controller_plans_.size() > 0 ||
         current_controller_trajectories_.size() > 0) {
+      MOVE_HUMANS_PROFILE_SCOPE("control/set_plans");
       if (!controller_->setPlans(current_controller_plans_,
                                  current_controller_trajectories_)) {
         ROS_ERROR_NAMED(NODE_NAME,
@@ -527,13 +933,17 @@ bool MoveHumans::executeCycle(move_humans::map_pose &goals,
       }
     }
 
-    bool all_human_goals_reached = true;
-    for (auto &plan_vector_kv : *controller_plans_) {
-      if (plan_vector_kv.second.size() > 0) {
+    // humans still being planned have not reached their goals
+    bool all_human_goals_reached = !plans_pending_;
+    for (auto &human_plans_kv : human_plans_) {
+      if (human_plans_kv.second.cursor <
+          human_plans_kv.second.segments->size()) {
         all_human_goals_reached = false;
       }
     }
-    if (all_human_goals_reached) {
+    // humans can still be handed to shards of regions, their goals stay
+    // active until they are preempted
+    if (all_human_goals_reached && !shard_partition_.handsOff()) {
       ROS_INFO_NAMED(NODE_NAME, "All goals reached!");
       mhas_->setSucceeded(move_humans::MoveHumansResult(), "Goals reached");
       resetState();
@@ -541,34 +951,43 @@ bool MoveHumans::executeCycle(move_humans::map_pose &goals,
     }
 
     boost::unique_lock<costmap_2d::Costmap2D::mutex_t> costmap_lock(
-        *(controller_costmap_ros_->getCostmap()->getMutex()));
+        *(controller_costmap_ros_->getCostmap()->getMutex()),
+        boost::defer_lock);
+    {
+      MOVE_HUMANS_PROFILE_SCOPE("control/costmap_lock_wait");
+      costmap_lock.lock();
+    }
     move_humans::map_traj_point current_human_points;
-    if (controller_->computeHumansStates(current_human_points)) {
+    bool states_computed = true;
+    controller_->setHumansIndex(humansIndex());
+    static move_humans::Profiler::Probe &compute_probe =
+        move_humans::Profiler::instance().timer("control/compute_states");
+    move_humans::ScopedTimer compute_timer(compute_probe);
+    if (control_dt_ > 0.0) {
+      // states of later steps replace earlier ones, humans reaching their
+      // goal in an earlier step are only given by that step
+      move_humans::map_traj_point step_human_points;
+      for (size_t step = 0; states_computed && step < control_steps_; step++) {
+        states_computed =
+            controller_->computeHumansStates(step_human_points, control_dt_);
+        for (auto &point_kv : step_human_points) {
+          current_human_points[point_kv.first] = point_kv.second;
+        }
+      }
+    } else {
+      states_computed = controller_->computeHumansStates(current_human_points);
+    }
+    compute_timer.stop();
+    if (states_computed) {
       ROS_DEBUG_NAMED(NODE_NAME,
                       "Got valid human positions from the controller");
+      updateHumansIndex(current_human_points);
+      MOVE_HUMANS_PROFILE_SCOPE("control/publish_humans");
       publishHumans(current_human_points);
       if (publish_feedback_) {
-        auto now = ros::Time::now();
-        auto controller_frame = controller_costmap_ros_->getGlobalFrameID();
-        move_humans::MoveHumansFeedback feedback;
-        for (auto &point_kv : current_human_points) {
-          auto &human_id = point_kv.first;
-          auto &human_traj_point = point_kv.second;
-
-          geometry_msgs::PoseStamped pose;
-          pose.header.stamp = now;
-          pose.header.frame_id = controller_frame;
-          pose.pose.position.x = human_traj_point.transform.translation.x;
-          pose.pose.position.y = human_traj_point.transform.translation.y;
-          pose.pose.orientation = human_traj_point.transform.rotation;
-
-          move_humans::HumanPose human_pose;
-          human_pose.human_id = human_id;
-          human_pose.pose = pose;
-          feedback.current_poses.push_back(human_pose);
-        }
-        mhas_->publishFeedback(feedback);
+        publishFeedback(current_human_points);
       }
+      last_human_pts_.swap(current_human_points);
     } else {
       ROS_DEBUG_NAMED(NODE_NAME,
                       "The controller could not calculate new human positions");
@@ -614,6 +1033,270 @@ void MoveHumans::resetState() {
   }
 }
 
+bool MoveHumans::waitForCostmaps(double timeout) {
+  ros::NodeHandle nh;
+  auto deadline = ros::WallTime::now() + ros::WallDuration(timeout);
+  while (nh.ok() && ros::WallTime::now() < deadline) {
+    planner_costmap_ros_->updateMap();
+    controller_costmap_ros_->updateMap();
+    if (planner_costmap_ros_->isCurrent() &&
+        controller_costmap_ros_->isCurrent()) {
+      return true;
+    }
+    ros::WallDuration(0.1).sleep();
+  }
+  return false;
+}
+
+bool MoveHumans::runFastForward() {
+  if (!fast_forward_) {
+    ROS_ERROR_NAMED(NODE_NAME, "move_humans was not started in fast-forward "
+                               "mode, not running scenarios");
+    return false;
+  }
+
+  ros::NodeHandle nh, private_nh("~");
+  double dt, max_time;
+  bool publish_clock;
+  std::string frame_id;
+  private_nh.param("fast_forward_dt", dt, 1.0 / controller_frequency_);
+  private_nh.param("fast_forward_max_time", max_time, FAST_FORWARD_MAX_TIME);
+  private_nh.param("publish_clock", publish_clock, false);
+  private_nh.param("frame_id", frame_id, std::string(SCENARIO_FRAME_ID));
+  if (dt <= 0.0) {
+    ROS_ERROR_NAMED(NODE_NAME, "fast_forward_dt must be positive");
+    return false;
+  }
+
+  std::vector<std::string> scenario_names;
+  std::vector<XmlRpc::XmlRpcValue> scenario_humans;
+  if (!readScenarios(scenario_names, scenario_humans)) {
+    ROS_ERROR_NAMED(NODE_NAME, "No scenarios to run");
+    return false;
+  }
+
+  if (!waitForCostmaps(FAST_FORWARD_COSTMAP_TIMEOUT)) {
+    ROS_ERROR_NAMED(NODE_NAME, "Costmaps did not get their data in %.1f s",
+                    FAST_FORWARD_COSTMAP_TIMEOUT);
+    return false;
+  }
+
+  // everything in this process runs on simulated time from now on
+  ros::Time sim_time = ros::Time::now();
+  ros::Duration step_duration(dt);
+  bool all_succeeded = true;
+  for (size_t scenario = 0; scenario < scenario_humans.size() && nh.ok();
+       scenario++) {
+    auto &name = scenario_names[scenario];
+    move_humans::map_pose starts, goals;
+    if (!move_humans::MoveHumansClient::parseHumans(
+            scenario_humans[scenario], frame_id, starts, goals) ||
+        starts.empty()) {
+      ROS_ERROR_NAMED(NODE_NAME, "Could not read humans of scenario %s",
+                      name.c_str());
+      all_succeeded = false;
+      continue;
+    }
+    starts = toGlobaolFrame(starts);
+    goals = toGlobaolFrame(goals);
+
+    auto wall_start = ros::WallTime::now();
+    move_humans::map_pose_vectors plans;
+    if (!planner_->makePlans(starts, goals, plans) || plans.empty()) {
+      ROS_ERROR_NAMED(NODE_NAME, "No plans for scenario %s", name.c_str());
+      all_succeeded = false;
+      continue;
+    }
+
+    // humans follow their plan segments one after the other, as in
+    // executeCycle
+    move_humans::map_size cursors;
+    move_humans::map_pose_vector segments;
+    for (auto &plan_kv : plans) {
+      cursors[plan_kv.first] = 0;
+      if (!plan_kv.second.empty()) {
+        segments[plan_kv.first] = plan_kv.second.front();
+      }
+    }
+
+    size_t steps = 0;
+    bool goals_reached = false;
+    move_humans::map_traj_point human_points;
+    while (nh.ok() && steps * dt < max_time) {
+      if (!segments.empty() && !controller_->setPlans(segments)) {
+        ROS_ERROR_NAMED(NODE_NAME, "Failed to pass the plans of scenario %s "
+                                   "to the controller",
+                        name.c_str());
+        break;
+      }
+      segments.clear();
+
+      sim_time += step_duration;
+      ros::Time::setNow(sim_time);
+      if (publish_clock) {
+        rosgraph_msgs::Clock clock;
+        clock.clock = sim_time;
+        clock_pub_.publish(clock);
+      }
+
+      controller_->setHumansIndex(humansIndex());
+      if (!controller_->computeHumansStates(human_points, dt)) {
+        ROS_ERROR_NAMED(NODE_NAME, "Controller failure in scenario %s",
+                        name.c_str());
+        break;
+      }
+      updateHumansIndex(human_points);
+      publishHumans(human_points);
+      steps++;
+
+      move_humans::id_vector reached_humans;
+      controller_->areGoalsReached(reached_humans);
+      for (auto &human_id : reached_humans) {
+        auto plan_it = plans.find(human_id);
+        auto &cursor = cursors[human_id];
+        if (plan_it != plans.end() && cursor < plan_it->second.size()) {
+          cursor++;
+          if (cursor < plan_it->second.size()) {
+            segments[human_id] = plan_it->second[cursor];
+          }
+        }
+      }
+      goals_reached = true;
+      for (auto &plan_kv : plans) {
+        if (cursors[plan_kv.first] < plan_kv.second.size()) {
+          goals_reached = false;
+        }
+      }
+      if (goals_reached) {
+        break;
+      }
+    }
+
+    double wall_time = (ros::WallTime::now() - wall_start).toSec();
+    ROS_INFO_NAMED(NODE_NAME, "Scenario %s: %lu humans %s after %.2f s in %lu "
+                              "steps, took %.3f s (%.1fx real time)",
+                   name.c_str(), plans.size(),
+                   goals_reached ? "reached their goals" : "stopped",
+                   steps * dt, steps, wall_time,
+                   wall_time > 0.0 ? steps * dt / wall_time : 0.0);
+    all_succeeded &= goals_reached;
+  }
+  return all_succeeded;
+}
+
+void MoveHumans::publishControlDiagnostics() {
+  if (!last_config_.publish_control_diagnostics) {
+    return;
+  }
+  auto now = ros::WallTime::now();
+  if (now - last_diagnostics_time_ < ros::WallDuration(DIAGNOSTICS_PERIOD)) {
+    return;
+  }
+  last_diagnostics_time_ = now;
+
+  auto statistics = control_scheduler_.statistics();
+  diagnostic_msgs::DiagnosticStatus status;
+  status.name = NODE_NAME ": control loop";
+  status.hardware_id = NODE_NAME;
+  if (statistics.overruns > last_diagnostics_overruns_) {
+    status.level = diagnostic_msgs::DiagnosticStatus::WARN;
+    status.message = "Control loop missed its deadlines";
+  } else {
+    status.level = diagnostic_msgs::DiagnosticStatus::OK;
+    status.message = "Control loop on time";
+  }
+  last_diagnostics_overruns_ = statistics.overruns;
+
+  auto add_value = [&status](const std::string &key,
+                             const std::string &value) {
+    diagnostic_msgs::KeyValue key_value;
+    key_value.key = key;
+    key_value.value = value;
+    status.values.push_back(key_value);
+  };
+  add_value("frequency (Hz)",
+            std::to_string(1.0 / control_scheduler_.period()));
+  add_value("ticks", std::to_string(statistics.ticks));
+  add_value("overruns", std::to_string(statistics.overruns));
+  add_value("skipped ticks", std::to_string(statistics.skipped_ticks));
+  add_value("substeps", std::to_string(statistics.substeps));
+  add_value("max latency (ms)", std::to_string(statistics.max_latency * 1e3));
+  add_value("p50 latency (ms)", std::to_string(statistics.p50_latency * 1e3));
+  add_value("p90 latency (ms)", std::to_string(statistics.p90_latency * 1e3));
+  add_value("p99 latency (ms)", std::to_string(statistics.p99_latency * 1e3));
+  {
+    boost::unique_lock<boost::mutex> lock(planner_mutex_);
+    add_value("queued plan requests", std::to_string(planning_queue_.size()));
+    add_value("expired plan requests",
+              std::to_string(planning_queue_.expired()));
+    add_value("superseded plan requests",
+              std::to_string(planning_queue_.superseded()));
+    add_value("costmap change replans", std::to_string(costmap_replans_));
+  }
+  if (shard_partition_.sharded()) {
+    add_value("shard", std::to_string(shard_partition_.index()) + " of " +
+                           std::to_string(shard_partition_.count()));
+    add_value("humans handed off", std::to_string(shard_handoffs_out_));
+    boost::unique_lock<boost::mutex> lock(updates_mutex_);
+    add_value("humans handed over", std::to_string(shard_handoffs_in_));
+  }
+
+  diagnostic_msgs::DiagnosticArray diagnostics;
+  diagnostics.header.stamp = ros::Time::now();
+  diagnostics.status.push_back(status);
+  diagnostics_pub_.publish(diagnostics);
+}
+
+void MoveHumans::publishProfileDiagnostics() {
+  if (!move_humans::Profiler::enabled()) {
+    return;
+  }
+  auto now = ros::WallTime::now();
+  if (now - last_profile_time_ < ros::WallDuration(DIAGNOSTICS_PERIOD)) {
+    return;
+  }
+  double period = (now - last_profile_time_).toSec();
+  last_profile_time_ = now;
+
+  diagnostic_msgs::DiagnosticStatus status;
+  status.name = NODE_NAME ": profile";
+  status.hardware_id = NODE_NAME;
+  status.level = diagnostic_msgs::DiagnosticStatus::OK;
+  status.message = "Timings since the last report";
+  auto add_value = [&status](const std::string &key,
+                             const std::string &value) {
+    diagnostic_msgs::KeyValue key_value;
+    key_value.key = key;
+    key_value.value = value;
+    status.values.push_back(key_value);
+  };
+
+  // probes that were not hit are left out
+  std::vector<move_humans::Profiler::Stats> stats;
+  move_humans::Profiler::instance().take(stats);
+  for (auto &probe_stats : stats) {
+    if (probe_stats.count == 0) {
+      continue;
+    }
+    auto &name = probe_stats.name;
+    if (!probe_stats.timed) {
+      add_value(name + " count", std::to_string(probe_stats.count));
+      continue;
+    }
+    add_value(name + " calls/s", std::to_string(probe_stats.count / period));
+    add_value(name + " mean (ms)", std::to_string(probe_stats.mean * 1e3));
+    add_value(name + " p50 (ms)", std::to_string(probe_stats.p50 * 1e3));
+    add_value(name + " p90 (ms)", std::to_string(probe_stats.p90 * 1e3));
+    add_value(name + " p99 (ms)", std::to_string(probe_stats.p99 * 1e3));
+    add_value(name + " max (ms)", std::to_string(probe_stats.max * 1e3));
+  }
+
+  diagnostic_msgs::DiagnosticArray diagnostics;
+  diagnostics.header.stamp = ros::Time::now();
+  diagnostics.status.push_back(status);
+  diagnostics_pub_.publish(diagnostics);
+}
+
 template <typename T>
 bool MoveHumans::loadPlugin(const std::string plugin_name,
                             boost::shared_ptr<T> &plugin,
@@ -624,10 +1307,17 @@ bool MoveHumans::loadPlugin(const std::string plugin_name,
   try {
     plugin = plugin_loader.createInstance(plugin_name);
 
+    // plans of the previous plugins are dropped together, the control loop
+    // picks up the next plans published after the current epoch
     boost::unique_lock<boost::mutex> lock(planner_mutex_);
-    planner_plans_->clear();
-    controller_plans_->clear();
-    latest_plans_->clear();
+    plan_handoff_.clear();
+    controller_plans_.reset();
+    controller_plans_epoch_ = plan_handoff_.epoch();
+    plans_pending_ = false;
+    human_plans_.clear();
+    streamed_humans_.clear();
+    reset_humans_.clear();
+    partial_plans_.clear();
     plugin->initialize(plugin_loader.getName(plugin_name), &tf_,
                        plugin_costmap);
     lock.unlock();
@@ -850,13 +1540,123 @@ move_humans::map_pose_vector MoveHumans::toGlobaolFrame(
   return global_pose_vector_map;
 }
 
+bool MoveHumans::readScenarios(
+    std::vector<std::string> &scenario_names,
+    std::vector<XmlRpc::XmlRpcValue> &scenario_humans) {
+  // every scenario is a list of humans, as the humans parameter
+  ros::NodeHandle private_nh("~");
+  scenario_names.clear();
+  scenario_humans.clear();
+  XmlRpc::XmlRpcValue scenarios, humans;
+  if (private_nh.getParam("scenarios", scenarios) &&
+      scenarios.getType() == XmlRpc::XmlRpcValue::TypeArray) {
+    for (auto i = 0; i < scenarios.size(); i++) {
+      if (scenarios[i].getType() != XmlRpc::XmlRpcValue::TypeStruct ||
+          !scenarios[i].hasMember("humans")) {
+        ROS_ERROR_NAMED(NODE_NAME, "Scenario %d has no humans, skipping it", i);
+        continue;
+      }
+      std::string name = "scenario " + std::to_string(i);
+      if (scenarios[i].hasMember("name") &&
+          scenarios[i]["name"].getType() == XmlRpc::XmlRpcValue::TypeString) {
+        name = (std::string)scenarios[i]["name"];
+      }
+      scenario_names.push_back(name);
+      scenario_humans.push_back(scenarios[i]["humans"]);
+    }
+  } else if (private_nh.getParam("humans", humans)) {
+    scenario_names.push_back("humans");
+    scenario_humans.push_back(humans);
+  }
+  return !scenario_humans.empty();
+}
+
 bool MoveHumans::clearCostmapsService(std_srvs::Empty::Request &req,
                                       std_srvs::Empty::Response &resp) {
+  // costmaps that do not exist yet are cleared when they are created
+  boost::recursive_mutex::scoped_lock lock(configuration_mutex_);
+  if (!components_initialized_) {
+    return true;
+  }
   planner_costmap_ros_->resetLayers();
   controller_costmap_ros_->resetLayers();
   return true;
 }
 
+bool MoveHumans::prewarmPlansService(std_srvs::Trigger::Request &req,
+                                     std_srvs::Trigger::Response &res) {
+  std::vector<std::string> scenario_names;
+  std::vector<XmlRpc::XmlRpcValue> scenario_humans;
+  if (!readScenarios(scenario_names, scenario_humans)) {
+    res.success = false;
+    res.message = "No scenarios to plan";
+    return true;
+  }
+  // with lazy_init this starts the costmaps, which are current on a later
+  // request
+  if (!initializeComponents()) {
+    res.success = false;
+    res.message = "Plugins could not be loaded";
+    return true;
+  }
+  if (!planner_costmap_ros_->isCurrent()) {
+    res.success = false;
+    res.message = "Planner costmap has no current data";
+    return true;
+  }
+
+  std::string frame_id;
+  ros::NodeHandle("~").param("frame_id", frame_id,
+                             std::string(SCENARIO_FRAME_ID));
+  size_t planned = 0, humans = 0;
+  auto wall_start = ros::WallTime::now();
+  for (size_t scenario = 0; scenario < scenario_humans.size(); scenario++) {
+    move_humans::map_pose starts, goals;
+    move_humans::map_pose_vectors plans;
+    if (!move_humans::MoveHumansClient::parseHumans(
+            scenario_humans[scenario], frame_id, starts, goals) ||
+        starts.empty()) {
+      ROS_ERROR_NAMED(NODE_NAME, "Could not read humans of scenario %s",
+                      scenario_names[scenario].c_str());
+      continue;
+    }
+    humans += starts.size();
+    if (planner_->makePlans(toGlobaolFrame(starts), toGlobaolFrame(goals),
+                            plans)) {
+      planned += plans.size();
+    }
+  }
+
+  res.success = planned > 0;
+  res.message = "Planned " + std::to_string(planned) + " of " +
+                std::to_string(humans) + " humans of " +
+                std::to_string(scenario_humans.size()) + " scenarios in " +
+                std::to_string((ros::WallTime::now() - wall_start).toSec()) +
+                " s";
+  ROS_INFO_NAMED(NODE_NAME, "%s", res.message.c_str());
+  return true;
+}
+
+bool MoveHumans::writeProfileTraceService(std_srvs::Trigger::Request &req,
+                                          std_srvs::Trigger::Response &res) {
+  std::string path;
+  {
+    boost::recursive_mutex::scoped_lock lock(configuration_mutex_);
+    path = last_config_.profile_trace_file;
+  }
+  auto &profiler = move_humans::Profiler::instance();
+  long events = path.empty() ? -1 : profiler.writeChromeTrace(path);
+  res.success = events >= 0;
+  if (res.success) {
+    res.message = "Wrote " + std::to_string(events) + " trace events to " +
+                  path + (profiler.tracing() ? "" : ", tracing is disabled");
+  } else {
+    res.message = "Could not write the profile trace to '" + path + "'";
+  }
+  ROS_INFO_NAMED(NODE_NAME, "%s", res.message.c_str());
+  return true;
+}
+
 bool MoveHumans::followExternalPaths(std_srvs::SetBool::Request &req,
                                      std_srvs::SetBool::Response &res) {
   std::string message = req.data ? "F" : "Not f";
@@ -872,6 +1672,604 @@ bool MoveHumans::followExternalPaths(std_srvs::SetBool::Request &req,
   return true;
 }
 
+bool MoveHumans::updateHumansService(
+    move_humans::UpdateHumans::Request &req,
+    move_humans::UpdateHumans::Response &res) {
+  if (mhas_ == NULL || !mhas_->isActive()) {
+    res.success = false;
+    res.message = "No running goal to update, a new goal must be sent";
+    return true;
+  }
+
+  // updates of humans of other shards remove them here, in case they were
+  // handed to this shard before
+  if (shard_partition_.sharded()) {
+    for (auto &update : req.updates) {
+      if (update.operation != move_humans::HumanGoalUpdate::SET) {
+        continue;
+      }
+      move_humans::map_pose start;
+      start[update.human_id] = update.start;
+      start = toGlobaolFrame(start);
+      if (!ownsHuman(update.human_id, start[update.human_id])) {
+        update.operation = move_humans::HumanGoalUpdate::REMOVE;
+      }
+    }
+  }
+
+  // updates are applied by the control loop, which owns the goals
+  boost::unique_lock<boost::mutex> lock(updates_mutex_);
+  pending_updates_.insert(pending_updates_.end(), req.updates.begin(),
+                          req.updates.end());
+  lock.unlock();
+  res.success = true;
+  res.message = "Queued " + std::to_string(req.updates.size()) +
+                " human update" + (req.updates.size() != 1 ? "s" : "");
+  ROS_DEBUG_NAMED(NODE_NAME, "%s", res.message.c_str());
+  return true;
+}
+
+bool MoveHumans::applyHumanUpdates(move_humans::map_pose &starts,
+                                   move_humans::map_pose_vector &sub_goals,
+                                   move_humans::map_pose &goals) {
+  std::vector<move_humans::HumanGoalUpdate> updates;
+  boost::unique_lock<boost::mutex> updates_lock(updates_mutex_);
+  updates.swap(pending_updates_);
+  updates_lock.unlock();
+  if (updates.empty()) {
+    return false;
+  }
+
+  // later updates of a human override earlier ones
+  move_humans::map_pose set_starts, set_goals;
+  move_humans::map_pose_vector set_sub_goals;
+  std::set<uint64_t> removed;
+  for (auto &update : updates) {
+    auto human_id = update.human_id;
+    if (update.operation == move_humans::HumanGoalUpdate::REMOVE) {
+      set_starts.erase(human_id);
+      set_goals.erase(human_id);
+      set_sub_goals.erase(human_id);
+      removed.insert(human_id);
+      continue;
+    }
+    if (update.operation != move_humans::HumanGoalUpdate::SET) {
+      ROS_ERROR_NAMED(NODE_NAME, "Ignoring unknown update %d for human %lu",
+                      update.operation, human_id);
+      continue;
+    }
+    if (!isQuaternionValid(update.start.pose.orientation) ||
+        !isQuaternionValid(update.goal.pose.orientation)) {
+      ROS_ERROR_NAMED(NODE_NAME, "Not updating human %lu, start or goal pose "
+                                 "was sent with an invalid quaternion",
+                      human_id);
+      continue;
+    }
+    move_humans::pose_vector valid_sub_goals;
+    for (auto &sub_goal : update.sub_goals) {
+      if (!isQuaternionValid(sub_goal.pose.orientation)) {
+        ROS_ERROR_NAMED(NODE_NAME, "Removing a sub-goals for human %lu, it was "
+                                   "sent with an invalid quaternion",
+                        human_id);
+      } else {
+        valid_sub_goals.push_back(sub_goal);
+      }
+    }
+    set_starts[human_id] = update.start;
+    set_goals[human_id] = update.goal;
+    if (valid_sub_goals.size() > 0) {
+      set_sub_goals[human_id] = valid_sub_goals;
+    } else {
+      set_sub_goals.erase(human_id);
+    }
+    removed.erase(human_id);
+  }
+  set_starts = toGlobaolFrame(set_starts);
+  set_goals = toGlobaolFrame(set_goals);
+  set_sub_goals = toGlobaolFrame(set_sub_goals);
+
+  removeHumans(removed, starts, sub_goals, goals);
+  for (auto &goal_kv : set_goals) {
+    auto &human_id = goal_kv.first;
+    starts[human_id] = set_starts[human_id];
+    goals[human_id] = goal_kv.second;
+    auto sub_goals_it = set_sub_goals.find(human_id);
+    if (sub_goals_it != set_sub_goals.end()) {
+      sub_goals[human_id] = sub_goals_it->second;
+    } else {
+      sub_goals.erase(human_id);
+    }
+  }
+
+  queuePlanRequests(starts, sub_goals, set_goals, removed);
+
+  ROS_DEBUG_NAMED(NODE_NAME, "Applied updates, %lu humans changed and %lu "
+                             "removed",
+                  set_goals.size(), removed.size());
+  publishGoals(goals);
+  return true;
+}
+
+void MoveHumans::removeHumans(const std::set<uint64_t> &removed,
+                              move_humans::map_pose &starts,
+                              move_humans::map_pose_vector &sub_goals,
+                              move_humans::map_pose &goals) {
+  // removed humans are dropped right away, plans in flight for them are
+  // ignored when they arrive as they have no goal anymore
+  if (removed.empty()) {
+    return;
+  }
+  move_humans::id_vector removed_ids(removed.begin(), removed.end());
+  for (auto human_id : removed_ids) {
+    starts.erase(human_id);
+    goals.erase(human_id);
+    sub_goals.erase(human_id);
+    human_plans_.erase(human_id);
+  }
+  planner_->removeHumans(removed_ids);
+  if (!controller_->removeHumans(removed_ids)) {
+    ROS_WARN_NAMED(NODE_NAME, "The controller can not remove humans, they "
+                              "stay where they are");
+  }
+  clear_human_markers_ = last_config_.publish_human_markers;
+}
+
+void MoveHumans::dropUnstreamedPlans() {
+  for (auto human_plans_it = human_plans_.begin();
+       human_plans_it != human_plans_.end();) {
+    if (streamed_humans_.count(human_plans_it->first) == 0) {
+      human_plans_it = human_plans_.erase(human_plans_it);
+    } else {
+      ++human_plans_it;
+    }
+  }
+  streamed_humans_.clear();
+}
+
+void MoveHumans::forgetReplacedHumans(const move_humans::map_pose &goals) {
+  move_humans::id_vector replaced_ids;
+  for (auto &goal_kv : planner_goals_) {
+    if (goals.find(goal_kv.first) == goals.end()) {
+      replaced_ids.push_back(goal_kv.first);
+    }
+  }
+  if (!replaced_ids.empty()) {
+    planner_->removeHumans(replaced_ids);
+  }
+}
+
+void MoveHumans::queuePlanRequests(
+    const move_humans::map_pose &starts,
+    const move_humans::map_pose_vector &sub_goals,
+    const move_humans::map_pose &changed_goals,
+    const std::set<uint64_t> &removed) {
+  // humans that do not have plans yet are planned first, the others by
+  // their distance to the robot
+  double robot_x, robot_y;
+  bool has_robot =
+      !changed_goals.empty() && getRobotPosition(robot_x, robot_y);
+  auto now = ros::Time::now();
+  std::vector<move_humans::PlanningQueue::Request> requests;
+  for (auto &goal_kv : changed_goals) {
+    auto &human_id = goal_kv.first;
+    move_humans::PlanningQueue::Request request;
+    request.human_id = human_id;
+    request.start = starts.at(human_id);
+    request.goal = goal_kv.second;
+    auto sub_goals_it = sub_goals.find(human_id);
+    if (sub_goals_it != sub_goals.end()) {
+      request.sub_goals = sub_goals_it->second;
+    }
+    request.urgent = human_plans_.find(human_id) == human_plans_.end();
+    if (has_robot) {
+      request.priority = std::hypot(request.start.pose.position.x - robot_x,
+                                    request.start.pose.position.y - robot_y);
+    }
+    requests.push_back(request);
+  }
+
+  // full planning keeps the updates, only the changed humans are planned
+  // until then
+  boost::unique_lock<boost::mutex> lock(planner_mutex_);
+  for (auto human_id : removed) {
+    planner_starts_.erase(human_id);
+    planner_goals_.erase(human_id);
+    planner_sub_goals_.erase(human_id);
+    planning_queue_.remove(human_id);
+  }
+  for (auto &request : requests) {
+    auto &human_id = request.human_id;
+    planner_starts_[human_id] = request.start;
+    planner_goals_[human_id] = request.goal;
+    if (!request.sub_goals.empty()) {
+      planner_sub_goals_[human_id] = request.sub_goals;
+    } else {
+      planner_sub_goals_.erase(human_id);
+    }
+    if (plan_request_timeout_ > 0.0) {
+      request.deadline = now + ros::Duration(plan_request_timeout_);
+    }
+    planning_queue_.push(request);
+  }
+  if (changed_goals.size() > 0) {
+    planner_cond_.notify_one();
+  }
+  lock.unlock();
+}
+
+void MoveHumans::costmapCB(const nav_msgs::OccupancyGridConstPtr &grid) {
+  boost::mutex::scoped_lock lock(costmap_changes_mutex_);
+  move_humans::ChangedBoxes changed;
+  if (costmap_changes_.update(*grid, changed)) {
+    changed_boxes_.insert(changed_boxes_.end(), changed.begin(), changed.end());
+  }
+}
+
+void MoveHumans::costmapUpdateCB(
+    const map_msgs::OccupancyGridUpdateConstPtr &update) {
+  boost::mutex::scoped_lock lock(costmap_changes_mutex_);
+  move_humans::ChangedBoxes changed;
+  if (costmap_changes_.update(*update, changed)) {
+    changed_boxes_.insert(changed_boxes_.end(), changed.begin(), changed.end());
+  }
+}
+
+bool MoveHumans::replanChangedHumans(move_humans::map_pose &starts,
+                                     move_humans::map_pose_vector &sub_goals,
+                                     const move_humans::map_pose &goals) {
+  move_humans::ChangedBoxes boxes;
+  boost::unique_lock<boost::mutex> changes_lock(costmap_changes_mutex_);
+  boxes.swap(changed_boxes_);
+  changes_lock.unlock();
+  if (boxes.empty() || !last_config_.replan_on_costmap_changes ||
+      state_ != move_humans::MoveHumansState::CONTROLLING) {
+    return false;
+  }
+
+  // boxes are grown by the size of a human, so that plans passing close to
+  // changed cells are replanned as well
+  double margin = last_config_.costmap_change_margin;
+  for (auto &box : boxes) {
+    box = box.inflated(margin);
+  }
+  auto bounds = boxes.front();
+  for (auto &box : boxes) {
+    bounds.merge(box);
+  }
+  move_humans::id_vector changed_humans;
+  for (auto &human_plans_kv : human_plans_) {
+    auto &human_plans = human_plans_kv.second;
+    if (human_plans.cursor < human_plans.segments->size() &&
+        move_humans::plansCross(*human_plans.segments, human_plans.cursor,
+                                boxes, bounds)) {
+      changed_humans.push_back(human_plans_kv.first);
+    }
+  }
+  if (changed_humans.empty()) {
+    return false;
+  }
+
+  // humans are replanned from where they are to the sub-goals they did not
+  // reach yet
+  auto current_poses = currentPoses(changed_humans);
+  move_humans::map_pose changed_goals;
+  for (auto human_id : changed_humans) {
+    auto goal_it = goals.find(human_id);
+    if (goal_it == goals.end()) {
+      continue;
+    }
+    auto pose_it = current_poses.find(human_id);
+    if (pose_it != current_poses.end()) {
+      starts[human_id] = pose_it->second;
+    }
+    dropPassedSubGoals(human_id, sub_goals);
+    changed_goals[human_id] = goal_it->second;
+  }
+  queuePlanRequests(starts, sub_goals, changed_goals, std::set<uint64_t>());
+  costmap_replans_ += changed_goals.size();
+
+  ROS_DEBUG_NAMED(NODE_NAME, "Replanning %lu humans crossing %lu changed "
+                             "costmap regions",
+                  changed_goals.size(), boxes.size());
+  return true;
+}
+
+move_humans::map_pose
+MoveHumans::currentPoses(const move_humans::id_vector &human_ids) {
+  std::map<uint64_t, std::pair<double, double>> positions;
+  auto humans_index = humansIndex();
+  for (auto &entry : humans_index->entries()) {
+    positions[entry.id] = std::make_pair(entry.x, entry.y);
+  }
+  move_humans::map_pose current_poses;
+  for (auto human_id : human_ids) {
+    auto position_it = positions.find(human_id);
+    if (position_it == positions.end()) {
+      continue;
+    }
+    geometry_msgs::PoseStamped pose;
+    pose.header.frame_id = controller_costmap_ros_->getGlobalFrameID();
+    pose.header.stamp = ros::Time::now();
+    pose.pose.position.x = position_it->second.first;
+    pose.pose.position.y = position_it->second.second;
+    pose.pose.orientation.w = 1.0;
+    current_poses[human_id] = pose;
+  }
+  return toGlobaolFrame(current_poses);
+}
+
+void MoveHumans::dropPassedSubGoals(uint64_t human_id,
+                                    move_humans::map_pose_vector &sub_goals) {
+  auto sub_goals_it = sub_goals.find(human_id);
+  auto human_plans_it = human_plans_.find(human_id);
+  if (sub_goals_it == sub_goals.end() || human_plans_it == human_plans_.end()) {
+    return;
+  }
+  // segments after the current one start at the sub-goals still ahead,
+  // counted from the plans so that humans replanned again before their new
+  // plans arrived keep the same sub-goals
+  auto &human_plans = human_plans_it->second;
+  auto &human_sub_goals = sub_goals_it->second;
+  size_t segments = human_plans.segments->size();
+  size_t ahead =
+      human_plans.cursor < segments ? segments - human_plans.cursor - 1 : 0;
+  if (ahead < human_sub_goals.size()) {
+    human_sub_goals.erase(human_sub_goals.begin(),
+                          human_sub_goals.end() - ahead);
+  }
+  if (human_sub_goals.empty()) {
+    sub_goals.erase(sub_goals_it);
+  }
+}
+
+bool MoveHumans::ownsHuman(uint64_t human_id,
+                           const geometry_msgs::PoseStamped &pose) {
+  boost::mutex::scoped_lock lock(shard_mutex_);
+  return shard_partition_.owns(human_id, pose.pose.position.x);
+}
+
+void MoveHumans::updateShardBounds() {
+  // regions without boundaries are spread over the planner costmap, which
+  // all shards build from the same static map
+  auto costmap = planner_costmap_ros_->getCostmap();
+  double min_x, max_x;
+  {
+    boost::unique_lock<costmap_2d::Costmap2D::mutex_t> costmap_lock(
+        *(costmap->getMutex()));
+    min_x = costmap->getOriginX();
+    max_x = min_x + costmap->getSizeInMetersX();
+  }
+  boost::mutex::scoped_lock lock(shard_mutex_);
+  shard_partition_.setMapBounds(min_x, max_x);
+}
+
+void MoveHumans::filterShardHumans(move_humans::map_pose &starts,
+                                   move_humans::map_pose_vector &sub_goals,
+                                   move_humans::map_pose &goals) {
+  if (!shard_partition_.sharded()) {
+    return;
+  }
+  updateShardBounds();
+  size_t humans = starts.size();
+  auto start_it = starts.begin();
+  while (start_it != starts.end()) {
+    auto human_id = start_it->first;
+    if (ownsHuman(human_id, start_it->second)) {
+      ++start_it;
+      continue;
+    }
+    goals.erase(human_id);
+    sub_goals.erase(human_id);
+    start_it = starts.erase(start_it);
+  }
+  ROS_INFO_NAMED(NODE_NAME, "Shard %lu owns %lu of %lu humans",
+                 shard_partition_.index(), starts.size(), humans);
+}
+
+bool MoveHumans::handOffHumans(move_humans::map_pose &starts,
+                               move_humans::map_pose_vector &sub_goals,
+                               move_humans::map_pose &goals) {
+  if (!shard_partition_.handsOff() ||
+      state_ != move_humans::MoveHumansState::CONTROLLING) {
+    return false;
+  }
+
+  // humans accepted by their new shard are removed from this one
+  std::set<uint64_t> accepted;
+  std::map<uint64_t, ros::Time> sent;
+  {
+    boost::mutex::scoped_lock lock(shard_mutex_);
+    accepted.swap(shard_handoffs_accepted_);
+    for (auto human_id : accepted) {
+      shard_handoffs_sent_.erase(human_id);
+    }
+    sent = shard_handoffs_sent_;
+  }
+  if (!accepted.empty()) {
+    removeHumans(accepted, starts, sub_goals, goals);
+    queuePlanRequests(starts, sub_goals, move_humans::map_pose(), accepted);
+    shard_handoffs_out_ += accepted.size();
+    ROS_DEBUG_NAMED(NODE_NAME, "%lu humans were accepted by other shards",
+                    accepted.size());
+    publishGoals(goals);
+  }
+
+  // only humans with plans are handed off, the others have not moved yet,
+  // humans waiting for an answer are not handed off again until it times
+  // out
+  auto now = ros::Time::now();
+  move_humans::id_vector human_ids;
+  auto humans_index = humansIndex();
+  for (auto &entry : humans_index->entries()) {
+    auto sent_it = sent.find(entry.id);
+    if (goals.find(entry.id) != goals.end() &&
+        human_plans_.find(entry.id) != human_plans_.end() &&
+        (sent_it == sent.end() ||
+         now - sent_it->second > ros::Duration(SHARD_HANDOFF_TIMEOUT))) {
+      human_ids.push_back(entry.id);
+    }
+  }
+  if (human_ids.empty()) {
+    return !accepted.empty();
+  }
+  auto current_poses = currentPoses(human_ids);
+
+  // humans are added to their new shard from where they are, with the
+  // sub-goals they did not reach yet
+  std::map<size_t, move_humans::ShardHandoff> handoffs;
+  std::set<uint64_t> handed_off;
+  auto index = shard_partition_.index();
+  double margin = last_config_.shard_handoff_margin;
+  for (auto &pose_kv : current_poses) {
+    size_t owner;
+    {
+      boost::mutex::scoped_lock lock(shard_mutex_);
+      owner = shard_partition_.regionOwner(pose_kv.second.pose.position.x,
+                                           index, margin);
+    }
+    if (owner == index) {
+      continue;
+    }
+    auto human_id = pose_kv.first;
+    move_humans::HumanGoalUpdate update;
+    update.operation = move_humans::HumanGoalUpdate::SET;
+    update.human_id = human_id;
+    update.start = pose_kv.second;
+    dropPassedSubGoals(human_id, sub_goals);
+    auto sub_goals_it = sub_goals.find(human_id);
+    if (sub_goals_it != sub_goals.end()) {
+      update.sub_goals = sub_goals_it->second;
+    }
+    update.goal = goals[human_id];
+    handoffs[owner].updates.push_back(update);
+    handed_off.insert(human_id);
+  }
+  if (handed_off.empty()) {
+    return !accepted.empty();
+  }
+
+  for (auto &handoff_kv : handoffs) {
+    auto &handoff = handoff_kv.second;
+    handoff.header.stamp = now;
+    handoff.type = move_humans::ShardHandoff::HANDOFF;
+    handoff.from_shard = index;
+    handoff.to_shard = handoff_kv.first;
+    shard_handoff_pub_.publish(handoff);
+  }
+  {
+    boost::mutex::scoped_lock lock(shard_mutex_);
+    for (auto human_id : handed_off) {
+      shard_handoffs_sent_[human_id] = now;
+    }
+  }
+
+  ROS_DEBUG_NAMED(NODE_NAME, "Handing %lu humans to %lu other shards",
+                  handed_off.size(), handoffs.size());
+  return true;
+}
+
+void MoveHumans::shardHandoffCB(
+    const move_humans::ShardHandoffConstPtr &handoff) {
+  if (handoff->to_shard != shard_partition_.index()) {
+    return;
+  }
+
+  if (handoff->type == move_humans::ShardHandoff::ACCEPT) {
+    boost::mutex::scoped_lock lock(shard_mutex_);
+    for (auto &update : handoff->updates) {
+      if (shard_handoffs_sent_.count(update.human_id) > 0) {
+        shard_handoffs_accepted_.insert(update.human_id);
+      }
+    }
+    return;
+  }
+  if (handoff->type == move_humans::ShardHandoff::REJECT) {
+    ROS_WARN_THROTTLE_NAMED(1.0, NODE_NAME,
+                            "Shard %u without a running goal rejected %lu "
+                            "humans, handing them off again later",
+                            handoff->from_shard, handoff->updates.size());
+    return;
+  }
+
+  // the humans are accepted only while a goal is running, the handing shard
+  // keeps them otherwise
+  move_humans::ShardHandoff answer;
+  answer.header.stamp = ros::Time::now();
+  answer.from_shard = handoff->to_shard;
+  answer.to_shard = handoff->from_shard;
+  answer.updates.resize(handoff->updates.size());
+  for (size_t i = 0; i < handoff->updates.size(); i++) {
+    answer.updates[i].human_id = handoff->updates[i].human_id;
+  }
+  if (mhas_ != NULL && mhas_->isActive()) {
+    answer.type = move_humans::ShardHandoff::ACCEPT;
+    // handed over humans are added like updates of the running goal
+    boost::unique_lock<boost::mutex> lock(updates_mutex_);
+    pending_updates_.insert(pending_updates_.end(), handoff->updates.begin(),
+                            handoff->updates.end());
+    shard_handoffs_in_ += handoff->updates.size();
+  } else {
+    answer.type = move_humans::ShardHandoff::REJECT;
+  }
+  shard_handoff_pub_.publish(answer);
+}
+
+void MoveHumans::clearShardHandoffs() {
+  boost::mutex::scoped_lock lock(shard_mutex_);
+  shard_handoffs_sent_.clear();
+  shard_handoffs_accepted_.clear();
+}
+
+bool MoveHumans::getRobotPosition(double &x, double &y) {
+  if (robot_frame_.empty()) {
+    return false;
+  }
+  try {
+    tf::StampedTransform robot_transform;
+    tf_.lookupTransform(planner_costmap_ros_->getGlobalFrameID(), robot_frame_,
+                        ros::Time(0), robot_transform);
+    x = robot_transform.getOrigin().x();
+    y = robot_transform.getOrigin().y();
+    return true;
+  } catch (tf::TransformException &ex) {
+    ROS_WARN_THROTTLE_NAMED(10.0, NODE_NAME,
+                            "No position of robot frame %s, plan requests are "
+                            "not ordered by distance to the robot: %s",
+                            robot_frame_.c_str(), ex.what());
+    return false;
+  }
+}
+
+void MoveHumans::updateHumansIndex(
+    const move_humans::map_traj_point &human_pts) {
+  move_humans::SpatialIndexPtr index;
+  index.swap(spare_humans_index_);
+  if (!index || !index.unique()) {
+    index.reset(new move_humans::SpatialIndex());
+  }
+  index->setCellSize(last_config_.spatial_index_cell_size > 0.0
+                         ? last_config_.spatial_index_cell_size
+                         : SPATIAL_INDEX_CELL_RADII * human_radius_);
+  index->rebuild(human_pts);
+
+  boost::mutex::scoped_lock lock(humans_index_mutex_);
+  spare_humans_index_.swap(humans_index_);
+  humans_index_.swap(index);
+}
+
+void MoveHumans::publishGoals(const move_humans::map_pose &goals) {
+  if (last_config_.publish_human_goals) {
+    geometry_msgs::PoseArray current_goals;
+    if (goals.size() > 0) {
+      current_goals.header.frame_id = goals.begin()->second.header.frame_id;
+      for (auto &goal_kv : goals) {
+        current_goals.poses.push_back(goal_kv.second.pose);
+      }
+      current_goals_pub_.publish(current_goals);
+    }
+  }
+}
+
 void MoveHumans::controllerPathsCB(
     const hanp_msgs::HumanTrajectoryArrayConstPtr traj_array) {
   boost::mutex::scoped_lock(external_trajs_mutex_);
@@ -879,45 +2277,80 @@ void MoveHumans::controllerPathsCB(
   new_external_controller_trajs_ = true;
 }
 
-void MoveHumans::publishHumans(const move_humans::map_traj_point &human_pts) {
+void MoveHumans::publishHumans(const move_humans::map_traj_point &human_pts,
+                               bool force) {
   auto now = ros::Time::now();
   auto controller_frame = controller_costmap_ros_->getGlobalFrameID();
-  auto publish_human_markers = last_config_.publish_human_markers;
-
-  hanp_msgs::TrackedHumans humans;
-  visualization_msgs::MarkerArray humans_markers;
-  for (auto &human_pt_kv : human_pts) {
-    hanp_msgs::TrackedSegment human_segment;
-    human_segment.type = DEFAUTL_SEGMENT_TYPE;
-    human_segment.pose.pose.position.x =
-        human_pt_kv.second.transform.translation.x;
-    human_segment.pose.pose.position.y =
-        human_pt_kv.second.transform.translation.y;
-    human_segment.pose.pose.orientation = human_pt_kv.second.transform.rotation;
-    human_segment.pose.covariance[0] = human_radius_;
-    human_segment.pose.covariance[7] = human_radius_;
-
-    auto yaw = tf::getYaw(human_segment.pose.pose.orientation);
-    human_segment.twist.twist.linear.x = human_pt_kv.second.velocity.linear.x * std::cos(yaw);
-    human_segment.twist.twist.linear.y = human_pt_kv.second.velocity.linear.x * std::sin(yaw);
-    human_segment.twist.twist.angular.z = human_pt_kv.second.velocity.angular.z;
-    hanp_msgs::TrackedHuman human;
-    human.track_id = human_pt_kv.first;
-    human.segments.push_back(human_segment);
-    humans.humans.push_back(human);
-
-    if (publish_human_markers) {
-      visualization_msgs::Marker human_arrow, human_cylinder;
+
+  if (clear_human_markers_) {
+    visualization_msgs::MarkerArray clear_markers;
+    visualization_msgs::Marker clear_marker;
+    clear_marker.header.stamp = now;
+    clear_marker.header.frame_id = controller_frame;
+    clear_marker.action = 3; // visualization_msgs::Marker::DELETEALL;
+    clear_markers.markers.push_back(clear_marker);
+    humans_markers_pub_.publish(clear_markers);
+    clear_human_markers_ = false;
+  }
+
+  // sent even without humans, so that receivers drop removed humans
+  publishHumanStream(human_pts, force, now, controller_frame);
+
+  if (human_pts.empty()) {
+    return;
+  }
+
+  // messages are kept between cycles so that their buffers are reused
+  if (humans_throttle_.due(humans_pub_,
+                           force ? 0.0 : last_config_.humans_publish_rate,
+                           now)) {
+    humans_msg_.header.stamp = now;
+    humans_msg_.header.frame_id = controller_frame;
+    humans_msg_.humans.resize(human_pts.size());
+    size_t i = 0;
+    for (auto &human_pt_kv : human_pts) {
+      auto &point = human_pt_kv.second;
+      auto &human = humans_msg_.humans[i++];
+      human.track_id = human_pt_kv.first;
+      human.segments.resize(1);
+      auto &human_segment = human.segments[0];
+      human_segment.type = DEFAUTL_SEGMENT_TYPE;
+      human_segment.pose.pose.position.x = point.transform.translation.x;
+      human_segment.pose.pose.position.y = point.transform.translation.y;
+      human_segment.pose.pose.orientation = point.transform.rotation;
+      human_segment.pose.covariance[0] = human_radius_;
+      human_segment.pose.covariance[7] = human_radius_;
+
+      auto yaw = tf::getYaw(human_segment.pose.pose.orientation);
+      human_segment.twist.twist.linear.x =
+          point.velocity.linear.x * std::cos(yaw);
+      human_segment.twist.twist.linear.y =
+          point.velocity.linear.x * std::sin(yaw);
+      human_segment.twist.twist.angular.z = point.velocity.angular.z;
+    }
+    humans_pub_.publish(humans_msg_);
+  }
+
+  if (last_config_.publish_human_markers &&
+      markers_throttle_.due(humans_markers_pub_,
+                            force ? 0.0 : last_config_.markers_publish_rate,
+                            now)) {
+    humans_markers_msg_.markers.resize(human_pts.size() * 2);
+    size_t i = 0;
+    for (auto &human_pt_kv : human_pts) {
+      auto &point = human_pt_kv.second;
+      auto &human_arrow = humans_markers_msg_.markers[i++];
+      auto &human_cylinder = humans_markers_msg_.markers[i++];
 
       human_arrow.header.stamp = now;
       human_arrow.header.frame_id = controller_frame;
       human_arrow.type = visualization_msgs::Marker::ARROW;
       human_arrow.action = visualization_msgs::Marker::MODIFY;
       human_arrow.id = human_pt_kv.first + HUMANS_ARROWS_ID_OFFSET;
-      human_arrow.pose.position.x = human_pt_kv.second.transform.translation.x;
-      human_arrow.pose.position.y = human_pt_kv.second.transform.translation.y;
-      human_arrow.pose.position.z = human_pt_kv.second.transform.translation.z;
-      human_arrow.pose.orientation = human_pt_kv.second.transform.rotation;
+      human_arrow.pose.position.x = point.transform.translation.x;
+      human_arrow.pose.position.y = point.transform.translation.y;
+      human_arrow.pose.position.z = point.transform.translation.z;
+      human_arrow.pose.orientation = point.transform.rotation;
       human_arrow.scale.x = human_radius_ * 2.0;
       human_arrow.scale.y = 0.1;
       human_arrow.scale.z = 0.1;
@@ -932,11 +2365,9 @@ void MoveHumans::publishHumans(const move_humans::map_traj_point &human_pts) {
       human_cylinder.type = visualization_msgs::Marker::CYLINDER;
       human_cylinder.action = visualization_msgs::Marker::MODIFY;
       human_cylinder.id = human_pt_kv.first;
-      human_cylinder.pose.position.x =
-          human_pt_kv.second.transform.translation.x;
-      human_cylinder.pose.position.y =
-          human_pt_kv.second.transform.translation.y;
-      human_cylinder.pose.position.z += (HUMANS_CYLINDERS_HEIGHT / 2);
+      human_cylinder.pose.position.x = point.transform.translation.x;
+      human_cylinder.pose.position.y = point.transform.translation.y;
+      human_cylinder.pose.position.z = HUMANS_CYLINDERS_HEIGHT / 2;
       // human_cylinder.pose.orientation =
       // human_pt_kv.second.transform.rotation;
       human_cylinder.scale.x = human_radius_ * 2;
@@ -947,29 +2378,62 @@ void MoveHumans::publishHumans(const move_humans::map_traj_point &human_pts) {
       human_cylinder.color.g = HUMAN_COLOR_G;
       human_cylinder.color.b = HUMAN_COLOR_B;
       human_cylinder.lifetime = ros::Duration(MARKER_LIFETIME);
-
-      humans_markers.markers.push_back(human_arrow);
-      humans_markers.markers.push_back(human_cylinder);
     }
+    humans_markers_pub_.publish(humans_markers_msg_);
   }
-  if (!humans.humans.empty()) {
-    humans.header.stamp = now;
-    humans.header.frame_id = controller_frame;
-    humans_pub_.publish(humans);
+}
 
-    if (publish_human_markers) {
-      humans_markers_pub_.publish(humans_markers);
-    }
+void MoveHumans::publishHumanStream(
+    const move_humans::map_traj_point &human_pts, bool force,
+    const ros::Time &now, const std::string &frame_id) {
+  if (!last_config_.publish_human_stream) {
+    return;
+  }
 
-    if (clear_human_markers_) {
-      visualization_msgs::Marker clear_markers;
-      clear_markers.header.stamp = now;
-      clear_markers.header.frame_id = controller_frame;
-      clear_markers.action = 3; // visualization_msgs::Marker::DELETEALL;
-      humans_markers.markers.push_back(clear_markers);
-      humans_markers_pub_.publish(humans_markers);
-      clear_human_markers_ = false;
-    }
+  // new subscribers need a keyframe to decode the following deltas
+  auto subscribers = human_stream_pub_.getNumSubscribers();
+  if (subscribers > human_stream_subscribers_) {
+    human_state_encoder_.reset();
+  }
+  human_stream_subscribers_ = subscribers;
+  if (subscribers == 0 ||
+      !stream_throttle_.due(force ? 0.0 : last_config_.stream_publish_rate,
+                            now)) {
+    return;
+  }
+
+  human_state_encoder_.setParams(
+      last_config_.stream_position_resolution,
+      last_config_.stream_yaw_resolution, last_config_.stream_delta_threshold,
+      last_config_.stream_yaw_delta_threshold,
+      last_config_.stream_keyframe_period);
+  if (human_state_encoder_.encode(human_pts, now, human_stream_msg_)) {
+    human_stream_msg_.header.stamp = now;
+    human_stream_msg_.header.frame_id = frame_id;
+    human_stream_pub_.publish(human_stream_msg_);
+  }
+}
+
+void MoveHumans::publishFeedback(
+    const move_humans::map_traj_point &human_pts) {
+  auto now = ros::Time::now();
+  if (!feedback_throttle_.due(last_config_.feedback_publish_rate, now)) {
+    return;
+  }
+
+  auto controller_frame = controller_costmap_ros_->getGlobalFrameID();
+  feedback_msg_.current_poses.resize(human_pts.size());
+  size_t i = 0;
+  for (auto &point_kv : human_pts) {
+    auto &human_traj_point = point_kv.second;
+    auto &human_pose = feedback_msg_.current_poses[i++];
+    human_pose.human_id = point_kv.first;
+    human_pose.pose.header.stamp = now;
+    human_pose.pose.header.frame_id = controller_frame;
+    human_pose.pose.pose.position.x = human_traj_point.transform.translation.x;
+    human_pose.pose.pose.position.y = human_traj_point.transform.translation.y;
+    human_pose.pose.pose.orientation = human_traj_point.transform.rotation;
   }
+  mhas_->publishFeedback(feedback_msg_);
 }
 };
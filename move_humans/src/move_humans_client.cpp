@@ -7,15 +7,22 @@
 #define ADD_SUBGOAL_SERVICE_NAME "add_sub_goal"
 #define UPDATE_GOAL_SERVICE_NAME "update_goal"
 #define TELEPORT_HUMAN_SERVICE_NAME "teleport_human"
+#define UPDATE_HUMANS_SERVICE_NAME "/move_humans_node/update_humans"
+#define ACTION_SERVER_NAME "/move_humans_node/action_server"
 #define GOAL_REACHING_THRESHOLD 0.1 // m
 
 #include "move_humans/move_humans_client.h"
 
 namespace move_humans {
-MoveHumansClient::MoveHumansClient(tf::TransformListener &tf) : tf_(tf) {
+MoveHumansClient::MoveHumansClient(tf::TransformListener &tf)
+    : tf_(tf), send_full_goal_(false) {
   ros::NodeHandle private_nh("~");
 
-  mhac_ = new MoveHumansActionClient("/move_humans_node/action_server", true);
+  // shards of a sharded simulation run in their own namespaces
+  std::string action_server_name;
+  private_nh.param("action_server_name", action_server_name,
+                   std::string(ACTION_SERVER_NAME));
+  mhac_ = new MoveHumansActionClient(action_server_name, true);
 
   private_nh.param("frame_id", frame_id_, std::string(FRAME_ID));
 
@@ -32,6 +39,12 @@ MoveHumansClient::MoveHumansClient(tf::TransformListener &tf) : tf_(tf) {
                    std::string(UPDATE_GOAL_SERVICE_NAME));
   private_nh.param("teleport_human_service_name", teleport_human_service_name_,
                    std::string(TELEPORT_HUMAN_SERVICE_NAME));
+  std::string update_humans_service_name;
+  private_nh.param("update_humans_service_name", update_humans_service_name,
+                   std::string(UPDATE_HUMANS_SERVICE_NAME));
+  update_humans_client_ =
+      ros::NodeHandle().serviceClient<move_humans::UpdateHumans>(
+          update_humans_service_name);
 
   if (!getHumansGoals(private_nh, starts_, goals_)) {
     ROS_ERROR_NAMED(
@@ -96,6 +109,29 @@ void MoveHumansClient::clientThread() {
   lock.lock();
   while (nh.ok()) {
     client_cond_.wait(lock);
+    if (!send_full_goal_ && changed_humans_.empty()) {
+      continue;
+    }
+
+    // changes of single humans are sent as updates of the running goal, so
+    // that only they are replanned, a new goal is sent if this fails
+    if (!send_full_goal_) {
+      move_humans::UpdateHumans update_humans;
+      getUpdates(update_humans.request.updates);
+      lock.unlock();
+      bool updated = update_humans_client_.call(update_humans) &&
+                     update_humans.response.success;
+      lock.lock();
+      if (updated) {
+        ROS_DEBUG_NAMED(NODE_NAME, "Sent updates for %lu humans",
+                        update_humans.request.updates.size());
+        continue;
+      }
+      ROS_DEBUG_NAMED(NODE_NAME, "Could not update the running goal: %s",
+                      update_humans.response.message.c_str());
+    }
+    send_full_goal_ = false;
+    changed_humans_.clear();
 
     move_humans::MoveHumansGoal goal;
     for (auto &start_kv : starts_) {
@@ -157,6 +193,31 @@ void MoveHumansClient::clientThread() {
   // }
 }
 
+void MoveHumansClient::getUpdates(
+    std::vector<move_humans::HumanGoalUpdate> &updates) {
+  for (auto &changed_kv : changed_humans_) {
+    auto &human_id = changed_kv.first;
+    move_humans::HumanGoalUpdate update;
+    update.human_id = human_id;
+    auto starts_it = starts_.find(human_id);
+    auto goals_it = goals_.find(human_id);
+    if (changed_kv.second == move_humans::HumanGoalUpdate::REMOVE ||
+        starts_it == starts_.end() || goals_it == goals_.end()) {
+      update.operation = move_humans::HumanGoalUpdate::REMOVE;
+    } else {
+      update.operation = move_humans::HumanGoalUpdate::SET;
+      update.start = starts_it->second;
+      update.goal = goals_it->second;
+      auto sub_goals_it = sub_goals_.find(human_id);
+      if (sub_goals_it != sub_goals_.end()) {
+        update.sub_goals = sub_goals_it->second;
+      }
+    }
+    updates.push_back(update);
+  }
+  changed_humans_.clear();
+}
+
 bool MoveHumansClient::getHumansGoals(ros::NodeHandle &nh,
                                       move_humans::map_pose &starts,
                                       move_humans::map_pose &goals) {
@@ -166,6 +227,17 @@ bool MoveHumansClient::getHumansGoals(ros::NodeHandle &nh,
     return false;
   }
 
+  return parseHumans(humans, frame_id_, starts, goals);
+}
+
+bool MoveHumansClient::parseHumans(XmlRpc::XmlRpcValue &humans,
+                                   const std::string &frame_id,
+                                   move_humans::map_pose &starts,
+                                   move_humans::map_pose &goals) {
+  if (humans.getType() != XmlRpc::XmlRpcValue::TypeArray) {
+    return false;
+  }
+
   for (auto i = 0; i < humans.size(); i++) {
     // ROS_ASSERT(humans[i].getType() == XmlRpc::XmlRpcValue::TypeStruct);
     if (humans[i].getType() != XmlRpc::XmlRpcValue::TypeStruct) {
@@ -201,7 +273,7 @@ bool MoveHumansClient::getHumansGoals(ros::NodeHandle &nh,
             }
           }
           if (are_doubles) {
-            start_pose.pose.header.frame_id = frame_id_;
+            start_pose.pose.header.frame_id = frame_id;
             start_pose.pose.pose.position.x = (double)(it->second[0]);
             start_pose.pose.pose.position.y = (double)(it->second[1]);
             start_pose.pose.pose.position.z = 0;
@@ -224,7 +296,7 @@ bool MoveHumansClient::getHumansGoals(ros::NodeHandle &nh,
             }
           }
           if (are_doubles) {
-            goal_pose.pose.header.frame_id = frame_id_;
+            goal_pose.pose.header.frame_id = frame_id;
             goal_pose.pose.pose.position.x = (double)(it->second[0]);
             goal_pose.pose.pose.position.y = (double)(it->second[1]);
             goal_pose.pose.pose.position.z = 0;
@@ -274,6 +346,7 @@ bool MoveHumansClient::resetSimulation(std_srvs::Trigger::Request &req,
     message += "Simulation restarted";
     res.message = message;
     res.success = true;
+    send_full_goal_ = true;
     client_cond_.notify_one();
   }
   return true;
@@ -316,6 +389,8 @@ bool MoveHumansClient::deleteHuman(move_humans::HumanUpdate::Request &req,
   reached_goals_.erase(std::remove(reached_goals_.begin(), reached_goals_.end(),
                                    req.human_pose.human_id),
                        reached_goals_.end());
+  changed_humans_[req.human_pose.human_id] =
+      move_humans::HumanGoalUpdate::REMOVE;
   client_cond_.notify_one();
   message += "Deleted human " + std::to_string(req.human_pose.human_id);
   ROS_INFO_NAMED(NODE_NAME, "%s", message.c_str());
@@ -368,6 +443,10 @@ bool MoveHumansClient::addSubgoal(move_humans::HumanUpdate::Request &req,
     res.message = message;
     res.success = true;
   }
+  if (res.success) {
+    changed_humans_[req.human_pose.human_id] =
+        move_humans::HumanGoalUpdate::SET;
+  }
   client_cond_.notify_one();
   return true;
 }
@@ -412,6 +491,10 @@ bool MoveHumansClient::updateGoal(move_humans::HumanUpdate::Request &req,
     res.message = message;
     res.success = true;
   }
+  if (res.success) {
+    changed_humans_[req.human_pose.human_id] =
+        move_humans::HumanGoalUpdate::SET;
+  }
   client_cond_.notify_one();
   return true;
 }
@@ -446,6 +529,10 @@ bool MoveHumansClient::teleportHuman(move_humans::HumanUpdate::Request &req,
     res.message = message;
     res.success = true;
   }
+  if (res.success) {
+    changed_humans_[req.human_pose.human_id] =
+        move_humans::HumanGoalUpdate::SET;
+  }
   client_cond_.notify_one();
   return true;
 }
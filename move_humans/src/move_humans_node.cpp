@@ -9,6 +9,17 @@ int main(int argc, char **argv) {
 
   tf::TransformListener tf(ros::Duration(10));
 
+  // in fast-forward mode all scenarios are run without the client and the
+  // node exits when they are done
+  bool fast_forward;
+  ros::NodeHandle("~").param("fast_forward", fast_forward, false);
+  if (fast_forward) {
+    ros::AsyncSpinner spinner(1);
+    spinner.start();
+    move_humans::MoveHumans move_humans(tf, true);
+    return move_humans.runFastForward() ? 0 : 1;
+  }
+
   // starting the move_humans server
   move_humans::MoveHumans move_humans(tf);
 
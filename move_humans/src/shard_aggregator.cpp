@@ -0,0 +1,111 @@
+#define NODE_NAME "shard_aggregator"
+#define HUMANS_PUB_TOPIC "humans"
+#define DEFAULT_RATE 20.0 // Hz
+#define DEFAULT_HOLD_TIME 0.5 // s
+
+#include <tf/transform_datatypes.h>
+
+#include "move_humans/shard_aggregator.h"
+
+namespace move_humans {
+ShardAggregator::ShardAggregator() {
+  ros::NodeHandle private_nh("~");
+
+  // humans topics of the shards, in the order of their shard index
+  std::vector<std::string> shard_topics;
+  double rate;
+  private_nh.param("shards", shard_topics, std::vector<std::string>());
+  private_nh.param("rate", rate, DEFAULT_RATE);
+  private_nh.param("hold_time", hold_time_, DEFAULT_HOLD_TIME);
+  if (shard_topics.empty()) {
+    ROS_ERROR_NAMED(NODE_NAME, "No shards to aggregate, set the humans topics "
+                               "of the shards in the shards parameter");
+  }
+  if (rate <= 0.0) {
+    ROS_WARN_NAMED(NODE_NAME, "Invalid rate %.2f Hz, using %.2f Hz", rate,
+                   DEFAULT_RATE);
+    rate = DEFAULT_RATE;
+  }
+
+  humans_pub_ =
+      private_nh.advertise<hanp_msgs::TrackedHumans>(HUMANS_PUB_TOPIC, 1);
+
+  ros::NodeHandle nh;
+  for (size_t shard = 0; shard < shard_topics.size(); shard++) {
+    shard_subs_.push_back(nh.subscribe<hanp_msgs::TrackedHumans>(
+        shard_topics[shard], 1,
+        boost::bind(&ShardAggregator::shardHumansCB, this, _1, shard)));
+  }
+  publish_timer_ = nh.createTimer(ros::Duration(1.0 / rate),
+                                  &ShardAggregator::publishHumans, this);
+
+  ROS_INFO_NAMED(NODE_NAME, "Aggregating humans of %lu shards at %.2f Hz",
+                 shard_topics.size(), rate);
+}
+
+void ShardAggregator::shardHumansCB(
+    const hanp_msgs::TrackedHumansConstPtr &humans, size_t shard) {
+  boost::mutex::scoped_lock lock(tracks_mutex_);
+  if (frame_id_.empty()) {
+    frame_id_ = humans->header.frame_id;
+  } else if (humans->header.frame_id != frame_id_) {
+    ROS_WARN_THROTTLE_NAMED(5.0, NODE_NAME,
+                            "Ignoring humans of shard %lu in frame %s, shards "
+                            "must publish humans in frame %s",
+                            shard, humans->header.frame_id.c_str(),
+                            frame_id_.c_str());
+    return;
+  }
+
+  // while a human is handed over both shards may publish it, the newer
+  // state is kept
+  auto &stamp = humans->header.stamp;
+  for (auto &human : humans->humans) {
+    auto &track = tracks_[human.track_id];
+    if (track.stamp <= stamp) {
+      track.human = human;
+      track.stamp = stamp;
+      track.shard = shard;
+    }
+  }
+}
+
+void ShardAggregator::publishHumans(const ros::TimerEvent &event) {
+  auto now = ros::Time::now();
+  boost::mutex::scoped_lock lock(tracks_mutex_);
+  humans_msg_.header.stamp = now;
+  humans_msg_.header.frame_id = frame_id_;
+  humans_msg_.humans.clear();
+  auto track_it = tracks_.begin();
+  while (track_it != tracks_.end()) {
+    auto &track = track_it->second;
+    double age = (now - track.stamp).toSec();
+    if (age > hold_time_) {
+      track_it = tracks_.erase(track_it);
+      continue;
+    }
+
+    // humans are moved to the common stamp with the velocities they had
+    humans_msg_.humans.push_back(track.human);
+    if (age > 0.0) {
+      for (auto &segment : humans_msg_.humans.back().segments) {
+        auto &pose = segment.pose.pose;
+        auto &twist = segment.twist.twist;
+        pose.position.x += twist.linear.x * age;
+        pose.position.y += twist.linear.y * age;
+        if (twist.angular.z != 0.0) {
+          pose.orientation = tf::createQuaternionMsgFromYaw(
+              tf::getYaw(pose.orientation) + twist.angular.z * age);
+        }
+      }
+    }
+    ++track_it;
+  }
+  lock.unlock();
+
+  if (humans_msg_.header.frame_id.empty()) {
+    return;
+  }
+  humans_pub_.publish(humans_msg_);
+}
+}; // namespace move_humans
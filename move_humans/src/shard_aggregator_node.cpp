@@ -0,0 +1,15 @@
+#include "move_humans/shard_aggregator.h"
+
+// the main method starts a rosnode and initializes the ShardAggregator class
+int main(int argc, char **argv) {
+
+  // starting the shard_aggregator node
+  ros::init(argc, argv, "shard_aggregator");
+
+  move_humans::ShardAggregator shard_aggregator;
+
+  // start spinning
+  ros::spin();
+
+  return 0;
+}
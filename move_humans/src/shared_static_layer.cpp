@@ -0,0 +1,332 @@
+#define NODE_NAME "shared_static_layer"
+#define MAP_TOPIC "map"
+#define INFLATION_RADIUS 0.55 // m
+#define COST_SCALING_FACTOR 10.0
+#define LETHAL_COST_THRESHOLD 100
+#define UNKNOWN_COST_VALUE -1
+#define DISTANCE_INF 1e20f
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <pluginlib/class_list_macros.h>
+#include <costmap_2d/cost_values.h>
+
+#include "move_humans/shared_static_layer.h"
+
+PLUGINLIB_EXPORT_CLASS(move_humans::SharedStaticLayer, costmap_2d::Layer)
+
+namespace move_humans {
+// squared distances d of the n values f, by the lower envelope of parabolas
+// of Felzenszwalb and Huttenlocher, v and z hold n and n + 1 values
+static void squaredDistances(const float *f, int n, float *d, int *v,
+                             float *z) {
+  int k = 0;
+  v[0] = 0;
+  z[0] = -DISTANCE_INF;
+  z[1] = DISTANCE_INF;
+  for (int q = 1; q < n; q++) {
+    float s;
+    while (true) {
+      s = ((f[q] + (float)q * q) - (f[v[k]] + (float)v[k] * v[k])) /
+          (2.0f * (q - v[k]));
+      // z[0] is below any intersection, so that k never gets negative
+      if (s > z[k]) {
+        break;
+      }
+      k--;
+    }
+    k++;
+    v[k] = q;
+    z[k] = s;
+    z[k + 1] = DISTANCE_INF;
+  }
+  k = 0;
+  for (int q = 0; q < n; q++) {
+    while (z[k + 1] < q) {
+      k++;
+    }
+    d[q] = (float)(q - v[k]) * (q - v[k]) + f[v[k]];
+  }
+}
+
+SharedStaticLayer::SharedStaticLayer()
+    : track_unknown_space_(false), trinary_costmap_(true),
+      use_maximum_(false), inflate_unknown_(false),
+      lethal_threshold_(LETHAL_COST_THRESHOLD),
+      unknown_cost_value_((unsigned char)UNKNOWN_COST_VALUE),
+      inflation_radius_(INFLATION_RADIUS),
+      cost_scaling_factor_(COST_SCALING_FACTOR), width_(0), height_(0),
+      resolution_(0.0), origin_x_(0.0), origin_y_(0.0),
+      inscribed_radius_(0.0), has_updated_data_(false) {}
+
+void SharedStaticLayer::onInitialize() {
+  ros::NodeHandle nh("~/" + name_);
+  current_ = false;
+  nh.param("enabled", enabled_, true);
+  nh.param("map_topic", map_topic_, std::string(MAP_TOPIC));
+  nh.param("cache_dir", cache_dir_, std::string(""));
+  nh.param("track_unknown_space", track_unknown_space_,
+           layered_costmap_->isTrackingUnknown());
+  nh.param("trinary_costmap", trinary_costmap_, true);
+  nh.param("use_maximum", use_maximum_, false);
+  nh.param("inflate_unknown", inflate_unknown_, false);
+  int lethal_threshold, unknown_cost_value;
+  nh.param("lethal_cost_threshold", lethal_threshold, LETHAL_COST_THRESHOLD);
+  nh.param("unknown_cost_value", unknown_cost_value, UNKNOWN_COST_VALUE);
+  lethal_threshold_ = std::max(std::min(lethal_threshold, 100), 0);
+  unknown_cost_value_ = (unsigned char)unknown_cost_value;
+  nh.param("inflation_radius", inflation_radius_, INFLATION_RADIUS);
+  nh.param("cost_scaling_factor", cost_scaling_factor_, COST_SCALING_FACTOR);
+
+  if (layered_costmap_->isRolling()) {
+    ROS_ERROR_NAMED(NODE_NAME, "%s does not support rolling costmaps, the "
+                               "layer is disabled",
+                    name_.c_str());
+    enabled_ = false;
+    return;
+  }
+  // unlike costmap_2d::StaticLayer, the costmap does not wait for the map
+  activate();
+}
+
+void SharedStaticLayer::activate() {
+  map_sub_ = ros::NodeHandle().subscribe(map_topic_, 1,
+                                         &SharedStaticLayer::mapCB, this);
+}
+
+void SharedStaticLayer::deactivate() { map_sub_.shutdown(); }
+
+void SharedStaticLayer::reset() {
+  // the costs are written again to the cleared master grid
+  boost::mutex::scoped_lock lock(mutex_);
+  has_updated_data_ = costs_ != NULL;
+}
+
+void SharedStaticLayer::mapCB(const nav_msgs::OccupancyGridConstPtr &map) {
+  auto &info = map->info;
+  if (map->data.size() != (size_t)info.width * info.height) {
+    ROS_ERROR_NAMED(NODE_NAME, "Ignoring map with %lu cells for %ux%u cells",
+                    map->data.size(), info.width, info.height);
+    return;
+  }
+  if (map->header.frame_id != layered_costmap_->getGlobalFrameID()) {
+    ROS_WARN_NAMED(NODE_NAME, "Map in frame %s is used as map of the "
+                              "costmap in frame %s",
+                   map->header.frame_id.c_str(),
+                   layered_costmap_->getGlobalFrameID().c_str());
+  }
+
+  // the costmap takes the geometry of the map, as with the static layer of
+  // costmap_2d
+  auto master = layered_costmap_->getCostmap();
+  if (master->getSizeInCellsX() != info.width ||
+      master->getSizeInCellsY() != info.height ||
+      master->getResolution() != info.resolution ||
+      master->getOriginX() != info.origin.position.x ||
+      master->getOriginY() != info.origin.position.y) {
+    ROS_INFO_NAMED(NODE_NAME, "Resizing costmap to %ux%u cells at %.3f m/cell",
+                   info.width, info.height, info.resolution);
+    layered_costmap_->resizeMap(info.width, info.height, info.resolution,
+                                info.origin.position.x,
+                                info.origin.position.y, true);
+  }
+
+  boost::mutex::scoped_lock lock(mutex_);
+  map_ = map;
+  costs_.reset();
+  current_ = false;
+}
+
+void SharedStaticLayer::updateBounds(double robot_x, double robot_y,
+                                     double robot_yaw, double *min_x,
+                                     double *min_y, double *max_x,
+                                     double *max_y) {
+  if (!enabled_) {
+    return;
+  }
+  boost::unique_lock<boost::mutex> lock(mutex_);
+  double inscribed_radius = layered_costmap_->getInscribedRadius();
+  if (costs_ && inscribed_radius != inscribed_radius_) {
+    costs_.reset();
+    current_ = false;
+    if (!map_) {
+      // the latched map is received again
+      lock.unlock();
+      deactivate();
+      activate();
+      return;
+    }
+  }
+  if (!costs_ && (!map_ || !loadCosts(inscribed_radius))) {
+    return;
+  }
+  if (!has_updated_data_) {
+    return;
+  }
+  *min_x = std::min(*min_x, origin_x_);
+  *min_y = std::min(*min_y, origin_y_);
+  *max_x = std::max(*max_x, origin_x_ + width_ * resolution_);
+  *max_y = std::max(*max_y, origin_y_ + height_ * resolution_);
+  has_updated_data_ = false;
+}
+
+void SharedStaticLayer::updateCosts(costmap_2d::Costmap2D &master_grid,
+                                    int min_i, int min_j, int max_i,
+                                    int max_j) {
+  if (!enabled_) {
+    return;
+  }
+  boost::mutex::scoped_lock lock(mutex_);
+  // the master grid has the size of the map, unless it was resized since
+  if (!costs_ || master_grid.getSizeInCellsX() != width_ ||
+      master_grid.getSizeInCellsY() != height_) {
+    return;
+  }
+  min_i = std::max(min_i, 0);
+  min_j = std::max(min_j, 0);
+  max_i = std::min(max_i, (int)width_);
+  max_j = std::min(max_j, (int)height_);
+  if (min_i >= max_i) {
+    return;
+  }
+  auto master = master_grid.getCharMap();
+  auto costs = costs_->data();
+  for (int j = min_j; j < max_j; j++) {
+    size_t row = (size_t)j * width_;
+    if (!use_maximum_) {
+      std::memcpy(master + row + min_i, costs + row + min_i, max_i - min_i);
+      continue;
+    }
+    for (int i = min_i; i < max_i; i++) {
+      auto cost = costs[row + i];
+      auto &old_cost = master[row + i];
+      if (cost != costmap_2d::NO_INFORMATION &&
+          (old_cost == costmap_2d::NO_INFORMATION || cost > old_cost)) {
+        old_cost = cost;
+      }
+    }
+  }
+}
+
+bool SharedStaticLayer::loadCosts(double inscribed_radius) {
+  auto &map = *map_;
+  auto &info = map.info;
+  auto map_hash = CacheFile::hash(map.data.data(), map.data.size());
+  map_hash = CacheFile::hashValue(info.width, map_hash);
+  map_hash = CacheFile::hashValue(info.height, map_hash);
+  map_hash = CacheFile::hashValue(info.resolution, map_hash);
+  map_hash = CacheFile::hashValue(info.origin.position.x, map_hash);
+  map_hash = CacheFile::hashValue(info.origin.position.y, map_hash);
+  auto params_hash =
+      CacheFile::hash(&inscribed_radius, sizeof(inscribed_radius));
+  params_hash = CacheFile::hashValue(inflation_radius_, params_hash);
+  params_hash = CacheFile::hashValue(cost_scaling_factor_, params_hash);
+  params_hash = CacheFile::hashValue(lethal_threshold_, params_hash);
+  params_hash = CacheFile::hashValue(unknown_cost_value_, params_hash);
+  params_hash = CacheFile::hashValue(track_unknown_space_, params_hash);
+  params_hash = CacheFile::hashValue(trinary_costmap_, params_hash);
+  params_hash = CacheFile::hashValue(inflate_unknown_, params_hash);
+
+  costs_ = StaticCostmapCache::get(
+      cache_dir_, map_hash, params_hash, info.width, info.height,
+      boost::bind(&SharedStaticLayer::computeCosts, this, boost::cref(map),
+                  inscribed_radius, _1));
+  if (!costs_) {
+    return false;
+  }
+  width_ = info.width;
+  height_ = info.height;
+  resolution_ = info.resolution;
+  origin_x_ = info.origin.position.x;
+  origin_y_ = info.origin.position.y;
+  inscribed_radius_ = inscribed_radius;
+  map_.reset();
+  has_updated_data_ = true;
+  current_ = true;
+  ROS_INFO_NAMED(NODE_NAME, "%s uses the shared costs of a %ux%u map",
+                 name_.c_str(), width_, height_);
+  return true;
+}
+
+unsigned char SharedStaticLayer::interpretValue(unsigned char value) const {
+  if (value == unknown_cost_value_) {
+    return track_unknown_space_ ? costmap_2d::NO_INFORMATION
+                                : costmap_2d::FREE_SPACE;
+  }
+  if (value >= lethal_threshold_) {
+    return costmap_2d::LETHAL_OBSTACLE;
+  }
+  if (trinary_costmap_) {
+    return costmap_2d::FREE_SPACE;
+  }
+  return (unsigned char)((double)value / lethal_threshold_ *
+                         costmap_2d::LETHAL_OBSTACLE);
+}
+
+void SharedStaticLayer::computeCosts(const nav_msgs::OccupancyGrid &map,
+                                     double inscribed_radius,
+                                     std::vector<unsigned char> &costs) const {
+  int width = map.info.width, height = map.info.height;
+  double resolution = map.info.resolution;
+  size_t size = (size_t)width * height;
+  costs.resize(size);
+  for (size_t i = 0; i < size; i++) {
+    costs[i] = interpretValue((unsigned char)map.data[i]);
+  }
+
+  // squared cell distances of all cells to their nearest lethal cell, by
+  // columns and then by rows
+  std::vector<float> distances(size);
+  for (size_t i = 0; i < size; i++) {
+    distances[i] =
+        costs[i] == costmap_2d::LETHAL_OBSTACLE ? 0.0f : DISTANCE_INF;
+  }
+  int n = std::max(width, height);
+  std::vector<float> f(n), d(n), z(n + 1);
+  std::vector<int> v(n);
+  for (int x = 0; x < width; x++) {
+    for (int y = 0; y < height; y++) {
+      f[y] = distances[(size_t)y * width + x];
+    }
+    squaredDistances(f.data(), height, d.data(), v.data(), z.data());
+    for (int y = 0; y < height; y++) {
+      distances[(size_t)y * width + x] = d[y];
+    }
+  }
+  for (int y = 0; y < height; y++) {
+    auto row = &distances[(size_t)y * width];
+    std::copy(row, row + width, f.begin());
+    squaredDistances(f.data(), width, row, v.data(), z.data());
+  }
+
+  // inflation costs as in costmap_2d::InflationLayer, cells are inflated up
+  // to the inflation radius rounded up to cells
+  double cell_radius = std::ceil(inflation_radius_ / resolution);
+  float max_sq_distance = cell_radius * cell_radius;
+  for (size_t i = 0; i < size; i++) {
+    if (costs[i] == costmap_2d::LETHAL_OBSTACLE ||
+        distances[i] > max_sq_distance) {
+      continue;
+    }
+    double distance = std::sqrt(distances[i]) * resolution;
+    unsigned char cost;
+    if (distance <= inscribed_radius) {
+      cost = costmap_2d::INSCRIBED_INFLATED_OBSTACLE;
+    } else {
+      double factor =
+          std::exp(-cost_scaling_factor_ * (distance - inscribed_radius));
+      cost = (unsigned char)((costmap_2d::INSCRIBED_INFLATED_OBSTACLE - 1) *
+                             factor);
+    }
+    if (costs[i] == costmap_2d::NO_INFORMATION) {
+      if (inflate_unknown_ ? cost > costmap_2d::FREE_SPACE
+                           : cost >= costmap_2d::INSCRIBED_INFLATED_OBSTACLE) {
+        costs[i] = cost;
+      }
+    } else {
+      costs[i] = std::max(costs[i], cost);
+    }
+  }
+}
+}; // namespace move_humans
@@ -0,0 +1,135 @@
+#define NODE_NAME "static_costmap_cache"
+#define STATIC_COSTMAP_CACHE_MAGIC 0x4353484d // "MHSC" little-endian
+#define STATIC_COSTMAP_CACHE_VERSION 1
+#define STATIC_COSTMAP_CACHE_SUFFIX ".costs"
+
+#include <cerrno>
+#include <cstring>
+#include <ros/ros.h>
+
+#include "move_humans/static_costmap_cache.h"
+
+namespace move_humans {
+// file layout: header, then the costs row by row
+struct StaticCostmapCache::FileHeader {
+  CacheFile::Header file;
+  uint32_t width, height;
+};
+
+StaticCostmapCache::CostsConstPtr StaticCostmapCache::get(
+    const std::string &directory, uint64_t map_hash, uint64_t params_hash,
+    unsigned int width, unsigned int height, const ComputeCosts &compute) {
+  // costmaps asking for the same costs at once wait for the first one to
+  // compute them
+  costs_key key(map_hash, params_hash);
+  boost::mutex::scoped_lock lock(registryMutex());
+  auto &registered = registry()[key];
+  auto costs = registered.lock();
+  if (costs && costs->width == width && costs->height == height) {
+    return costs;
+  }
+
+  std::string path;
+  boost::shared_ptr<Costs> new_costs;
+  if (!directory.empty()) {
+    path = directory + "/" +
+           CacheFile::name(map_hash, params_hash, STATIC_COSTMAP_CACHE_SUFFIX);
+    new_costs = mapFile(path, key, width, height);
+  }
+  if (!new_costs) {
+    std::vector<unsigned char> computed;
+    auto start = ros::WallTime::now();
+    compute(computed);
+    if (computed.size() != (size_t)width * height) {
+      ROS_ERROR_NAMED(NODE_NAME, "Computed %lu costs for a %ux%u map",
+                      computed.size(), width, height);
+      return CostsConstPtr();
+    }
+    ROS_INFO_NAMED(NODE_NAME, "Computed costs of a %ux%u map in %.3f s",
+                   width, height, (ros::WallTime::now() - start).toSec());
+
+    // the file is mapped again, so that its pages are shared
+    if (!path.empty() && !CacheFile::makeDirectory(directory)) {
+      ROS_ERROR_NAMED(NODE_NAME, "Can not create costmap cache directory %s: "
+                                 "%s",
+                      directory.c_str(), strerror(errno));
+    } else if (!path.empty() &&
+               writeFile(path, key, width, height, computed)) {
+      new_costs = mapFile(path, key, width, height);
+    }
+    if (!new_costs) {
+      new_costs.reset(new Costs());
+      new_costs->width = width;
+      new_costs->height = height;
+      new_costs->owned_.swap(computed);
+      new_costs->data_ = new_costs->owned_.data();
+    }
+  }
+  registered = new_costs;
+  return new_costs;
+}
+
+boost::mutex &StaticCostmapCache::registryMutex() {
+  static boost::mutex mutex;
+  return mutex;
+}
+
+std::map<StaticCostmapCache::costs_key,
+         boost::weak_ptr<const StaticCostmapCache::Costs>> &
+StaticCostmapCache::registry() {
+  static std::map<costs_key, boost::weak_ptr<const Costs>> registry;
+  return registry;
+}
+
+boost::shared_ptr<StaticCostmapCache::Costs>
+StaticCostmapCache::mapFile(const std::string &path, const costs_key &key,
+                            unsigned int width, unsigned int height) {
+  auto mapping = CacheFile::map(path);
+  if (!mapping) {
+    if (errno != ENOENT) {
+      ROS_WARN_NAMED(NODE_NAME, "Can not map costmap cache file %s: %s",
+                     path.c_str(), strerror(errno));
+    }
+    return boost::shared_ptr<Costs>();
+  }
+  if (mapping->size() != sizeof(FileHeader) + (size_t)width * height) {
+    ROS_WARN_NAMED(NODE_NAME, "Ignoring costmap cache file %s of another size",
+                   path.c_str());
+    return boost::shared_ptr<Costs>();
+  }
+
+  // files that do not match their name are ignored
+  auto &header = *(const FileHeader *)mapping->data();
+  if (!mapping->matches(STATIC_COSTMAP_CACHE_MAGIC,
+                        STATIC_COSTMAP_CACHE_VERSION, key.first, key.second) ||
+      header.width != width || header.height != height) {
+    ROS_WARN_NAMED(NODE_NAME, "Ignoring invalid costmap cache file %s",
+                   path.c_str());
+    return boost::shared_ptr<Costs>();
+  }
+  boost::shared_ptr<Costs> costs(new Costs());
+  costs->width = width;
+  costs->height = height;
+  costs->data_ = (const unsigned char *)mapping->data() + sizeof(FileHeader);
+  costs->mapping_ = mapping;
+  return costs;
+}
+
+bool StaticCostmapCache::writeFile(const std::string &path,
+                                   const costs_key &key, unsigned int width,
+                                   unsigned int height,
+                                   const std::vector<unsigned char> &costs) {
+  FileHeader header = {{STATIC_COSTMAP_CACHE_MAGIC,
+                        STATIC_COSTMAP_CACHE_VERSION, key.first, key.second},
+                       width,
+                       height};
+  CacheFile::Parts parts = {{&header, sizeof(header)},
+                            {costs.data(), costs.size()}};
+  if (!CacheFile::write(path, parts)) {
+    ROS_ERROR_NAMED(NODE_NAME, "Can not write costmap cache file %s: %s",
+                    path.c_str(), strerror(errno));
+    return false;
+  }
+  return true;
+}
+}; // namespace move_humans
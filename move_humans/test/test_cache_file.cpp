@@ -0,0 +1,101 @@
+#define MAGIC 0x54534554 // "TEST" little-endian
+#define VERSION 3
+
+#include <gtest/gtest.h>
+#include <move_humans/cache_file.h>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+using move_humans::CacheFile;
+
+class CacheFileTest : public testing::Test {
+protected:
+  void SetUp() override {
+    char directory_template[] = "/tmp/test_cache_file_XXXXXX";
+    ASSERT_TRUE(mkdtemp(directory_template));
+    directory = directory_template;
+    path = directory + "/" + CacheFile::name(1, 2, ".test");
+  }
+
+  void TearDown() override {
+    unlink(path.c_str());
+    rmdir((directory + "/sub").c_str());
+    rmdir(directory.c_str());
+  }
+
+  std::string directory, path;
+};
+
+TEST(CacheFile, Hash) {
+  // FNV-1a test vectors
+  EXPECT_EQ(CacheFile::hash("", 0), 0xcbf29ce484222325ULL);
+  EXPECT_EQ(CacheFile::hash("a", 1), 0xaf63dc4c8601ec8cULL);
+  EXPECT_EQ(CacheFile::hash("foobar", 6), 0x85944171f73967e8ULL);
+  // chained hashes are the hashes of the concatenation
+  EXPECT_EQ(CacheFile::hash("bar", 3, CacheFile::hash("foo", 3)),
+            CacheFile::hash("foobar", 6));
+  char value = 'a';
+  EXPECT_EQ(CacheFile::hashValue(value, 0xcbf29ce484222325ULL),
+            CacheFile::hash("a", 1));
+}
+
+TEST(CacheFile, Name) {
+  EXPECT_EQ(CacheFile::name(0x1234, 0xffffffffffffffffULL, ".plans"),
+            "0000000000001234_ffffffffffffffff.plans");
+}
+
+TEST_F(CacheFileTest, WriteAndMap) {
+  CacheFile::Header header = {MAGIC, VERSION, 1, 2};
+  std::string contents = "contents";
+  CacheFile::Parts parts = {{&header, sizeof(header)},
+                            {NULL, 0},
+                            {contents.data(), contents.size()}};
+  ASSERT_TRUE(CacheFile::write(path, parts));
+
+  auto mapping = CacheFile::map(path);
+  ASSERT_TRUE(mapping != NULL);
+  ASSERT_EQ(mapping->size(), sizeof(header) + contents.size());
+  EXPECT_TRUE(mapping->matches(MAGIC, VERSION));
+  EXPECT_TRUE(mapping->matches(MAGIC, VERSION, 1, 2));
+  EXPECT_FALSE(mapping->matches(MAGIC, VERSION + 1));
+  EXPECT_FALSE(mapping->matches(MAGIC + 1, VERSION));
+  EXPECT_FALSE(mapping->matches(MAGIC, VERSION, 2, 1));
+  EXPECT_EQ(std::string(mapping->data() + sizeof(header), contents.size()),
+            contents);
+
+  // mappings of the old file stay valid when it is written again
+  header.map_hash = 5;
+  ASSERT_TRUE(CacheFile::write(path, parts));
+  EXPECT_TRUE(mapping->matches(MAGIC, VERSION, 1, 2));
+  EXPECT_TRUE(CacheFile::map(path)->matches(MAGIC, VERSION, 5, 2));
+}
+
+TEST_F(CacheFileTest, MissingAndShortFiles) {
+  EXPECT_TRUE(CacheFile::map(path) == NULL);
+  EXPECT_EQ(errno, ENOENT);
+
+  CacheFile::Header header = {MAGIC, VERSION, 1, 2};
+  ASSERT_TRUE(CacheFile::write(path, {{&header, sizeof(header) - 1}}));
+  EXPECT_TRUE(CacheFile::map(path) == NULL);
+  EXPECT_EQ(errno, EINVAL);
+}
+
+TEST_F(CacheFileTest, WriteFailure) {
+  CacheFile::Header header = {MAGIC, VERSION, 1, 2};
+  EXPECT_FALSE(CacheFile::write(directory + "/missing/file",
+                                {{&header, sizeof(header)}}));
+  EXPECT_EQ(errno, ENOENT);
+}
+
+TEST_F(CacheFileTest, MakeDirectory) {
+  EXPECT_TRUE(CacheFile::makeDirectory(directory));
+  EXPECT_TRUE(CacheFile::makeDirectory(directory + "/sub"));
+  EXPECT_FALSE(CacheFile::makeDirectory(directory + "/missing/sub"));
+}
+}; // namespace
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
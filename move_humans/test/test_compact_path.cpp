@@ -0,0 +1,101 @@
+#include <gtest/gtest.h>
+#include <move_humans/compact_path.h>
+
+namespace {
+using move_humans::CompactPath;
+
+CompactPath path(const std::vector<std::pair<double, double>> &points) {
+  CompactPath compact_path;
+  for (auto &point : points) {
+    compact_path.push_back(point.first, point.second);
+  }
+  return compact_path;
+}
+
+void expectPoints(const std::vector<std::pair<double, double>> &expected,
+                  const CompactPath &compact_path) {
+  ASSERT_EQ(expected.size(), compact_path.size());
+  for (size_t i = 0; i < expected.size(); i++) {
+    EXPECT_FLOAT_EQ(expected[i].first, compact_path.x(i));
+    EXPECT_FLOAT_EQ(expected[i].second, compact_path.y(i));
+  }
+}
+
+TEST(CompactPath, SimplifyEmptyInput) {
+  CompactPath empty;
+  EXPECT_EQ(empty.simplify(0.1), 0u);
+  EXPECT_TRUE(empty.empty());
+
+  // first and last points are always kept
+  auto two = path({{0.0, 0.0}, {1.0, 0.0}});
+  EXPECT_EQ(two.simplify(10.0), 0u);
+  EXPECT_EQ(two.size(), 2u);
+}
+
+TEST(CompactPath, SimplifyStraightLine) {
+  auto straight = path({{0.0, 0.0}, {1.0, 0.0}, {2.0, 0.01}, {3.0, 0.0}});
+  EXPECT_EQ(straight.simplify(0.05), 2u);
+  expectPoints({{0.0, 0.0}, {3.0, 0.0}}, straight);
+}
+
+TEST(CompactPath, SimplifyKeepsCorners) {
+  auto corner = path({{0.0, 0.0}, {1.0, 0.0}, {2.0, 0.0}, {2.0, 1.0},
+                      {2.0, 2.0}});
+  EXPECT_EQ(corner.simplify(0.05), 2u);
+  expectPoints({{0.0, 0.0}, {2.0, 0.0}, {2.0, 2.0}}, corner);
+}
+
+TEST(CompactPath, SimplifyZeroTolerance) {
+  auto straight = path({{0.0, 0.0}, {1.0, 0.0}, {2.0, 0.0}});
+  EXPECT_EQ(straight.simplify(0.0), 0u);
+  EXPECT_EQ(straight.size(), 3u);
+}
+
+TEST(CompactPath, SimplifyChecksSegments) {
+  auto straight = path({{0.0, 0.0}, {1.0, 0.0}, {2.0, 0.0}, {3.0, 0.0},
+                        {4.0, 0.0}});
+  // segments longer than two points apart are blocked
+  auto short_segments = [](const CompactPath &, size_t first, size_t last) {
+    return last - first <= 2;
+  };
+  EXPECT_EQ(straight.simplify(0.05, short_segments), 2u);
+  expectPoints({{0.0, 0.0}, {2.0, 0.0}, {4.0, 0.0}}, straight);
+
+  auto blocked = [](const CompactPath &, size_t, size_t) { return false; };
+  auto other = path({{0.0, 0.0}, {1.0, 0.0}, {2.0, 0.0}});
+  EXPECT_EQ(other.simplify(0.05, blocked), 0u);
+  EXPECT_EQ(other.size(), 3u);
+}
+
+TEST(CompactPath, Poses) {
+  CompactPath compact_path;
+  compact_path.frame_id = "map";
+  compact_path.stamp = ros::Time(5.0);
+  compact_path.push_back(1.0, 2.0, 0.5);
+  compact_path.push_back(3.0, 4.0, -1.0);
+
+  move_humans::pose_vector poses;
+  compact_path.toPoses(poses);
+  ASSERT_EQ(poses.size(), 2u);
+  EXPECT_EQ(poses[1].header.frame_id, "map");
+  EXPECT_DOUBLE_EQ(poses[1].header.stamp.toSec(), 5.0);
+  EXPECT_DOUBLE_EQ(poses[1].pose.position.x, 3.0);
+  EXPECT_NEAR(tf::getYaw(poses[1].pose.orientation), -1.0, 1e-6);
+
+  CompactPath assigned;
+  assigned.assign(poses);
+  EXPECT_EQ(assigned.frame_id, "map");
+  expectPoints({{1.0, 2.0}, {3.0, 4.0}}, assigned);
+  EXPECT_NEAR(assigned.yaw(0), 0.5, 1e-6);
+
+  assigned.append(compact_path);
+  EXPECT_EQ(assigned.size(), 4u);
+  assigned.assign(move_humans::pose_vector());
+  EXPECT_TRUE(assigned.empty());
+}
+}; // namespace
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,208 @@
+#define MAP_SIZE 40
+#define RESOLUTION 0.5
+#define ORIGIN -5.0
+#define TILE_SIZE 8
+
+#include <gtest/gtest.h>
+#include <move_humans/costmap_changes.h>
+
+namespace {
+using move_humans::ChangedBox;
+using move_humans::ChangedBoxes;
+using move_humans::CostmapChangeTracker;
+
+nav_msgs::OccupancyGrid grid() {
+  nav_msgs::OccupancyGrid grid;
+  grid.info.width = MAP_SIZE;
+  grid.info.height = MAP_SIZE;
+  grid.info.resolution = RESOLUTION;
+  grid.info.origin.position.x = ORIGIN;
+  grid.info.origin.position.y = ORIGIN;
+  grid.data.assign(MAP_SIZE * MAP_SIZE, 0);
+  return grid;
+}
+
+map_msgs::OccupancyGridUpdate window(int x, int y, unsigned int width,
+                                     unsigned int height, int8_t value = 0) {
+  map_msgs::OccupancyGridUpdate update;
+  update.x = x;
+  update.y = y;
+  update.width = width;
+  update.height = height;
+  update.data.assign(width * height, value);
+  return update;
+}
+
+void expectBox(const ChangedBox &box, double min_x, double min_y,
+               double max_x, double max_y) {
+  EXPECT_DOUBLE_EQ(box.min_x, min_x);
+  EXPECT_DOUBLE_EQ(box.min_y, min_y);
+  EXPECT_DOUBLE_EQ(box.max_x, max_x);
+  EXPECT_DOUBLE_EQ(box.max_y, max_y);
+}
+
+geometry_msgs::PoseStamped pose(double x, double y) {
+  geometry_msgs::PoseStamped pose;
+  pose.pose.position.x = x;
+  pose.pose.position.y = y;
+  return pose;
+}
+
+TEST(CostmapChangeTracker, UpdatesBeforeFullGrid) {
+  CostmapChangeTracker tracker(TILE_SIZE);
+  ChangedBoxes changed(1);
+  EXPECT_FALSE(tracker.hasGrid());
+  EXPECT_FALSE(tracker.update(window(0, 0, 4, 4, 100), changed));
+  EXPECT_TRUE(changed.empty());
+
+  // the first full grid only replaces the copy
+  EXPECT_FALSE(tracker.update(grid(), changed));
+  EXPECT_TRUE(tracker.hasGrid());
+  EXPECT_TRUE(changed.empty());
+}
+
+TEST(CostmapChangeTracker, UnchangedGrid) {
+  CostmapChangeTracker tracker(TILE_SIZE);
+  ChangedBoxes changed;
+  tracker.update(grid(), changed);
+  EXPECT_FALSE(tracker.update(grid(), changed));
+  EXPECT_TRUE(changed.empty());
+}
+
+TEST(CostmapChangeTracker, UnchangedUpdateWindow) {
+  CostmapChangeTracker tracker(TILE_SIZE);
+  ChangedBoxes changed;
+  tracker.update(grid(), changed);
+  EXPECT_FALSE(tracker.update(window(0, 0, MAP_SIZE, MAP_SIZE), changed));
+  EXPECT_TRUE(changed.empty());
+
+  // a window with the values it already changed to
+  ASSERT_TRUE(tracker.update(window(4, 4, 2, 2, 100), changed));
+  EXPECT_FALSE(tracker.update(window(4, 4, 2, 2, 100), changed));
+  EXPECT_TRUE(changed.empty());
+}
+
+TEST(CostmapChangeTracker, ChangedCells) {
+  CostmapChangeTracker tracker(TILE_SIZE);
+  ChangedBoxes changed;
+  tracker.update(grid(), changed);
+
+  // one changed cell in a large window
+  auto update = window(0, 0, MAP_SIZE, MAP_SIZE);
+  update.data[3 * MAP_SIZE + 2] = 100;
+  ASSERT_TRUE(tracker.update(update, changed));
+  ASSERT_EQ(changed.size(), 1u);
+  expectBox(changed[0], ORIGIN + 2 * RESOLUTION, ORIGIN + 3 * RESOLUTION,
+            ORIGIN + 3 * RESOLUTION, ORIGIN + 4 * RESOLUTION);
+
+  // distant cells of one update are boxed per tile
+  update.data[(MAP_SIZE - 1) * MAP_SIZE + MAP_SIZE - 1] = 100;
+  update.data[(MAP_SIZE - 2) * MAP_SIZE + MAP_SIZE - 3] = 100;
+  ASSERT_TRUE(tracker.update(update, changed));
+  ASSERT_EQ(changed.size(), 1u);
+  expectBox(changed[0], ORIGIN + (MAP_SIZE - 3) * RESOLUTION,
+            ORIGIN + (MAP_SIZE - 2) * RESOLUTION,
+            ORIGIN + MAP_SIZE * RESOLUTION, ORIGIN + MAP_SIZE * RESOLUTION);
+  update.data[0] = 50;
+  ASSERT_TRUE(tracker.update(update, changed));
+  EXPECT_EQ(changed.size(), 1u);
+  update.data[0] = 0;
+  update.data[MAP_SIZE - 1] = 50;
+  ASSERT_TRUE(tracker.update(update, changed));
+  EXPECT_EQ(changed.size(), 2u);
+
+  // cells of windows are placed at the window offset
+  ASSERT_TRUE(tracker.update(window(10, 20, 1, 1, 100), changed));
+  ASSERT_EQ(changed.size(), 1u);
+  expectBox(changed[0], ORIGIN + 10 * RESOLUTION, ORIGIN + 20 * RESOLUTION,
+            ORIGIN + 11 * RESOLUTION, ORIGIN + 21 * RESOLUTION);
+
+  // full grids are compared with the updated copy
+  auto full = grid();
+  full.data[20 * MAP_SIZE + 10] = 100;
+  full.data[3 * MAP_SIZE + 2] = 100;
+  full.data[(MAP_SIZE - 1) * MAP_SIZE + MAP_SIZE - 1] = 100;
+  full.data[(MAP_SIZE - 2) * MAP_SIZE + MAP_SIZE - 3] = 100;
+  EXPECT_TRUE(tracker.update(full, changed));
+  ASSERT_EQ(changed.size(), 1u);
+  expectBox(changed[0], ORIGIN + (MAP_SIZE - 1) * RESOLUTION, ORIGIN,
+            ORIGIN + MAP_SIZE * RESOLUTION, ORIGIN + RESOLUTION);
+}
+
+TEST(CostmapChangeTracker, OutOfBoundsUpdates) {
+  CostmapChangeTracker tracker(TILE_SIZE);
+  ChangedBoxes changed;
+  tracker.update(grid(), changed);
+  EXPECT_FALSE(tracker.update(window(-1, 0, 2, 2, 100), changed));
+  EXPECT_FALSE(tracker.update(window(MAP_SIZE - 1, 0, 2, 2, 100), changed));
+  EXPECT_FALSE(tracker.update(window(0, MAP_SIZE, 1, 1, 100), changed));
+  auto short_data = window(0, 0, 2, 2, 100);
+  short_data.data.pop_back();
+  EXPECT_FALSE(tracker.update(short_data, changed));
+  EXPECT_TRUE(changed.empty());
+
+  // the copy was not touched by the rejected updates
+  EXPECT_FALSE(tracker.update(grid(), changed));
+}
+
+TEST(CostmapChangeTracker, GeometryChange) {
+  CostmapChangeTracker tracker(TILE_SIZE);
+  ChangedBoxes changed;
+  tracker.update(grid(), changed);
+
+  auto moved = grid();
+  moved.info.origin.position.x += 1.0;
+  moved.data[0] = 100;
+  EXPECT_FALSE(tracker.update(moved, changed));
+  EXPECT_TRUE(changed.empty());
+  EXPECT_FALSE(tracker.update(moved, changed));
+
+  // a grid without all of its cells is dropped
+  auto invalid = grid();
+  invalid.data.pop_back();
+  EXPECT_FALSE(tracker.update(invalid, changed));
+  EXPECT_FALSE(tracker.hasGrid());
+  EXPECT_FALSE(tracker.update(window(0, 0, 1, 1, 100), changed));
+}
+
+TEST(ChangedBox, Intersects) {
+  ChangedBox box = {0.0, 0.0, 1.0, 1.0};
+  EXPECT_TRUE(box.intersects(-1.0, 0.5, 2.0, 0.5));
+  EXPECT_TRUE(box.intersects(0.5, 0.5, 0.5, 0.5));
+  EXPECT_TRUE(box.intersects(-1.0, -1.0, 2.0, 2.0));
+  EXPECT_TRUE(box.intersects(1.0, -1.0, 1.0, 2.0));
+  EXPECT_FALSE(box.intersects(-1.0, 1.5, 2.0, 1.5));
+  EXPECT_FALSE(box.intersects(-2.0, 0.5, -1.0, 0.5));
+  EXPECT_FALSE(box.intersects(-1.0, 0.5, 0.5, 3.0));
+
+  auto inflated = box.inflated(0.5);
+  expectBox(inflated, -0.5, -0.5, 1.5, 1.5);
+  EXPECT_TRUE(inflated.contains(1.5, -0.5));
+  EXPECT_FALSE(box.contains(1.5, -0.5));
+  box.merge({2.0, -1.0, 3.0, 0.5});
+  expectBox(box, 0.0, -1.0, 3.0, 1.0);
+}
+
+TEST(ChangedBox, PlansCross) {
+  move_humans::pose_vectors plans(2);
+  plans[0] = {pose(0.0, 0.0), pose(2.0, 0.0)};
+  plans[1] = {pose(2.0, 0.0), pose(2.0, 4.0)};
+  ChangedBoxes boxes = {{1.5, 1.0, 2.5, 2.0}};
+  ChangedBox bounds = boxes[0];
+  EXPECT_TRUE(plansCross(plans, 0, boxes, bounds));
+  EXPECT_TRUE(plansCross(plans, 1, boxes, bounds));
+  EXPECT_FALSE(plansCross(plans, 2, boxes, bounds));
+  EXPECT_FALSE(plansCross(plans, 0, ChangedBoxes(), bounds));
+
+  boxes = {{0.5, 1.0, 1.0, 2.0}};
+  EXPECT_FALSE(plansCross(plans, 0, boxes, boxes[0]));
+  boxes = {{0.5, -0.5, 1.0, 0.5}};
+  EXPECT_TRUE(plansCross(plans, 0, boxes, boxes[0]));
+  EXPECT_FALSE(plansCross(plans, 1, boxes, boxes[0]));
+}
+}; // namespace
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,146 @@
+#include <gtest/gtest.h>
+#include <tf/transform_datatypes.h>
+#include <move_humans/human_state_encoder.h>
+
+namespace {
+using move_humans::HumanStateEncoder;
+using move_humans::HumanStateStream;
+
+int32_t get32(const std::vector<uint8_t> &data, size_t offset) {
+  return (int32_t)((uint32_t)data[offset] | (uint32_t)data[offset + 1] << 8 |
+                   (uint32_t)data[offset + 2] << 16 |
+                   (uint32_t)data[offset + 3] << 24);
+}
+
+int16_t get16(const std::vector<uint8_t> &data, size_t offset) {
+  return (int16_t)((uint16_t)data[offset] | (uint16_t)data[offset + 1] << 8);
+}
+
+void setHuman(move_humans::map_traj_point &human_pts, uint64_t id, double x,
+              double y, double yaw) {
+  auto &point = human_pts[id];
+  point.transform.translation.x = x;
+  point.transform.translation.y = y;
+  point.transform.rotation = tf::createQuaternionMsgFromYaw(yaw);
+}
+
+class HumanStateEncoderTest : public testing::Test {
+protected:
+  HumanStateEncoderTest() : now(100.0) {
+    encoder.setParams(0.01, 0.01, 0.02, 0.02, 1.0);
+  }
+
+  bool encode() {
+    now += ros::Duration(0.1);
+    return encoder.encode(human_pts, now, stream);
+  }
+
+  HumanStateEncoder encoder;
+  move_humans::map_traj_point human_pts;
+  HumanStateStream stream;
+  ros::Time now;
+};
+
+TEST_F(HumanStateEncoderTest, EmptyInput) {
+  // the first message is a keyframe even without humans, so that receivers
+  // drop humans they still have
+  ASSERT_TRUE(encode());
+  EXPECT_EQ(stream.type, HumanStateStream::KEYFRAME);
+  EXPECT_EQ(stream.count, 0u);
+  EXPECT_TRUE(stream.data.empty());
+  EXPECT_FALSE(encode());
+}
+
+TEST_F(HumanStateEncoderTest, Keyframe) {
+  setHuman(human_pts, 7, 1.5, -2.25, 0.5);
+  ASSERT_TRUE(encode());
+  EXPECT_EQ(stream.type, HumanStateStream::KEYFRAME);
+  EXPECT_EQ(stream.sequence, 0u);
+  ASSERT_EQ(stream.count, 1u);
+  ASSERT_EQ(stream.data.size(), 14u);
+  EXPECT_EQ(get32(stream.data, 0), 7);
+  EXPECT_EQ(get32(stream.data, 4), 150);
+  EXPECT_EQ(get32(stream.data, 8), -225);
+  EXPECT_EQ(get16(stream.data, 12), 50);
+  EXPECT_FLOAT_EQ(stream.position_resolution, 0.01);
+}
+
+TEST_F(HumanStateEncoderTest, UnmovedHumansAreNotSent) {
+  setHuman(human_pts, 1, 0.0, 0.0, 0.0);
+  setHuman(human_pts, 2, 1.0, 1.0, 0.0);
+  ASSERT_TRUE(encode());
+  EXPECT_FALSE(encode());
+
+  setHuman(human_pts, 2, 1.05, 1.0, 0.0);
+  ASSERT_TRUE(encode());
+  EXPECT_EQ(stream.type, HumanStateStream::DELTA);
+  EXPECT_EQ(stream.sequence, 1u);
+  ASSERT_EQ(stream.count, 1u);
+  ASSERT_EQ(stream.data.size(), 10u);
+  EXPECT_EQ(get32(stream.data, 0), 2);
+  EXPECT_EQ(get16(stream.data, 4), 5);
+  EXPECT_EQ(get16(stream.data, 6), 0);
+  EXPECT_EQ(get16(stream.data, 8), 0);
+}
+
+TEST_F(HumanStateEncoderTest, DeltasAreTakenAgainstSentStates) {
+  setHuman(human_pts, 1, 0.0, 0.0, 0.0);
+  ASSERT_TRUE(encode());
+
+  // moves below the threshold add up until they are sent
+  setHuman(human_pts, 1, 0.01, 0.0, 0.0);
+  EXPECT_FALSE(encode());
+  setHuman(human_pts, 1, 0.02, 0.0, 0.0);
+  ASSERT_TRUE(encode());
+  ASSERT_EQ(stream.count, 1u);
+  EXPECT_EQ(get16(stream.data, 4), 2);
+}
+
+TEST_F(HumanStateEncoderTest, KeyframeWhenHumansChange) {
+  setHuman(human_pts, 1, 0.0, 0.0, 0.0);
+  ASSERT_TRUE(encode());
+
+  setHuman(human_pts, 2, 1.0, 0.0, 0.0);
+  ASSERT_TRUE(encode());
+  EXPECT_EQ(stream.type, HumanStateStream::KEYFRAME);
+  EXPECT_EQ(stream.count, 2u);
+
+  human_pts.erase(1);
+  ASSERT_TRUE(encode());
+  EXPECT_EQ(stream.type, HumanStateStream::KEYFRAME);
+  EXPECT_EQ(stream.count, 1u);
+}
+
+TEST_F(HumanStateEncoderTest, KeyframeWhenDeltaOverflows) {
+  setHuman(human_pts, 1, 0.0, 0.0, 0.0);
+  ASSERT_TRUE(encode());
+  setHuman(human_pts, 1, 400.0, 0.0, 0.0);
+  ASSERT_TRUE(encode());
+  EXPECT_EQ(stream.type, HumanStateStream::KEYFRAME);
+  EXPECT_EQ(get32(stream.data, 4), 40000);
+}
+
+TEST_F(HumanStateEncoderTest, KeyframePeriodAndReset) {
+  setHuman(human_pts, 1, 0.0, 0.0, 0.0);
+  ASSERT_TRUE(encode());
+
+  now += ros::Duration(1.0);
+  ASSERT_TRUE(encode());
+  EXPECT_EQ(stream.type, HumanStateStream::KEYFRAME);
+  EXPECT_FALSE(encode());
+
+  encoder.reset();
+  ASSERT_TRUE(encode());
+  EXPECT_EQ(stream.type, HumanStateStream::KEYFRAME);
+
+  // other resolutions can not be mixed with sent states
+  encoder.setParams(0.02, 0.01, 0.02, 0.02, 1.0);
+  ASSERT_TRUE(encode());
+  EXPECT_EQ(stream.type, HumanStateStream::KEYFRAME);
+}
+}; // namespace
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
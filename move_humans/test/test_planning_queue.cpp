@@ -0,0 +1,126 @@
+#include <gtest/gtest.h>
+#include <move_humans/planning_queue.h>
+
+namespace {
+using move_humans::PlanningQueue;
+
+PlanningQueue::Request request(uint64_t human_id, bool urgent = false,
+                               double priority = 0.0,
+                               ros::Time deadline = ros::Time()) {
+  PlanningQueue::Request request;
+  request.human_id = human_id;
+  request.urgent = urgent;
+  request.priority = priority;
+  request.deadline = deadline;
+  return request;
+}
+
+std::vector<uint64_t> ids(const std::vector<PlanningQueue::Request> &requests) {
+  std::vector<uint64_t> human_ids;
+  for (auto &request : requests) {
+    human_ids.push_back(request.human_id);
+  }
+  return human_ids;
+}
+
+TEST(PlanningQueue, EmptyInput) {
+  PlanningQueue queue;
+  std::vector<PlanningQueue::Request> requests(1);
+  EXPECT_TRUE(queue.empty());
+  EXPECT_EQ(queue.take(ros::Time(10.0), 0, requests), 0u);
+  EXPECT_TRUE(requests.empty());
+  EXPECT_EQ(queue.take(ros::Time(10.0), 5, requests), 0u);
+  EXPECT_TRUE(requests.empty());
+}
+
+TEST(PlanningQueue, NewRequestSupersedesQueuedOne) {
+  PlanningQueue queue;
+  queue.push(request(1, false, 2.0));
+  queue.push(request(2));
+  queue.push(request(1, true, 1.0));
+  EXPECT_EQ(queue.size(), 2u);
+  EXPECT_EQ(queue.superseded(), 1u);
+
+  std::vector<PlanningQueue::Request> requests;
+  queue.take(ros::Time(10.0), 0, requests);
+  ASSERT_EQ(requests.size(), 2u);
+  EXPECT_EQ(requests[0].human_id, 1u);
+  EXPECT_TRUE(requests[0].urgent);
+  EXPECT_DOUBLE_EQ(requests[0].priority, 1.0);
+  EXPECT_TRUE(queue.empty());
+
+  // taken requests are not superseded by new ones
+  queue.push(request(1));
+  EXPECT_EQ(queue.superseded(), 1u);
+}
+
+TEST(PlanningQueue, UrgentThenPriorityThenOrder) {
+  PlanningQueue queue;
+  queue.push(request(1, false, 1.0));
+  queue.push(request(2, false, 0.5));
+  queue.push(request(3, true, 3.0));
+  queue.push(request(4, false, 1.0));
+  queue.push(request(5, true, 2.0));
+
+  std::vector<PlanningQueue::Request> requests;
+  queue.take(ros::Time(10.0), 0, requests);
+  EXPECT_EQ(ids(requests), std::vector<uint64_t>({5, 3, 2, 1, 4}));
+}
+
+TEST(PlanningQueue, MaxRequests) {
+  PlanningQueue queue;
+  for (uint64_t id = 1; id <= 5; id++) {
+    queue.push(request(id, false, -(double)id));
+  }
+
+  std::vector<PlanningQueue::Request> requests;
+  queue.take(ros::Time(10.0), 2, requests);
+  EXPECT_EQ(ids(requests), std::vector<uint64_t>({5, 4}));
+  EXPECT_EQ(queue.size(), 3u);
+  queue.take(ros::Time(10.0), 10, requests);
+  EXPECT_EQ(ids(requests), std::vector<uint64_t>({3, 2, 1}));
+  EXPECT_TRUE(queue.empty());
+}
+
+TEST(PlanningQueue, ExpiredRequestsAreKeptWithoutUrgency) {
+  PlanningQueue queue;
+  queue.push(request(1, true, 0.0, ros::Time(5.0)));
+  queue.push(request(2, true, 1.0, ros::Time(20.0)));
+  queue.push(request(3, false, 0.5));
+
+  std::vector<PlanningQueue::Request> requests;
+  EXPECT_EQ(queue.take(ros::Time(10.0), 0, requests), 1u);
+  EXPECT_EQ(queue.expired(), 1u);
+  EXPECT_EQ(ids(requests), std::vector<uint64_t>({2, 1, 3}));
+  EXPECT_FALSE(requests[1].urgent);
+  EXPECT_TRUE(requests[1].deadline.isZero());
+  EXPECT_FALSE(requests[0].deadline.isZero());
+
+  // requests expire once, even if they are not taken
+  queue.push(request(1, true, 0.0, ros::Time(5.0)));
+  queue.push(request(2, true, 1.0, ros::Time(5.0)));
+  EXPECT_EQ(queue.take(ros::Time(10.0), 1, requests), 2u);
+  EXPECT_EQ(queue.expired(), 3u);
+  EXPECT_EQ(ids(requests), std::vector<uint64_t>({1}));
+  EXPECT_EQ(queue.take(ros::Time(10.0), 1, requests), 0u);
+  EXPECT_EQ(queue.expired(), 3u);
+  EXPECT_EQ(ids(requests), std::vector<uint64_t>({2}));
+  EXPECT_FALSE(requests[0].urgent);
+}
+
+TEST(PlanningQueue, RemoveAndClear) {
+  PlanningQueue queue;
+  queue.push(request(1));
+  queue.push(request(2));
+  queue.remove(1);
+  queue.remove(3);
+  EXPECT_EQ(queue.size(), 1u);
+  queue.clear();
+  EXPECT_TRUE(queue.empty());
+}
+}; // namespace
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,119 @@
+#include <gtest/gtest.h>
+#include <move_humans/spatial_index.h>
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+namespace {
+using move_humans::SpatialIndex;
+
+// neighbours by scanning all entries, for comparison
+SpatialIndex::Neighbors scan(const std::vector<SpatialIndex::Entry> &points,
+                             double x, double y) {
+  SpatialIndex::Neighbors neighbors;
+  for (auto &point : points) {
+    neighbors.emplace_back(std::hypot(point.x - x, point.y - y), point.id);
+  }
+  std::sort(neighbors.begin(), neighbors.end());
+  return neighbors;
+}
+
+std::vector<SpatialIndex::Entry> randomPoints(size_t count, double size) {
+  std::mt19937 rng(42);
+  std::uniform_real_distribution<double> coordinate(-size, size);
+  std::vector<SpatialIndex::Entry> points;
+  for (size_t i = 0; i < count; i++) {
+    points.push_back({i, coordinate(rng), coordinate(rng)});
+  }
+  return points;
+}
+
+void expectNeighbors(const SpatialIndex::Neighbors &expected,
+                     const SpatialIndex::Neighbors &neighbors) {
+  ASSERT_EQ(expected.size(), neighbors.size());
+  for (size_t i = 0; i < expected.size(); i++) {
+    EXPECT_EQ(expected[i].second, neighbors[i].second);
+    EXPECT_DOUBLE_EQ(expected[i].first, neighbors[i].first);
+  }
+}
+
+TEST(SpatialIndex, EmptyInput) {
+  SpatialIndex index;
+  SpatialIndex::Neighbors neighbors(1);
+  index.radiusSearch(0.0, 0.0, 10.0, neighbors);
+  EXPECT_TRUE(neighbors.empty());
+  neighbors.resize(1);
+  index.nearest(0.0, 0.0, 3, neighbors);
+  EXPECT_TRUE(neighbors.empty());
+
+  // rebuilding without humans forgets the previous ones
+  index.rebuild(randomPoints(10, 5.0));
+  EXPECT_EQ(index.size(), 10u);
+  index.rebuild(std::vector<SpatialIndex::Entry>());
+  EXPECT_EQ(index.size(), 0u);
+  index.radiusSearch(0.0, 0.0, 10.0, neighbors);
+  EXPECT_TRUE(neighbors.empty());
+}
+
+TEST(SpatialIndex, RadiusSearchMatchesScan) {
+  auto points = randomPoints(500, 20.0);
+  SpatialIndex index(1.0);
+  index.rebuild(points);
+  for (auto &query : randomPoints(50, 25.0)) {
+    auto expected = scan(points, query.x, query.y);
+    expected.erase(std::find_if(expected.begin(), expected.end(),
+                                [](const std::pair<double, uint64_t> &n) {
+                                  return n.first > 2.5;
+                                }),
+                   expected.end());
+    SpatialIndex::Neighbors neighbors;
+    index.radiusSearch(query.x, query.y, 2.5, neighbors);
+    expectNeighbors(expected, neighbors);
+  }
+}
+
+TEST(SpatialIndex, NearestMatchesScan) {
+  auto points = randomPoints(300, 20.0);
+  // cells much smaller and much larger than the distances between humans
+  for (double cell_size : {0.1, 1.0, 50.0}) {
+    SpatialIndex index(cell_size);
+    index.rebuild(points);
+    for (auto &query : randomPoints(20, 40.0)) {
+      auto expected = scan(points, query.x, query.y);
+      expected.resize(5);
+      SpatialIndex::Neighbors neighbors;
+      index.nearest(query.x, query.y, 5, neighbors);
+      expectNeighbors(expected, neighbors);
+    }
+  }
+}
+
+TEST(SpatialIndex, NearestWithFewerHumans) {
+  auto points = randomPoints(3, 5.0);
+  SpatialIndex index;
+  index.rebuild(points);
+  SpatialIndex::Neighbors neighbors;
+  index.nearest(100.0, 100.0, 10, neighbors);
+  expectNeighbors(scan(points, 100.0, 100.0), neighbors);
+}
+
+TEST(SpatialIndex, NegativeRadius) {
+  SpatialIndex index;
+  index.rebuild(randomPoints(10, 1.0));
+  SpatialIndex::Neighbors neighbors;
+  index.radiusSearch(0.0, 0.0, -1.0, neighbors);
+  EXPECT_TRUE(neighbors.empty());
+}
+
+TEST(SpatialIndex, CellSize) {
+  SpatialIndex index(0.0);
+  EXPECT_DOUBLE_EQ(index.cellSize(), 0.5);
+  index.setCellSize(2.0);
+  EXPECT_DOUBLE_EQ(index.cellSize(), 2.0);
+}
+}; // namespace
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
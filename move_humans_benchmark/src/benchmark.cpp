@@ -0,0 +1,474 @@
+#define NODE_NAME "move_humans_benchmark"
+#define GLOBAL_FRAME "map"
+#define DEFAULT_HUMANS "1,10,50,100,250,500"
+#define DEFAULT_CONTROLLER "teleport"
+#define DEFAULT_MAX_SUB_GOALS 2
+#define DEFAULT_CYCLES 100
+#define DEFAULT_CONTROLLER_FREQUENCY 10.0
+#define DEFAULT_INSCRIBED_RADIUS 0.1
+#define DEFAULT_INFLATION_RADIUS 0.3
+#define DEFAULT_COST_SCALING_FACTOR 10.0
+#define DEFAULT_SEED 42
+#define FREE_COST_THRESHOLD 128
+#define MIN_START_GOAL_DIST 1.0
+
+#include <ros/ros.h>
+#include <costmap_2d/costmap_2d.h>
+#include <costmap_2d/cost_values.h>
+#include <map_server/image_loader.h>
+#include <nav_msgs/GetMap.h>
+#include <yaml-cpp/yaml.h>
+#include <multigoal_planner/multigoal_planner.h>
+#include <social_force_controller/social_force_controller.h>
+#include <teleport_controller/teleport_controller.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <sstream>
+
+// every allocation of the process is counted, so that allocations done by
+// the plugins during a measured call can be reported
+static std::atomic<size_t> g_allocations(0), g_allocated_bytes(0);
+
+void *operator new(size_t size) {
+  g_allocations.fetch_add(1, std::memory_order_relaxed);
+  g_allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+  void *ptr = std::malloc(size ? size : 1);
+  if (!ptr) {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+void *operator new[](size_t size) { return operator new(size); }
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+void operator delete[](void *ptr) noexcept { std::free(ptr); }
+void operator delete(void *ptr, size_t) noexcept { std::free(ptr); }
+void operator delete[](void *ptr, size_t) noexcept { std::free(ptr); }
+
+namespace move_humans_benchmark {
+struct Options {
+  std::string map_file, backend, controller;
+  std::vector<size_t> humans;
+  int max_sub_goals, cycles, threads, controller_threads;
+  double controller_frequency, inscribed_radius, inflation_radius,
+      cost_scaling_factor;
+  unsigned int seed;
+};
+
+struct Measurement {
+  Measurement() : allocations(0), bytes(0) {
+    start_allocations_ = g_allocations.load();
+    start_bytes_ = g_allocated_bytes.load();
+    start_ = std::chrono::steady_clock::now();
+  }
+
+  // milliseconds since construction, also records allocations
+  double stop() {
+    auto end = std::chrono::steady_clock::now();
+    allocations = g_allocations.load() - start_allocations_;
+    bytes = g_allocated_bytes.load() - start_bytes_;
+    return std::chrono::duration<double, std::milli>(end - start_).count();
+  }
+
+  size_t allocations, bytes;
+
+private:
+  std::chrono::steady_clock::time_point start_;
+  size_t start_allocations_, start_bytes_;
+};
+
+double percentile(std::vector<double> values, double p) {
+  if (values.empty()) {
+    return 0.0;
+  }
+  std::sort(values.begin(), values.end());
+  size_t index = std::min((size_t)std::ceil(p / 100.0 * values.size()),
+                          values.size()) -
+                 (p > 0.0 ? 1 : 0);
+  return values[index];
+}
+
+bool loadMap(const std::string &map_file, nav_msgs::OccupancyGrid &map) {
+  YAML::Node doc;
+  try {
+    doc = YAML::LoadFile(map_file);
+  } catch (YAML::Exception &e) {
+    ROS_ERROR_NAMED(NODE_NAME, "Failed to load map file %s: %s",
+                    map_file.c_str(), e.what());
+    return false;
+  }
+
+  std::string image = doc["image"].as<std::string>();
+  if (image.empty() || image[0] != '/') {
+    auto dir_end = map_file.find_last_of('/');
+    if (dir_end != std::string::npos) {
+      image = map_file.substr(0, dir_end + 1) + image;
+    }
+  }
+  double origin[3];
+  for (size_t i = 0; i < 3; i++) {
+    origin[i] = doc["origin"][i].as<double>();
+  }
+
+  nav_msgs::GetMap::Response map_resp;
+  try {
+    map_server::loadMapFromFile(
+        &map_resp, image.c_str(), doc["resolution"].as<double>(),
+        doc["negate"].as<int>(), doc["occupied_thresh"].as<double>(),
+        doc["free_thresh"].as<double>(), origin);
+  } catch (std::runtime_error &e) {
+    ROS_ERROR_NAMED(NODE_NAME, "Failed to load map image %s: %s",
+                    image.c_str(), e.what());
+    return false;
+  }
+  map = map_resp.map;
+  return true;
+}
+
+// fill costmap from an occupancy grid and inflate obstacles the same way as
+// the inflation layer of costmap_2d
+void fillCostmap(const nav_msgs::OccupancyGrid &map, const Options &options,
+                 costmap_2d::Costmap2D &costmap) {
+  unsigned int nx = map.info.width, ny = map.info.height;
+  double resolution = map.info.resolution;
+  costmap.resizeMap(nx, ny, resolution, map.info.origin.position.x,
+                    map.info.origin.position.y);
+
+  std::vector<unsigned int> lethal_cells;
+  for (unsigned int i = 0; i < nx * ny; i++) {
+    unsigned char cost = costmap_2d::FREE_SPACE;
+    if (map.data[i] < 0) {
+      cost = costmap_2d::NO_INFORMATION;
+    } else if (map.data[i] >= 100) {
+      cost = costmap_2d::LETHAL_OBSTACLE;
+      lethal_cells.push_back(i);
+    }
+    costmap.getCharMap()[i] = cost;
+  }
+
+  int radius = std::ceil(options.inflation_radius / resolution);
+  auto costs = costmap.getCharMap();
+  for (auto i : lethal_cells) {
+    int cx = i % nx, cy = i / nx;
+    for (int y = std::max(cy - radius, 0);
+         y <= std::min(cy + radius, (int)ny - 1); y++) {
+      for (int x = std::max(cx - radius, 0);
+           x <= std::min(cx + radius, (int)nx - 1); x++) {
+        double dist = std::hypot(x - cx, y - cy) * resolution;
+        if (dist > options.inflation_radius) {
+          continue;
+        }
+        unsigned char cost = costmap_2d::INSCRIBED_INFLATED_OBSTACLE;
+        if (dist > options.inscribed_radius) {
+          cost = (costmap_2d::INSCRIBED_INFLATED_OBSTACLE - 1) *
+                 std::exp(-options.cost_scaling_factor *
+                          (dist - options.inscribed_radius));
+        }
+        auto &cell = costs[y * nx + x];
+        if (cell == costmap_2d::NO_INFORMATION ||
+            (cell < cost && cell != costmap_2d::LETHAL_OBSTACLE)) {
+          cell = cost;
+        }
+      }
+    }
+  }
+}
+
+geometry_msgs::PoseStamped randomPose(const costmap_2d::Costmap2D &costmap,
+                                      const std::vector<unsigned int> &free,
+                                      std::mt19937 &rng) {
+  std::uniform_int_distribution<size_t> cell(0, free.size() - 1);
+  unsigned int i = free[cell(rng)];
+  geometry_msgs::PoseStamped pose;
+  pose.header.frame_id = GLOBAL_FRAME;
+  pose.header.stamp = ros::Time::now();
+  costmap.mapToWorld(i % costmap.getSizeInCellsX(),
+                     i / costmap.getSizeInCellsX(), pose.pose.position.x,
+                     pose.pose.position.y);
+  pose.pose.orientation.w = 1.0;
+  return pose;
+}
+
+void generateHumans(const costmap_2d::Costmap2D &costmap, size_t count,
+                    int max_sub_goals, std::mt19937 &rng,
+                    move_humans::map_pose &starts,
+                    move_humans::map_pose_vector &sub_goals,
+                    move_humans::map_pose &goals) {
+  std::vector<unsigned int> free;
+  auto costs = costmap.getCharMap();
+  for (unsigned int i = 0;
+       i < costmap.getSizeInCellsX() * costmap.getSizeInCellsY(); i++) {
+    if (costs[i] < FREE_COST_THRESHOLD) {
+      free.push_back(i);
+    }
+  }
+
+  std::uniform_int_distribution<int> sub_goal_count(0, max_sub_goals);
+  for (uint64_t human_id = 1; human_id <= count; human_id++) {
+    auto start = randomPose(costmap, free, rng);
+    auto goal = randomPose(costmap, free, rng);
+    while (std::hypot(goal.pose.position.x - start.pose.position.x,
+                      goal.pose.position.y - start.pose.position.y) <
+           MIN_START_GOAL_DIST) {
+      goal = randomPose(costmap, free, rng);
+    }
+    starts[human_id] = start;
+    goals[human_id] = goal;
+    int n_sub_goals = sub_goal_count(rng);
+    for (int i = 0; i < n_sub_goals; i++) {
+      sub_goals[human_id].push_back(randomPose(costmap, free, rng));
+    }
+  }
+}
+
+// controller cycles on the first segment of every plan
+template <typename Controller>
+void runController(Controller &controller, const Options &options,
+                   const move_humans::map_pose_vectors &plans,
+                   ros::Time &sim_time, std::vector<double> &cycle_times,
+                   size_t &cycle_allocations) {
+  move_humans::map_pose_vector controller_plans;
+  for (auto &plan_kv : plans) {
+    if (!plan_kv.second.empty()) {
+      controller_plans[plan_kv.first] = plan_kv.second.front();
+    }
+  }
+  controller.setPlans(controller_plans);
+
+  ros::Duration cycle_duration(1.0 / options.controller_frequency);
+  move_humans::map_traj_point humans;
+  for (int cycle = 0; cycle < options.cycles; cycle++) {
+    sim_time += cycle_duration;
+    ros::Time::setNow(sim_time);
+    Measurement measurement;
+    controller.computeHumansStates(humans);
+    move_humans::id_vector reached_humans;
+    controller.areGoalsReached(reached_humans);
+    cycle_times.push_back(measurement.stop());
+    cycle_allocations += measurement.allocations;
+  }
+}
+
+void run(const Options &options, costmap_2d::Costmap2D &costmap) {
+  multigoal_planner::MultiGoalPlanner planner;
+  planner.initialize("planner", &costmap, GLOBAL_FRAME);
+  auto planner_config =
+      multigoal_planner::MultiGoalPlannerConfig::__getDefault__();
+  planner_config.publish_human_plans = false;
+  planner_config.publish_human_poses = false;
+  planner_config.publish_potential = false;
+  if (options.threads >= 0) {
+    planner_config.planning_threads = options.threads;
+  }
+  if (options.backend == "dijkstra") {
+    planner_config.search_backend = multigoal_planner::DIJKSTRA_BACKEND;
+  } else if (options.backend == "astar") {
+    planner_config.search_backend = multigoal_planner::ASTAR_BACKEND;
+  } else if (options.backend == "bidirectional") {
+    planner_config.search_backend = multigoal_planner::BIDIRECTIONAL_BACKEND;
+  }
+  planner.setConfig(planner_config);
+
+  std::mt19937 rng(options.seed);
+  ros::Time sim_time = ros::Time::now();
+
+  std::printf("%6s | %10s %8s %10s | %8s %8s %8s %8s | %10s | %8s %8s %8s "
+              "%10s\n",
+              "humans", "batch ms", "failed", "batch allc", "h p50", "h p90",
+              "h p99", "h max", "h allc", "c p50", "c p99", "c max",
+              "c allc");
+
+  for (auto count : options.humans) {
+    move_humans::map_pose starts, goals;
+    move_humans::map_pose_vector sub_goals;
+    generateHumans(costmap, count, options.max_sub_goals, rng, starts,
+                   sub_goals, goals);
+
+    // every human alone, for the latency of a single human
+    std::vector<double> human_times;
+    size_t human_allocations = 0;
+    for (auto &start_kv : starts) {
+      move_humans::map_pose human_start, human_goal;
+      move_humans::map_pose_vector human_sub_goals;
+      human_start[start_kv.first] = start_kv.second;
+      human_goal[start_kv.first] = goals[start_kv.first];
+      auto sub_goals_it = sub_goals.find(start_kv.first);
+      if (sub_goals_it != sub_goals.end()) {
+        human_sub_goals[start_kv.first] = sub_goals_it->second;
+      }
+      move_humans::map_pose_vectors human_plans;
+      Measurement measurement;
+      planner.makePlans(human_start, human_sub_goals, human_goal,
+                        human_plans);
+      human_times.push_back(measurement.stop());
+      human_allocations += measurement.allocations;
+    }
+
+    // all humans at once, as move_humans plans them
+    move_humans::map_pose_vectors plans;
+    Measurement batch_measurement;
+    planner.makePlans(starts, sub_goals, goals, plans);
+    double batch_time = batch_measurement.stop();
+
+    std::vector<double> cycle_times;
+    size_t cycle_allocations = 0;
+    if (options.controller == "social_force") {
+      social_force_controller::SocialForceController controller;
+      controller.initialize("controller", GLOBAL_FRAME);
+      if (options.controller_threads >= 0) {
+        auto controller_config = social_force_controller::
+            SocialForceControllerConfig::__getDefault__();
+        controller_config.parallel_threads = options.controller_threads;
+        controller.setConfig(controller_config);
+      }
+      runController(controller, options, plans, sim_time, cycle_times,
+                    cycle_allocations);
+    } else {
+      teleport_controller::TeleportController controller;
+      controller.initialize("controller", GLOBAL_FRAME);
+      if (options.controller_threads >= 0) {
+        auto controller_config =
+            teleport_controller::TeleportControllerConfig::__getDefault__();
+        controller_config.publish_plans = false;
+        controller_config.parallel_threads = options.controller_threads;
+        controller.setConfig(controller_config);
+      }
+      runController(controller, options, plans, sim_time, cycle_times,
+                    cycle_allocations);
+    }
+
+    std::printf("%6lu | %10.2f %8lu %10lu | %8.3f %8.3f %8.3f %8.3f | %10lu "
+                "| %8.3f %8.3f %8.3f %10lu\n",
+                count, batch_time, count - plans.size(),
+                batch_measurement.allocations, percentile(human_times, 50),
+                percentile(human_times, 90), percentile(human_times, 99),
+                percentile(human_times, 100),
+                human_allocations / std::max(count, (size_t)1),
+                percentile(cycle_times, 50), percentile(cycle_times, 99),
+                percentile(cycle_times, 100),
+                cycle_allocations / std::max(options.cycles, 1));
+    std::fflush(stdout);
+  }
+}
+
+void usage(const char *name) {
+  std::printf(
+      "usage: %s --map <map.yaml> [options]\n"
+      "  --humans <n,n,...>      numbers of humans to benchmark (%s)\n"
+      "  --sub-goals <n>         maximum random sub-goals per human (%d)\n"
+      "  --backend <name>        dijkstra, astar or bidirectional\n"
+      "  --threads <n>           planning threads, 0 for one per core\n"
+      "  --controller <name>     teleport or social_force (%s)\n"
+      "  --controller-threads <n>  controller threads, 0 for one per core\n"
+      "  --cycles <n>            controller cycles per run (%d)\n"
+      "  --controller-frequency <hz>  simulated control rate (%.1f)\n"
+      "  --inscribed-radius <m>  inscribed radius for inflation (%.2f)\n"
+      "  --inflation-radius <m>  inflation radius (%.2f)\n"
+      "  --cost-scaling <f>      inflation cost scaling factor (%.1f)\n"
+      "  --seed <n>              seed for random humans (%d)\n",
+      name, DEFAULT_HUMANS, DEFAULT_MAX_SUB_GOALS, DEFAULT_CONTROLLER,
+      DEFAULT_CYCLES,
+      DEFAULT_CONTROLLER_FREQUENCY, DEFAULT_INSCRIBED_RADIUS,
+      DEFAULT_INFLATION_RADIUS, DEFAULT_COST_SCALING_FACTOR, DEFAULT_SEED);
+}
+
+std::vector<size_t> parseCounts(const std::string &counts) {
+  std::vector<size_t> values;
+  std::stringstream ss(counts);
+  std::string value;
+  while (std::getline(ss, value, ',')) {
+    if (!value.empty()) {
+      values.push_back(std::strtoul(value.c_str(), NULL, 10));
+    }
+  }
+  return values;
+}
+}; // namespace move_humans_benchmark
+
+int main(int argc, char **argv) {
+  using namespace move_humans_benchmark;
+
+  Options options;
+  options.humans = parseCounts(DEFAULT_HUMANS);
+  options.controller = DEFAULT_CONTROLLER;
+  options.max_sub_goals = DEFAULT_MAX_SUB_GOALS;
+  options.cycles = DEFAULT_CYCLES;
+  options.threads = -1;
+  options.controller_threads = -1;
+  options.controller_frequency = DEFAULT_CONTROLLER_FREQUENCY;
+  options.inscribed_radius = DEFAULT_INSCRIBED_RADIUS;
+  options.inflation_radius = DEFAULT_INFLATION_RADIUS;
+  options.cost_scaling_factor = DEFAULT_COST_SCALING_FACTOR;
+  options.seed = DEFAULT_SEED;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--help" || arg == "-h") {
+      usage(argv[0]);
+      return 0;
+    }
+    if (i + 1 >= argc) {
+      usage(argv[0]);
+      return 1;
+    }
+    std::string value = argv[++i];
+    if (arg == "--map") {
+      options.map_file = value;
+    } else if (arg == "--humans") {
+      options.humans = parseCounts(value);
+    } else if (arg == "--sub-goals") {
+      options.max_sub_goals = std::atoi(value.c_str());
+    } else if (arg == "--backend") {
+      options.backend = value;
+    } else if (arg == "--threads") {
+      options.threads = std::atoi(value.c_str());
+    } else if (arg == "--controller") {
+      options.controller = value;
+    } else if (arg == "--controller-threads") {
+      options.controller_threads = std::atoi(value.c_str());
+    } else if (arg == "--cycles") {
+      options.cycles = std::atoi(value.c_str());
+    } else if (arg == "--controller-frequency") {
+      options.controller_frequency = std::atof(value.c_str());
+    } else if (arg == "--inscribed-radius") {
+      options.inscribed_radius = std::atof(value.c_str());
+    } else if (arg == "--inflation-radius") {
+      options.inflation_radius = std::atof(value.c_str());
+    } else if (arg == "--cost-scaling") {
+      options.cost_scaling_factor = std::atof(value.c_str());
+    } else if (arg == "--seed") {
+      options.seed = std::strtoul(value.c_str(), NULL, 10);
+    } else {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (options.map_file.empty() || options.controller_frequency <= 0.0 ||
+      (options.controller != "teleport" &&
+       options.controller != "social_force")) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  // time is simulated, no master or node is needed
+  ros::Time::init();
+
+  nav_msgs::OccupancyGrid map;
+  if (!loadMap(options.map_file, map)) {
+    return 1;
+  }
+  costmap_2d::Costmap2D costmap;
+  fillCostmap(map, options, costmap);
+  ROS_INFO_NAMED(NODE_NAME, "Loaded %d x %d map at %.3f m resolution",
+                 costmap.getSizeInCellsX(), costmap.getSizeInCellsY(),
+                 costmap.getResolution());
+
+  run(options, costmap);
+  return 0;
+}
@@ -23,6 +23,31 @@ namespace MoveHumans {
     }
   }
 
+  export class HumanStateStream extends ROSLIB.Message {
+    public static KEYFRAME = 0;
+    public static DELTA = 1;
+
+    public header: StdMsgs.Header;
+    public type: number;
+    public sequence: number;
+    public position_resolution: number;
+    public yaw_resolution: number;
+    public count: number;
+    public data: string | number[];
+
+    constructor(values: {
+      header: StdMsgs.Header,
+      type: number,
+      sequence: number,
+      position_resolution: number,
+      yaw_resolution: number,
+      count: number,
+      data: string | number[]
+    }) {
+      super(values);
+    }
+  }
+
   export class HumanUpdateRequest extends ROSLIB.ServiceRequest {
     public human_pose: MoveHumans.HumanPose;
 
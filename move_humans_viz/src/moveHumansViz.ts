@@ -6,6 +6,7 @@ function init() {
     0.7,
     "/move_humans_node/TeleportController/plans",
     "/move_humans_node/TeleportController/human_markers",
+    "/move_humans_node/human_stream",
     "/move_humans_node/reset_simulation",
     "/move_humans_node/add_human",
     "/move_humans_node/delete_human",
@@ -35,6 +36,7 @@ class MoveHumansViz {
     mapOpacity: number,
     humanPathsTopic: string,
     humanMarkersTopic: string,
+    humanStreamTopic: string,
     resetSimulationService: string,
     addHumanService: string,
     deleteHumanService: string,
@@ -86,13 +88,23 @@ class MoveHumansViz {
       width: 5,
     });
 
-    // setup human marker client
-    let humansMarkers = new ROS3D.MarkerArrayClient({
-      ros: this.ros,
-      topic: humanMarkersTopic,
-      tfClient: this.tfClient,
-      rootObject: this.viewer.scene,
-    });
+    // show humans from the compact state stream if available, markers
+    // otherwise
+    if (humanStreamTopic) {
+      let humanStream = new HumanStreamClient({
+        ros: this.ros,
+        topic: humanStreamTopic,
+        tfClient: this.tfClient,
+        rootObject: this.viewer.scene,
+      });
+    } else {
+      let humansMarkers = new ROS3D.MarkerArrayClient({
+        ros: this.ros,
+        topic: humanMarkersTopic,
+        tfClient: this.tfClient,
+        rootObject: this.viewer.scene,
+      });
+    }
 
     // setup services
     this.resetSimulationClient = new ROSLIB.Service({
@@ -286,3 +298,202 @@ class MoveHumansViz {
     (<HTMLButtonElement>document.getElementById("update-goal-button")).disabled = false;
   }
 }
+
+interface HumanState {
+  id: number;
+  x: number;
+  y: number;
+  yaw: number;
+}
+
+// decodes move_humans/HumanStateStream messages, see HumanStateStream.msg,
+// states are kept quantized so that deltas apply exactly as they were encoded
+class HumanStateStreamDecoder {
+  private static KEYFRAME_RECORD_SIZE = 14;
+  private static DELTA_RECORD_SIZE = 10;
+
+  private states: { [id: number]: HumanState } = {};
+  private positionResolution = 0;
+  private yawResolution = 0;
+  private sequence = 0;
+  private synced = false;
+
+  // apply a message, returns false if it could not be applied, in which case
+  // states are stale until the next keyframe
+  public decode(msg: MoveHumans.HumanStateStream): boolean {
+    let data = HumanStateStreamDecoder.toBytes(msg.data);
+    let view = new DataView(data.buffer, data.byteOffset, data.byteLength);
+
+    if (msg.type === MoveHumans.HumanStateStream.KEYFRAME) {
+      if (data.byteLength < msg.count * HumanStateStreamDecoder.KEYFRAME_RECORD_SIZE) {
+        this.synced = false;
+        return false;
+      }
+      let states: { [id: number]: HumanState } = {};
+      for (let i = 0, offset = 0; i < msg.count; i++) {
+        let id = view.getUint32(offset, true);
+        states[id] = {
+          id: id,
+          x: view.getInt32(offset + 4, true),
+          y: view.getInt32(offset + 8, true),
+          yaw: view.getInt16(offset + 12, true),
+        };
+        offset += HumanStateStreamDecoder.KEYFRAME_RECORD_SIZE;
+      }
+      this.states = states;
+      this.positionResolution = msg.position_resolution;
+      this.yawResolution = msg.yaw_resolution;
+      this.synced = true;
+    } else {
+      // a delta only applies on top of the previous message
+      if (!this.synced || msg.sequence !== ((this.sequence + 1) >>> 0) ||
+        data.byteLength < msg.count * HumanStateStreamDecoder.DELTA_RECORD_SIZE) {
+        this.synced = false;
+        this.sequence = msg.sequence;
+        return false;
+      }
+      for (let i = 0, offset = 0; i < msg.count; i++) {
+        let state = this.states[view.getUint32(offset, true)];
+        if (!state) {
+          this.synced = false;
+          this.sequence = msg.sequence;
+          return false;
+        }
+        state.x += view.getInt16(offset + 4, true);
+        state.y += view.getInt16(offset + 6, true);
+        state.yaw += view.getInt16(offset + 8, true);
+        offset += HumanStateStreamDecoder.DELTA_RECORD_SIZE;
+      }
+    }
+    this.sequence = msg.sequence;
+    return true;
+  }
+
+  public isSynced() {
+    return this.synced;
+  }
+
+  // current states in meters and radians
+  public humans(): HumanState[] {
+    let humans: HumanState[] = [];
+    for (let id in this.states) {
+      if (this.states.hasOwnProperty(id)) {
+        let state = this.states[id];
+        humans.push({
+          id: state.id,
+          x: state.x * this.positionResolution,
+          y: state.y * this.positionResolution,
+          yaw: state.yaw * this.yawResolution,
+        });
+      }
+    }
+    return humans;
+  }
+
+  // rosbridge sends uint8[] as a base64 string
+  private static toBytes(data: string | number[]): Uint8Array {
+    if (typeof data === "string") {
+      let raw = atob(data);
+      let bytes = new Uint8Array(raw.length);
+      for (let i = 0; i < raw.length; i++) {
+        bytes[i] = raw.charCodeAt(i);
+      }
+      return bytes;
+    }
+    return new Uint8Array(data);
+  }
+}
+
+// draws humans received on a HumanStateStream topic, objects of humans that
+// are still present are moved instead of recreated
+class HumanStreamClient {
+  private static HUMAN_RADIUS = 0.25;
+  private static HUMAN_HEIGHT = 1.5;
+  private static HUMAN_COLOR = 0x808000;
+
+  private decoder = new HumanStateStreamDecoder();
+  private humans: { [id: number]: THREE.Object3D } = {};
+  private tfClient: ROSLIB.TFClient;
+  private rootObject: THREE.Object3D;
+  private sceneNode: ROS3D.SceneNode;
+  private humansObject = new THREE.Object3D();
+  private frameId: string;
+
+  constructor(options: {
+    ros: ROSLIB.Ros,
+    topic: string,
+    tfClient: ROSLIB.TFClient,
+    rootObject: THREE.Object3D,
+  }) {
+    this.tfClient = options.tfClient;
+    this.rootObject = options.rootObject;
+
+    // deltas depend on all previous messages, so they must not be dropped
+    let topic = new ROSLIB.Topic({
+      ros: options.ros,
+      name: options.topic,
+      messageType: "move_humans/HumanStateStream",
+      queue_length: 10,
+    });
+    topic.subscribe(this.streamCallback);
+  }
+
+  private streamCallback = (msg: MoveHumans.HumanStateStream) => {
+    if (!this.decoder.decode(msg)) {
+      return;
+    }
+
+    if (msg.header.frame_id !== this.frameId) {
+      if (this.sceneNode) {
+        this.rootObject.remove(this.sceneNode);
+      }
+      this.frameId = msg.header.frame_id;
+      this.sceneNode = new ROS3D.SceneNode({
+        frameID: this.frameId,
+        tfClient: this.tfClient,
+        object: this.humansObject,
+      });
+      this.rootObject.add(this.sceneNode);
+    }
+
+    let present: { [id: number]: boolean } = {};
+    for (let human of this.decoder.humans()) {
+      present[human.id] = true;
+      let object = this.humans[human.id];
+      if (!object) {
+        object = HumanStreamClient.createHuman();
+        this.humans[human.id] = object;
+        this.humansObject.add(object);
+      }
+      object.position.set(human.x, human.y, 0);
+      object.rotation.set(0, 0, human.yaw);
+    }
+    for (let id in this.humans) {
+      if (this.humans.hasOwnProperty(id) && !present[id]) {
+        this.humansObject.remove(this.humans[id]);
+        delete this.humans[id];
+      }
+    }
+  }
+
+  // geometry and material are shared by all humans
+  private static geometry: THREE.CylinderGeometry;
+  private static material: THREE.MeshBasicMaterial;
+
+  private static createHuman(): THREE.Object3D {
+    if (!HumanStreamClient.geometry) {
+      HumanStreamClient.geometry = new THREE.CylinderGeometry(HumanStreamClient.HUMAN_RADIUS,
+        HumanStreamClient.HUMAN_RADIUS, HumanStreamClient.HUMAN_HEIGHT);
+      HumanStreamClient.material = new THREE.MeshBasicMaterial({ color: HumanStreamClient.HUMAN_COLOR });
+    }
+    let human = new THREE.Object3D();
+    let cylinder = new THREE.Mesh(HumanStreamClient.geometry, HumanStreamClient.material);
+    // three.js cylinders are along y, humans stand along z
+    cylinder.rotation.x = Math.PI / 2;
+    cylinder.position.z = HumanStreamClient.HUMAN_HEIGHT / 2;
+    human.add(cylinder);
+    human.add(new THREE.ArrowHelper(new THREE.Vector3(1, 0, 0), new THREE.Vector3(0, 0, 0),
+      HumanStreamClient.HUMAN_RADIUS * 2, HumanStreamClient.HUMAN_COLOR));
+    return human;
+  }
+}
@@ -0,0 +1,86 @@
+#ifndef MULTIGOAL_PLANNER_ASTAR_EXPANSION_H
+#define MULTIGOAL_PLANNER_ASTAR_EXPANSION_H
+
+#include <cmath>
+#include <vector>
+#include <global_planner/expander.h>
+
+namespace multigoal_planner {
+// A* expansion with an admissible euclidean heuristic, potentials are rooted
+// at the start like global_planner::DijkstraExpansion so that the same
+// tracebacks can be used on the result
+class EuclideanAStarExpansion : public global_planner::Expander {
+public:
+  EuclideanAStarExpansion(global_planner::PotentialCalculator *p_calc, int nx,
+                          int ny);
+
+  bool calculatePotentials(unsigned char *costs, double start_x,
+                           double start_y, double end_x, double end_y,
+                           int cycles, float *potential);
+
+protected:
+  struct Index {
+    Index(int index, float cost) : i(index), cost(cost) {}
+    int i;
+    float cost;
+  };
+  struct greater1 {
+    bool operator()(const Index &a, const Index &b) const {
+      return a.cost > b.cost;
+    }
+  };
+
+  // cost of traversing a cell, the same as used by DijkstraExpansion
+  inline unsigned char getCost(const unsigned char *costs, int n) const {
+    float c = costs[n];
+    if (c < lethal_cost_ - 1 ||
+        (unknown_ && costs[n] == costmap_2d::NO_INFORMATION)) {
+      c = c * factor_ + neutral_cost_;
+      if (c >= lethal_cost_) {
+        c = lethal_cost_ - 1;
+      }
+      return c;
+    }
+    return lethal_cost_;
+  }
+
+  inline float heuristic(int i, int end_x, int end_y) const {
+    return std::hypot((float)(i % nx_ - end_x), (float)(i / nx_ - end_y)) *
+           neutral_cost_;
+  }
+
+  // assign potential to a cell and queue it, if it is free and not yet
+  // reached, when admit is given only cells with a potential in admit are
+  // considered
+  void add(const unsigned char *costs, float *potential, float prev_potential,
+           int next_i, int end_x, int end_y, std::vector<Index> &queue,
+           const float *admit = NULL);
+  void expand(const unsigned char *costs, float *potential, int i, int end_x,
+              int end_y, std::vector<Index> &queue, const float *admit = NULL);
+
+  std::vector<Index> queue_;
+};
+
+// bidirectional variant of the euclidean A* expansion, searches from both
+// ends until the frontiers meet, then completes the start rooted potential
+// only across the cells reached from the goal, this gives a potential with
+// the same semantics as the uni-directional expansions while exploring much
+// less of the map for distant end points
+class BidirectionalAStarExpansion : public EuclideanAStarExpansion {
+public:
+  BidirectionalAStarExpansion(global_planner::PotentialCalculator *p_calc,
+                              int nx, int ny);
+
+  bool calculatePotentials(unsigned char *costs, double start_x,
+                           double start_y, double end_x, double end_y,
+                           int cycles, float *potential);
+
+  void setSize(int nx, int ny);
+
+private:
+  std::vector<float> goal_potential_;
+  std::vector<Index> goal_queue_;
+};
+}; // namespace multigoal_planner
+
+#endif // MULTIGOAL_PLANNER_ASTAR_EXPANSION_H
@@ -0,0 +1,11 @@
+#ifndef MULTIGOAL_PLANNER_CELL_WINDOW_H
+#define MULTIGOAL_PLANNER_CELL_WINDOW_H
+
+namespace multigoal_planner {
+// rectangular part of the costmap, in cells
+struct CellWindow {
+  int x0, y0, nx, ny;
+};
+}; // namespace multigoal_planner
+
+#endif // MULTIGOAL_PLANNER_CELL_WINDOW_H
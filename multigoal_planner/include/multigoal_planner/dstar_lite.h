@@ -0,0 +1,69 @@
+#ifndef MULTIGOAL_PLANNER_DSTAR_LITE_H
+#define MULTIGOAL_PLANNER_DSTAR_LITE_H
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include <multigoal_planner/cell_window.h>
+
+namespace multigoal_planner {
+// D* Lite search for one segment, rooted at the goal and kept between
+// planning calls, each update only repairs the part of the search affected by
+// changed costs inside the window and by the movement of the start
+class DStarLite {
+public:
+  DStarLite(const CellWindow &window, int map_nx, int map_ny, int goal_x,
+            int goal_y, bool allow_unknown);
+
+  // whether this search can be reused for the given costmap size, goal and
+  // start, in map cells
+  bool matches(int map_nx, int map_ny, int goal_x, int goal_y, int start_x,
+               int start_y) const;
+
+  // bring the search up to date with costs of the whole costmap and the
+  // start, in map cells, costs are only compared if their version changed,
+  // returns false if the start can not be reached
+  bool update(const unsigned char *costs, uint64_t costs_version,
+              int start_x, int start_y, int cycles);
+
+  const CellWindow &window() const { return window_; }
+
+  // cost-to-goal of the cells of the window, POT_HIGH where unknown
+  const float *potential() const { return g_.data(); }
+
+private:
+  typedef std::pair<float, float> Key;
+  struct Entry {
+    Entry(const Key &key, int i) : key(key), i(i) {}
+    Key key;
+    int i;
+  };
+  struct greater1 {
+    bool operator()(const Entry &a, const Entry &b) const {
+      return a.key > b.key;
+    }
+  };
+
+  CellWindow window_;
+  int map_nx_, map_ny_, goal_i_, start_i_;
+  uint64_t costs_version_;
+  bool unknown_, initialized_;
+  float km_;
+  std::vector<unsigned char> costs_;
+  std::vector<float> g_, rhs_;
+  std::vector<Entry> queue_;
+  std::vector<int> changed_;
+
+  unsigned char getCost(unsigned char cost) const;
+  float edgeCost(int a, int b) const;
+  float heuristic(int a, int b) const;
+  Key calculateKey(int i) const;
+  bool isBorder(int i) const;
+  void push(int i);
+  void updateVertex(int i);
+  void updateNeighbours(int i);
+  void computeShortestPath(int cycles);
+};
+}; // namespace multigoal_planner
+
+#endif // MULTIGOAL_PLANNER_DSTAR_LITE_H
@@ -0,0 +1,61 @@
+#ifndef MULTIGOAL_PLANNER_GOAL_POTENTIAL_CACHE_H
+#define MULTIGOAL_PLANNER_GOAL_POTENTIAL_CACHE_H
+
+#include <cstdint>
+#include <list>
+#include <unordered_map>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+namespace multigoal_planner {
+// potential over the whole costmap rooted at a goal cell, computed once by
+// the first planning worker that locks it
+struct GoalPotential {
+  GoalPotential() : computed(false) {}
+
+  boost::mutex mutex;
+  bool computed;
+  std::vector<float> potential;
+};
+
+// least recently used set of goal rooted potentials for one costmap revision,
+// safe to be used from several planning workers
+class GoalPotentialCache {
+public:
+  GoalPotentialCache();
+
+  // maximum memory used by potentials, least recently used ones are dropped
+  void setCapacity(size_t bytes);
+
+  // drop all potentials if the costmap revision changed
+  void setRevision(uint64_t revision);
+
+  // get potential for the goal cell, if it is not cached and create is true a
+  // not yet computed one is added, returns empty pointer if it does not fit
+  boost::shared_ptr<GoalPotential> lookup(uint64_t goal_cell, size_t cells,
+                                          bool create);
+
+  void clear();
+
+  size_t size() const { return entries_.size(); }
+
+private:
+  typedef std::list<uint64_t> lru_list;
+  struct Entry {
+    boost::shared_ptr<GoalPotential> potential;
+    size_t bytes;
+    lru_list::iterator lru_it;
+  };
+
+  boost::mutex mutex_;
+  size_t capacity_, bytes_;
+  uint64_t revision_;
+  lru_list lru_;
+  std::unordered_map<uint64_t, Entry> entries_;
+
+  void evict(size_t bytes);
+};
+}; // namespace multigoal_planner
+
+#endif // MULTIGOAL_PLANNER_GOAL_POTENTIAL_CACHE_H
@@ -11,12 +11,70 @@
 #include <geometry_msgs/PoseArray.h>
 #include <hanp_msgs/HumanPathArray.h>
 #include <boost/thread.hpp>
+#include <set>
 #include <move_humans/types.h>
 #include <move_humans/planner_interface.h>
+#include <move_humans/thread_pool.h>
+#include <move_humans/costmap_snapshot.h>
+#include <move_humans/compact_path.h>
+#include <move_humans/profiler.h>
+#include <multigoal_planner/cell_window.h>
+#include <multigoal_planner/potential_buffers.h>
+#include <multigoal_planner/goal_potential_cache.h>
+#include <multigoal_planner/plan_cache.h>
+#include <multigoal_planner/dstar_lite.h>
 
 #include <multigoal_planner/MultiGoalPlannerConfig.h>
 
 namespace multigoal_planner {
+// expansions available for calculating potentials, values of the
+// search_backend parameter
+enum SearchBackend {
+  DIJKSTRA_BACKEND = 0,
+  ASTAR_BACKEND = 1,
+  BIDIRECTIONAL_BACKEND = 2
+};
+
+// expander and tracebacks for grids of one size, their buffers are only
+// reallocated when the size changes
+struct SearchGrid {
+  SearchGrid(int nx, int ny, bool allow_unknown, int backend);
+  ~SearchGrid();
+
+  // resize calculator, expander and tracebacks, only if the size changed
+  void setSize(int nx, int ny);
+
+  // expander covering every reachable cell, for goal rooted potentials
+  global_planner::Expander *fieldPlanner();
+
+  int nx, ny, backend;
+  bool allow_unknown;
+  global_planner::PotentialCalculator *p_calc;
+  global_planner::Expander *planner, *field_planner;
+  global_planner::Traceback *path_maker, *path_maker_fallback;
+};
+
+// search state owned by one planning thread, the whole costmap, the coarse
+// costmap and planning windows have grids of their own, so that planning on
+// one of them never reallocates the buffers of another
+struct PlanningWorker {
+  PlanningWorker(int nx, int ny, bool allow_unknown, int backend);
+
+  // resize the grid of the whole costmap, windows of a larger costmap are
+  // dropped
+  void setSize(int nx, int ny);
+
+  // grid of at least nx * ny cells for a window, the window grid only grows
+  // unless it is much larger than needed, windows are padded to its size
+  SearchGrid &windowGrid(int nx, int ny);
+
+  int backend;
+  SearchGrid map, coarse, window;
+  global_planner::OrientationFilter orientation_filter;
+  float *potential_array; // owned by MultiGoalPlanner::potential_buffers_
+  std::vector<unsigned char> window_costs, corridor_mask;
+};
+
 class MultiGoalPlanner : public move_humans::PlannerInterface {
 public:
   MultiGoalPlanner();
@@ -27,6 +85,14 @@ public:
   void initialize(std::string name, tf::TransformListener *tf,
                   costmap_2d::Costmap2DROS *costmap_ros);
 
+  // initialize without any ROS communication, for running the planner
+  // outside of a node, e.g. in benchmarks, plans are not published
+  void initialize(std::string name, costmap_2d::Costmap2D *costmap,
+                  std::string global_frame);
+
+  // replace the configuration, as dynamic_reconfigure would
+  void setConfig(const MultiGoalPlannerConfig &config);
+
   bool makePlans(const move_humans::map_pose &starts,
                  const move_humans::map_pose &goals,
                  move_humans::map_pose_vectors &plans);
@@ -36,16 +102,30 @@ public:
                  const move_humans::map_pose &goals,
                  move_humans::map_pose_vectors &plans);
 
+  bool submitPlans(const move_humans::map_pose &starts,
+                   const move_humans::map_pose_vector &sub_goals,
+                   const move_humans::map_pose &goals,
+                   const PlansCallback &plans_cb);
+
+  bool removeHumans(const move_humans::id_vector &human_ids);
+
 private:
   tf::TransformListener *tf_;
   costmap_2d::Costmap2DROS *costmap_ros_;
   costmap_2d::Costmap2D *costmap_;
 
+  // planning only reads the snapshot taken at the start of makePlans, the
+  // costmap itself is never locked for longer than copying it
+  move_humans::CostmapSnapshotter snapshotter_;
+  move_humans::CostmapSnapshotConstPtr snapshot_;
+
   ros::Publisher plans_pub_, plans_poses_pub_, potential_pub_;
-  void publishPlans(move_humans::map_pose_vector &plans);
+  // segments of every human are published as one path
+  void publishPlans(const move_humans::map_pose_vectors &plans);
 
   dynamic_reconfigure::Server<MultiGoalPlannerConfig> *dsrv_;
-  multigoal_planner::MultiGoalPlannerConfig default_config_, last_config_;
+  multigoal_planner::MultiGoalPlannerConfig default_config_, last_config_,
+      planning_config_;
   void reconfigureCB(MultiGoalPlannerConfig &config, uint32_t level);
 
   boost::mutex configuration_mutex_;
@@ -55,22 +135,97 @@ private:
   int publish_scale_;
   double sq_dist_plan_threshold_;
 
-  global_planner::PotentialCalculator *p_calc_;
-  global_planner::Expander *planner_;
-  global_planner::Traceback *path_maker_, *path_maker_fallback_;
-  global_planner::OrientationFilter *orientation_filter_;
-  float *potential_array_;
+  std::vector<boost::shared_ptr<PlanningWorker>> workers_;
+  move_humans::ThreadPool planning_pool_;
+  PotentialBuffers potential_buffers_;
+  GoalPotentialCache potential_cache_;
+  std::unordered_map<uint64_t, int> goal_uses_;
+
+  // incremental searches of every segment of every human, kept between calls
+  // until the human is removed, removals are applied by the next call
+  typedef std::vector<boost::shared_ptr<DStarLite>> segment_searches;
+  std::map<uint64_t, segment_searches> incremental_searches_;
+  boost::mutex removed_humans_mutex_;
+  std::set<uint64_t> removed_humans_;
+
+  // max-pooled copy of the snapshot for coarse-to-fine planning
+  std::vector<unsigned char> coarse_costs_;
+  int coarse_nx_, coarse_ny_, coarse_factor_;
+  uint64_t coarse_version_;
+
+  // plans of segments kept on disk between runs, keyed by the hashes of the
+  // costmap and of the configuration the plans depend on, new plans are
+  // written every plan_cache_persist_period_ seconds and when the planner
+  // is destroyed
+  PlanCache plan_cache_;
+  bool use_plan_cache_;
+  uint64_t plan_cache_version_, plan_cache_map_hash_;
+  double plan_cache_persist_period_;
+  ros::WallTime last_plan_cache_persist_;
+  void selectPlanCache();
+  void persistPlanCache();
 
   std::string tf_prefix_, planner_frame_;
   boost::mutex planning_mutex_;
 
-  bool getPlanFromPotential(double start_x, double start_y, double goal_x,
-                            double goal_y, move_humans::pose_vector &plan);
+  // plan all humans into plans, giving every human to plans_cb as soon as it
+  // is planned if set
+  bool planHumans(const move_humans::map_pose &starts,
+                  const move_humans::map_pose_vector &sub_goals,
+                  const move_humans::map_pose &goals,
+                  move_humans::map_pose_vectors &plans,
+                  const PlansCallback &plans_cb);
+  void setupWorkers(int num_threads, int backend, int nx, int ny);
+  bool makeHumanPlan(PlanningWorker &worker, uint64_t human_id,
+                     const geometry_msgs::PoseStamped &start,
+                     const move_humans::pose_vector &sub_goal_vector,
+                     const geometry_msgs::PoseStamped &goal,
+                     move_humans::pose_vectors &plan_vector,
+                     segment_searches *searches);
+  bool planSegment(PlanningWorker &worker, double start_x, double start_y,
+                   double goal_x, double goal_y,
+                   move_humans::CompactPath &plan,
+                   boost::shared_ptr<DStarLite> *search);
+  bool searchSegment(PlanningWorker &worker, double start_x, double start_y,
+                     double goal_x, double goal_y,
+                     move_humans::CompactPath &plan,
+                     boost::shared_ptr<DStarLite> *search);
+  CellWindow segmentWindow(double start_x, double start_y, double goal_x,
+                           double goal_y, double margin);
+  bool planIncremental(PlanningWorker &worker,
+                       boost::shared_ptr<DStarLite> &search, double start_x,
+                       double start_y, double goal_x, double goal_y,
+                       move_humans::CompactPath &plan);
+  void countGoalUses(const move_humans::map_pose &starts,
+                     const move_humans::map_pose_vector &sub_goals,
+                     const move_humans::map_pose &goals, int nx);
+  bool planOnGoalPotential(PlanningWorker &worker,
+                           GoalPotential &goal_potential, double start_x,
+                           double start_y, double goal_x, double goal_y,
+                           move_humans::CompactPath &plan);
+  void downsampleCostmap(int factor);
+  bool planCoarseToFine(PlanningWorker &worker, double start_x,
+                        double start_y, double goal_x, double goal_y,
+                        move_humans::CompactPath &plan);
+  bool planInWindow(PlanningWorker &worker, const CellWindow &window,
+                    double start_x, double start_y, double goal_x,
+                    double goal_y, move_humans::CompactPath &plan,
+                    bool corridor = false);
+  bool getPlanFromPotential(SearchGrid &grid, const float *potential,
+                            const CellWindow &window, double start_x,
+                            double start_y, double goal_x, double goal_y,
+                            move_humans::CompactPath &plan,
+                            bool goal_rooted = false);
 
+  // whether the straight segment between two points of a path in the planner
+  // frame is no costlier than the points between them
+  bool isShortcutFree(const move_humans::CompactPath &path, size_t first,
+                      size_t last);
   bool worldToMap(double wx, double wy, double &mx, double &my);
   void mapToWorld(double mx, double my, double &wx, double &wy);
-  void outlineMap(unsigned char *costarr, int nx, int ny, unsigned char value);
-  void publishPotential(float *potential);
+  void outlineMap(unsigned char *costarr, int nx, int ny, unsigned char value,
+                  int stride);
+  void publishPotential(const float *potential, const CellWindow &window);
 };
 };
 
@@ -0,0 +1,84 @@
+#ifndef MULTIGOAL_PLANNER_PLAN_CACHE_H
+#define MULTIGOAL_PLANNER_PLAN_CACHE_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <move_humans/cache_file.h>
+#include <move_humans/compact_path.h>
+
+namespace multigoal_planner {
+// persistent plans of segments between two costmap cells, plans of one
+// costmap and planner configuration are stored in one memory-mapped file of
+// the cache directory named after their hashes, files are mapped when the
+// cache is opened and only read when a segment of them is looked up
+class PlanCache {
+public:
+  PlanCache();
+  ~PlanCache();
+
+  // map all cache files of directory, which is created if it does not exist,
+  // returns false if the directory can not be used
+  bool open(const std::string &directory);
+  void close();
+  bool isOpen() const { return !directory_.empty(); }
+
+  // use the plans of the costmap and planner configuration with these hashes,
+  // plans added for the previously selected ones are persisted first
+  void select(uint64_t map_hash, uint64_t params_hash);
+
+  // points of the plan of the segment from start cell to goal cell of the
+  // selected file or added since the last persist, frame and stamp of plan
+  // are left as they are, safe to be used from several planning workers
+  bool lookup(uint32_t start_cell, uint32_t goal_cell,
+              move_humans::CompactPath &plan);
+  void insert(uint32_t start_cell, uint32_t goal_cell,
+              const move_humans::CompactPath &plan);
+
+  // write plans added since the last call together with the plans of the
+  // selected file to that file, returns the number of added plans
+  size_t persist();
+
+  // number of plans in mapped files
+  size_t size() const;
+  size_t files() const { return files_.size(); }
+
+private:
+  struct FileHeader;
+  struct IndexEntry;
+  struct MappedFile {
+    MappedFile() : header(NULL), index(NULL), points(NULL) {}
+
+    move_humans::CacheFile::MappingConstPtr mapping;
+    const FileHeader *header;
+    const IndexEntry *index;
+    const double *points;
+
+    // index of the entry with key, (size_t)-1 if not found
+    size_t find(uint64_t key) const;
+  };
+  typedef std::pair<uint64_t, uint64_t> file_key;
+
+  std::string directory_;
+  std::map<file_key, boost::shared_ptr<MappedFile>> files_;
+  file_key selected_key_;
+  boost::shared_ptr<MappedFile> selected_;
+
+  // plans not yet persisted as x, y pairs
+  boost::mutex pending_mutex_;
+  std::unordered_map<uint64_t, std::vector<double>> pending_;
+
+  static uint64_t key(uint32_t start_cell, uint32_t goal_cell) {
+    return ((uint64_t)start_cell << 32) | goal_cell;
+  }
+  std::string filePath(const file_key &key) const;
+  static boost::shared_ptr<MappedFile> mapFile(const std::string &path);
+};
+}; // namespace multigoal_planner
+
+#endif // MULTIGOAL_PLANNER_PLAN_CACHE_H
@@ -0,0 +1,28 @@
+#ifndef MULTIGOAL_PLANNER_POTENTIAL_BUFFERS_H
+#define MULTIGOAL_PLANNER_POTENTIAL_BUFFERS_H
+
+#include <memory>
+#include <vector>
+
+namespace multigoal_planner {
+// potential buffers that live as long as the planner, one per planning worker,
+// buffers are only reallocated when the size of the costmap changes
+class PotentialBuffers {
+public:
+  PotentialBuffers();
+
+  // make sure there are exactly count buffers of nx * ny cells, returns true
+  // if any memory had to be (re)allocated
+  bool resize(size_t count, int nx, int ny);
+
+  float *get(size_t index) const { return buffers_[index].get(); }
+  size_t size() const { return buffers_.size(); }
+  size_t cells() const { return cells_; }
+
+private:
+  size_t cells_;
+  std::vector<std::unique_ptr<float[]>> buffers_;
+};
+}; // namespace multigoal_planner
+
+#endif // MULTIGOAL_PLANNER_POTENTIAL_BUFFERS_H
@@ -0,0 +1,145 @@
+#include <multigoal_planner/astar_expansion.h>
+#include <algorithm>
+
+namespace multigoal_planner {
+EuclideanAStarExpansion::EuclideanAStarExpansion(
+    global_planner::PotentialCalculator *p_calc, int nx, int ny)
+    : global_planner::Expander(p_calc, nx, ny) {}
+
+bool EuclideanAStarExpansion::calculatePotentials(
+    unsigned char *costs, double start_x, double start_y, double end_x,
+    double end_y, int cycles, float *potential) {
+  queue_.clear();
+  std::fill(potential, potential + ns_, POT_HIGH);
+
+  int start_i = toIndex(start_x, start_y), goal_i = toIndex(end_x, end_y);
+  potential[start_i] = 0;
+  queue_.push_back(Index(start_i, heuristic(start_i, end_x, end_y)));
+
+  int cycle = 0;
+  while (!queue_.empty() && cycle < cycles) {
+    Index top = queue_.front();
+    std::pop_heap(queue_.begin(), queue_.end(), greater1());
+    queue_.pop_back();
+
+    if (top.i == goal_i) {
+      return true;
+    }
+    expand(costs, potential, top.i, end_x, end_y, queue_);
+    cycle++;
+  }
+  return false;
+}
+
+void EuclideanAStarExpansion::add(const unsigned char *costs, float *potential,
+                                  float prev_potential, int next_i, int end_x,
+                                  int end_y, std::vector<Index> &queue,
+                                  const float *admit) {
+  if (next_i < 0 || next_i >= ns_) {
+    return;
+  }
+  if (potential[next_i] < POT_HIGH) {
+    return;
+  }
+  if (admit != NULL && admit[next_i] >= POT_HIGH) {
+    return;
+  }
+  unsigned char cost = getCost(costs, next_i);
+  if (cost >= lethal_cost_) {
+    return;
+  }
+
+  potential[next_i] =
+      p_calc_->calculatePotential(potential, cost, next_i, prev_potential);
+  queue.push_back(
+      Index(next_i, potential[next_i] + heuristic(next_i, end_x, end_y)));
+  std::push_heap(queue.begin(), queue.end(), greater1());
+}
+
+void EuclideanAStarExpansion::expand(const unsigned char *costs,
+                                     float *potential, int i, int end_x,
+                                     int end_y, std::vector<Index> &queue,
+                                     const float *admit) {
+  add(costs, potential, potential[i], i + 1, end_x, end_y, queue, admit);
+  add(costs, potential, potential[i], i - 1, end_x, end_y, queue, admit);
+  add(costs, potential, potential[i], i + nx_, end_x, end_y, queue, admit);
+  add(costs, potential, potential[i], i - nx_, end_x, end_y, queue, admit);
+}
+
+BidirectionalAStarExpansion::BidirectionalAStarExpansion(
+    global_planner::PotentialCalculator *p_calc, int nx, int ny)
+    : EuclideanAStarExpansion(p_calc, nx, ny) {
+  setSize(nx, ny);
+}
+
+void BidirectionalAStarExpansion::setSize(int nx, int ny) {
+  EuclideanAStarExpansion::setSize(nx, ny);
+  goal_potential_.resize(ns_);
+}
+
+bool BidirectionalAStarExpansion::calculatePotentials(
+    unsigned char *costs, double start_x, double start_y, double end_x,
+    double end_y, int cycles, float *potential) {
+  queue_.clear();
+  goal_queue_.clear();
+  std::fill(potential, potential + ns_, POT_HIGH);
+  std::fill(goal_potential_.begin(), goal_potential_.end(), POT_HIGH);
+  float *goal_potential = goal_potential_.data();
+
+  int start_i = toIndex(start_x, start_y), goal_i = toIndex(end_x, end_y);
+  potential[start_i] = 0;
+  goal_potential[goal_i] = 0;
+  queue_.push_back(Index(start_i, heuristic(start_i, end_x, end_y)));
+  goal_queue_.push_back(Index(goal_i, heuristic(goal_i, start_x, start_y)));
+
+  // grow both frontiers, always expanding the one with the cheaper top, until
+  // a cell is reached from both sides
+  int cycle = 0;
+  bool met = potential[goal_i] < POT_HIGH;
+  while (!met && !queue_.empty() && !goal_queue_.empty() && cycle < cycles) {
+    bool forward = queue_.front().cost <= goal_queue_.front().cost;
+    auto &queue = forward ? queue_ : goal_queue_;
+    float *own = forward ? potential : goal_potential;
+    const float *other = forward ? goal_potential : potential;
+
+    Index top = queue.front();
+    std::pop_heap(queue.begin(), queue.end(), greater1());
+    queue.pop_back();
+    if (other[top.i] < POT_HIGH) {
+      // the meeting cell is expanded by the continuation, it may be the only
+      // one joining both frontiers, e.g. in a doorway
+      if (forward) {
+        queue.push_back(top);
+        std::push_heap(queue.begin(), queue.end(), greater1());
+      }
+      met = true;
+      break;
+    }
+
+    if (forward) {
+      expand(costs, own, top.i, end_x, end_y, queue);
+    } else {
+      expand(costs, own, top.i, start_x, start_y, queue);
+    }
+    cycle++;
+  }
+  if (!met) {
+    return false;
+  }
+
+  // continue the start rooted expansion only across cells reached from the
+  // goal, which contain a path between the meeting cell and the goal
+  while (!queue_.empty() && cycle < cycles) {
+    Index top = queue_.front();
+    std::pop_heap(queue_.begin(), queue_.end(), greater1());
+    queue_.pop_back();
+
+    if (top.i == goal_i) {
+      return true;
+    }
+    expand(costs, potential, top.i, end_x, end_y, queue_, goal_potential);
+    cycle++;
+  }
+  return false;
+}
+} // namespace multigoal_planner
@@ -0,0 +1,191 @@
+#define NEUTRAL_COST 50
+#define LETHAL_COST 253
+#define COST_FACTOR 3.0
+
+#include <multigoal_planner/dstar_lite.h>
+#include <global_planner/expander.h>
+#include <algorithm>
+#include <cstdlib>
+
+namespace multigoal_planner {
+DStarLite::DStarLite(const CellWindow &window, int map_nx, int map_ny,
+                     int goal_x, int goal_y, bool allow_unknown)
+    : window_(window), map_nx_(map_nx), map_ny_(map_ny), start_i_(-1),
+      costs_version_(0), unknown_(allow_unknown), initialized_(false),
+      km_(0.0) {
+  goal_i_ = (goal_y - window_.y0) * window_.nx + (goal_x - window_.x0);
+}
+
+bool DStarLite::matches(int map_nx, int map_ny, int goal_x, int goal_y,
+                        int start_x, int start_y) const {
+  return map_nx == map_nx_ && map_ny == map_ny_ &&
+         goal_i_ ==
+             (goal_y - window_.y0) * window_.nx + (goal_x - window_.x0) &&
+         start_x > window_.x0 && start_y > window_.y0 &&
+         start_x < window_.x0 + window_.nx - 1 &&
+         start_y < window_.y0 + window_.ny - 1;
+}
+
+bool DStarLite::update(const unsigned char *costs, uint64_t costs_version,
+                       int start_x, int start_y, int cycles) {
+  int ns = window_.nx * window_.ny;
+  int start_i = (start_y - window_.y0) * window_.nx + (start_x - window_.x0);
+
+  if (!initialized_) {
+    costs_.resize(ns);
+    for (int y = 0; y < window_.ny; y++) {
+      const unsigned char *row =
+          costs + (window_.y0 + y) * map_nx_ + window_.x0;
+      for (int x = 0; x < window_.nx; x++) {
+        int i = y * window_.nx + x;
+        costs_[i] = isBorder(i) ? LETHAL_COST : getCost(row[x]);
+      }
+    }
+    g_.assign(ns, POT_HIGH);
+    rhs_.assign(ns, POT_HIGH);
+    queue_.clear();
+    km_ = 0.0;
+    start_i_ = start_i;
+    rhs_[goal_i_] = 0.0;
+    push(goal_i_);
+    costs_version_ = costs_version;
+    initialized_ = true;
+  } else {
+    // keys stay valid lower bounds after the start moved by adding the
+    // distance it moved to all new keys
+    if (start_i != start_i_) {
+      km_ += heuristic(start_i_, start_i);
+      start_i_ = start_i;
+    }
+
+    if (costs_version != costs_version_) {
+      changed_.clear();
+      for (int y = 1; y < window_.ny - 1; y++) {
+        const unsigned char *row =
+            costs + (window_.y0 + y) * map_nx_ + window_.x0;
+        for (int x = 1; x < window_.nx - 1; x++) {
+          int i = y * window_.nx + x;
+          unsigned char cost = getCost(row[x]);
+          if (cost != costs_[i]) {
+            costs_[i] = cost;
+            changed_.push_back(i);
+          }
+        }
+      }
+      for (auto i : changed_) {
+        updateVertex(i);
+        updateNeighbours(i);
+      }
+      costs_version_ = costs_version;
+    }
+  }
+
+  computeShortestPath(cycles);
+  return g_[start_i_] < POT_HIGH && g_[start_i_] == rhs_[start_i_];
+}
+
+unsigned char DStarLite::getCost(unsigned char cost) const {
+  // the same traversal costs as the expanders of global_planner
+  if (cost < LETHAL_COST - 1 ||
+      (unknown_ && cost == costmap_2d::NO_INFORMATION)) {
+    float c = cost * COST_FACTOR + NEUTRAL_COST;
+    return std::min(c, (float)(LETHAL_COST - 1));
+  }
+  return LETHAL_COST;
+}
+
+float DStarLite::edgeCost(int a, int b) const {
+  if (costs_[a] >= LETHAL_COST || costs_[b] >= LETHAL_COST) {
+    return POT_HIGH;
+  }
+  return 0.5 * (costs_[a] + costs_[b]);
+}
+
+float DStarLite::heuristic(int a, int b) const {
+  return (std::abs(a % window_.nx - b % window_.nx) +
+          std::abs(a / window_.nx - b / window_.nx)) *
+         NEUTRAL_COST;
+}
+
+DStarLite::Key DStarLite::calculateKey(int i) const {
+  float k2 = std::min(g_[i], rhs_[i]);
+  if (k2 >= POT_HIGH) {
+    return Key(POT_HIGH, POT_HIGH);
+  }
+  return Key(k2 + heuristic(start_i_, i) + km_, k2);
+}
+
+bool DStarLite::isBorder(int i) const {
+  int x = i % window_.nx, y = i / window_.nx;
+  return x == 0 || y == 0 || x == window_.nx - 1 || y == window_.ny - 1;
+}
+
+void DStarLite::push(int i) {
+  queue_.push_back(Entry(calculateKey(i), i));
+  std::push_heap(queue_.begin(), queue_.end(), greater1());
+}
+
+void DStarLite::updateVertex(int i) {
+  if (isBorder(i)) {
+    return;
+  }
+  if (i != goal_i_) {
+    float rhs = POT_HIGH;
+    int neighbours[] = {i + 1, i - 1, i + window_.nx, i - window_.nx};
+    for (auto n : neighbours) {
+      if (g_[n] < POT_HIGH) {
+        rhs = std::min(rhs, g_[n] + edgeCost(i, n));
+      }
+    }
+    rhs_[i] = std::min(rhs, (float)POT_HIGH);
+  }
+  // cells can be queued several times, outdated entries are skipped when
+  // popped
+  if (g_[i] != rhs_[i]) {
+    push(i);
+  }
+}
+
+void DStarLite::updateNeighbours(int i) {
+  if (isBorder(i)) {
+    return;
+  }
+  updateVertex(i + 1);
+  updateVertex(i - 1);
+  updateVertex(i + window_.nx);
+  updateVertex(i - window_.nx);
+}
+
+void DStarLite::computeShortestPath(int cycles) {
+  int cycle = 0;
+  while (!queue_.empty() && cycle < cycles) {
+    Entry top = queue_.front();
+    if (!(top.key < calculateKey(start_i_)) &&
+        rhs_[start_i_] == g_[start_i_]) {
+      break;
+    }
+    std::pop_heap(queue_.begin(), queue_.end(), greater1());
+    queue_.pop_back();
+
+    int u = top.i;
+    if (g_[u] == rhs_[u]) {
+      continue;
+    }
+    Key key = calculateKey(u);
+    if (top.key < key) {
+      queue_.push_back(Entry(key, u));
+      std::push_heap(queue_.begin(), queue_.end(), greater1());
+      continue;
+    }
+
+    if (g_[u] > rhs_[u]) {
+      g_[u] = rhs_[u];
+    } else {
+      g_[u] = POT_HIGH;
+      updateVertex(u);
+    }
+    updateNeighbours(u);
+    cycle++;
+  }
+}
+} // namespace multigoal_planner
@@ -0,0 +1,62 @@
+#include <multigoal_planner/goal_potential_cache.h>
+
+namespace multigoal_planner {
+GoalPotentialCache::GoalPotentialCache()
+    : capacity_(0), bytes_(0), revision_(0) {}
+
+void GoalPotentialCache::setCapacity(size_t bytes) {
+  boost::mutex::scoped_lock lock(mutex_);
+  capacity_ = bytes;
+  evict(0);
+}
+
+void GoalPotentialCache::setRevision(uint64_t revision) {
+  boost::mutex::scoped_lock lock(mutex_);
+  if (revision != revision_) {
+    lru_.clear();
+    entries_.clear();
+    bytes_ = 0;
+    revision_ = revision;
+  }
+}
+
+boost::shared_ptr<GoalPotential>
+GoalPotentialCache::lookup(uint64_t goal_cell, size_t cells, bool create) {
+  boost::mutex::scoped_lock lock(mutex_);
+  auto entry_it = entries_.find(goal_cell);
+  if (entry_it != entries_.end()) {
+    lru_.splice(lru_.begin(), lru_, entry_it->second.lru_it);
+    return entry_it->second.potential;
+  }
+
+  size_t bytes = cells * sizeof(float);
+  if (!create || bytes > capacity_) {
+    return boost::shared_ptr<GoalPotential>();
+  }
+  evict(bytes);
+  lru_.push_front(goal_cell);
+  Entry &entry = entries_[goal_cell];
+  entry.potential.reset(new GoalPotential());
+  entry.bytes = bytes;
+  entry.lru_it = lru_.begin();
+  bytes_ += bytes;
+  return entry.potential;
+}
+
+void GoalPotentialCache::clear() {
+  boost::mutex::scoped_lock lock(mutex_);
+  lru_.clear();
+  entries_.clear();
+  bytes_ = 0;
+}
+
+void GoalPotentialCache::evict(size_t bytes) {
+  // potentials still used by a worker stay alive until it releases them
+  while (!lru_.empty() && bytes_ + bytes > capacity_) {
+    auto entry_it = entries_.find(lru_.back());
+    bytes_ -= entry_it->second.bytes;
+    entries_.erase(entry_it);
+    lru_.pop_back();
+  }
+}
+} // namespace multigoal_planner
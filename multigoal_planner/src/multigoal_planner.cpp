@@ -5,30 +5,140 @@
 #define PLANS_PUB_TOPIC "plans"
 #define PLANS_POSES_PUB_TOPIC "plans_poses"
 #define POTENTIAL_PUB_TOPIC "potential"
+#define MIN_ROI_MARGIN_CELLS 2
+#define COARSE_CORRIDOR_SAMPLE 0.5
+#define SHORTCUT_SAMPLE_CELLS 0.5
+#define WINDOW_GRID_SHRINK_FACTOR 4
+#define POTENTIAL_CACHE_FIELDS 4
+#define PLAN_CACHE_PERSIST_PERIOD 30.0 // s
 
 #include <multigoal_planner/multigoal_planner.h>
+#include <multigoal_planner/astar_expansion.h>
 #include <pluginlib/class_list_macros.h>
 #include <global_planner/dijkstra.h>
 #include <global_planner/gradient_path.h>
 #include <global_planner/grid_path.h>
 #include <global_planner/quadratic_calculator.h>
-#include <boost/range/adaptor/reversed.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
 
 PLUGINLIB_EXPORT_CLASS(multigoal_planner::MultiGoalPlanner,
                        move_humans::PlannerInterface)
 
 namespace multigoal_planner {
 MultiGoalPlanner::MultiGoalPlanner()
-    : tf_(NULL), costmap_ros_(NULL), initialized_(false), allow_unknown_(true) {
-}
+    : tf_(NULL), costmap_ros_(NULL), dsrv_(NULL), initialized_(false),
+      setup_(false), allow_unknown_(true), coarse_nx_(0), coarse_ny_(0),
+      coarse_factor_(0), coarse_version_(0), use_plan_cache_(false),
+      plan_cache_version_(0), plan_cache_map_hash_(0),
+      plan_cache_persist_period_(PLAN_CACHE_PERSIST_PERIOD) {}
 
 MultiGoalPlanner::MultiGoalPlanner(std::string name, tf::TransformListener *tf,
                                    costmap_2d::Costmap2DROS *costmap_ros)
-    : tf_(NULL), costmap_ros_(NULL), initialized_(false), allow_unknown_(true) {
+    : MultiGoalPlanner() {
   initialize(name, tf, costmap_ros);
 }
 
-MultiGoalPlanner::~MultiGoalPlanner() { delete dsrv_; }
+MultiGoalPlanner::~MultiGoalPlanner() {
+  delete dsrv_;
+
+  // plans added since the last periodic write are not lost
+  boost::mutex::scoped_lock lock(planning_mutex_);
+  persistPlanCache();
+}
+
+SearchGrid::SearchGrid(int nx, int ny, bool allow_unknown, int backend)
+    : nx(nx), ny(ny), backend(backend), allow_unknown(allow_unknown),
+      field_planner(NULL) {
+  p_calc = new global_planner::QuadraticCalculator(nx, ny);
+  switch (backend) {
+  case ASTAR_BACKEND:
+    planner = new EuclideanAStarExpansion(p_calc, nx, ny);
+    break;
+  case BIDIRECTIONAL_BACKEND:
+    planner = new BidirectionalAStarExpansion(p_calc, nx, ny);
+    break;
+  default:
+    planner = new global_planner::DijkstraExpansion(p_calc, nx, ny);
+    break;
+  }
+  planner->setHasUnknown(allow_unknown);
+  path_maker = new global_planner::GradientPath(p_calc);
+  path_maker->setSize(nx, ny);
+  path_maker_fallback = new global_planner::GridPath(p_calc);
+  path_maker_fallback->setSize(nx, ny);
+}
+
+SearchGrid::~SearchGrid() {
+  delete path_maker_fallback;
+  delete path_maker;
+  delete field_planner;
+  delete planner;
+  delete p_calc;
+}
+
+void SearchGrid::setSize(int nx, int ny) {
+  if (nx == this->nx && ny == this->ny) {
+    return;
+  }
+  this->nx = nx;
+  this->ny = ny;
+  p_calc->setSize(nx, ny);
+  planner->setSize(nx, ny);
+  if (field_planner) {
+    field_planner->setSize(nx, ny);
+  }
+  path_maker->setSize(nx, ny);
+  path_maker_fallback->setSize(nx, ny);
+}
+
+global_planner::Expander *SearchGrid::fieldPlanner() {
+  // goal directed expansions stop early, so keep a separate dijkstra
+  if (backend == DIJKSTRA_BACKEND) {
+    return planner;
+  }
+  if (!field_planner) {
+    field_planner = new global_planner::DijkstraExpansion(p_calc, nx, ny);
+    field_planner->setHasUnknown(allow_unknown);
+  }
+  return field_planner;
+}
+
+PlanningWorker::PlanningWorker(int nx, int ny, bool allow_unknown,
+                               int backend)
+    : backend(backend), map(nx, ny, allow_unknown, backend),
+      coarse(0, 0, allow_unknown, backend),
+      window(0, 0, allow_unknown, backend), potential_array(NULL) {
+  orientation_filter.setMode(global_planner::OrientationMode::FORWARD);
+}
+
+void PlanningWorker::setSize(int nx, int ny) {
+  if (nx == map.nx && ny == map.ny) {
+    return;
+  }
+  map.setSize(nx, ny);
+  // windows have to fit into the potential buffer of the costmap
+  if (window.nx > nx || window.ny > ny) {
+    window.setSize(0, 0);
+  }
+}
+
+SearchGrid &PlanningWorker::windowGrid(int nx, int ny) {
+  bool fits = nx <= window.nx && ny <= window.ny;
+  bool oversized = (size_t)window.nx * window.ny >
+                   WINDOW_GRID_SHRINK_FACTOR * (size_t)nx * ny;
+  if (!fits || oversized) {
+    int grid_nx = std::max(nx, window.nx), grid_ny = std::max(ny, window.ny);
+    if ((size_t)grid_nx * grid_ny >
+        WINDOW_GRID_SHRINK_FACTOR * (size_t)nx * ny) {
+      grid_nx = nx;
+      grid_ny = ny;
+    }
+    window.setSize(grid_nx, grid_ny);
+  }
+  return window;
+}
 
 void MultiGoalPlanner::initialize(std::string name, tf::TransformListener *tf,
                                   costmap_2d::Costmap2DROS *costmap_ros) {
@@ -37,15 +147,7 @@ void MultiGoalPlanner::initialize(std::string name, tf::TransformListener *tf,
     costmap_ros_ = costmap_ros;
     costmap_ = costmap_ros_->getCostmap();
     planner_frame_ = costmap_ros_->getGlobalFrameID();
-
-    auto cx = costmap_->getSizeInCellsX(), cy = costmap_->getSizeInCellsY();
-
-    p_calc_ = new global_planner::QuadraticCalculator(cx, cy);
-    planner_ = new global_planner::DijkstraExpansion(p_calc_, cx, cy);
-    path_maker_ = new global_planner::GradientPath(p_calc_);
-    path_maker_fallback_ = new global_planner::GridPath(p_calc_);
-    orientation_filter_ = new global_planner::OrientationFilter();
-    orientation_filter_->setMode(global_planner::OrientationMode::FORWARD);
+    snapshotter_.setCostmap(costmap_, true, costmap_2d::LETHAL_OBSTACLE);
 
     ros::NodeHandle private_nh("~/" + name);
     private_nh.param("convert_offset", convert_offset_,
@@ -57,7 +159,15 @@ void MultiGoalPlanner::initialize(std::string name, tf::TransformListener *tf,
                      SQ_DIST_PLAN_THRESHOLD);
     private_nh.param("publish_scale", publish_scale_, 100);
 
-    planner_->setHasUnknown(allow_unknown_);
+    std::string plan_cache_dir;
+    private_nh.param("plan_cache_dir", plan_cache_dir, std::string(""));
+    private_nh.param("plan_cache_persist_period", plan_cache_persist_period_,
+                     PLAN_CACHE_PERSIST_PERIOD);
+    if (!plan_cache_dir.empty() && plan_cache_.open(plan_cache_dir)) {
+      ROS_INFO_NAMED(NODE_NAME, "Loaded %ld cached plans from %ld files in %s",
+                     plan_cache_.size(), plan_cache_.files(),
+                     plan_cache_dir.c_str());
+    }
 
     ros::NodeHandle prefix_nh;
     tf_prefix_ = tf::getPrefixParam(prefix_nh);
@@ -81,6 +191,40 @@ void MultiGoalPlanner::initialize(std::string name, tf::TransformListener *tf,
   }
 }
 
+void MultiGoalPlanner::initialize(std::string name,
+                                  costmap_2d::Costmap2D *costmap,
+                                  std::string global_frame) {
+  if (!initialized_) {
+    costmap_ = costmap;
+    planner_frame_ = global_frame;
+    snapshotter_.setCostmap(costmap_, true, costmap_2d::LETHAL_OBSTACLE);
+
+    convert_offset_ = CONVERT_OFFSET;
+    allow_unknown_ = true;
+    default_tolerance_ = DEFAULT_TOLERANCE;
+    sq_dist_plan_threshold_ = SQ_DIST_PLAN_THRESHOLD;
+    publish_scale_ = 100;
+
+    auto config = MultiGoalPlannerConfig::__getDefault__();
+    config.publish_human_plans = false;
+    config.publish_human_poses = false;
+    config.publish_potential = false;
+    default_config_ = config;
+    last_config_ = config;
+    setup_ = true;
+
+    initialized_ = true;
+  } else {
+    ROS_WARN_NAMED(NODE_NAME, "This planner has already been initialized, you "
+                              "can't call it twice, doing nothing");
+  }
+}
+
+void MultiGoalPlanner::setConfig(const MultiGoalPlannerConfig &config) {
+  boost::mutex::scoped_lock l(configuration_mutex_);
+  last_config_ = config;
+}
+
 void MultiGoalPlanner::reconfigureCB(MultiGoalPlannerConfig &config,
                                      uint32_t level) {
   boost::mutex::scoped_lock l(configuration_mutex_);
@@ -107,6 +251,22 @@ bool MultiGoalPlanner::makePlans(const move_humans::map_pose &starts,
                                  const move_humans::map_pose_vector &sub_goals,
                                  const move_humans::map_pose &goals,
                                  move_humans::map_pose_vectors &plans) {
+  return planHumans(starts, sub_goals, goals, plans, PlansCallback());
+}
+
+bool MultiGoalPlanner::submitPlans(
+    const move_humans::map_pose &starts,
+    const move_humans::map_pose_vector &sub_goals,
+    const move_humans::map_pose &goals, const PlansCallback &plans_cb) {
+  move_humans::map_pose_vectors plans;
+  return planHumans(starts, sub_goals, goals, plans, plans_cb);
+}
+
+bool MultiGoalPlanner::planHumans(const move_humans::map_pose &starts,
+                                  const move_humans::map_pose_vector &sub_goals,
+                                  const move_humans::map_pose &goals,
+                                  move_humans::map_pose_vectors &plans,
+                                  const PlansCallback &plans_cb) {
   boost::mutex::scoped_lock lock(planning_mutex_);
   auto tolerance = default_tolerance_;
 
@@ -136,164 +296,733 @@ bool MultiGoalPlanner::makePlans(const move_humans::map_pose &starts,
 
   plans.clear();
 
-  int nx = costmap_->getSizeInCellsX(), ny = costmap_->getSizeInCellsY();
-  p_calc_->setSize(nx, ny);
-  planner_->setSize(nx, ny);
-  path_maker_->setSize(nx, ny);
-  path_maker_fallback_->setSize(nx, ny);
-  potential_array_ = new float[nx * ny];
+  {
+    boost::mutex::scoped_lock l(configuration_mutex_);
+    planning_config_ = last_config_;
+  }
+
+  // the snapshot is already outlined, it is copied only if the costmap
+  // changed since the last call
+  snapshot_ = snapshotter_.update();
+  if (!snapshot_) {
+    ROS_ERROR_NAMED(NODE_NAME, "No costmap to plan on");
+    return false;
+  }
 
-  outlineMap(costmap_->getCharMap(), nx, ny, costmap_2d::LETHAL_OBSTACLE);
+  int nx = snapshot_->getSizeInCellsX(), ny = snapshot_->getSizeInCellsY();
+  setupWorkers(planning_config_.planning_threads,
+               planning_config_.search_backend, nx, ny);
 
-  move_humans::map_pose_vector combined_plans;
-  for (auto start_kv : starts) {
-    auto &human_id = start_kv.first;
-    ROS_DEBUG_NAMED(NODE_NAME, "Planning for humans %ld", human_id);
-    auto &start = start_kv.second;
-    auto &goal = goals.find(human_id)->second;
-    auto &sub_goal_vector = (sub_goals.find(human_id) != sub_goals.end())
-                                ? sub_goals.find(human_id)->second
-                                : move_humans::pose_vector();
-
-    if (tf::resolve(tf_prefix_, start.header.frame_id) !=
-        tf::resolve(tf_prefix_, planner_frame_)) {
-      ROS_ERROR_NAMED(NODE_NAME, "The start pose must be in the %s frame; for "
-                                 "human %ld, it is instead in the %s frame",
-                      tf::resolve(tf_prefix_, planner_frame_).c_str(), human_id,
-                      tf::resolve(tf_prefix_, start.header.frame_id).c_str());
-      continue;
+  if (planning_config_.potential_cache) {
+    // without a size the cache holds a few potentials of this costmap
+    size_t field_bytes = (size_t)nx * ny * sizeof(float);
+    size_t capacity = planning_config_.potential_cache_size * 1024 * 1024;
+    if (capacity == 0) {
+      capacity = POTENTIAL_CACHE_FIELDS * field_bytes;
+    } else if (capacity < field_bytes) {
+      ROS_WARN_THROTTLE_NAMED(60.0, NODE_NAME,
+                              "potential_cache_size of %.1f MB can not hold "
+                              "the potential of a goal, which needs %.1f MB",
+                              planning_config_.potential_cache_size,
+                              field_bytes / (1024.0 * 1024.0));
     }
-    if (tf::resolve(tf_prefix_, goal.header.frame_id) !=
-        tf::resolve(tf_prefix_, planner_frame_)) {
-      ROS_ERROR_NAMED(NODE_NAME, "The goal pose must be in the %s frame; for "
-                                 "human %ld, it is instead in the %s frame",
-                      tf::resolve(tf_prefix_, planner_frame_).c_str(), human_id,
-                      tf::resolve(tf_prefix_, goal.header.frame_id).c_str());
-      continue;
+    potential_cache_.setCapacity(capacity);
+    potential_cache_.setRevision(snapshot_->getVersion());
+    countGoalUses(starts, sub_goals, goals, nx);
+  } else {
+    potential_cache_.clear();
+    goal_uses_.clear();
+  }
+
+  if (planning_config_.coarse_planning) {
+    downsampleCostmap(planning_config_.coarse_factor);
+  } else {
+    coarse_costs_.clear();
+    coarse_factor_ = 0;
+  }
+
+  use_plan_cache_ = planning_config_.plan_cache && plan_cache_.isOpen();
+  if (use_plan_cache_) {
+    selectPlanCache();
+  }
+
+  // searches are only touched by the worker planning for their human, so all
+  // of them are added before planning, humans missing from a call keep their
+  // searches as partial passes only plan some of them
+  {
+    boost::mutex::scoped_lock l(removed_humans_mutex_);
+    for (auto human_id : removed_humans_) {
+      incremental_searches_.erase(human_id);
     }
-    bool valid_sub_goals = true;
-    for (auto &sub_goal : sub_goal_vector) {
-      if (tf::resolve(tf_prefix_, sub_goal.header.frame_id) !=
-          tf::resolve(tf_prefix_, planner_frame_)) {
-        ROS_ERROR_NAMED(
-            NODE_NAME, "The sub-goal pose must be in the %s frame; for human "
-                       "%ld, it is instead in the %s frame",
-            tf::resolve(tf_prefix_, planner_frame_).c_str(), human_id,
-            tf::resolve(tf_prefix_, sub_goal.header.frame_id).c_str());
-        valid_sub_goals = false;
-        break;
-      }
+    removed_humans_.clear();
+  }
+  if (planning_config_.incremental_replanning) {
+    for (auto &start_kv : starts) {
+      incremental_searches_[start_kv.first];
     }
-    if (!valid_sub_goals) {
-      continue;
+  } else {
+    incremental_searches_.clear();
+  }
+
+  // plan for each human on a free worker, results are kept per human index so
+  // that they can be merged in the order of human ids, and are given to the
+  // callback from the worker as soon as they are found
+  const move_humans::pose_vector no_sub_goals;
+  std::vector<const move_humans::map_pose::value_type *> humans;
+  for (auto &start_kv : starts) {
+    humans.push_back(&start_kv);
+  }
+  std::vector<move_humans::pose_vectors> plan_vectors(humans.size());
+  std::vector<char> planned(humans.size(), false);
+
+  planning_pool_.parallelFor(
+      humans.size(), 1, [&](size_t begin, size_t end, size_t worker_index) {
+        auto &worker = *workers_[worker_index];
+        for (auto i = begin; i < end; i++) {
+          auto &human_id = humans[i]->first;
+          auto &start = humans[i]->second;
+          auto &goal = goals.find(human_id)->second;
+          auto sub_goals_it = sub_goals.find(human_id);
+          auto &sub_goal_vector = (sub_goals_it != sub_goals.end())
+                                      ? sub_goals_it->second
+                                      : no_sub_goals;
+          auto searches_it = incremental_searches_.find(human_id);
+          MOVE_HUMANS_PROFILE_SCOPE("multigoal_planner/make_human_plan");
+          planned[i] = makeHumanPlan(
+              worker, human_id, start, sub_goal_vector, goal, plan_vectors[i],
+              (searches_it != incremental_searches_.end())
+                  ? &searches_it->second
+                  : NULL);
+          if (planned[i] && plans_cb) {
+            plans_cb(human_id, plan_vectors[i]);
+          }
+        }
+      });
+
+  for (size_t i = 0; i < humans.size(); i++) {
+    if (planned[i]) {
+      plans[humans[i]->first].swap(plan_vectors[i]);
     }
+  }
+
+  // the whole file is written again, so new plans are collected for a while
+  if (use_plan_cache_ &&
+      ros::WallTime::now() - last_plan_cache_persist_ >=
+          ros::WallDuration(plan_cache_persist_period_)) {
+    persistPlanCache();
+  }
 
-    double valid_point_x, valid_point_y;
-    std::vector<double> points_x, points_y;
+  publishPlans(plans);
 
-    if (!worldToMap(start.pose.position.x, start.pose.position.y, valid_point_x,
-                    valid_point_y)) {
-      ROS_WARN_NAMED(NODE_NAME,
-                     "Start position of human %ld is off the global costmap",
-                     human_id);
-      continue;
+  return !plans.empty();
+}
+
+bool MultiGoalPlanner::removeHumans(const move_humans::id_vector &human_ids) {
+  // the searches may be in use by a running call
+  boost::mutex::scoped_lock l(removed_humans_mutex_);
+  removed_humans_.insert(human_ids.begin(), human_ids.end());
+  return true;
+}
+
+void MultiGoalPlanner::setupWorkers(int num_threads, int backend, int nx,
+                                    int ny) {
+  planning_pool_.resize(num_threads);
+  for (auto &worker : workers_) {
+    if (worker->backend != backend) {
+      worker.reset(new PlanningWorker(nx, ny, allow_unknown_, backend));
     }
-    points_x.push_back(valid_point_x);
-    points_y.push_back(valid_point_y);
-    for (auto &sub_goal : sub_goal_vector) {
-      if (!worldToMap(sub_goal.pose.position.x, sub_goal.pose.position.y,
-                      valid_point_x, valid_point_y)) {
-        ROS_WARN_NAMED(
-            NODE_NAME,
-            "Sub-goal position of human %ld is off the global costmap",
-            human_id);
-        continue;
+  }
+  while (workers_.size() < planning_pool_.size()) {
+    workers_.push_back(boost::shared_ptr<PlanningWorker>(
+        new PlanningWorker(nx, ny, allow_unknown_, backend)));
+  }
+  workers_.resize(planning_pool_.size());
+
+  if (potential_buffers_.resize(workers_.size(), nx, ny)) {
+    ROS_DEBUG_NAMED(NODE_NAME, "Allocated potential buffers for %ld workers of "
+                               "%d x %d cells",
+                    workers_.size(), nx, ny);
+  }
+  for (size_t i = 0; i < workers_.size(); i++) {
+    workers_[i]->setSize(nx, ny);
+    workers_[i]->potential_array = potential_buffers_.get(i);
+  }
+}
+
+void MultiGoalPlanner::countGoalUses(
+    const move_humans::map_pose &starts,
+    const move_humans::map_pose_vector &sub_goals,
+    const move_humans::map_pose &goals, int nx) {
+  goal_uses_.clear();
+  double mx, my;
+  for (auto &start_kv : starts) {
+    auto sub_goals_it = sub_goals.find(start_kv.first);
+    if (sub_goals_it != sub_goals.end()) {
+      for (auto &sub_goal : sub_goals_it->second) {
+        if (worldToMap(sub_goal.pose.position.x, sub_goal.pose.position.y, mx,
+                       my)) {
+          goal_uses_[(uint64_t)((int)my) * nx + (int)mx]++;
+        }
       }
-      points_x.push_back(valid_point_x);
-      points_y.push_back(valid_point_y);
     }
-    if (!worldToMap(goal.pose.position.x, goal.pose.position.y, valid_point_x,
-                    valid_point_y)) {
+    auto &goal = goals.find(start_kv.first)->second;
+    if (worldToMap(goal.pose.position.x, goal.pose.position.y, mx, my)) {
+      goal_uses_[(uint64_t)((int)my) * nx + (int)mx]++;
+    }
+  }
+}
+
+bool MultiGoalPlanner::makeHumanPlan(
+    PlanningWorker &worker, uint64_t human_id,
+    const geometry_msgs::PoseStamped &start,
+    const move_humans::pose_vector &sub_goal_vector,
+    const geometry_msgs::PoseStamped &goal,
+    move_humans::pose_vectors &plan_vector, segment_searches *searches) {
+  ROS_DEBUG_NAMED(NODE_NAME, "Planning for humans %ld", human_id);
+  if (tf::resolve(tf_prefix_, start.header.frame_id) !=
+      tf::resolve(tf_prefix_, planner_frame_)) {
+    ROS_ERROR_NAMED(NODE_NAME, "The start pose must be in the %s frame; for "
+                               "human %ld, it is instead in the %s frame",
+                    tf::resolve(tf_prefix_, planner_frame_).c_str(), human_id,
+                    tf::resolve(tf_prefix_, start.header.frame_id).c_str());
+    return false;
+  }
+  if (tf::resolve(tf_prefix_, goal.header.frame_id) !=
+      tf::resolve(tf_prefix_, planner_frame_)) {
+    ROS_ERROR_NAMED(NODE_NAME, "The goal pose must be in the %s frame; for "
+                               "human %ld, it is instead in the %s frame",
+                    tf::resolve(tf_prefix_, planner_frame_).c_str(), human_id,
+                    tf::resolve(tf_prefix_, goal.header.frame_id).c_str());
+    return false;
+  }
+  for (auto &sub_goal : sub_goal_vector) {
+    if (tf::resolve(tf_prefix_, sub_goal.header.frame_id) !=
+        tf::resolve(tf_prefix_, planner_frame_)) {
+      ROS_ERROR_NAMED(
+          NODE_NAME, "The sub-goal pose must be in the %s frame; for human "
+                     "%ld, it is instead in the %s frame",
+          tf::resolve(tf_prefix_, planner_frame_).c_str(), human_id,
+          tf::resolve(tf_prefix_, sub_goal.header.frame_id).c_str());
+      return false;
+    }
+  }
+
+  double valid_point_x, valid_point_y;
+  std::vector<double> points_x, points_y;
+
+  if (!worldToMap(start.pose.position.x, start.pose.position.y, valid_point_x,
+                  valid_point_y)) {
+    ROS_WARN_NAMED(NODE_NAME,
+                   "Start position of human %ld is off the global costmap",
+                   human_id);
+    return false;
+  }
+  points_x.push_back(valid_point_x);
+  points_y.push_back(valid_point_y);
+  for (auto &sub_goal : sub_goal_vector) {
+    if (!worldToMap(sub_goal.pose.position.x, sub_goal.pose.position.y,
+                    valid_point_x, valid_point_y)) {
       ROS_WARN_NAMED(NODE_NAME,
-                     "Goal position of human %ld is off the global costmap",
+                     "Sub-goal position of human %ld is off the global costmap",
                      human_id);
       continue;
     }
     points_x.push_back(valid_point_x);
     points_y.push_back(valid_point_y);
+  }
+  if (!worldToMap(goal.pose.position.x, goal.pose.position.y, valid_point_x,
+                  valid_point_y)) {
+    ROS_WARN_NAMED(NODE_NAME,
+                   "Goal position of human %ld is off the global costmap",
+                   human_id);
+    return false;
+  }
+  points_x.push_back(valid_point_x);
+  points_y.push_back(valid_point_y);
 
-    if (points_x.size() < 2 || points_x.size() != points_y.size()) {
-      continue;
+  if (points_x.size() < 2 || points_x.size() != points_y.size()) {
+    return false;
+  }
+
+  if (searches) {
+    searches->resize(points_x.size() - 1);
+  }
+  // segments stay compact until they are handed out as poses
+  move_humans::CompactPath::SegmentCheck segment_free;
+  if (planning_config_.simplify_costmap_aware) {
+    segment_free =
+        boost::bind(&MultiGoalPlanner::isShortcutFree, this, _1, _2, _3);
+  }
+  move_humans::CompactPath plan;
+  for (auto i = 0; i < (points_x.size() - 1); i++) {
+    plan.clear();
+    if (planSegment(worker, points_x[i], points_y[i], points_x[i + 1],
+                    points_y[i + 1], plan,
+                    searches ? &(*searches)[i] : NULL)) {
+      plan.simplify(planning_config_.simplify_tolerance, segment_free);
+      plan_vector.emplace_back();
+      plan.toPoses(plan_vector.back());
+    } else {
+      ROS_ERROR_NAMED(NODE_NAME, "Failed to plan for human %ld", human_id);
+      plan_vector.clear();
+      break;
     }
+  }
 
-    move_humans::pose_vectors plan_vector;
-    move_humans::pose_vector combined_plan;
-    for (auto i = 0; i < (points_x.size() - 1); i++) {
-      bool found_legal = planner_->calculatePotentials(
-          costmap_->getCharMap(), points_x[i], points_y[i], points_x[i + 1],
-          points_y[i + 1], nx * ny * 2, potential_array_);
-
-      if (found_legal) {
-        move_humans::pose_vector plan;
-        if (getPlanFromPotential(points_x[i], points_y[i], points_x[i + 1],
-                                 points_y[i + 1], plan)) {
-          plan_vector.push_back(plan);
-          combined_plan.insert(combined_plan.end(), plan.begin(), plan.end());
-
-        } else {
-          ROS_ERROR_NAMED(NODE_NAME, "Failed to get a plan from potential when "
-                                     "a legal potential was found");
-          combined_plan.clear();
-          plan_vector.clear();
-          break;
-        }
-      } else {
-        ROS_ERROR_NAMED(NODE_NAME, "Failed to plan for human %ld", human_id);
-        combined_plan.clear();
-        plan_vector.clear();
+  if (plan_vector.empty()) {
+    return false;
+  }
+
+  geometry_msgs::PoseStamped goal_copy = goal;
+  goal_copy.header.stamp = ros::Time::now();
+  plan_vector.back().push_back(goal_copy);
+  for (auto &plan : plan_vector) {
+    if (!plan.empty()) {
+      worker.orientation_filter.processPath(plan.front(), plan);
+    }
+  }
+  ROS_DEBUG_NAMED(NODE_NAME, "Added %ld plans for %ld human",
+                  plan_vector.size(), human_id);
+  return true;
+}
+
+void MultiGoalPlanner::persistPlanCache() {
+  last_plan_cache_persist_ = ros::WallTime::now();
+  auto added = plan_cache_.persist();
+  if (added > 0) {
+    ROS_DEBUG_NAMED(NODE_NAME, "Added %ld plans to the plan cache", added);
+  }
+}
+
+void MultiGoalPlanner::selectPlanCache() {
+  using move_humans::CacheFile;
+
+  // costs are only hashed again when the snapshot changed
+  int nx = snapshot_->getSizeInCellsX(), ny = snapshot_->getSizeInCellsY();
+  if (plan_cache_version_ != snapshot_->getVersion() ||
+      plan_cache_map_hash_ == 0) {
+    auto map_hash = CacheFile::hash(snapshot_->getCharMap(), (size_t)nx * ny);
+    map_hash = CacheFile::hashValue(nx, map_hash);
+    map_hash = CacheFile::hashValue(ny, map_hash);
+    map_hash = CacheFile::hashValue(snapshot_->getResolution(), map_hash);
+    map_hash = CacheFile::hashValue(snapshot_->getOriginX(), map_hash);
+    map_hash = CacheFile::hashValue(snapshot_->getOriginY(), map_hash);
+    plan_cache_map_hash_ = map_hash;
+    plan_cache_version_ = snapshot_->getVersion();
+  }
+
+  // every parameter that changes which plan is found for a segment
+  auto &config = planning_config_;
+  auto params_hash = CacheFile::hash(&convert_offset_, sizeof(float));
+  params_hash = CacheFile::hashValue(allow_unknown_, params_hash);
+  params_hash = CacheFile::hashValue(config.search_backend, params_hash);
+  params_hash = CacheFile::hashValue(config.potential_cache, params_hash);
+  params_hash = CacheFile::hashValue(config.roi_planning, params_hash);
+  if (config.roi_planning) {
+    params_hash = CacheFile::hashValue(config.roi_margin, params_hash);
+    params_hash = CacheFile::hashValue(config.roi_growth, params_hash);
+  }
+  params_hash = CacheFile::hashValue(config.coarse_planning, params_hash);
+  if (config.coarse_planning) {
+    params_hash = CacheFile::hashValue(config.coarse_factor, params_hash);
+    params_hash = CacheFile::hashValue(config.coarse_corridor, params_hash);
+  }
+  plan_cache_.select(plan_cache_map_hash_, params_hash);
+}
+
+bool MultiGoalPlanner::planSegment(PlanningWorker &worker, double start_x,
+                                   double start_y, double goal_x,
+                                   double goal_y,
+                                   move_humans::CompactPath &plan,
+                                   boost::shared_ptr<DStarLite> *search) {
+  // incremental searches have to see every call, so they are never cached
+  if (!use_plan_cache_ || search) {
+    return searchSegment(worker, start_x, start_y, goal_x, goal_y, plan,
+                         search);
+  }
+
+  unsigned int nx = snapshot_->getSizeInCellsX();
+  uint32_t start_cell = (uint32_t)start_y * nx + (uint32_t)start_x;
+  uint32_t goal_cell = (uint32_t)goal_y * nx + (uint32_t)goal_x;
+  plan.frame_id = planner_frame_;
+  plan.stamp = ros::Time::now();
+  if (plan_cache_.lookup(start_cell, goal_cell, plan)) {
+    return true;
+  }
+  if (!searchSegment(worker, start_x, start_y, goal_x, goal_y, plan, NULL)) {
+    return false;
+  }
+  plan_cache_.insert(start_cell, goal_cell, plan);
+  return true;
+}
+
+bool MultiGoalPlanner::searchSegment(PlanningWorker &worker, double start_x,
+                                     double start_y, double goal_x,
+                                     double goal_y,
+                                     move_humans::CompactPath &plan,
+                                     boost::shared_ptr<DStarLite> *search) {
+  int nx = snapshot_->getSizeInCellsX(), ny = snapshot_->getSizeInCellsY();
+
+  // repair the search of the previous call, if nothing is found the segment
+  // is planned from scratch
+  if (search) {
+    if (planIncremental(worker, *search, start_x, start_y, goal_x, goal_y,
+                        plan)) {
+      return true;
+    }
+    plan.clear();
+  }
+
+  // segments ending in a goal shared with other segments are traced back on a
+  // potential rooted at that goal, which is computed only once
+  if (planning_config_.potential_cache && !search) {
+    uint64_t goal_cell = (uint64_t)((int)goal_y) * nx + (int)goal_x;
+    auto uses_it = goal_uses_.find(goal_cell);
+    bool shared = uses_it != goal_uses_.end() && uses_it->second > 1;
+    auto goal_potential =
+        potential_cache_.lookup(goal_cell, (size_t)nx * ny, shared);
+    if (goal_potential &&
+        planOnGoalPotential(worker, *goal_potential, start_x, start_y, goal_x,
+                            goal_y, plan)) {
+      return true;
+    }
+    plan.clear();
+  }
+
+  // route on the downsampled costmap, then expand only in a corridor around
+  // the coarse route
+  if (planning_config_.coarse_planning && !coarse_costs_.empty()) {
+    if (planCoarseToFine(worker, start_x, start_y, goal_x, goal_y, plan)) {
+      return true;
+    }
+    ROS_DEBUG_NAMED(NODE_NAME, "Coarse-to-fine planning failed, planning at "
+                               "full resolution");
+    plan.clear();
+  }
+
+  // expand only around the segment, growing the window until a plan is found
+  // or the window covers the whole costmap
+  if (planning_config_.roi_planning) {
+    double margin = std::max(planning_config_.roi_margin /
+                                 snapshot_->getResolution(),
+                             (double)MIN_ROI_MARGIN_CELLS);
+    while (true) {
+      CellWindow window =
+          segmentWindow(start_x, start_y, goal_x, goal_y, margin);
+      if (window.nx == nx && window.ny == ny) {
         break;
       }
+      if (planInWindow(worker, window, start_x, start_y, goal_x, goal_y,
+                       plan)) {
+        return true;
+      }
+      ROS_DEBUG_NAMED(NODE_NAME, "No plan found inside %d x %d window, "
+                                 "growing it",
+                      window.nx, window.ny);
+      plan.clear();
+      margin *= planning_config_.roi_growth;
     }
+  }
+
+  CellWindow window = {0, 0, nx, ny};
+  // expanders do not modify the costs
+  if (!worker.map.planner->calculatePotentials(
+          const_cast<unsigned char *>(snapshot_->getCharMap()), start_x,
+          start_y, goal_x, goal_y, nx * ny * 2, worker.potential_array)) {
+    return false;
+  }
+  if (!getPlanFromPotential(worker.map, worker.potential_array, window,
+                            start_x, start_y, goal_x, goal_y, plan)) {
+    ROS_ERROR_NAMED(NODE_NAME, "Failed to get a plan from potential when a "
+                               "legal potential was found");
+    return false;
+  }
+  return true;
+}
 
-    if (!combined_plan.empty()) {
-      geometry_msgs::PoseStamped goal_copy = goal;
-      goal_copy.header.stamp = ros::Time::now();
-      combined_plan.push_back(goal_copy);
-      orientation_filter_->processPath(combined_plan.front(), combined_plan);
+CellWindow MultiGoalPlanner::segmentWindow(double start_x, double start_y,
+                                           double goal_x, double goal_y,
+                                           double margin) {
+  int nx = snapshot_->getSizeInCellsX(), ny = snapshot_->getSizeInCellsY();
+  int x0 = std::max((int)(std::min(start_x, goal_x) - margin), 0);
+  int y0 = std::max((int)(std::min(start_y, goal_y) - margin), 0);
+  int x1 =
+      std::min((int)std::ceil(std::max(start_x, goal_x) + margin), nx - 1);
+  int y1 =
+      std::min((int)std::ceil(std::max(start_y, goal_y) + margin), ny - 1);
+  CellWindow window = {x0, y0, x1 - x0 + 1, y1 - y0 + 1};
+  return window;
+}
 
-      plan_vector.back().push_back(goal_copy);
-      for (auto &plan : plan_vector) {
-        if (!plan.empty()) {
-          orientation_filter_->processPath(plan.front(), plan);
-        }
+bool MultiGoalPlanner::planIncremental(PlanningWorker &worker,
+                                       boost::shared_ptr<DStarLite> &search,
+                                       double start_x, double start_y,
+                                       double goal_x, double goal_y,
+                                       move_humans::CompactPath &plan) {
+  int nx = snapshot_->getSizeInCellsX(), ny = snapshot_->getSizeInCellsY();
+  if (!search || !search->matches(nx, ny, goal_x, goal_y, start_x, start_y)) {
+    // searches span the first planning window of the segment, they are
+    // started again once the start leaves it
+    CellWindow window = {0, 0, nx, ny};
+    if (planning_config_.roi_planning) {
+      window = segmentWindow(start_x, start_y, goal_x, goal_y,
+                             std::max(planning_config_.roi_margin /
+                                          snapshot_->getResolution(),
+                                      (double)MIN_ROI_MARGIN_CELLS));
+    }
+    search.reset(
+        new DStarLite(window, nx, ny, goal_x, goal_y, allow_unknown_));
+    ROS_DEBUG_NAMED(NODE_NAME, "Started incremental search in %d x %d window",
+                    window.nx, window.ny);
+  }
+
+  auto &window = search->window();
+  if (!search->update(snapshot_->getCharMap(), snapshot_->getVersion(),
+                      start_x, start_y, window.nx * window.ny * 2)) {
+    search.reset();
+    return false;
+  }
+  // the potential of the search is padded to the window grid, cells outside
+  // of the search are unreachable
+  auto &grid = worker.windowGrid(window.nx, window.ny);
+  auto potential = search->potential();
+  for (int y = 0; y < grid.ny; y++) {
+    float *row = worker.potential_array + (size_t)y * grid.nx;
+    int copied = 0;
+    if (y < window.ny) {
+      std::memcpy(row, potential + (size_t)y * window.nx,
+                  window.nx * sizeof(float));
+      copied = window.nx;
+    }
+    std::fill(row + copied, row + grid.nx, POT_HIGH);
+  }
+  CellWindow grid_window = {window.x0, window.y0, grid.nx, grid.ny};
+  return getPlanFromPotential(grid, worker.potential_array, grid_window,
+                              start_x - window.x0, start_y - window.y0,
+                              goal_x - window.x0, goal_y - window.y0, plan,
+                              true);
+}
+
+bool MultiGoalPlanner::planOnGoalPotential(PlanningWorker &worker,
+                                           GoalPotential &goal_potential,
+                                           double start_x, double start_y,
+                                           double goal_x, double goal_y,
+                                           move_humans::CompactPath &plan) {
+  int nx = snapshot_->getSizeInCellsX(), ny = snapshot_->getSizeInCellsY();
+  CellWindow window = {0, 0, nx, ny};
+
+  boost::mutex::scoped_lock lock(goal_potential.mutex);
+  if (!goal_potential.computed) {
+    // there is no end to reach, so the expansion covers every cell reachable
+    // from the goal, the border cell used as end is always lethal, so the
+    // expander empties its queue and reports a failure for a complete field
+    goal_potential.potential.resize((size_t)nx * ny);
+    worker.map.fieldPlanner()->calculatePotentials(
+        const_cast<unsigned char *>(snapshot_->getCharMap()), goal_x, goal_y,
+        0, 0, nx * ny * 2, goal_potential.potential.data());
+    goal_potential.computed = true;
+    ROS_DEBUG_NAMED(NODE_NAME, "Computed potential rooted at goal (%.1f, %.1f)",
+                    goal_x, goal_y);
+  }
+  lock.unlock();
+
+  // starts the expansion did not reach are planned by the other searches
+  if (goal_potential.potential[(size_t)((int)start_y) * nx + (int)start_x] >=
+      POT_HIGH) {
+    return false;
+  }
+  return getPlanFromPotential(worker.map, goal_potential.potential.data(),
+                              window, start_x, start_y, goal_x, goal_y, plan,
+                              true);
+}
+
+void MultiGoalPlanner::downsampleCostmap(int factor) {
+  if (coarse_version_ == snapshot_->getVersion() && coarse_factor_ == factor &&
+      !coarse_costs_.empty()) {
+    return;
+  }
+  int nx = snapshot_->getSizeInCellsX(), ny = snapshot_->getSizeInCellsY();
+  auto costs = snapshot_->getCharMap();
+  coarse_nx_ = (nx + factor - 1) / factor;
+  coarse_ny_ = (ny + factor - 1) / factor;
+  coarse_costs_.assign(coarse_nx_ * coarse_ny_, costmap_2d::FREE_SPACE);
+
+  // every coarse cell gets the highest cost of its cells, unknown cells only
+  // count if there is no obstacle in them, so that coarse routes never cross
+  // walls thinner than a coarse cell
+  std::vector<char> unknown(coarse_costs_.size(), false);
+  for (int y = 0; y < ny; y++) {
+    const unsigned char *row = costs + y * nx;
+    unsigned char *coarse_row = &coarse_costs_[(y / factor) * coarse_nx_];
+    char *unknown_row = &unknown[(y / factor) * coarse_nx_];
+    for (int x = 0; x < nx; x++) {
+      if (row[x] == costmap_2d::NO_INFORMATION) {
+        unknown_row[x / factor] = true;
+      } else if (row[x] > coarse_row[x / factor]) {
+        coarse_row[x / factor] = row[x];
       }
-      plans[human_id] = plan_vector;
-      combined_plans[human_id] = combined_plan;
-      ROS_DEBUG_NAMED(NODE_NAME, "Added %ld plans for %ld human",
-                      plan_vector.size(), human_id);
     }
   }
+  for (size_t i = 0; i < coarse_costs_.size(); i++) {
+    if (unknown[i] &&
+        coarse_costs_[i] < costmap_2d::INSCRIBED_INFLATED_OBSTACLE) {
+      coarse_costs_[i] = costmap_2d::NO_INFORMATION;
+    }
+  }
+  outlineMap(coarse_costs_.data(), coarse_nx_, coarse_ny_,
+             costmap_2d::LETHAL_OBSTACLE, coarse_nx_);
 
-  delete potential_array_;
-  publishPlans(combined_plans);
+  coarse_factor_ = factor;
+  coarse_version_ = snapshot_->getVersion();
+  ROS_DEBUG_NAMED(NODE_NAME, "Downsampled costmap to %d x %d cells",
+                  coarse_nx_, coarse_ny_);
+}
 
-  return !plans.empty();
+bool MultiGoalPlanner::planCoarseToFine(PlanningWorker &worker,
+                                        double start_x, double start_y,
+                                        double goal_x, double goal_y,
+                                        move_humans::CompactPath &plan) {
+  int nx = snapshot_->getSizeInCellsX(), ny = snapshot_->getSizeInCellsY();
+  double factor = coarse_factor_;
+
+  double c_start_x = start_x / factor, c_start_y = start_y / factor,
+         c_goal_x = goal_x / factor, c_goal_y = goal_y / factor;
+  auto &coarse = worker.coarse;
+  coarse.setSize(coarse_nx_, coarse_ny_);
+  if (!coarse.planner->calculatePotentials(
+          coarse_costs_.data(), c_start_x, c_start_y, c_goal_x, c_goal_y,
+          coarse_nx_ * coarse_ny_ * 2, worker.potential_array)) {
+    return false;
+  }
+  std::vector<std::pair<float, float>> coarse_path;
+  if (!coarse.path_maker->getPath(worker.potential_array, c_start_x,
+                                  c_start_y, c_goal_x, c_goal_y,
+                                  coarse_path)) {
+    coarse_path.clear();
+    if (!coarse.path_maker_fallback->getPath(worker.potential_array,
+                                             c_start_x, c_start_y, c_goal_x,
+                                             c_goal_y, coarse_path)) {
+      return false;
+    }
+  }
+
+  // the corridor covers every fine cell closer than its radius to the coarse
+  // route, sampled densely enough for the squares around samples to overlap
+  std::vector<std::pair<double, double>> samples;
+  samples.push_back(std::make_pair(start_x, start_y));
+  for (auto &point : coarse_path) {
+    samples.push_back(std::make_pair((point.first + 0.5) * factor - 0.5,
+                                     (point.second + 0.5) * factor - 0.5));
+  }
+  samples.push_back(std::make_pair(goal_x, goal_y));
+
+  int radius = std::max(
+      (int)std::ceil(planning_config_.coarse_corridor /
+                     snapshot_->getResolution()),
+      MIN_ROI_MARGIN_CELLS);
+  radius += coarse_factor_;
+  int x0 = nx, y0 = ny, x1 = 0, y1 = 0;
+  for (auto &sample : samples) {
+    x0 = std::min(x0, std::max((int)sample.first - radius, 0));
+    y0 = std::min(y0, std::max((int)sample.second - radius, 0));
+    x1 = std::max(x1, std::min((int)sample.first + radius + 1, nx - 1));
+    y1 = std::max(y1, std::min((int)sample.second + radius + 1, ny - 1));
+  }
+  CellWindow window = {x0, y0, x1 - x0 + 1, y1 - y0 + 1};
+
+  worker.corridor_mask.assign(window.nx * window.ny, false);
+  for (size_t i = 0; i < samples.size(); i++) {
+    // insert intermediate samples where consecutive ones are far apart
+    double dx = 0.0, dy = 0.0;
+    int steps = 1;
+    if (i + 1 < samples.size()) {
+      dx = samples[i + 1].first - samples[i].first;
+      dy = samples[i + 1].second - samples[i].second;
+      steps = std::max(1, (int)std::ceil(std::hypot(dx, dy) /
+                                         (COARSE_CORRIDOR_SAMPLE * radius)));
+    }
+    for (int step = 0; step < steps; step++) {
+      int cx = samples[i].first + dx * step / steps - window.x0;
+      int cy = samples[i].second + dy * step / steps - window.y0;
+      int sx0 = std::max(cx - radius, 0), sx1 = std::min(cx + radius,
+                                                         window.nx - 1);
+      int sy0 = std::max(cy - radius, 0), sy1 = std::min(cy + radius,
+                                                         window.ny - 1);
+      for (int y = sy0; y <= sy1; y++) {
+        std::memset(&worker.corridor_mask[y * window.nx + sx0], true,
+                    sx1 - sx0 + 1);
+      }
+    }
+  }
+
+  return planInWindow(worker, window, start_x, start_y, goal_x, goal_y, plan,
+                      true);
+}
+
+bool MultiGoalPlanner::planInWindow(PlanningWorker &worker,
+                                    const CellWindow &window, double start_x,
+                                    double start_y, double goal_x,
+                                    double goal_y,
+                                    move_humans::CompactPath &plan,
+                                    bool corridor) {
+  // the window is padded with lethal cells to the size of the window grid
+  int nx = snapshot_->getSizeInCellsX();
+  auto costs = snapshot_->getCharMap();
+  auto &grid = worker.windowGrid(window.nx, window.ny);
+  worker.window_costs.resize((size_t)grid.nx * grid.ny);
+  for (int y = 0; y < grid.ny; y++) {
+    auto row = &worker.window_costs[(size_t)y * grid.nx];
+    int copied = 0;
+    if (y < window.ny) {
+      std::memcpy(row, costs + (size_t)(window.y0 + y) * nx + window.x0,
+                  window.nx);
+      // cells outside of the corridor are blocked
+      if (corridor) {
+        auto mask = &worker.corridor_mask[(size_t)y * window.nx];
+        for (int x = 0; x < window.nx; x++) {
+          if (!mask[x]) {
+            row[x] = costmap_2d::LETHAL_OBSTACLE;
+          }
+        }
+      }
+      copied = window.nx;
+    }
+    std::memset(row + copied, costmap_2d::LETHAL_OBSTACLE, grid.nx - copied);
+  }
+  outlineMap(worker.window_costs.data(), window.nx, window.ny,
+             costmap_2d::LETHAL_OBSTACLE, grid.nx);
+
+  double w_start_x = start_x - window.x0, w_start_y = start_y - window.y0,
+         w_goal_x = goal_x - window.x0, w_goal_y = goal_y - window.y0;
+  if (!grid.planner->calculatePotentials(
+          worker.window_costs.data(), w_start_x, w_start_y, w_goal_x,
+          w_goal_y, grid.nx * grid.ny * 2, worker.potential_array)) {
+    return false;
+  }
+  CellWindow grid_window = {window.x0, window.y0, grid.nx, grid.ny};
+  return getPlanFromPotential(grid, worker.potential_array, grid_window,
+                              w_start_x, w_start_y, w_goal_x, w_goal_y, plan);
 }
 
-void MultiGoalPlanner::publishPlans(move_humans::map_pose_vector &plans) {
+void MultiGoalPlanner::publishPlans(
+    const move_humans::map_pose_vectors &plans) {
   if (last_config_.publish_human_plans) {
     hanp_msgs::HumanPathArray human_path_array;
     for (auto &plan_kv : plans) {
+      if (plan_kv.second.empty() || plan_kv.second.front().empty()) {
+        continue;
+      }
       hanp_msgs::HumanPath human_path;
-      if (!plan_kv.second.empty()) {
-        human_path.header.stamp = plan_kv.second.front().header.stamp;
-        human_path.header.frame_id = plan_kv.second.front().header.frame_id;
-        human_path.id = plan_kv.first;
-        human_path.path.header.stamp = human_path.header.stamp;
-        human_path.path.header.frame_id = human_path.header.frame_id;
-        human_path.path.poses = plan_kv.second;
-        human_path_array.paths.push_back(human_path);
+      auto &header = plan_kv.second.front().front().header;
+      human_path.header.stamp = header.stamp;
+      human_path.header.frame_id = header.frame_id;
+      human_path.id = plan_kv.first;
+      human_path.path.header = human_path.header;
+      for (auto &plan : plan_kv.second) {
+        human_path.path.poses.insert(human_path.path.poses.end(),
+                                     plan.begin(), plan.end());
       }
+      human_path_array.paths.push_back(human_path);
     }
     if (!human_path_array.paths.empty()) {
       human_path_array.header.stamp =
@@ -308,14 +1037,18 @@ void MultiGoalPlanner::publishPlans(move_humans::map_pose_vector &plans) {
   if (last_config_.publish_human_poses) {
     geometry_msgs::PoseArray paths_poses;
     for (auto &plan_kv : plans) {
-      for (size_t i = 0; i < plan_kv.second.size(); i++) {
-        if (!header_set) {
-          paths_poses.header.stamp = plan_kv.second[i].header.stamp;
-          paths_poses.header.frame_id = plan_kv.second[i].header.frame_id;
+      size_t i = 0;
+      for (auto &plan : plan_kv.second) {
+        for (auto &pose : plan) {
+          if (!header_set) {
+            paths_poses.header.stamp = pose.header.stamp;
+            paths_poses.header.frame_id = pose.header.frame_id;
+            header_set = true;
+          }
+          auto pose_copy = pose.pose;
+          pose_copy.position.z = i++ / last_config_.poses_z_reduce_factor;
+          paths_poses.poses.push_back(pose_copy);
         }
-        auto pose_copy = plan_kv.second[i].pose;
-        pose_copy.position.z = i / last_config_.poses_z_reduce_factor;
-        paths_poses.poses.push_back(pose_copy);
       }
     }
 
@@ -325,64 +1058,116 @@ void MultiGoalPlanner::publishPlans(move_humans::map_pose_vector &plans) {
   }
 }
 
+bool MultiGoalPlanner::isShortcutFree(const move_humans::CompactPath &path,
+                                      size_t first, size_t last) {
+  // the shortcut may not cross cells costlier than any cell of the points
+  // it replaces
+  auto costs = snapshot_->getCharMap();
+  unsigned int nx = snapshot_->getSizeInCellsX();
+  double mx, my;
+  unsigned char max_cost = 0;
+  for (size_t i = first; i <= last; i++) {
+    if (!worldToMap(path.x(i), path.y(i), mx, my)) {
+      return false;
+    }
+    max_cost = std::max(max_cost, costs[(unsigned int)my * nx +
+                                        (unsigned int)mx]);
+  }
+
+  double length = std::hypot(path.x(last) - path.x(first),
+                             path.y(last) - path.y(first));
+  int samples = (int)std::ceil(length / (SHORTCUT_SAMPLE_CELLS *
+                                         snapshot_->getResolution()));
+  for (int s = 1; s < samples; s++) {
+    double t = (double)s / samples;
+    if (!worldToMap(path.x(first) + t * (path.x(last) - path.x(first)),
+                    path.y(first) + t * (path.y(last) - path.y(first)), mx,
+                    my) ||
+        costs[(unsigned int)my * nx + (unsigned int)mx] > max_cost) {
+      return false;
+    }
+  }
+  return true;
+}
+
 bool MultiGoalPlanner::worldToMap(double wx, double wy, double &mx,
                                   double &my) {
-  double origin_x = costmap_->getOriginX(), origin_y = costmap_->getOriginY();
-  double resolution = costmap_->getResolution();
+  double origin_x = snapshot_->getOriginX(),
+         origin_y = snapshot_->getOriginY();
+  double resolution = snapshot_->getResolution();
   if (wx < origin_x || wy < origin_y) {
     return false;
   }
   mx = (wx - origin_x) / resolution - convert_offset_;
   my = (wy - origin_y) / resolution - convert_offset_;
-  if (mx < costmap_->getSizeInCellsX() && my < costmap_->getSizeInCellsY()) {
+  if (mx < snapshot_->getSizeInCellsX() &&
+      my < snapshot_->getSizeInCellsY()) {
     return true;
   }
   return false;
 }
 
 void MultiGoalPlanner::outlineMap(unsigned char *costarr, int nx, int ny,
-                                  unsigned char value) {
+                                  unsigned char value, int stride) {
   unsigned char *pc = costarr;
   for (int i = 0; i < nx; i++) {
     *pc++ = value;
   }
-  pc = costarr + (ny - 1) * nx;
+  pc = costarr + (size_t)(ny - 1) * stride;
   for (int i = 0; i < nx; i++) {
     *pc++ = value;
   }
   pc = costarr;
-  for (int i = 0; i < ny; i++, pc += nx) {
+  for (int i = 0; i < ny; i++, pc += stride) {
     *pc = value;
   }
   pc = costarr + nx - 1;
-  for (int i = 0; i < ny; i++, pc += nx) {
+  for (int i = 0; i < ny; i++, pc += stride) {
     *pc = value;
   }
 }
 
-bool MultiGoalPlanner::getPlanFromPotential(double start_x, double start_y,
-                                            double goal_x, double goal_y,
-                                            move_humans::pose_vector &plan) {
+bool MultiGoalPlanner::getPlanFromPotential(
+    SearchGrid &grid, const float *potential, const CellWindow &window,
+    double start_x, double start_y, double goal_x, double goal_y,
+    move_humans::CompactPath &plan, bool goal_rooted) {
+  // tracebacks go from their end to the root of the potential, so for goal
+  // rooted potentials the path already is in the order of the plan
+  double root_x = start_x, root_y = start_y, end_x = goal_x, end_y = goal_y;
+  if (goal_rooted) {
+    std::swap(root_x, end_x);
+    std::swap(root_y, end_y);
+  }
+
+  // getPath does not modify the potential
+  float *potential_array = const_cast<float *>(potential);
   std::vector<std::pair<float, float>> path;
-  if (!path_maker_->getPath(potential_array_, start_x, start_y, goal_x, goal_y,
-                            path)) {
+  if (!grid.path_maker->getPath(potential_array, root_x, root_y, end_x,
+                                end_y, path)) {
     ROS_WARN_NAMED(NODE_NAME, "No path from potential using gradient");
-    if (last_config_.publish_potential) {
-      publishPotential(potential_array_);
+    MOVE_HUMANS_PROFILE_COUNT("multigoal_planner/traceback_fallbacks", 1);
+    if (planning_config_.publish_potential) {
+      publishPotential(potential, window);
     }
     path.clear();
-    if (!path_maker_fallback_->getPath(potential_array_, start_x, start_y,
-                                       goal_x, goal_y, path)) {
+    if (!grid.path_maker_fallback->getPath(potential_array, root_x, root_y,
+                                           end_x, end_y, path)) {
       ROS_ERROR_NAMED(NODE_NAME, "No path from potential using grid");
       return false;
     }
   }
+  if (!goal_rooted) {
+    std::reverse(path.begin(), path.end());
+  }
 
-  ros::Time plan_time = ros::Time::now();
+  plan.frame_id = planner_frame_;
+  plan.stamp = ros::Time::now();
+  plan.reserve(plan.size() + path.size());
   double world_x, world_y, last_world_x = 0.0, last_world_y = 0.0, wx_diff,
                            wy_diff, sq_dist_w;
-  for (auto &point : boost::adaptors::reverse(path)) {
-    mapToWorld(point.first, point.second, world_x, world_y);
+  for (auto &point : path) {
+    mapToWorld(point.first + window.x0, point.second + window.y0, world_x,
+               world_y);
 
     wx_diff = world_x - last_world_x;
     wy_diff = world_y - last_world_y;
@@ -393,32 +1178,23 @@ bool MultiGoalPlanner::getPlanFromPotential(double start_x, double start_y,
     last_world_x = world_x;
     last_world_y = world_y;
 
-    geometry_msgs::PoseStamped pose;
-    pose.header.stamp = plan_time;
-    pose.header.frame_id = planner_frame_;
-    pose.pose.position.x = world_x;
-    pose.pose.position.y = world_y;
-    pose.pose.position.z = 0.0;
-    pose.pose.orientation.x = 0.0;
-    pose.pose.orientation.y = 0.0;
-    pose.pose.orientation.z = 0.0;
-    pose.pose.orientation.w = 1.0;
-    plan.push_back(pose);
+    plan.push_back(world_x, world_y);
   }
   return !plan.empty();
 }
 
 void MultiGoalPlanner::mapToWorld(double mx, double my, double &wx,
                                   double &wy) {
-  wx = costmap_->getOriginX() +
-       (mx + convert_offset_) * costmap_->getResolution();
-  wy = costmap_->getOriginY() +
-       (my + convert_offset_) * costmap_->getResolution();
+  wx = snapshot_->getOriginX() +
+       (mx + convert_offset_) * snapshot_->getResolution();
+  wy = snapshot_->getOriginY() +
+       (my + convert_offset_) * snapshot_->getResolution();
 }
 
-void MultiGoalPlanner::publishPotential(float *potential) {
-  int nx = costmap_->getSizeInCellsX(), ny = costmap_->getSizeInCellsY();
-  double resolution = costmap_->getResolution();
+void MultiGoalPlanner::publishPotential(const float *potential,
+                                        const CellWindow &window) {
+  int nx = window.nx, ny = window.ny;
+  double resolution = snapshot_->getResolution();
   nav_msgs::OccupancyGrid grid;
 
   grid.header.frame_id = planner_frame_;
@@ -428,7 +1204,7 @@ void MultiGoalPlanner::publishPotential(float *potential) {
   grid.info.height = ny;
 
   double wx, wy;
-  costmap_->mapToWorld(0, 0, wx, wy);
+  snapshot_->mapToWorld(window.x0, window.y0, wx, wy);
   grid.info.origin.position.x = wx - resolution / 2;
   grid.info.origin.position.y = wy - resolution / 2;
   grid.info.origin.position.z = 0.0;
@@ -438,19 +1214,18 @@ void MultiGoalPlanner::publishPotential(float *potential) {
 
   float max = 0.0;
   for (unsigned int i = 0; i < grid.data.size(); i++) {
-    float potential = potential_array_[i];
-    if (potential < POT_HIGH) {
-      if (potential > max) {
-        max = potential;
+    if (potential[i] < POT_HIGH) {
+      if (potential[i] > max) {
+        max = potential[i];
       }
     }
   }
 
   for (unsigned int i = 0; i < grid.data.size(); i++) {
-    if (potential_array_[i] >= POT_HIGH) {
+    if (potential[i] >= POT_HIGH) {
       grid.data[i] = -1;
     } else
-      grid.data[i] = potential_array_[i] * publish_scale_ / max;
+      grid.data[i] = potential[i] * publish_scale_ / max;
   }
   potential_pub_.publish(grid);
 }
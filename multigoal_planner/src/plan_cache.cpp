@@ -0,0 +1,257 @@
+#define NODE_NAME "multigoal_planner"
+#define PLAN_CACHE_MAGIC 0x4350474d // "MGPC" little-endian
+#define PLAN_CACHE_VERSION 1
+#define PLAN_CACHE_SUFFIX ".plans"
+
+#include <multigoal_planner/plan_cache.h>
+#include <ros/ros.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <dirent.h>
+
+namespace multigoal_planner {
+using move_humans::CacheFile;
+
+// file layout: header, index sorted by key, then x, y pairs of all plans
+struct PlanCache::FileHeader {
+  CacheFile::Header file;
+  uint64_t count;
+};
+
+struct PlanCache::IndexEntry {
+  uint64_t key, offset, points; // offset and points in x, y pairs
+};
+
+PlanCache::PlanCache() : selected_key_(0, 0) {}
+
+PlanCache::~PlanCache() { close(); }
+
+size_t PlanCache::MappedFile::find(uint64_t key) const {
+  auto end = index + header->count;
+  auto entry = std::lower_bound(
+      index, end, key,
+      [](const IndexEntry &entry, uint64_t key) { return entry.key < key; });
+  return (entry != end && entry->key == key) ? entry - index : (size_t)-1;
+}
+
+bool PlanCache::open(const std::string &directory) {
+  close();
+  if (directory.empty()) {
+    return false;
+  }
+  if (!CacheFile::makeDirectory(directory)) {
+    ROS_ERROR_NAMED(NODE_NAME, "Can not create plan cache directory %s: %s",
+                    directory.c_str(), strerror(errno));
+    return false;
+  }
+  DIR *dir = opendir(directory.c_str());
+  if (!dir) {
+    ROS_ERROR_NAMED(NODE_NAME, "Can not open plan cache directory %s: %s",
+                    directory.c_str(), strerror(errno));
+    return false;
+  }
+  directory_ = directory;
+
+  size_t suffix_size = strlen(PLAN_CACHE_SUFFIX);
+  while (auto entry = readdir(dir)) {
+    std::string name = entry->d_name;
+    if (name.size() <= suffix_size ||
+        name.compare(name.size() - suffix_size, suffix_size,
+                     PLAN_CACHE_SUFFIX) != 0) {
+      continue;
+    }
+    auto file = mapFile(directory_ + "/" + name);
+    if (!file) {
+      continue;
+    }
+    file_key key(file->header->file.map_hash, file->header->file.params_hash);
+    if (name != CacheFile::name(key.first, key.second, PLAN_CACHE_SUFFIX)) {
+      ROS_WARN_NAMED(NODE_NAME, "Ignoring misnamed plan cache file %s",
+                     name.c_str());
+      continue;
+    }
+    files_[key] = file;
+  }
+  closedir(dir);
+  return true;
+}
+
+void PlanCache::close() {
+  directory_.clear();
+  files_.clear();
+  selected_.reset();
+  boost::mutex::scoped_lock lock(pending_mutex_);
+  pending_.clear();
+}
+
+void PlanCache::select(uint64_t map_hash, uint64_t params_hash) {
+  file_key key(map_hash, params_hash);
+  if (key == selected_key_ && (selected_ || files_.count(key) == 0)) {
+    return;
+  }
+  // plans of the previous costmap are written to its file first
+  if (key != selected_key_) {
+    persist();
+    boost::mutex::scoped_lock lock(pending_mutex_);
+    pending_.clear();
+  }
+  selected_key_ = key;
+  auto file_it = files_.find(key);
+  selected_ = file_it != files_.end() ? file_it->second
+                                      : boost::shared_ptr<MappedFile>();
+}
+
+bool PlanCache::lookup(uint32_t start_cell, uint32_t goal_cell,
+                       move_humans::CompactPath &plan) {
+  auto segment_key = key(start_cell, goal_cell);
+  const double *points = NULL;
+  size_t count = 0;
+  size_t entry = selected_ ? selected_->find(segment_key) : (size_t)-1;
+  if (entry != (size_t)-1) {
+    points = selected_->points + 2 * selected_->index[entry].offset;
+    count = selected_->index[entry].points;
+  }
+
+  boost::mutex::scoped_lock lock(pending_mutex_);
+  auto pending_it = pending_.find(segment_key);
+  if (pending_it != pending_.end()) {
+    points = pending_it->second.data();
+    count = pending_it->second.size() / 2;
+  }
+  if (!points || count == 0) {
+    return false;
+  }
+
+  plan.clear();
+  plan.reserve(count);
+  for (size_t i = 0; i < count; i++) {
+    plan.push_back(points[2 * i], points[2 * i + 1]);
+  }
+  return true;
+}
+
+void PlanCache::insert(uint32_t start_cell, uint32_t goal_cell,
+                       const move_humans::CompactPath &plan) {
+  std::vector<double> points;
+  points.reserve(2 * plan.size());
+  for (size_t i = 0; i < plan.size(); i++) {
+    points.push_back(plan.x(i));
+    points.push_back(plan.y(i));
+  }
+  boost::mutex::scoped_lock lock(pending_mutex_);
+  pending_[key(start_cell, goal_cell)].swap(points);
+}
+
+size_t PlanCache::persist() {
+  boost::mutex::scoped_lock lock(pending_mutex_);
+  if (!isOpen() || pending_.empty()) {
+    return 0;
+  }
+
+  // merge plans of the mapped file with the new ones, sorted by key
+  std::vector<IndexEntry> index;
+  std::vector<std::pair<uint64_t, const double *>> sources;
+  if (selected_) {
+    for (size_t i = 0; i < selected_->header->count; i++) {
+      auto &entry = selected_->index[i];
+      if (pending_.find(entry.key) == pending_.end()) {
+        index.push_back({entry.key, 0, entry.points});
+        sources.emplace_back(entry.key, selected_->points + 2 * entry.offset);
+      }
+    }
+  }
+  for (auto &pending_kv : pending_) {
+    index.push_back({pending_kv.first, 0, pending_kv.second.size() / 2});
+    sources.emplace_back(pending_kv.first, pending_kv.second.data());
+  }
+  std::sort(index.begin(), index.end(),
+            [](const IndexEntry &a, const IndexEntry &b) {
+              return a.key < b.key;
+            });
+  std::sort(sources.begin(), sources.end());
+  uint64_t offset = 0;
+  for (auto &entry : index) {
+    entry.offset = offset;
+    offset += entry.points;
+  }
+
+  // readers of the old mapping are not affected by the new file
+  auto path = filePath(selected_key_);
+  FileHeader header = {{PLAN_CACHE_MAGIC, PLAN_CACHE_VERSION,
+                        selected_key_.first, selected_key_.second},
+                       index.size()};
+  CacheFile::Parts parts = {{&header, sizeof(header)},
+                            {index.data(), index.size() * sizeof(IndexEntry)}};
+  for (size_t i = 0; i < index.size(); i++) {
+    parts.emplace_back(sources[i].second,
+                       index[i].points * 2 * sizeof(double));
+  }
+  if (!CacheFile::write(path, parts)) {
+    ROS_ERROR_NAMED(NODE_NAME, "Can not write plan cache file %s: %s",
+                    path.c_str(), strerror(errno));
+    return 0;
+  }
+
+  size_t added = pending_.size();
+  pending_.clear();
+  selected_ = mapFile(path);
+  if (selected_) {
+    files_[selected_key_] = selected_;
+  } else {
+    files_.erase(selected_key_);
+  }
+  return added;
+}
+
+size_t PlanCache::size() const {
+  size_t count = 0;
+  for (auto &file_kv : files_) {
+    count += file_kv.second->header->count;
+  }
+  return count;
+}
+
+std::string PlanCache::filePath(const file_key &key) const {
+  return directory_ + "/" +
+         CacheFile::name(key.first, key.second, PLAN_CACHE_SUFFIX);
+}
+
+boost::shared_ptr<PlanCache::MappedFile>
+PlanCache::mapFile(const std::string &path) {
+  boost::shared_ptr<MappedFile> file(new MappedFile());
+  file->mapping = CacheFile::map(path);
+  if (!file->mapping) {
+    ROS_WARN_NAMED(NODE_NAME, "Can not map plan cache file %s: %s",
+                   path.c_str(), strerror(errno));
+    return boost::shared_ptr<MappedFile>();
+  }
+
+  // files that do not match their header are ignored
+  auto &mapping = *file->mapping;
+  file->header = (const FileHeader *)mapping.data();
+  if (mapping.size() < sizeof(FileHeader) ||
+      !mapping.matches(PLAN_CACHE_MAGIC, PLAN_CACHE_VERSION) ||
+      sizeof(FileHeader) + file->header->count * sizeof(IndexEntry) >
+          mapping.size()) {
+    ROS_WARN_NAMED(NODE_NAME, "Ignoring invalid plan cache file %s",
+                   path.c_str());
+    return boost::shared_ptr<MappedFile>();
+  }
+  size_t index_end =
+      sizeof(FileHeader) + file->header->count * sizeof(IndexEntry);
+  file->index = (const IndexEntry *)(mapping.data() + sizeof(FileHeader));
+  file->points = (const double *)(mapping.data() + index_end);
+  size_t points = 0;
+  for (size_t i = 0; i < file->header->count; i++) {
+    points = std::max(points, (size_t)(file->index[i].offset +
+                                       file->index[i].points));
+  }
+  if (index_end + points * 2 * sizeof(double) > mapping.size()) {
+    ROS_WARN_NAMED(NODE_NAME, "Ignoring truncated plan cache file %s",
+                   path.c_str());
+    return boost::shared_ptr<MappedFile>();
+  }
+  return file;
+}
+}; // namespace multigoal_planner
@@ -0,0 +1,22 @@
+#include <multigoal_planner/potential_buffers.h>
+
+namespace multigoal_planner {
+PotentialBuffers::PotentialBuffers() : cells_(0) {}
+
+bool PotentialBuffers::resize(size_t count, int nx, int ny) {
+  size_t cells = (size_t)nx * (size_t)ny;
+  bool allocated = false;
+  if (cells != cells_) {
+    buffers_.clear();
+    cells_ = cells;
+  }
+  if (buffers_.size() > count) {
+    buffers_.resize(count);
+  }
+  while (buffers_.size() < count) {
+    buffers_.push_back(std::unique_ptr<float[]>(new float[cells_]));
+    allocated = true;
+  }
+  return allocated;
+}
+} // namespace multigoal_planner
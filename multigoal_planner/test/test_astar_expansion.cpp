@@ -0,0 +1,111 @@
+#define MAP_X 21
+#define MAP_Y 11
+#define DOOR_X 10
+#define DOOR_Y 5
+#define NEUTRAL_COST 50.0
+
+#include <gtest/gtest.h>
+#include <costmap_2d/cost_values.h>
+#include <global_planner/grid_path.h>
+#include <global_planner/potential_calculator.h>
+#include <multigoal_planner/astar_expansion.h>
+#include <vector>
+
+namespace {
+using multigoal_planner::BidirectionalAStarExpansion;
+using multigoal_planner::EuclideanAStarExpansion;
+
+// two rooms joined by a one cell doorway, outlined like the costmaps of the
+// planner so that expansions do not wrap around rows
+std::vector<unsigned char> doorwayCosts() {
+  std::vector<unsigned char> costs(MAP_X * MAP_Y, costmap_2d::FREE_SPACE);
+  for (int y = 0; y < MAP_Y; y++) {
+    for (int x = 0; x < MAP_X; x++) {
+      if (x == 0 || y == 0 || x == MAP_X - 1 || y == MAP_Y - 1 ||
+          (x == DOOR_X && y != DOOR_Y)) {
+        costs[y * MAP_X + x] = costmap_2d::LETHAL_OBSTACLE;
+      }
+    }
+  }
+  return costs;
+}
+
+// potential is rooted at start, plans are traced back from goal
+void expectPlan(global_planner::Expander &expansion, int start_x, int start_y,
+                int goal_x, int goal_y) {
+  global_planner::PotentialCalculator p_calc(MAP_X, MAP_Y);
+  auto costs = doorwayCosts();
+  std::vector<float> potential(MAP_X * MAP_Y);
+  ASSERT_TRUE(expansion.calculatePotentials(costs.data(), start_x, start_y,
+                                            goal_x, goal_y, MAP_X * MAP_Y * 2,
+                                            potential.data()));
+  EXPECT_LT(potential[goal_y * MAP_X + goal_x], POT_HIGH);
+
+  global_planner::GridPath path_maker(&p_calc);
+  path_maker.setSize(MAP_X, MAP_Y);
+  std::vector<std::pair<float, float>> path;
+  ASSERT_TRUE(path_maker.getPath(potential.data(), start_x, start_y, goal_x,
+                                 goal_y, path));
+  ASSERT_FALSE(path.empty());
+  EXPECT_EQ(path.front(), std::make_pair((float)goal_x, (float)goal_y));
+  EXPECT_EQ(path.back(), std::make_pair((float)start_x, (float)start_y));
+  bool through_door = false;
+  for (auto &point : path) {
+    EXPECT_NE(costs[(int)point.second * MAP_X + (int)point.first],
+              costmap_2d::LETHAL_OBSTACLE);
+    through_door |= point == std::make_pair((float)DOOR_X, (float)DOOR_Y);
+  }
+  EXPECT_TRUE(through_door);
+}
+
+class ExpansionTest : public testing::Test {
+protected:
+  ExpansionTest() : p_calc(MAP_X, MAP_Y) {}
+
+  global_planner::PotentialCalculator p_calc;
+};
+
+TEST_F(ExpansionTest, AStarThroughDoorway) {
+  EuclideanAStarExpansion expansion(&p_calc, MAP_X, MAP_Y);
+  expectPlan(expansion, 3, DOOR_Y, 17, DOOR_Y);
+  expectPlan(expansion, 2, 1, 18, 9);
+}
+
+TEST_F(ExpansionTest, AStarPotentialIsPathCost) {
+  EuclideanAStarExpansion expansion(&p_calc, MAP_X, MAP_Y);
+  auto costs = doorwayCosts();
+  std::vector<float> potential(MAP_X * MAP_Y);
+  ASSERT_TRUE(expansion.calculatePotentials(costs.data(), 3, DOOR_Y, 17,
+                                            DOOR_Y, MAP_X * MAP_Y * 2,
+                                            potential.data()));
+  EXPECT_FLOAT_EQ(potential[DOOR_Y * MAP_X + 17], 14 * NEUTRAL_COST);
+}
+
+TEST_F(ExpansionTest, BidirectionalThroughDoorway) {
+  BidirectionalAStarExpansion expansion(&p_calc, MAP_X, MAP_Y);
+  // frontiers meeting in the doorway, before and behind it
+  expectPlan(expansion, 3, DOOR_Y, 17, DOOR_Y);
+  expectPlan(expansion, 2, 1, 18, 9);
+  expectPlan(expansion, 9, DOOR_Y, 17, DOOR_Y);
+  expectPlan(expansion, 3, DOOR_Y, 11, DOOR_Y);
+  expectPlan(expansion, 17, 2, 1, 8);
+}
+
+TEST_F(ExpansionTest, UnreachableGoal) {
+  auto costs = doorwayCosts();
+  costs[DOOR_Y * MAP_X + DOOR_X] = costmap_2d::LETHAL_OBSTACLE;
+  std::vector<float> potential(MAP_X * MAP_Y);
+  EuclideanAStarExpansion astar(&p_calc, MAP_X, MAP_Y);
+  EXPECT_FALSE(astar.calculatePotentials(costs.data(), 3, DOOR_Y, 17, DOOR_Y,
+                                         MAP_X * MAP_Y * 2, potential.data()));
+  BidirectionalAStarExpansion bidirectional(&p_calc, MAP_X, MAP_Y);
+  EXPECT_FALSE(bidirectional.calculatePotentials(costs.data(), 3, DOOR_Y, 17,
+                                                 DOOR_Y, MAP_X * MAP_Y * 2,
+                                                 potential.data()));
+}
+}; // namespace
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,106 @@
+#define MAP_SIZE 20
+#define NEUTRAL_COST 50.0
+
+#include <gtest/gtest.h>
+#include <costmap_2d/cost_values.h>
+#include <global_planner/potential_calculator.h>
+#include <multigoal_planner/dstar_lite.h>
+#include <vector>
+
+namespace {
+using multigoal_planner::CellWindow;
+using multigoal_planner::DStarLite;
+
+const CellWindow FULL_WINDOW = {0, 0, MAP_SIZE, MAP_SIZE};
+
+std::vector<unsigned char> freeCosts() {
+  return std::vector<unsigned char>(MAP_SIZE * MAP_SIZE,
+                                    costmap_2d::FREE_SPACE);
+}
+
+// wall along x from y0 to y1, both included
+void addWall(std::vector<unsigned char> &costs, int x, int y0, int y1) {
+  for (int y = y0; y <= y1; y++) {
+    costs[y * MAP_SIZE + x] = costmap_2d::LETHAL_OBSTACLE;
+  }
+}
+
+float potentialAt(const DStarLite &search, int x, int y) {
+  auto &window = search.window();
+  return search.potential()[(y - window.y0) * window.nx + (x - window.x0)];
+}
+
+TEST(DStarLite, FreeMapPotentialIsPathCost) {
+  auto costs = freeCosts();
+  DStarLite search(FULL_WINDOW, MAP_SIZE, MAP_SIZE, 15, 10, true);
+  ASSERT_TRUE(search.update(costs.data(), 1, 5, 10, 1000000));
+  EXPECT_FLOAT_EQ(potentialAt(search, 5, 10), 10 * NEUTRAL_COST);
+  EXPECT_FLOAT_EQ(potentialAt(search, 15, 10), 0.0);
+}
+
+TEST(DStarLite, RepairMatchesNewSearch) {
+  auto costs = freeCosts();
+  DStarLite search(FULL_WINDOW, MAP_SIZE, MAP_SIZE, 15, 10, true);
+  ASSERT_TRUE(search.update(costs.data(), 1, 5, 10, 1000000));
+
+  // a wall between start and goal with a gap at its upper end
+  addWall(costs, 10, 1, MAP_SIZE - 4);
+  ASSERT_TRUE(search.update(costs.data(), 2, 5, 10, 1000000));
+  DStarLite fresh(FULL_WINDOW, MAP_SIZE, MAP_SIZE, 15, 10, true);
+  ASSERT_TRUE(fresh.update(costs.data(), 1, 5, 10, 1000000));
+  EXPECT_GT(potentialAt(search, 5, 10), 10 * NEUTRAL_COST);
+  EXPECT_FLOAT_EQ(potentialAt(search, 5, 10), potentialAt(fresh, 5, 10));
+
+  // the start moving keeps the repaired search valid
+  ASSERT_TRUE(search.update(costs.data(), 2, 6, 12, 1000000));
+  ASSERT_TRUE(fresh.update(costs.data(), 1, 6, 12, 1000000));
+  EXPECT_FLOAT_EQ(potentialAt(search, 6, 12), potentialAt(fresh, 6, 12));
+}
+
+TEST(DStarLite, UnreachableStart) {
+  auto costs = freeCosts();
+  addWall(costs, 10, 1, MAP_SIZE - 2);
+  DStarLite search(FULL_WINDOW, MAP_SIZE, MAP_SIZE, 15, 10, true);
+  EXPECT_FALSE(search.update(costs.data(), 1, 5, 10, 1000000));
+  EXPECT_GE(potentialAt(search, 5, 10), POT_HIGH);
+}
+
+TEST(DStarLite, UnchangedVersionKeepsCosts) {
+  auto costs = freeCosts();
+  DStarLite search(FULL_WINDOW, MAP_SIZE, MAP_SIZE, 15, 10, true);
+  ASSERT_TRUE(search.update(costs.data(), 1, 5, 10, 1000000));
+
+  // costs are only compared when their version changed
+  addWall(costs, 10, 1, MAP_SIZE - 2);
+  EXPECT_TRUE(search.update(costs.data(), 1, 5, 10, 1000000));
+  EXPECT_FLOAT_EQ(potentialAt(search, 5, 10), 10 * NEUTRAL_COST);
+  EXPECT_FALSE(search.update(costs.data(), 2, 5, 10, 1000000));
+}
+
+TEST(DStarLite, UnknownCells) {
+  std::vector<unsigned char> costs(MAP_SIZE * MAP_SIZE,
+                                   costmap_2d::NO_INFORMATION);
+  DStarLite allowed(FULL_WINDOW, MAP_SIZE, MAP_SIZE, 15, 10, true);
+  EXPECT_TRUE(allowed.update(costs.data(), 1, 5, 10, 1000000));
+  DStarLite forbidden(FULL_WINDOW, MAP_SIZE, MAP_SIZE, 15, 10, false);
+  EXPECT_FALSE(forbidden.update(costs.data(), 1, 5, 10, 1000000));
+}
+
+TEST(DStarLite, Matches) {
+  CellWindow window = {2, 2, 10, 10};
+  DStarLite search(window, MAP_SIZE, MAP_SIZE, 6, 6, true);
+  EXPECT_TRUE(search.matches(MAP_SIZE, MAP_SIZE, 6, 6, 4, 4));
+  // other costmap size or goal
+  EXPECT_FALSE(search.matches(MAP_SIZE + 1, MAP_SIZE, 6, 6, 4, 4));
+  EXPECT_FALSE(search.matches(MAP_SIZE, MAP_SIZE, 7, 6, 4, 4));
+  // starts on the window border or outside of the window
+  EXPECT_FALSE(search.matches(MAP_SIZE, MAP_SIZE, 6, 6, 2, 4));
+  EXPECT_FALSE(search.matches(MAP_SIZE, MAP_SIZE, 6, 6, 11, 4));
+  EXPECT_FALSE(search.matches(MAP_SIZE, MAP_SIZE, 6, 6, 15, 15));
+}
+}; // namespace
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,202 @@
+#include <gtest/gtest.h>
+#include <multigoal_planner/plan_cache.h>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <dirent.h>
+#include <unistd.h>
+
+namespace {
+using move_humans::CompactPath;
+using multigoal_planner::PlanCache;
+
+CompactPath line(size_t points, double offset) {
+  CompactPath plan;
+  for (size_t i = 0; i < points; i++) {
+    plan.push_back(offset + i * 0.1, offset - i * 0.1);
+  }
+  return plan;
+}
+
+void expectPlan(const CompactPath &expected, const CompactPath &plan) {
+  ASSERT_EQ(expected.size(), plan.size());
+  for (size_t i = 0; i < expected.size(); i++) {
+    EXPECT_DOUBLE_EQ(expected.x(i), plan.x(i));
+    EXPECT_DOUBLE_EQ(expected.y(i), plan.y(i));
+  }
+}
+
+class PlanCacheTest : public testing::Test {
+protected:
+  void SetUp() override {
+    char directory_template[] = "/tmp/test_plan_cache_XXXXXX";
+    ASSERT_TRUE(mkdtemp(directory_template));
+    directory = directory_template;
+  }
+
+  void TearDown() override {
+    cache.close();
+    if (DIR *dir = opendir(directory.c_str())) {
+      while (auto entry = readdir(dir)) {
+        std::string name = entry->d_name;
+        if (name != "." && name != "..") {
+          unlink((directory + "/" + name).c_str());
+        }
+      }
+      closedir(dir);
+    }
+    rmdir(directory.c_str());
+  }
+
+  std::string path(uint64_t map_hash, uint64_t params_hash) {
+    char name[64];
+    snprintf(name, sizeof(name), "/%016llx_%016llx.plans",
+             (unsigned long long)map_hash, (unsigned long long)params_hash);
+    return directory + name;
+  }
+
+  // persist one plan of the costmap and configuration with these hashes
+  void persistPlan(uint64_t map_hash, uint64_t params_hash) {
+    ASSERT_TRUE(cache.open(directory));
+    cache.select(map_hash, params_hash);
+    cache.insert(1, 2, line(10, 0.0));
+    ASSERT_EQ(cache.persist(), 1u);
+    cache.close();
+  }
+
+  // overwrite bytes of file at offset, or cut it to offset without bytes
+  void corrupt(const std::string &file_path, long offset,
+               const std::string &bytes) {
+    if (bytes.empty()) {
+      ASSERT_EQ(truncate(file_path.c_str(), offset), 0);
+      return;
+    }
+    FILE *file = fopen(file_path.c_str(), "r+b");
+    ASSERT_TRUE(file);
+    fseek(file, offset, SEEK_SET);
+    fwrite(bytes.data(), 1, bytes.size(), file);
+    fclose(file);
+  }
+
+  std::string directory;
+  PlanCache cache;
+};
+
+TEST_F(PlanCacheTest, EmptyInput) {
+  CompactPath plan;
+  EXPECT_FALSE(cache.open(""));
+  EXPECT_FALSE(cache.isOpen());
+  EXPECT_FALSE(cache.lookup(1, 2, plan));
+  EXPECT_EQ(cache.persist(), 0u);
+
+  ASSERT_TRUE(cache.open(directory));
+  EXPECT_EQ(cache.files(), 0u);
+  cache.select(1, 1);
+  EXPECT_EQ(cache.persist(), 0u);
+  EXPECT_EQ(cache.files(), 0u);
+  EXPECT_FALSE(cache.lookup(1, 2, plan));
+}
+
+TEST_F(PlanCacheTest, InsertPersistAndReopen) {
+  ASSERT_TRUE(cache.open(directory));
+  cache.select(10, 20);
+  cache.insert(1, 2, line(10, 0.0));
+  cache.insert(3, 4, line(5, 1.0));
+
+  CompactPath plan;
+  ASSERT_TRUE(cache.lookup(1, 2, plan));
+  expectPlan(line(10, 0.0), plan);
+  EXPECT_FALSE(cache.lookup(2, 1, plan));
+  EXPECT_EQ(cache.persist(), 2u);
+  EXPECT_EQ(cache.files(), 1u);
+  EXPECT_EQ(cache.size(), 2u);
+  ASSERT_TRUE(cache.lookup(3, 4, plan));
+  expectPlan(line(5, 1.0), plan);
+
+  // new plans are merged with the ones of the file
+  cache.insert(3, 4, line(3, 2.0));
+  cache.insert(5, 6, line(4, 3.0));
+  EXPECT_EQ(cache.persist(), 2u);
+  EXPECT_EQ(cache.size(), 3u);
+
+  ASSERT_TRUE(cache.open(directory));
+  EXPECT_EQ(cache.files(), 1u);
+  EXPECT_FALSE(cache.lookup(1, 2, plan));
+  cache.select(10, 20);
+  ASSERT_TRUE(cache.lookup(1, 2, plan));
+  expectPlan(line(10, 0.0), plan);
+  ASSERT_TRUE(cache.lookup(3, 4, plan));
+  expectPlan(line(3, 2.0), plan);
+  ASSERT_TRUE(cache.lookup(5, 6, plan));
+  expectPlan(line(4, 3.0), plan);
+}
+
+TEST_F(PlanCacheTest, OtherHashesDoNotMatch) {
+  persistPlan(10, 20);
+  ASSERT_TRUE(cache.open(directory));
+  CompactPath plan;
+  cache.select(10, 21);
+  EXPECT_FALSE(cache.lookup(1, 2, plan));
+  cache.select(11, 20);
+  EXPECT_FALSE(cache.lookup(1, 2, plan));
+  cache.select(10, 20);
+  EXPECT_TRUE(cache.lookup(1, 2, plan));
+}
+
+TEST_F(PlanCacheTest, SelectPersistsPreviousPlans) {
+  ASSERT_TRUE(cache.open(directory));
+  cache.select(10, 20);
+  cache.insert(1, 2, line(10, 0.0));
+  cache.select(11, 20);
+  CompactPath plan;
+  EXPECT_FALSE(cache.lookup(1, 2, plan));
+  EXPECT_EQ(cache.files(), 1u);
+
+  ASSERT_TRUE(cache.open(directory));
+  cache.select(10, 20);
+  EXPECT_TRUE(cache.lookup(1, 2, plan));
+}
+
+TEST_F(PlanCacheTest, HashMismatchIsIgnored) {
+  persistPlan(10, 20);
+  // file of other hashes named after the selected ones
+  ASSERT_EQ(rename(path(10, 20).c_str(), path(10, 21).c_str()), 0);
+  ASSERT_TRUE(cache.open(directory));
+  EXPECT_EQ(cache.files(), 0u);
+  CompactPath plan;
+  cache.select(10, 21);
+  EXPECT_FALSE(cache.lookup(1, 2, plan));
+  cache.select(10, 20);
+  EXPECT_FALSE(cache.lookup(1, 2, plan));
+}
+
+TEST_F(PlanCacheTest, BadMagicIsIgnored) {
+  persistPlan(10, 20);
+  corrupt(path(10, 20), 0, "XXXX");
+  ASSERT_TRUE(cache.open(directory));
+  EXPECT_EQ(cache.files(), 0u);
+}
+
+TEST_F(PlanCacheTest, BadVersionIsIgnored) {
+  persistPlan(10, 20);
+  corrupt(path(10, 20), 4, std::string("\x7f\0\0\0", 4));
+  ASSERT_TRUE(cache.open(directory));
+  EXPECT_EQ(cache.files(), 0u);
+}
+
+TEST_F(PlanCacheTest, TruncatedFilesAreIgnored) {
+  // cut in the points, in the index and in the header
+  for (long size : {200, 40, 8}) {
+    persistPlan(10, 20);
+    corrupt(path(10, 20), size, "");
+    ASSERT_TRUE(cache.open(directory));
+    EXPECT_EQ(cache.files(), 0u);
+    cache.close();
+  }
+}
+}; // namespace
+
+int main(int argc, char **argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
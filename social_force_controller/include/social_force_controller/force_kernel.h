@@ -0,0 +1,47 @@
+#ifndef SOCIAL_FORCE_CONTROLLER_FORCE_KERNEL_H_
+#define SOCIAL_FORCE_CONTROLLER_FORCE_KERNEL_H_
+
+#include <vector>
+
+namespace social_force_controller {
+// human-human interactions of one step as structure of arrays, pair i acts
+// on a human heading along (ex, ey) from a neighbour at offset (dx, dy),
+// radii is the sum of both radii
+struct InteractionPairs {
+  std::vector<float> dx, dy, radii, ex, ey;
+
+  void resize(size_t size) {
+    dx.resize(size);
+    dy.resize(size);
+    radii.resize(size);
+    ex.resize(size);
+    ey.resize(size);
+  }
+  size_t size() const { return dx.size(); }
+
+  void set(size_t i, float pair_dx, float pair_dy, float pair_radii,
+           float heading_x, float heading_y) {
+    dx[i] = pair_dx;
+    dy[i] = pair_dy;
+    radii[i] = pair_radii;
+    ex[i] = heading_x;
+    ey[i] = heading_y;
+  }
+};
+
+struct ForceParams {
+  float strength;   // m/s^2 at contact
+  float range;      // m, decay length of the repulsion
+  float anisotropy; // weight of neighbours behind, 1 for isotropic
+};
+
+// repulsion of pairs [begin, end) on their humans, strength *
+// exp((radii - d) / range) away from the neighbour, weighted by anisotropy
+// for neighbours behind, into fx[i] and fy[i], uses AVX2 or NEON when the
+// build enables them, all paths use the same exponential approximation
+void computePairForces(const InteractionPairs &pairs,
+                       const ForceParams &params, size_t begin, size_t end,
+                       float *fx, float *fy);
+}; // namespace social_force_controller
+
+#endif // SOCIAL_FORCE_CONTROLLER_FORCE_KERNEL_H_
@@ -0,0 +1,139 @@
+#ifndef SOCIAL_FORCE_CONTROLLER_H_
+#define SOCIAL_FORCE_CONTROLLER_H_
+
+#include <unordered_map>
+#include <vector>
+#include <ros/ros.h>
+#include <costmap_2d/costmap_2d_ros.h>
+#include <tf/transform_listener.h>
+#include <dynamic_reconfigure/server.h>
+#include <boost/dynamic_bitset.hpp>
+#include <boost/thread.hpp>
+#include <move_humans/controller_interface.h>
+#include <move_humans/spatial_index.h>
+#include <move_humans/thread_pool.h>
+#include <social_force_controller/force_kernel.h>
+
+#include <social_force_controller/SocialForceControllerConfig.h>
+
+namespace social_force_controller {
+
+// moves humans along their plans with a social force model, every human is
+// pulled towards a carrot point ahead on its plan and pushed away from its
+// nearest neighbours, so that humans avoid each other instead of walking
+// through each other as with teleport_controller
+class SocialForceController : public move_humans::ControllerInterface {
+public:
+  SocialForceController();
+  ~SocialForceController();
+
+  void initialize(std::string name, tf::TransformListener *tf,
+                  costmap_2d::Costmap2DROS *costmap_ros);
+
+  // initialize without any ROS communication, plans must be given in the
+  // controller frame and obstacles are not considered
+  void initialize(std::string name, std::string controller_frame);
+
+  // replace the configuration, as dynamic_reconfigure would
+  void setConfig(const SocialForceControllerConfig &config);
+
+  bool setPlans(const move_humans::map_pose_vector &plans);
+  bool setPlans(const move_humans::map_pose_vector &plans,
+                const move_humans::map_trajectory &trajectories);
+
+  bool computeHumansStates(move_humans::map_traj_point &humans);
+  bool computeHumansStates(move_humans::map_traj_point &humans, double dt);
+
+  bool areGoalsReached(move_humans::id_vector &reached_humans);
+
+  bool removeHumans(const move_humans::id_vector &human_ids);
+
+  void setHumansIndex(const move_humans::SpatialIndexConstPtr &index) {
+    humans_index_ = index;
+  }
+
+  bool isInitialized() { return initialized_; }
+
+private:
+  bool initialized_;
+  bool setup_;
+
+  void reconfigureCB(SocialForceControllerConfig &config, uint32_t level);
+
+  costmap_2d::Costmap2DROS *costmap_ros_;
+  tf::TransformListener *tf_;
+  std::string controller_frame_;
+
+  // dense per-human storage indexed by slot, removing a human moves the last
+  // slot into its place
+  std::unordered_map<uint64_t, size_t> slots_;
+  std::vector<uint64_t> ids_;
+  std::vector<move_humans::pose_vector> plans_;
+  // plan in controller frame and yaw of its last pose
+  std::vector<std::vector<double>> path_x_, path_y_;
+  std::vector<double> goal_yaw_;
+  // index of the path point the human walks towards
+  std::vector<size_t> cursors_;
+  std::vector<double> x_, y_, yaw_, vel_x_, vel_y_, angular_vel_;
+  boost::dynamic_bitset<> has_plan_, transformed_, has_state_, reached_;
+
+  size_t addHuman(uint64_t id);
+  void removeHuman(uint64_t id);
+  void resizeHumans(size_t size);
+
+  // transform new plans to controller frame, returns true if any human not
+  // at goal has a transformed plan
+  bool transformPlans();
+  bool transformPlan(size_t slot);
+
+  // advance all humans by cycle_time seconds in substeps
+  bool stepHumans(move_humans::map_traj_point &humans, double cycle_time);
+  void substep(double dt);
+
+  // new velocities of active humans [begin, end) from goal and social
+  // forces, reads positions of all humans and only writes new velocities
+  void solveVelocities(size_t begin, size_t end,
+                       move_humans::SpatialIndex::Neighbors &neighbors,
+                       double dt);
+  // move the active human at index with its new velocity, only writes the
+  // state of its slot, returns true if the human reached its goal
+  bool integrate(size_t index, double dt);
+  bool isFree(double x, double y) const;
+
+  // states of the last control cycle given by move_humans, a human starting
+  // on its plan waits while another human is within contact distance of the
+  // plan start, humans started in this cycle are in started_
+  move_humans::SpatialIndexConstPtr humans_index_;
+  std::vector<size_t> started_;
+  move_humans::SpatialIndex::Neighbors start_neighbors_;
+  bool isStartOccupied(size_t slot);
+
+  // slots of humans moving in this cycle and neighbour queries over them
+  std::vector<size_t> active_;
+  move_humans::SpatialIndex index_;
+  std::vector<move_humans::SpatialIndex::Entry> index_entries_;
+
+  // interactions of the active human at index are at index * max_neighbors
+  InteractionPairs pairs_;
+  std::vector<uint8_t> pair_counts_;
+  std::vector<float> pair_fx_, pair_fy_;
+  std::vector<double> new_vel_x_, new_vel_y_;
+  std::vector<uint8_t> step_reached_;
+  std::vector<move_humans::SpatialIndex::Neighbors> worker_neighbors_;
+  move_humans::ThreadPool step_pool_;
+  // run fn(begin, end, worker) over the active humans, in parallel if
+  // configured and there are enough of them
+  void forActive(const move_humans::ThreadPool::RangeFunction &fn);
+
+  boost::mutex configuration_mutex_;
+
+  dynamic_reconfigure::Server<SocialForceControllerConfig> *dsrv_;
+  social_force_controller::SocialForceControllerConfig default_config_,
+      last_config_, step_config_;
+
+  ros::Time last_calc_time_;
+  bool reset_time_ = true;
+};
+}; // namespace social_force_controller
+
+#endif // SOCIAL_FORCE_CONTROLLER_H_
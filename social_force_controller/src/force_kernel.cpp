@@ -0,0 +1,175 @@
+#define MIN_PAIR_DIST 1e-3f // m
+#define EXP_MIN_ARG -87.0f
+#define EXP_MAX_ARG 80.0f
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#include "social_force_controller/force_kernel.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+// exp(x) as 2^n * p(f) with x = n ln2 + f, |f| <= ln2 / 2 and p the degree 6
+// taylor polynomial, relative error below 1e-6 over the clamped range
+#define EXP_LOG2E 1.44269504f
+#define EXP_LN2_HI 0.693359375f
+#define EXP_LN2_LO -2.12194440e-4f
+#define EXP_C2 (1.0f / 2.0f)
+#define EXP_C3 (1.0f / 6.0f)
+#define EXP_C4 (1.0f / 24.0f)
+#define EXP_C5 (1.0f / 120.0f)
+#define EXP_C6 (1.0f / 720.0f)
+
+namespace social_force_controller {
+namespace {
+inline float fastExp(float x) {
+  x = std::min(std::max(x, EXP_MIN_ARG), EXP_MAX_ARG);
+  float n = std::floor(x * EXP_LOG2E + 0.5f);
+  float f = x - n * EXP_LN2_HI - n * EXP_LN2_LO;
+  float p =
+      1.0f +
+      f * (1.0f +
+           f * (EXP_C2 + f * (EXP_C3 + f * (EXP_C4 + f * (EXP_C5 + f * EXP_C6)))));
+  int32_t bits = ((int32_t)n + 127) << 23;
+  float scale;
+  std::memcpy(&scale, &bits, sizeof(scale));
+  return p * scale;
+}
+
+#if defined(__AVX2__)
+inline __m256 fastExp(__m256 x) {
+  x = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(EXP_MIN_ARG)),
+                    _mm256_set1_ps(EXP_MAX_ARG));
+  __m256 n = _mm256_floor_ps(_mm256_add_ps(
+      _mm256_mul_ps(x, _mm256_set1_ps(EXP_LOG2E)), _mm256_set1_ps(0.5f)));
+  __m256 f = _mm256_sub_ps(
+      _mm256_sub_ps(x, _mm256_mul_ps(n, _mm256_set1_ps(EXP_LN2_HI))),
+      _mm256_mul_ps(n, _mm256_set1_ps(EXP_LN2_LO)));
+  __m256 p = _mm256_set1_ps(EXP_C6);
+  p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(EXP_C5));
+  p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(EXP_C4));
+  p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(EXP_C3));
+  p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(EXP_C2));
+  p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(1.0f));
+  p = _mm256_add_ps(_mm256_mul_ps(p, f), _mm256_set1_ps(1.0f));
+  __m256i bits = _mm256_slli_epi32(
+      _mm256_add_epi32(_mm256_cvtps_epi32(n), _mm256_set1_epi32(127)), 23);
+  return _mm256_mul_ps(p, _mm256_castsi256_ps(bits));
+}
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+inline float32x4_t fastExp(float32x4_t x) {
+  x = vminq_f32(vmaxq_f32(x, vdupq_n_f32(EXP_MIN_ARG)),
+                vdupq_n_f32(EXP_MAX_ARG));
+  float32x4_t n = vrndmq_f32(
+      vaddq_f32(vmulq_f32(x, vdupq_n_f32(EXP_LOG2E)), vdupq_n_f32(0.5f)));
+  float32x4_t f =
+      vsubq_f32(vsubq_f32(x, vmulq_f32(n, vdupq_n_f32(EXP_LN2_HI))),
+                vmulq_f32(n, vdupq_n_f32(EXP_LN2_LO)));
+  float32x4_t p = vdupq_n_f32(EXP_C6);
+  p = vaddq_f32(vmulq_f32(p, f), vdupq_n_f32(EXP_C5));
+  p = vaddq_f32(vmulq_f32(p, f), vdupq_n_f32(EXP_C4));
+  p = vaddq_f32(vmulq_f32(p, f), vdupq_n_f32(EXP_C3));
+  p = vaddq_f32(vmulq_f32(p, f), vdupq_n_f32(EXP_C2));
+  p = vaddq_f32(vmulq_f32(p, f), vdupq_n_f32(1.0f));
+  p = vaddq_f32(vmulq_f32(p, f), vdupq_n_f32(1.0f));
+  int32x4_t bits =
+      vshlq_n_s32(vaddq_s32(vcvtq_s32_f32(n), vdupq_n_s32(127)), 23);
+  return vmulq_f32(p, vreinterpretq_f32_s32(bits));
+}
+#endif
+}; // namespace
+
+void computePairForces(const InteractionPairs &pairs,
+                       const ForceParams &params, size_t begin, size_t end,
+                       float *fx, float *fy) {
+  const float *dx = pairs.dx.data(), *dy = pairs.dy.data(),
+              *radii = pairs.radii.data(), *ex = pairs.ex.data(),
+              *ey = pairs.ey.data();
+  const float inv_range = 1.0f / std::max(params.range, MIN_PAIR_DIST);
+  // weight is anisotropy + (1 - anisotropy) * (1 + cos) / 2
+  const float weight_base = 0.5f * (1.0f + params.anisotropy);
+  const float weight_cos = 0.5f * (1.0f - params.anisotropy);
+  size_t size = std::min(end, pairs.size()), i = begin;
+
+  // no fused multiply-add so that results match the scalar loop
+#if defined(__AVX2__)
+  const __m256 vstrength = _mm256_set1_ps(params.strength),
+               vinv_range = _mm256_set1_ps(inv_range),
+               vweight_base = _mm256_set1_ps(weight_base),
+               vweight_cos = _mm256_set1_ps(weight_cos),
+               vmin_dist = _mm256_set1_ps(MIN_PAIR_DIST);
+  for (; i + 8 <= size; i += 8) {
+    __m256 vdx = _mm256_loadu_ps(dx + i), vdy = _mm256_loadu_ps(dy + i);
+    __m256 dist = _mm256_max_ps(
+        _mm256_sqrt_ps(
+            _mm256_add_ps(_mm256_mul_ps(vdx, vdx), _mm256_mul_ps(vdy, vdy))),
+        vmin_dist);
+    __m256 inv_dist = _mm256_div_ps(_mm256_set1_ps(1.0f), dist);
+    __m256 magnitude = _mm256_mul_ps(
+        vstrength, fastExp(_mm256_mul_ps(
+                       _mm256_sub_ps(_mm256_loadu_ps(radii + i), dist),
+                       vinv_range)));
+    __m256 cos_phi = _mm256_mul_ps(
+        _mm256_add_ps(_mm256_mul_ps(vdx, _mm256_loadu_ps(ex + i)),
+                      _mm256_mul_ps(vdy, _mm256_loadu_ps(ey + i))),
+        inv_dist);
+    __m256 scale = _mm256_mul_ps(
+        _mm256_mul_ps(
+            _mm256_add_ps(vweight_base, _mm256_mul_ps(vweight_cos, cos_phi)),
+            magnitude),
+        inv_dist);
+    _mm256_storeu_ps(fx + i,
+                     _mm256_sub_ps(_mm256_setzero_ps(),
+                                   _mm256_mul_ps(scale, vdx)));
+    _mm256_storeu_ps(fy + i,
+                     _mm256_sub_ps(_mm256_setzero_ps(),
+                                   _mm256_mul_ps(scale, vdy)));
+  }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+  const float32x4_t vstrength = vdupq_n_f32(params.strength),
+                    vinv_range = vdupq_n_f32(inv_range),
+                    vweight_base = vdupq_n_f32(weight_base),
+                    vweight_cos = vdupq_n_f32(weight_cos),
+                    vmin_dist = vdupq_n_f32(MIN_PAIR_DIST);
+  for (; i + 4 <= size; i += 4) {
+    float32x4_t vdx = vld1q_f32(dx + i), vdy = vld1q_f32(dy + i);
+    float32x4_t dist = vmaxq_f32(
+        vsqrtq_f32(vaddq_f32(vmulq_f32(vdx, vdx), vmulq_f32(vdy, vdy))),
+        vmin_dist);
+    float32x4_t inv_dist = vdivq_f32(vdupq_n_f32(1.0f), dist);
+    float32x4_t magnitude = vmulq_f32(
+        vstrength,
+        fastExp(vmulq_f32(vsubq_f32(vld1q_f32(radii + i), dist), vinv_range)));
+    float32x4_t cos_phi =
+        vmulq_f32(vaddq_f32(vmulq_f32(vdx, vld1q_f32(ex + i)),
+                            vmulq_f32(vdy, vld1q_f32(ey + i))),
+                  inv_dist);
+    float32x4_t scale = vmulq_f32(
+        vmulq_f32(vaddq_f32(vweight_base, vmulq_f32(vweight_cos, cos_phi)),
+                  magnitude),
+        inv_dist);
+    vst1q_f32(fx + i, vnegq_f32(vmulq_f32(scale, vdx)));
+    vst1q_f32(fy + i, vnegq_f32(vmulq_f32(scale, vdy)));
+  }
+#endif
+
+  for (; i < size; i++) {
+    float dist = std::max(std::sqrt(dx[i] * dx[i] + dy[i] * dy[i]),
+                          MIN_PAIR_DIST);
+    float inv_dist = 1.0f / dist;
+    float magnitude =
+        params.strength * fastExp((radii[i] - dist) * inv_range);
+    float cos_phi = (dx[i] * ex[i] + dy[i] * ey[i]) * inv_dist;
+    float scale =
+        (weight_base + weight_cos * cos_phi) * magnitude * inv_dist;
+    fx[i] = -(scale * dx[i]);
+    fy[i] = -(scale * dy[i]);
+  }
+}
+}; // namespace social_force_controller
@@ -0,0 +1,633 @@
+#define NODE_NAME "social_force_controller"
+#define DEFAULT_CONTROLLER_FRAME "map"
+#define MAX_SUBSTEP_TIME 0.05 // seconds
+#define MIN_SPEED 0.01        // m/s, below which humans keep their heading
+#define PAD_PAIR_DIST 1e3f    // m, offset of unused interaction pairs
+
+#include <pluginlib/class_list_macros.h>
+#include <angles/angles.h>
+#include <costmap_2d/cost_values.h>
+
+#include "social_force_controller/social_force_controller.h"
+
+PLUGINLIB_EXPORT_CLASS(social_force_controller::SocialForceController,
+                       move_humans::ControllerInterface)
+
+namespace social_force_controller {
+SocialForceController::SocialForceController()
+    : initialized_(false), setup_(false), costmap_ros_(NULL), tf_(NULL),
+      dsrv_(NULL) {}
+
+SocialForceController::~SocialForceController() { delete dsrv_; }
+
+void SocialForceController::initialize(std::string name,
+                                       tf::TransformListener *tf,
+                                       costmap_2d::Costmap2DROS *costmap_ros) {
+  if (!isInitialized()) {
+    ros::NodeHandle private_nh("~/" + name);
+    tf_ = tf;
+    costmap_ros_ = costmap_ros;
+    controller_frame_ = costmap_ros_->getGlobalFrameID();
+    if (controller_frame_.compare("") == 0) {
+      controller_frame_ = DEFAULT_CONTROLLER_FRAME;
+    }
+
+    dsrv_ = new dynamic_reconfigure::Server<SocialForceControllerConfig>(
+        private_nh);
+    dynamic_reconfigure::Server<SocialForceControllerConfig>::CallbackType cb =
+        boost::bind(&SocialForceController::reconfigureCB, this, _1, _2);
+    dsrv_->setCallback(cb);
+
+    initialized_ = true;
+  } else {
+    ROS_WARN_NAMED(NODE_NAME, "This controller has already been initialized");
+  }
+}
+
+void SocialForceController::initialize(std::string name,
+                                       std::string controller_frame) {
+  if (!isInitialized()) {
+    controller_frame_ = controller_frame;
+    if (controller_frame_.compare("") == 0) {
+      controller_frame_ = DEFAULT_CONTROLLER_FRAME;
+    }
+
+    auto config = SocialForceControllerConfig::__getDefault__();
+    default_config_ = config;
+    last_config_ = config;
+    setup_ = true;
+
+    initialized_ = true;
+  } else {
+    ROS_WARN_NAMED(NODE_NAME, "This controller has already been initialized");
+  }
+}
+
+void SocialForceController::setConfig(
+    const SocialForceControllerConfig &config) {
+  boost::mutex::scoped_lock l(configuration_mutex_);
+  last_config_ = config;
+}
+
+void SocialForceController::reconfigureCB(SocialForceControllerConfig &config,
+                                          uint32_t level) {
+  boost::mutex::scoped_lock l(configuration_mutex_);
+
+  if (setup_ && config.restore_defaults) {
+    config = default_config_;
+    config.restore_defaults = false;
+  }
+  if (!setup_) {
+    default_config_ = config;
+    setup_ = true;
+  }
+
+  last_config_ = config;
+}
+
+bool SocialForceController::setPlans(
+    const move_humans::map_pose_vector &plans) {
+  move_humans::map_trajectory trajectory_map;
+  return setPlans(plans, trajectory_map);
+}
+
+bool SocialForceController::setPlans(
+    const move_humans::map_pose_vector &plans,
+    const move_humans::map_trajectory &trajectories) {
+  if (!isInitialized()) {
+    ROS_ERROR_NAMED(NODE_NAME, "This controller has not been initialized");
+    return false;
+  }
+
+  ROS_DEBUG_NAMED(NODE_NAME, "Got %ld plan%s and %ld trajector%s", plans.size(),
+                  plans.size() > 1 ? "s" : "", trajectories.size(),
+                  trajectories.size() != 1 ? "ies" : "y");
+
+  for (auto &plan_kv : plans) {
+    size_t slot = addHuman(plan_kv.first);
+    plans_[slot] = plan_kv.second;
+    cursors_[slot] = 0;
+    has_plan_[slot] = true;
+    transformed_[slot] = false;
+    reached_[slot] = false;
+  }
+
+  // trajectories override plans, only their path is followed as humans move
+  // with their own dynamics
+  for (auto &trajectory_kv : trajectories) {
+    size_t slot = addHuman(trajectory_kv.first);
+    auto &trajectory = trajectory_kv.second;
+    auto &plan = plans_[slot];
+    plan.resize(trajectory.points.size());
+    for (size_t i = 0; i < trajectory.points.size(); i++) {
+      auto &transform = trajectory.points[i].transform;
+      plan[i].header = trajectory.header;
+      plan[i].pose.position.x = transform.translation.x;
+      plan[i].pose.position.y = transform.translation.y;
+      plan[i].pose.position.z = transform.translation.z;
+      plan[i].pose.orientation = transform.rotation;
+    }
+    cursors_[slot] = 0;
+    has_plan_[slot] = true;
+    transformed_[slot] = false;
+    reached_[slot] = false;
+  }
+
+  return true;
+}
+
+bool SocialForceController::computeHumansStates(
+    move_humans::map_traj_point &humans) {
+  // check if are running a new control sequency, reset time in case
+  auto now = ros::Time::now();
+  if (reset_time_) {
+    last_calc_time_ = now;
+    reset_time_ = false;
+    return true;
+  }
+  double cycle_time = (now - last_calc_time_).toSec();
+  last_calc_time_ = now;
+  return stepHumans(humans, cycle_time);
+}
+
+bool SocialForceController::computeHumansStates(
+    move_humans::map_traj_point &humans, double dt) {
+  // keep elapsed time consistent in case the caller switches back to it
+  last_calc_time_ = ros::Time::now();
+  reset_time_ = false;
+  return stepHumans(humans, dt);
+}
+
+bool SocialForceController::stepHumans(move_humans::map_traj_point &humans,
+                                       double cycle_time) {
+  {
+    boost::mutex::scoped_lock l(configuration_mutex_);
+    step_config_ = last_config_;
+  }
+
+  if (!transformPlans()) {
+    ROS_ERROR_NAMED(NODE_NAME, "Cannot transform plans to controller frame");
+    return false;
+  }
+
+  // humans of new plans start at the plan start if they are new or too far
+  // from it
+  active_.clear();
+  started_.clear();
+  for (size_t slot = 0; slot < ids_.size(); slot++) {
+    if (!has_plan_[slot] || !transformed_[slot] || reached_[slot]) {
+      continue;
+    }
+    auto &path_x = path_x_[slot];
+    auto &path_y = path_y_[slot];
+    if (cursors_[slot] == 0 &&
+        (!has_state_[slot] ||
+         std::hypot(path_x[0] - x_[slot], path_y[0] - y_[slot]) >
+             step_config_.reset_dist)) {
+      if (step_config_.wait_for_free_start && isStartOccupied(slot)) {
+        ROS_DEBUG_THROTTLE_NAMED(1.0, NODE_NAME,
+                                 "Human %ld waits for its start to be free",
+                                 ids_[slot]);
+        continue;
+      }
+      started_.push_back(slot);
+      if (has_state_[slot]) {
+        ROS_INFO_NAMED(NODE_NAME, "Resetting human %ld controller",
+                       ids_[slot]);
+      }
+      x_[slot] = path_x[0];
+      y_[slot] = path_y[0];
+      yaw_[slot] = path_x.size() > 1 ? std::atan2(path_y[1] - path_y[0],
+                                                  path_x[1] - path_x[0])
+                                     : goal_yaw_[slot];
+      vel_x_[slot] = vel_y_[slot] = angular_vel_[slot] = 0.0;
+      has_state_[slot] = true;
+    }
+    active_.push_back(slot);
+  }
+
+  if (cycle_time > 0.0) {
+    size_t substeps = (size_t)std::ceil(cycle_time / MAX_SUBSTEP_TIME);
+    for (size_t i = 0; i < substeps && !active_.empty(); i++) {
+      substep(cycle_time / substeps);
+    }
+  }
+
+  // give states of all humans, humans that reached their goals in this cycle
+  // are given for the last time and then forgotten until they get a new plan
+  humans.clear();
+  bool any_state = false;
+  for (size_t slot = 0; slot < ids_.size(); slot++) {
+    if (!has_state_[slot]) {
+      continue;
+    }
+    auto &point = humans[ids_[slot]];
+    point.transform.translation.x = x_[slot];
+    point.transform.translation.y = y_[slot];
+    point.transform.rotation = tf::createQuaternionMsgFromYaw(yaw_[slot]);
+    point.velocity.linear.x = std::hypot(vel_x_[slot], vel_y_[slot]);
+    point.velocity.angular.z = angular_vel_[slot];
+    point.time_from_start.fromSec(-1.0);
+    if (reached_[slot]) {
+      has_state_[slot] = false;
+      has_plan_[slot] = false;
+      plans_[slot].clear();
+      path_x_[slot].clear();
+      path_y_[slot].clear();
+    } else {
+      any_state = true;
+    }
+  }
+
+  if (!any_state) {
+    reset_time_ = true;
+  }
+  return true;
+}
+
+void SocialForceController::substep(double dt) {
+  // neighbours are queried among active humans, entries are their indices
+  // in active_
+  size_t count = active_.size(),
+         max_neighbors = (size_t)step_config_.max_neighbors;
+  index_entries_.resize(count);
+  for (size_t i = 0; i < count; i++) {
+    index_entries_[i] = {i, x_[active_[i]], y_[active_[i]]};
+  }
+  index_.setCellSize(step_config_.interaction_radius);
+  index_.rebuild(index_entries_);
+
+  pairs_.resize(count * max_neighbors);
+  pair_fx_.resize(count * max_neighbors);
+  pair_fy_.resize(count * max_neighbors);
+  pair_counts_.resize(count);
+  new_vel_x_.resize(count);
+  new_vel_y_.resize(count);
+  step_reached_.assign(count, 0);
+
+  // velocities are solved from the positions before the substep, positions
+  // are only moved once all velocities are known
+  forActive([this, dt](size_t begin, size_t end, size_t worker) {
+    solveVelocities(begin, end, worker_neighbors_[worker], dt);
+  });
+  forActive([this, dt](size_t begin, size_t end, size_t worker) {
+    for (size_t i = begin; i < end; i++) {
+      step_reached_[i] = integrate(i, dt);
+    }
+  });
+
+  size_t moving = 0;
+  for (size_t i = 0; i < count; i++) {
+    if (step_reached_[i]) {
+      reached_[active_[i]] = true;
+    } else {
+      active_[moving++] = active_[i];
+    }
+  }
+  active_.resize(moving);
+}
+
+void SocialForceController::forActive(
+    const move_humans::ThreadPool::RangeFunction &fn) {
+  if (step_config_.parallel_threads != 1 &&
+      active_.size() >= (size_t)step_config_.parallel_min_humans) {
+    step_pool_.resize(step_config_.parallel_threads);
+    worker_neighbors_.resize(step_pool_.size());
+    step_pool_.parallelFor(active_.size(), step_config_.parallel_grain, fn);
+  } else {
+    worker_neighbors_.resize(std::max(worker_neighbors_.size(), (size_t)1));
+    fn(0, active_.size(), 0);
+  }
+}
+
+void SocialForceController::solveVelocities(
+    size_t begin, size_t end, move_humans::SpatialIndex::Neighbors &neighbors,
+    double dt) {
+  size_t max_neighbors = (size_t)step_config_.max_neighbors;
+  float contact_dist = 2.0 * step_config_.human_radius;
+
+  // gather the nearest neighbours of every human, unused pairs are far away
+  for (size_t i = begin; i < end; i++) {
+    size_t slot = active_[i], pair = i * max_neighbors, pair_count = 0;
+    double speed = std::hypot(vel_x_[slot], vel_y_[slot]);
+    float heading_x = speed > MIN_SPEED ? vel_x_[slot] / speed
+                                        : std::cos(yaw_[slot]),
+          heading_y = speed > MIN_SPEED ? vel_y_[slot] / speed
+                                        : std::sin(yaw_[slot]);
+    index_.radiusSearch(x_[slot], y_[slot], step_config_.interaction_radius,
+                        neighbors);
+    for (auto &neighbor : neighbors) {
+      if (pair_count == max_neighbors) {
+        break;
+      }
+      if (neighbor.second == i) {
+        continue;
+      }
+      size_t neighbor_slot = active_[neighbor.second];
+      pairs_.set(pair + pair_count++, x_[neighbor_slot] - x_[slot],
+                 y_[neighbor_slot] - y_[slot], contact_dist, heading_x,
+                 heading_y);
+    }
+    pair_counts_[i] = pair_count;
+    for (; pair_count < max_neighbors; pair_count++) {
+      pairs_.set(pair + pair_count, PAD_PAIR_DIST, 0.0f, 0.0f, 1.0f, 0.0f);
+    }
+  }
+
+  ForceParams params;
+  params.strength = step_config_.social_strength;
+  params.range = step_config_.social_range;
+  params.anisotropy = step_config_.anisotropy;
+  computePairForces(pairs_, params, begin * max_neighbors,
+                    end * max_neighbors, pair_fx_.data(), pair_fy_.data());
+
+  for (size_t i = begin; i < end; i++) {
+    size_t slot = active_[i], cursor = cursors_[slot];
+    double social_x = 0.0, social_y = 0.0;
+    for (size_t pair = i * max_neighbors;
+         pair < i * max_neighbors + pair_counts_[i]; pair++) {
+      social_x += pair_fx_[pair];
+      social_y += pair_fy_[pair];
+    }
+
+    // relax towards the desired velocity to the carrot, slowing down on the
+    // last path point
+    double carrot_x = path_x_[slot][cursor] - x_[slot],
+           carrot_y = path_y_[slot][cursor] - y_[slot];
+    double carrot_dist = std::hypot(carrot_x, carrot_y);
+    double desired_speed = step_config_.max_linear_vel;
+    if (cursor + 1 == path_x_[slot].size()) {
+      desired_speed = std::min(desired_speed,
+                               carrot_dist / step_config_.relaxation_time);
+    }
+    double desired_x = 0.0, desired_y = 0.0;
+    if (carrot_dist > 0.0) {
+      desired_x = desired_speed * carrot_x / carrot_dist;
+      desired_y = desired_speed * carrot_y / carrot_dist;
+    }
+    double vel_x = vel_x_[slot] +
+                   ((desired_x - vel_x_[slot]) / step_config_.relaxation_time +
+                    social_x) *
+                       dt;
+    double vel_y = vel_y_[slot] +
+                   ((desired_y - vel_y_[slot]) / step_config_.relaxation_time +
+                    social_y) *
+                       dt;
+    double speed = std::hypot(vel_x, vel_y);
+    if (speed > step_config_.max_linear_vel) {
+      vel_x *= step_config_.max_linear_vel / speed;
+      vel_y *= step_config_.max_linear_vel / speed;
+    }
+    new_vel_x_[i] = vel_x;
+    new_vel_y_[i] = vel_y;
+  }
+}
+
+bool SocialForceController::integrate(size_t index, double dt) {
+  size_t slot = active_[index];
+  double vel_x = new_vel_x_[index], vel_y = new_vel_y_[index];
+  double x = x_[slot] + vel_x * dt, y = y_[slot] + vel_y * dt;
+
+  // slide along obstacles, stop if both directions are blocked
+  if (step_config_.avoid_obstacles && !isFree(x, y)) {
+    if (isFree(x, y_[slot])) {
+      y = y_[slot];
+      vel_y = 0.0;
+    } else if (isFree(x_[slot], y)) {
+      x = x_[slot];
+      vel_x = 0.0;
+    } else {
+      x = x_[slot];
+      y = y_[slot];
+      vel_x = vel_y = 0.0;
+    }
+  }
+  x_[slot] = x;
+  y_[slot] = y;
+  vel_x_[slot] = vel_x;
+  vel_y_[slot] = vel_y;
+
+  // turn towards the walking direction with limited angular velocity
+  angular_vel_[slot] = 0.0;
+  if (std::hypot(vel_x, vel_y) > MIN_SPEED) {
+    double max_turn = step_config_.max_angular_vel * dt;
+    double turn = std::min(
+        std::max(angles::shortest_angular_distance(yaw_[slot],
+                                                   std::atan2(vel_y, vel_x)),
+                 -max_turn),
+        max_turn);
+    yaw_[slot] = angles::normalize_angle(yaw_[slot] + turn);
+    angular_vel_[slot] = dt > 0.0 ? turn / dt : 0.0;
+  }
+
+  // move the carrot ahead along the path
+  auto &path_x = path_x_[slot];
+  auto &path_y = path_y_[slot];
+  size_t &cursor = cursors_[slot], last = path_x.size() - 1;
+  while (cursor < last && std::hypot(path_x[cursor] - x, path_y[cursor] - y) <
+                              step_config_.lookahead_dist) {
+    cursor++;
+  }
+
+  if (cursor == last && std::hypot(path_x[last] - x, path_y[last] - y) <
+                            step_config_.goal_tolerance) {
+    x_[slot] = path_x[last];
+    y_[slot] = path_y[last];
+    yaw_[slot] = goal_yaw_[slot];
+    vel_x_[slot] = vel_y_[slot] = angular_vel_[slot] = 0.0;
+    return true;
+  }
+  return false;
+}
+
+bool SocialForceController::isStartOccupied(size_t slot) {
+  double start_x = path_x_[slot][0], start_y = path_y_[slot][0],
+         contact_dist = 2.0 * step_config_.human_radius;
+  // humans started in this cycle are not in the index yet
+  for (auto started_slot : started_) {
+    if (std::hypot(x_[started_slot] - start_x, y_[started_slot] - start_y) <
+        contact_dist) {
+      return true;
+    }
+  }
+  if (!humans_index_) {
+    return false;
+  }
+  humans_index_->radiusSearch(start_x, start_y, contact_dist,
+                              start_neighbors_);
+  for (auto &neighbor : start_neighbors_) {
+    if (neighbor.second != ids_[slot]) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool SocialForceController::isFree(double x, double y) const {
+  if (!costmap_ros_) {
+    return true;
+  }
+  auto costmap = costmap_ros_->getCostmap();
+  unsigned int mx, my;
+  if (!costmap->worldToMap(x, y, mx, my)) {
+    return true;
+  }
+  auto cost = costmap->getCost(mx, my);
+  return cost < costmap_2d::LETHAL_OBSTACLE ||
+         cost == costmap_2d::NO_INFORMATION;
+}
+
+bool SocialForceController::areGoalsReached(
+    move_humans::id_vector &reached_humans) {
+  if (!isInitialized()) {
+    ROS_ERROR_NAMED(NODE_NAME, "This controller has not been initialized");
+    return false;
+  }
+
+  reached_humans.clear();
+  for (size_t slot = reached_.find_first();
+       slot != boost::dynamic_bitset<>::npos; slot = reached_.find_next(slot)) {
+    reached_humans.push_back(ids_[slot]);
+  }
+  return true;
+}
+
+bool SocialForceController::removeHumans(
+    const move_humans::id_vector &human_ids) {
+  if (!isInitialized()) {
+    ROS_ERROR_NAMED(NODE_NAME, "This controller has not been initialized");
+    return false;
+  }
+
+  for (auto human_id : human_ids) {
+    removeHuman(human_id);
+  }
+  return true;
+}
+
+bool SocialForceController::transformPlans() {
+  bool any_transformed = false;
+  for (size_t slot = 0; slot < ids_.size(); slot++) {
+    if (!has_plan_[slot] || reached_[slot]) {
+      continue;
+    }
+    if (!transformed_[slot]) {
+      transformed_[slot] = transformPlan(slot);
+    }
+    any_transformed |= transformed_[slot];
+  }
+  return any_transformed;
+}
+
+bool SocialForceController::transformPlan(size_t slot) {
+  auto human_id = ids_[slot];
+  auto &plan = plans_[slot];
+
+  if (plan.empty()) {
+    ROS_ERROR_NAMED(NODE_NAME, "Received empty plan for human %ld", human_id);
+    return false;
+  }
+
+  auto &plan_frame = plan[0].header.frame_id;
+  if (plan_frame == "") {
+    ROS_ERROR_NAMED(NODE_NAME, "Plan frame is empty for human %ld", human_id);
+    return false;
+  }
+
+  tf::StampedTransform plan_to_controller_transform;
+  plan_to_controller_transform.setIdentity();
+  if (plan_frame != controller_frame_) {
+    if (!tf_) {
+      ROS_ERROR_NAMED(NODE_NAME,
+                      "Plan of human %ld is not in controller frame %s",
+                      human_id, controller_frame_.c_str());
+      return false;
+    }
+    try {
+      tf_->lookupTransform(controller_frame_, plan_frame, ros::Time(0),
+                           plan_to_controller_transform);
+    } catch (tf::TransformException &ex) {
+      ROS_ERROR_NAMED(NODE_NAME, "No Transform available from %s to %s: %s",
+                      plan_frame.c_str(), controller_frame_.c_str(),
+                      ex.what());
+      return false;
+    }
+  }
+
+  auto &path_x = path_x_[slot];
+  auto &path_y = path_y_[slot];
+  path_x.resize(plan.size());
+  path_y.resize(plan.size());
+  for (size_t i = 0; i < plan.size(); i++) {
+    auto point = plan_to_controller_transform *
+                 tf::Vector3(plan[i].pose.position.x, plan[i].pose.position.y,
+                             plan[i].pose.position.z);
+    path_x[i] = point.x();
+    path_y[i] = point.y();
+  }
+  goal_yaw_[slot] = angles::normalize_angle(
+      tf::getYaw(plan_to_controller_transform.getRotation()) +
+      tf::getYaw(plan.back().pose.orientation));
+  return true;
+}
+
+size_t SocialForceController::addHuman(uint64_t id) {
+  auto slot_it = slots_.find(id);
+  if (slot_it != slots_.end()) {
+    return slot_it->second;
+  }
+  size_t slot = ids_.size();
+  resizeHumans(slot + 1);
+  ids_[slot] = id;
+  slots_[id] = slot;
+  return slot;
+}
+
+void SocialForceController::removeHuman(uint64_t id) {
+  auto slot_it = slots_.find(id);
+  if (slot_it == slots_.end()) {
+    return;
+  }
+  size_t slot = slot_it->second, last = ids_.size() - 1;
+  slots_.erase(slot_it);
+  if (slot != last) {
+    ids_[slot] = ids_[last];
+    plans_[slot].swap(plans_[last]);
+    path_x_[slot].swap(path_x_[last]);
+    path_y_[slot].swap(path_y_[last]);
+    goal_yaw_[slot] = goal_yaw_[last];
+    cursors_[slot] = cursors_[last];
+    x_[slot] = x_[last];
+    y_[slot] = y_[last];
+    yaw_[slot] = yaw_[last];
+    vel_x_[slot] = vel_x_[last];
+    vel_y_[slot] = vel_y_[last];
+    angular_vel_[slot] = angular_vel_[last];
+    has_plan_[slot] = has_plan_[last];
+    transformed_[slot] = transformed_[last];
+    has_state_[slot] = has_state_[last];
+    reached_[slot] = reached_[last];
+    slots_[ids_[slot]] = slot;
+  }
+  resizeHumans(last);
+}
+
+void SocialForceController::resizeHumans(size_t size) {
+  ids_.resize(size);
+  plans_.resize(size);
+  path_x_.resize(size);
+  path_y_.resize(size);
+  goal_yaw_.resize(size, 0.0);
+  cursors_.resize(size, 0);
+  x_.resize(size, 0.0);
+  y_.resize(size, 0.0);
+  yaw_.resize(size, 0.0);
+  vel_x_.resize(size, 0.0);
+  vel_y_.resize(size, 0.0);
+  angular_vel_.resize(size, 0.0);
+  has_plan_.resize(size);
+  transformed_.resize(size);
+  has_state_.resize(size);
+  reached_.resize(size);
+}
+}; // namespace social_force_controller
@@ -0,0 +1,70 @@
+#ifndef TELEPORT_CONTROLLER_HUMAN_REGISTRY_H_
+#define TELEPORT_CONTROLLER_HUMAN_REGISTRY_H_
+
+#include <unordered_map>
+#include <vector>
+#include <boost/dynamic_bitset.hpp>
+#include <hanp_msgs/Trajectory.h>
+#include <move_humans/types.h>
+#include <teleport_controller/projection.h>
+
+namespace teleport_controller {
+// dense storage of the state of controlled humans, ids are mapped to slots
+// once and the state of all humans is kept in arrays indexed by slot, so that
+// all humans can be advanced in one pass, removing a human moves the last
+// slot into its place
+class HumanRegistry {
+public:
+  static const size_t npos = (size_t)-1;
+
+  // slot of the human, npos if unknown
+  size_t find(uint64_t id) const {
+    auto slot_it = slots_.find(id);
+    return slot_it != slots_.end() ? slot_it->second : npos;
+  }
+
+  // slot of the human, added with empty state if unknown
+  size_t add(uint64_t id);
+
+  void remove(uint64_t id);
+  void clear();
+
+  size_t size() const { return ids.size(); }
+
+  // current state of the human at slot as trajectory point
+  hanp_msgs::TrajectoryPoint getPoint(size_t slot) const;
+  void setPoint(size_t slot, const hanp_msgs::TrajectoryPoint &point) {
+    storePoint(slot, point);
+    has_state[slot] = true;
+  }
+  // store the state without touching flags, so that different slots can be
+  // written concurrently
+  void storePoint(size_t slot, const hanp_msgs::TrajectoryPoint &point);
+
+  std::vector<uint64_t> ids;
+
+  // motion given to the controller, either a plan or a trajectory, and the
+  // same motion as trajectory in the controller frame
+  std::vector<move_humans::pose_vector> plans;
+  std::vector<hanp_msgs::Trajectory> source_trajs, trajs;
+  std::vector<PackedPoints> packed_trajs;
+
+  // last computed state, valid for slots in has_state
+  std::vector<double> x, y, yaw, linear_vel_x, linear_vel_y, angular_vel,
+      time_from_start;
+
+  // index of the last traversed point of trajs
+  std::vector<size_t> cursors;
+
+  boost::dynamic_bitset<> has_motion, from_traj, transformed, has_state,
+      reached;
+
+private:
+  std::unordered_map<uint64_t, size_t> slots_;
+
+  void moveSlot(size_t from, size_t to);
+  void resize(size_t size);
+};
+}; // namespace teleport_controller
+
+#endif // TELEPORT_CONTROLLER_HUMAN_REGISTRY_H_
@@ -0,0 +1,28 @@
+#ifndef TELEPORT_CONTROLLER_PROJECTION_H_
+#define TELEPORT_CONTROLLER_PROJECTION_H_
+
+#include <vector>
+#include <hanp_msgs/Trajectory.h>
+
+namespace teleport_controller {
+// trajectory positions packed in separate x and y arrays, for vectorized
+// distance computations
+struct PackedPoints {
+  std::vector<double> x, y;
+
+  void assign(const hanp_msgs::Trajectory &traj);
+  void clear() {
+    x.clear();
+    y.clear();
+  }
+  size_t size() const { return x.size(); }
+};
+
+// scanning from begin, index of the last point before the squared distance
+// to (px, py) starts growing, end - 1 if it does not grow before end,
+// uses AVX2 or NEON when the build enables them, begin must be less than end
+size_t nearestApproach(const double *x, const double *y, size_t begin,
+                       size_t end, double px, double py);
+}; // namespace teleport_controller
+
+#endif // TELEPORT_CONTROLLER_PROJECTION_H_
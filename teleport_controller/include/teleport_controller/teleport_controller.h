@@ -8,6 +8,10 @@
 #include <hanp_msgs/HumanPathArray.h>
 #include <boost/thread.hpp>
 #include <move_humans/controller_interface.h>
+#include <move_humans/profiler.h>
+#include <move_humans/publish_throttle.h>
+#include <move_humans/thread_pool.h>
+#include <teleport_controller/human_registry.h>
 
 #include <teleport_controller/TeleportControllerConfig.h>
 
@@ -23,14 +27,25 @@ public:
   void initialize(std::string name, tf::TransformListener *tf,
                   costmap_2d::Costmap2DROS *costmap_ros);
 
+  // initialize without any ROS communication, for running the controller
+  // outside of a node, e.g. in benchmarks, plans must be given in the
+  // controller frame and are not published
+  void initialize(std::string name, std::string controller_frame);
+
+  // replace the configuration, as dynamic_reconfigure would
+  void setConfig(const TeleportControllerConfig &config);
+
   bool setPlans(const move_humans::map_pose_vector &plans);
   bool setPlans(const move_humans::map_pose_vector &plans,
                 const move_humans::map_trajectory &twists);
 
   bool computeHumansStates(move_humans::map_traj_point &humans);
+  bool computeHumansStates(move_humans::map_traj_point &humans, double dt);
 
   bool areGoalsReached(move_humans::id_vector &reached_humans);
 
+  bool removeHumans(const move_humans::id_vector &human_ids);
+
   bool isInitialized() { return initialized_; }
 
 private:
@@ -39,17 +54,24 @@ private:
 
   void reconfigureCB(TeleportControllerConfig &config, uint32_t level);
 
+  // advance all humans by cycle_time seconds
+  bool stepHumans(move_humans::map_traj_point &humans, double cycle_time);
+
+  // advance the human at slot, returns StepResult flags, only writes the
+  // state arrays of the slot so that humans can be stepped in parallel
+  enum StepResult { STEP_MOVED = 1, STEP_REACHED = 2 };
+  uint8_t stepHuman(size_t slot, double cycle_time);
+  std::vector<uint8_t> step_results_;
+  move_humans::ThreadPool step_pool_;
+
   costmap_2d::Costmap2DROS *costmap_ros_;
   tf::TransformListener *tf_;
 
   ros::Publisher plans_pub_;
+  move_humans::PublishThrottle plans_throttle_;
+  hanp_msgs::HumanPathArray plans_msg_;
 
-  move_humans::map_pose_vector plans_;
-  move_humans::map_trajectory trajs_;
-  move_humans::map_traj_point last_traj_points_;
-  move_humans::map_size last_traversed_indices_;
-  move_humans::map_trajectory last_transformed_trajs_;
-  move_humans::id_vector reached_goals_;
+  HumanRegistry humans_;
   double sq_dist_threshold_, goal_reached_threshold_;
   std::string controller_frame_;
 
@@ -58,11 +80,45 @@ private:
   dynamic_reconfigure::Server<TeleportControllerConfig> *dsrv_;
   teleport_controller::TeleportControllerConfig default_config_, last_config_;
 
-  bool transformPlansAndTrajs(const move_humans::map_pose_vector &plans,
-                              const move_humans::map_trajectory &trajs,
-                              move_humans::map_trajectory &transformed_trajs);
+  // transform motions that are not yet in controller frame, returns true if
+  // any human not at goal has a transformed trajectory
+  bool transformPlansAndTrajs();
+  bool transformPlan(size_t slot);
+  bool transformTraj(size_t slot);
+
+  // planar transform from a frame to controller frame, looked up without
+  // waiting, roll and pitch of the frame are ignored
+  struct FrameTransform {
+    bool looked_up = false, valid = false, twist_looked_up = false,
+         has_twist = false;
+    ros::Time stamp;
+    double x, y, z, cos_yaw, sin_yaw, cos_half_yaw, sin_half_yaw;
+    geometry_msgs::Twist twist;
+
+    void set(const tf::StampedTransform &transform);
+    // translation is a geometry_msgs::Point or geometry_msgs::Vector3
+    template <typename Translation>
+    void apply(const Translation &translation,
+               const geometry_msgs::Quaternion &rotation,
+               geometry_msgs::Transform &transformed) const {
+      transformed.translation.x =
+          x + cos_yaw * translation.x - sin_yaw * translation.y;
+      transformed.translation.y =
+          y + sin_yaw * translation.x + cos_yaw * translation.y;
+      transformed.translation.z = z + translation.z;
+      applyRotation(rotation, transformed.rotation);
+    }
+    void applyRotation(const geometry_msgs::Quaternion &rotation,
+                       geometry_msgs::Quaternion &transformed) const;
+  };
+  std::map<std::string, FrameTransform> frame_transforms_;
+
+  // cached transform of frame for this cycle, NULL if not available
+  const FrameTransform *getFrameTransform(const std::string &frame,
+                                          bool with_twist);
 
   bool getProjectedPose(const hanp_msgs::Trajectory &traj,
+                        const PackedPoints &packed_traj,
                         const size_t begin_index,
                         const geometry_msgs::Vector3 &pose,
                         geometry_msgs::Vector3 &projected_pose,
@@ -73,7 +129,7 @@ private:
                     const geometry_msgs::Vector3 &point,
                     geometry_msgs::Vector3 &porjected_point);
 
-  void publishPlansFromTrajs(const move_humans::map_trajectory &trajs);
+  void publishPlansFromTrajs();
 
   enum point_advancing_type { ACCUMULATIVE, DIRECT };
   point_advancing_type point_advance_method_ =
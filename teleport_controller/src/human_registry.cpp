@@ -0,0 +1,100 @@
+#include "teleport_controller/human_registry.h"
+#include <tf/transform_datatypes.h>
+
+namespace teleport_controller {
+size_t HumanRegistry::add(uint64_t id) {
+  auto slot_it = slots_.find(id);
+  if (slot_it != slots_.end()) {
+    return slot_it->second;
+  }
+  size_t slot = ids.size();
+  resize(slot + 1);
+  ids[slot] = id;
+  slots_[id] = slot;
+  return slot;
+}
+
+void HumanRegistry::remove(uint64_t id) {
+  auto slot_it = slots_.find(id);
+  if (slot_it == slots_.end()) {
+    return;
+  }
+  size_t slot = slot_it->second, last = ids.size() - 1;
+  slots_.erase(slot_it);
+  if (slot != last) {
+    moveSlot(last, slot);
+    slots_[ids[slot]] = slot;
+  }
+  resize(last);
+}
+
+void HumanRegistry::clear() {
+  slots_.clear();
+  resize(0);
+}
+
+hanp_msgs::TrajectoryPoint HumanRegistry::getPoint(size_t slot) const {
+  hanp_msgs::TrajectoryPoint point;
+  point.transform.translation.x = x[slot];
+  point.transform.translation.y = y[slot];
+  point.transform.rotation = tf::createQuaternionMsgFromYaw(yaw[slot]);
+  point.velocity.linear.x = linear_vel_x[slot];
+  point.velocity.linear.y = linear_vel_y[slot];
+  point.velocity.angular.z = angular_vel[slot];
+  point.time_from_start.fromSec(time_from_start[slot]);
+  return point;
+}
+
+void HumanRegistry::storePoint(size_t slot,
+                               const hanp_msgs::TrajectoryPoint &point) {
+  x[slot] = point.transform.translation.x;
+  y[slot] = point.transform.translation.y;
+  yaw[slot] = tf::getYaw(point.transform.rotation);
+  linear_vel_x[slot] = point.velocity.linear.x;
+  linear_vel_y[slot] = point.velocity.linear.y;
+  angular_vel[slot] = point.velocity.angular.z;
+  time_from_start[slot] = point.time_from_start.toSec();
+}
+
+void HumanRegistry::moveSlot(size_t from, size_t to) {
+  ids[to] = ids[from];
+  plans[to].swap(plans[from]);
+  source_trajs[to] = std::move(source_trajs[from]);
+  trajs[to] = std::move(trajs[from]);
+  packed_trajs[to] = std::move(packed_trajs[from]);
+  x[to] = x[from];
+  y[to] = y[from];
+  yaw[to] = yaw[from];
+  linear_vel_x[to] = linear_vel_x[from];
+  linear_vel_y[to] = linear_vel_y[from];
+  angular_vel[to] = angular_vel[from];
+  time_from_start[to] = time_from_start[from];
+  cursors[to] = cursors[from];
+  has_motion[to] = has_motion[from];
+  from_traj[to] = from_traj[from];
+  transformed[to] = transformed[from];
+  has_state[to] = has_state[from];
+  reached[to] = reached[from];
+}
+
+void HumanRegistry::resize(size_t size) {
+  ids.resize(size);
+  plans.resize(size);
+  source_trajs.resize(size);
+  trajs.resize(size);
+  packed_trajs.resize(size);
+  x.resize(size, 0.0);
+  y.resize(size, 0.0);
+  yaw.resize(size, 0.0);
+  linear_vel_x.resize(size, 0.0);
+  linear_vel_y.resize(size, 0.0);
+  angular_vel.resize(size, 0.0);
+  time_from_start.resize(size, 0.0);
+  cursors.resize(size, 0);
+  has_motion.resize(size);
+  from_traj.resize(size);
+  transformed.resize(size);
+  has_state.resize(size);
+  reached.resize(size);
+}
+}; // namespace teleport_controller
@@ -0,0 +1,72 @@
+#include "teleport_controller/projection.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+namespace teleport_controller {
+void PackedPoints::assign(const hanp_msgs::Trajectory &traj) {
+  x.resize(traj.points.size());
+  y.resize(traj.points.size());
+  for (size_t i = 0; i < traj.points.size(); i++) {
+    x[i] = traj.points[i].transform.translation.x;
+    y[i] = traj.points[i].transform.translation.y;
+  }
+}
+
+size_t nearestApproach(const double *x, const double *y, size_t begin,
+                       size_t end, double px, double py) {
+  size_t i = begin;
+
+  // compare distances of points i..i+n-1 with those of i+1..i+n, the first
+  // lane where the distance grows ends the approach, no fused multiply-add
+  // so that results match the scalar loop
+#if defined(__AVX2__)
+  const __m256d vpx = _mm256_set1_pd(px), vpy = _mm256_set1_pd(py);
+  for (; i + 4 < end; i += 4) {
+    __m256d dx = _mm256_sub_pd(_mm256_loadu_pd(x + i), vpx);
+    __m256d dy = _mm256_sub_pd(_mm256_loadu_pd(y + i), vpy);
+    __m256d d0 = _mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy));
+    dx = _mm256_sub_pd(_mm256_loadu_pd(x + i + 1), vpx);
+    dy = _mm256_sub_pd(_mm256_loadu_pd(y + i + 1), vpy);
+    __m256d d1 = _mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy));
+    int grows = _mm256_movemask_pd(_mm256_cmp_pd(d1, d0, _CMP_GT_OQ));
+    if (grows) {
+      return i + __builtin_ctz(grows);
+    }
+  }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+  const float64x2_t vpx = vdupq_n_f64(px), vpy = vdupq_n_f64(py);
+  for (; i + 2 < end; i += 2) {
+    float64x2_t dx = vsubq_f64(vld1q_f64(x + i), vpx);
+    float64x2_t dy = vsubq_f64(vld1q_f64(y + i), vpy);
+    float64x2_t d0 = vaddq_f64(vmulq_f64(dx, dx), vmulq_f64(dy, dy));
+    dx = vsubq_f64(vld1q_f64(x + i + 1), vpx);
+    dy = vsubq_f64(vld1q_f64(y + i + 1), vpy);
+    float64x2_t d1 = vaddq_f64(vmulq_f64(dx, dx), vmulq_f64(dy, dy));
+    uint64x2_t grows = vcgtq_f64(d1, d0);
+    if (vgetq_lane_u64(grows, 0)) {
+      return i;
+    }
+    if (vgetq_lane_u64(grows, 1)) {
+      return i + 1;
+    }
+  }
+#endif
+
+  double x_diff = x[i] - px, y_diff = y[i] - py;
+  double sq_diff = x_diff * x_diff + y_diff * y_diff;
+  for (; i + 1 < end; i++) {
+    x_diff = x[i + 1] - px;
+    y_diff = y[i + 1] - py;
+    double next_sq_diff = x_diff * x_diff + y_diff * y_diff;
+    if (next_sq_diff > sq_diff) {
+      return i;
+    }
+    sq_diff = next_sq_diff;
+  }
+  return i;
+}
+}; // namespace teleport_controller
@@ -16,7 +16,9 @@ PLUGINLIB_EXPORT_CLASS(teleport_controller::TeleportController,
                        move_humans::ControllerInterface)
 
 namespace teleport_controller {
-TeleportController::TeleportController() : initialized_(false), setup_(false) {}
+TeleportController::TeleportController()
+    : initialized_(false), setup_(false), costmap_ros_(NULL), tf_(NULL),
+      dsrv_(NULL) {}
 
 TeleportController::~TeleportController() { delete dsrv_; }
 
@@ -46,6 +48,31 @@ void TeleportController::initialize(std::string name, tf::TransformListener *tf,
   }
 }
 
+void TeleportController::initialize(std::string name,
+                                    std::string controller_frame) {
+  if (!isInitialized()) {
+    controller_frame_ = controller_frame;
+    if (controller_frame_.compare("") == 0) {
+      controller_frame_ = DEFAULT_CONTROLLER_FRAME;
+    }
+
+    auto config = TeleportControllerConfig::__getDefault__();
+    config.publish_plans = false;
+    default_config_ = config;
+    last_config_ = config;
+    setup_ = true;
+
+    initialized_ = true;
+  } else {
+    ROS_WARN_NAMED(NODE_NAME, "This controller has already been initialized");
+  }
+}
+
+void TeleportController::setConfig(const TeleportControllerConfig &config) {
+  boost::mutex::scoped_lock l(configuration_mutex_);
+  last_config_ = config;
+}
+
 void TeleportController::reconfigureCB(TeleportControllerConfig &config,
                                        uint32_t level) {
   boost::mutex::scoped_lock l(configuration_mutex_);
@@ -80,37 +107,34 @@ bool TeleportController::setPlans(
                   trajectories.size() > 0 ? "y" : "ies");
 
   for (auto &plan_kv : plans) {
-    auto &human_id = plan_kv.first;
-    auto &plan = plan_kv.second;
-
-    reached_goals_.erase(
-        std::remove(reached_goals_.begin(), reached_goals_.end(), human_id),
-        reached_goals_.end());
-    last_traversed_indices_.erase(human_id);
-    last_transformed_trajs_.erase(human_id);
-    plans_[human_id] = plan;
+    size_t slot = humans_.add(plan_kv.first);
+    humans_.reached[slot] = false;
+    humans_.cursors[slot] = 0;
+    humans_.transformed[slot] = false;
+    humans_.plans[slot] = plan_kv.second;
+    humans_.source_trajs[slot].points.clear();
+    humans_.from_traj[slot] = false;
+    humans_.has_motion[slot] = true;
   }
 
   for (auto &trajectory_kv : trajectories) {
-    auto &human_id = trajectory_kv.first;
-    auto &trajectory = trajectory_kv.second;
-
-    reached_goals_.erase(
-        std::remove(reached_goals_.begin(), reached_goals_.end(), human_id),
-        reached_goals_.end());
-    last_traversed_indices_.erase(human_id);
-    last_transformed_trajs_.erase(human_id);
-    auto last_traj_points_it = last_traj_points_.find(human_id);
-    if (last_traj_points_it != last_traj_points_.end()) {
-      last_traj_points_it->second.time_from_start.fromSec(0.0);
-    }
+    size_t slot = humans_.add(trajectory_kv.first);
+    humans_.reached[slot] = false;
+    humans_.cursors[slot] = 0;
+    humans_.transformed[slot] = false;
+    humans_.time_from_start[slot] = 0.0;
 
     // trajectories override plans
-    plans_.erase(human_id);
-    trajs_[human_id] = trajectory;
-    if (trajs_[human_id].points.size() > 1) {
-      trajs_[human_id].points.erase(trajs_[human_id].points.begin());
-    }
+    humans_.plans[slot].clear();
+    auto &source = trajectory_kv.second;
+    auto &trajectory = humans_.source_trajs[slot];
+    trajectory.header = source.header;
+    trajectory.points.assign(source.points.size() > 1
+                                 ? source.points.begin() + 1
+                                 : source.points.begin(),
+                             source.points.end());
+    humans_.from_traj[slot] = true;
+    humans_.has_motion[slot] = true;
   }
 
   return true;
@@ -127,276 +151,325 @@ bool TeleportController::computeHumansStates(
   }
   double cycle_time = (now - last_calc_time_).toSec();
   last_calc_time_ = now;
+  return stepHumans(humans, cycle_time);
+}
+
+bool TeleportController::computeHumansStates(
+    move_humans::map_traj_point &humans, double dt) {
+  // keep elapsed time consistent in case the caller switches back to it
+  last_calc_time_ = ros::Time::now();
+  reset_time_ = false;
+  return stepHumans(humans, dt);
+}
 
-  // get a copy of transformed plans, will transform if plans are new
-  move_humans::map_trajectory transformed_trajs;
-  if (!transformPlansAndTrajs(plans_, trajs_, transformed_trajs)) {
+bool TeleportController::stepHumans(move_humans::map_traj_point &humans,
+                                    double cycle_time) {
+  // transform plans and trajectories to controller frame, if they are new
+  static move_humans::Profiler::Probe &transform_probe =
+      move_humans::Profiler::instance().timer("teleport_controller/transform");
+  move_humans::ScopedTimer transform_timer(transform_probe);
+  if (!transformPlansAndTrajs()) {
     ROS_ERROR_NAMED(NODE_NAME, "Cannot transform plans to controller frame");
     return false;
   }
+  transform_timer.stop();
+
+  // humans are stepped independently, flags of the registry are only
+  // updated from their step results once all of them are done
+  step_results_.assign(humans_.size(), 0);
+  if (last_config_.parallel_threads != 1 &&
+      humans_.size() >= (size_t)last_config_.parallel_min_humans) {
+    step_pool_.resize(last_config_.parallel_threads);
+    step_pool_.parallelFor(
+        humans_.size(), last_config_.parallel_grain,
+        [this, cycle_time](size_t begin, size_t end, size_t worker) {
+          for (size_t slot = begin; slot < end; slot++) {
+            step_results_[slot] = stepHuman(slot, cycle_time);
+          }
+        });
+  } else {
+    for (size_t slot = 0; slot < humans_.size(); slot++) {
+      step_results_[slot] = stepHuman(slot, cycle_time);
+    }
+  }
+  for (size_t slot = 0; slot < humans_.size(); slot++) {
+    if (step_results_[slot] & STEP_MOVED) {
+      humans_.has_state[slot] = true;
+    }
+    if (step_results_[slot] & STEP_REACHED) {
+      humans_.reached[slot] = true;
+    }
+  }
 
-  for (auto &traj_kv : transformed_trajs) {
-    auto &human_id = traj_kv.first;
-    auto &transformed_traj = traj_kv.second;
-
-    if (transformed_traj.points.empty()) {
-      ROS_ERROR_NAMED(
-          NODE_NAME, "Transformed trajectory is empty for human %ld", human_id);
-      reached_goals_.push_back(human_id);
+  // give states of all humans, humans that reached their goals in this cycle
+  // are given for the last time and then forgotten until they get a new plan
+  humans.clear();
+  bool any_state = false;
+  for (size_t slot = 0; slot < humans_.size(); slot++) {
+    if (!humans_.has_state[slot]) {
       continue;
     }
-
-    // get the last updated traj-point of the human, if we are revisiting them
-    hanp_msgs::TrajectoryPoint last_traj_point;
-    auto last_traj_points_it = last_traj_points_.find(human_id);
-    if (last_traj_points_it != last_traj_points_.end()) {
-      last_traj_point = last_traj_points_it->second;
+    humans[humans_.ids[slot]] = humans_.getPoint(slot);
+    if (humans_.reached[slot]) {
+      humans_.has_state[slot] = false;
+      humans_.has_motion[slot] = false;
+      humans_.plans[slot].clear();
+      humans_.source_trajs[slot].points.clear();
+      humans_.trajs[slot].points.clear();
+      humans_.packed_trajs[slot].clear();
     } else {
-      last_traj_point = transformed_traj.points.front();
+      any_state = true;
     }
+  }
 
-    // get last visited point index on the plan
-    auto last_traversed_indices_it = last_traversed_indices_.find(human_id);
-    size_t begin_index =
-        last_traversed_indices_it != last_traversed_indices_.end()
-            ? last_traversed_indices_it->second
-            : 0;
-
-    // reset controller if we got a new plan with too far starting pose
-    if (begin_index == 0) {
-      auto &start_pose = transformed_traj.points.front().transform;
-      double start_dist = std::hypot(
-          start_pose.translation.x - last_traj_point.transform.translation.x,
-          start_pose.translation.y - last_traj_point.transform.translation.y);
-      if (start_dist > last_config_.reset_dist) {
-        ROS_INFO_NAMED(NODE_NAME, "Resetting human %ld controller", human_id);
-        last_traj_point = transformed_traj.points.front();
-      }
-    }
+  if (!any_state) {
+    reset_time_ = true;
+  }
 
-    // find porjected last pose on the plan
-    geometry_msgs::Vector3 projected_last_trans;
-    size_t next_point_index;
-    if (!getProjectedPose(transformed_traj, begin_index,
-                          last_traj_point.transform.translation,
-                          projected_last_trans, next_point_index)) {
-      ROS_ERROR_NAMED(NODE_NAME, "Error in projecint current pose");
-      continue;
-    }
-    last_traj_point.transform.translation = projected_last_trans;
-    last_traj_point.transform.rotation =
-        transformed_traj.points[next_point_index].transform.rotation;
-    // not updating time and velocity of last_traj_point;
-
-    // get references to adjusted last pose and twist
-    auto last_point = last_traj_point;
-    double last_time = last_point.time_from_start.toSec();
-    double linear_dist, linear_time, angular_dist, angular_time, step_time,
-        total_time = 0.0, acc_time = 0.0, last_total_time = 0.0;
-    double start_point_time = last_time < 0.0 ? 0.0 : last_time;
-    while (next_point_index < transformed_traj.points.size()) {
-      auto &next_point = transformed_traj.points[next_point_index];
-      double point_time = next_point.time_from_start.toSec();
-      if (point_time < 0.0) {
-        linear_dist = std::hypot(next_point.transform.translation.x -
-                                     last_point.transform.translation.x,
-                                 next_point.transform.translation.y -
-                                     last_point.transform.translation.y);
-        if (linear_dist < POINT_JUMP_EPS) {
-          next_point_index++;
-          continue;
-        }
-        linear_time = linear_dist / last_config_.max_linear_vel;
-        angular_dist = std::abs(angles::shortest_angular_distance(
-            tf::getYaw(last_point.transform.rotation),
-            tf::getYaw(next_point.transform.rotation)));
-        angular_time = angular_dist / last_config_.max_angular_vel;
-        // angular_time = 0.0;
-        step_time = std::max(linear_time, angular_time);
-        acc_time += step_time;
-        total_time += step_time;
-      } else {
-        total_time = acc_time + (point_time - start_point_time);
-      }
+  publishPlansFromTrajs();
+  return true;
+}
 
-      if (total_time >= cycle_time) {
-        break;
-      }
-      last_total_time = total_time;
-      last_point = next_point;
-      next_point_index++;
-    }
+uint8_t TeleportController::stepHuman(size_t slot, double cycle_time) {
+  if (!humans_.has_motion[slot] || !humans_.transformed[slot] ||
+      humans_.reached[slot]) {
+    return 0;
+  }
+  auto human_id = humans_.ids[slot];
+  auto &transformed_traj = humans_.trajs[slot];
 
-    if (next_point_index >= (transformed_traj.points.size() - 1)) {
-      reached_goals_.push_back(human_id);
-      last_traj_point.transform = transformed_traj.points.back().transform;
-      last_traj_point.velocity.linear.x = 0.0;
-      last_traj_point.velocity.angular.z = 0.0;
-      last_traj_point.time_from_start.fromSec(-1.0);
-      last_traj_points_[human_id] = last_traj_point;
-      transformed_traj.points.clear();
-      continue;
-    }
-    if (next_point_index != 0) {
-      last_traversed_indices_[human_id] = next_point_index - 1;
-    } else {
-      last_traversed_indices_[human_id] = next_point_index;
+  if (transformed_traj.points.empty()) {
+    ROS_ERROR_NAMED(
+        NODE_NAME, "Transformed trajectory is empty for human %ld", human_id);
+    return STEP_REACHED;
+  }
+
+  // get the last updated traj-point of the human, if we are revisiting them
+  hanp_msgs::TrajectoryPoint last_traj_point =
+      humans_.has_state[slot] ? humans_.getPoint(slot)
+                              : transformed_traj.points.front();
+
+  // get last visited point index on the plan
+  size_t begin_index = humans_.cursors[slot];
+
+  // reset controller if we got a new plan with too far starting pose
+  if (begin_index == 0) {
+    auto &start_pose = transformed_traj.points.front().transform;
+    double start_dist = std::hypot(
+        start_pose.translation.x - last_traj_point.transform.translation.x,
+        start_pose.translation.y - last_traj_point.transform.translation.y);
+    if (start_dist > last_config_.reset_dist) {
+      ROS_INFO_NAMED(NODE_NAME, "Resetting human %ld controller", human_id);
+      last_traj_point = transformed_traj.points.front();
     }
+  }
 
-    double ep_time = cycle_time - last_total_time;
+  // find porjected last pose on the plan
+  geometry_msgs::Vector3 projected_last_trans;
+  size_t next_point_index;
+  static move_humans::Profiler::Probe &projection_probe =
+      move_humans::Profiler::instance().timer("teleport_controller/projection");
+  move_humans::ScopedTimer projection_timer(projection_probe);
+  if (!getProjectedPose(transformed_traj, humans_.packed_trajs[slot],
+                        begin_index,
+                        last_traj_point.transform.translation,
+                        projected_last_trans, next_point_index)) {
+    ROS_ERROR_NAMED(NODE_NAME, "Error in projecint current pose");
+    return 0;
+  }
+  projection_timer.stop();
+  // the walk and interpolation to the end of the step
+  MOVE_HUMANS_PROFILE_SCOPE("teleport_controller/interpolation");
+  last_traj_point.transform.translation = projected_last_trans;
+  last_traj_point.transform.rotation =
+      transformed_traj.points[next_point_index].transform.rotation;
+  // not updating time and velocity of last_traj_point;
+
+  // walk the stored trajectory from the adjusted last pose without copying
+  const hanp_msgs::TrajectoryPoint *last_point = &last_traj_point;
+  double last_time = last_point->time_from_start.toSec();
+  double linear_dist, linear_time, angular_dist, angular_time, step_time,
+      total_time = 0.0, acc_time = 0.0, last_total_time = 0.0;
+  double start_point_time = last_time < 0.0 ? 0.0 : last_time;
+  while (next_point_index < transformed_traj.points.size()) {
     auto &next_point = transformed_traj.points[next_point_index];
-
-    double last_point_time = last_point.time_from_start.toSec();
-    double next_point_time = next_point.time_from_start.toSec();
-
-    // ROS_INFO(
-    //     "n-1 x=%.2f y=%.2f theta=%.2f lin=%.2f ang=%.2f time=%.2f",
-    //     last_point.transform.translation.x, last_point.transform.translation.y,
-    //     tf::getYaw(last_point.transform.rotation), last_point.velocity.linear.x,
-    //     last_point.velocity.angular.z, last_point_time);
-    // ROS_INFO(
-    //     "n+1 x=%.2f y=%.2f theta=%.2f lin=%.2f ang=%.2f time=%.2f ep=%.2f",
-    //     next_point.transform.translation.x, next_point.transform.translation.y,
-    //     tf::getYaw(next_point.transform.rotation), next_point.velocity.linear.x,
-    //     next_point.velocity.angular.z, next_point_time, ep_time);
-
-    if (ep_time > EP_TIME_EPS) {
-      if (last_point_time >= 0.0 && next_point_time >= 0.0) {
-        // interpolate pose and velocity
-        double time_ratio =
-            std::min(ep_time / (next_point_time - last_point_time), 1.0);
-        last_point.transform.translation.x +=
-            (next_point.transform.translation.x -
-             last_point.transform.translation.x) *
-            time_ratio;
-        last_point.transform.translation.y +=
-            (next_point.transform.translation.y -
-             last_point.transform.translation.y) *
-            time_ratio;
-        last_point.transform.rotation = tf::createQuaternionMsgFromYaw(
-            tf::getYaw(last_point.transform.rotation) +
-            angles::shortest_angular_distance(
-                tf::getYaw(last_point.transform.rotation),
-                tf::getYaw(next_point.transform.rotation)) *
-                time_ratio);
-        last_point.velocity.linear.x +=
-            (next_point.velocity.linear.x - last_point.velocity.linear.x) *
-            time_ratio;
-        last_point.velocity.angular.z +=
-            (next_point.velocity.angular.z - last_point.velocity.angular.z) *
-            time_ratio;
-        last_point.time_from_start.fromSec(
-            last_point.time_from_start.toSec() +
-            (next_point.time_from_start.toSec() -
-             last_point.time_from_start.toSec()) *
-                time_ratio);
-        // ROS_INFO("tr=%.2f", time_ratio);
-
-        // // here we first get interpolated velocity linear_dist =
-        // std::hypot(next_point.transform.translation.x -
-        //                last_point.transform.translation.x,
-        //            next_point.transform.translation.y -
-        //                last_point.transform.translation.y);
-        // last_point.velocity.linear.x +=
-        //     (next_point.velocity.linear.x - last_point.velocity.linear.x) *
-        //     ep_time;
-        // last_point.velocity.angular.z +=
-        //     (next_point.velocity.angular.z - last_point.velocity.angular.z) *
-        //     ep_time;
-        // double can_lin_dist = last_point.velocity.linear.x * ep_time;
-        // double ratio_lin_dist = std::min(can_lin_dist / linear_dist, 1.0);
-
-        // last_point.transform.translation.x +=
-        //     (next_point.transform.translation.x -
-        //      last_point.transform.translation.x) *
-        //     ratio_lin_dist;
-        // last_point.transform.translation.y +=
-        //     (next_point.transform.translation.y -
-        //      last_point.transform.translation.y) *
-        //     ratio_lin_dist;
-
-        // angular_dist = angles::shortest_angular_distance(
-        //     tf::getYaw(last_point.transform.rotation),
-        //     tf::getYaw(next_point.transform.rotation));
-        // double can_ang_dist = next_point.velocity.angular.z * ep_time;
-        // double ratio_ang_dist =
-        //     std::min(can_ang_dist / std::abs(angular_dist), 1.0);
-        // last_point.transform.rotation = tf::createQuaternionMsgFromYaw(
-        //     tf::getYaw(last_point.transform.rotation) +
-        //     (angular_dist * ratio_ang_dist));
-      } else {
-        // assuming maximum velocities
-        linear_dist = std::hypot(next_point.transform.translation.x -
-                                     last_point.transform.translation.x,
-                                 next_point.transform.translation.y -
-                                     last_point.transform.translation.y);
-        double can_lin_dist = last_config_.max_linear_vel * ep_time;
-        double ratio_lin_dist = std::min(can_lin_dist / linear_dist, 1.0);
-        last_point.transform.translation.x +=
-            (next_point.transform.translation.x -
-             last_point.transform.translation.x) *
-            ratio_lin_dist;
-        last_point.transform.translation.y +=
-            (next_point.transform.translation.y -
-             last_point.transform.translation.y) *
-            ratio_lin_dist;
-
-        angular_dist = angles::shortest_angular_distance(
-            tf::getYaw(last_point.transform.rotation),
-            tf::getYaw(next_point.transform.rotation));
-        double can_ang_dist = last_config_.max_angular_vel * ep_time;
-        double ratio_ang_dist =
-            std::min(can_ang_dist / std::abs(angular_dist), 1.0);
-        last_point.transform.rotation = tf::createQuaternionMsgFromYaw(
-            tf::getYaw(last_point.transform.rotation) +
-            (angular_dist * ratio_ang_dist));
-        // ROS_INFO("ad=%.2f, cad=%.2f, rad=%.2f", angular_dist, can_ang_dist,
-        //          ratio_ang_dist);
-
-        // we calculate velocities from distance to last updated point
-        linear_dist = std::hypot(last_point.transform.translation.x -
-                                     last_traj_point.transform.translation.x,
-                                 last_point.transform.translation.y -
-                                     last_traj_point.transform.translation.y);
-        last_point.velocity.linear.x = linear_dist / cycle_time;
-        angular_dist = tf::getYaw(last_point.transform.rotation) -
-                       tf::getYaw(last_traj_point.transform.rotation);
-        last_point.velocity.angular.z = angular_dist / cycle_time;
-
-        last_point.time_from_start.fromSec(-1.0);
+    double point_time = next_point.time_from_start.toSec();
+    if (point_time < 0.0) {
+      linear_dist = std::hypot(next_point.transform.translation.x -
+                                   last_point->transform.translation.x,
+                               next_point.transform.translation.y -
+                                   last_point->transform.translation.y);
+      if (linear_dist < POINT_JUMP_EPS) {
+        next_point_index++;
+        continue;
       }
+      linear_time = linear_dist / last_config_.max_linear_vel;
+      angular_dist = std::abs(angles::shortest_angular_distance(
+          tf::getYaw(last_point->transform.rotation),
+          tf::getYaw(next_point.transform.rotation)));
+      angular_time = angular_dist / last_config_.max_angular_vel;
+      // angular_time = 0.0;
+      step_time = std::max(linear_time, angular_time);
+      acc_time += step_time;
+      total_time += step_time;
+    } else {
+      total_time = acc_time + (point_time - start_point_time);
     }
 
-    // ROS_INFO(
-    //     "new x=%.2f y=%.2f theta=%.2f lin=%.2f ang=%.2f time=%.2f\n",
-    //     last_point.transform.translation.x, last_point.transform.translation.y,
-    //     tf::getYaw(last_point.transform.rotation), last_point.velocity.linear.x,
-    //     last_point.velocity.angular.z, last_point.time_from_start.toSec());
-
-    last_traj_points_[human_id] = last_point;
-    if (next_point_index != 0) {
-      transformed_traj.points.erase(transformed_traj.points.begin(),
-                                    transformed_traj.points.begin() +
-                                        next_point_index - 1);
+    if (total_time >= cycle_time) {
+      break;
     }
-    transformed_traj.points.insert(transformed_traj.points.begin(), last_point);
+    last_total_time = total_time;
+    last_point = &next_point;
+    next_point_index++;
   }
 
-  humans = last_traj_points_;
-
-  for (auto &human_id : reached_goals_) {
-    last_traj_points_.erase(human_id);
-    transformed_trajs.erase(human_id);
-    plans_.erase(human_id);
-    trajs_.erase(human_id);
+  if (next_point_index >= (transformed_traj.points.size() - 1)) {
+    last_traj_point.transform = transformed_traj.points.back().transform;
+    last_traj_point.velocity.linear.x = 0.0;
+    last_traj_point.velocity.angular.z = 0.0;
+    last_traj_point.time_from_start.fromSec(-1.0);
+    humans_.storePoint(slot, last_traj_point);
+    return STEP_MOVED | STEP_REACHED;
   }
-
-  if (last_traj_points_.empty()) {
-    reset_time_ = true;
+  humans_.cursors[slot] =
+      next_point_index != 0 ? next_point_index - 1 : next_point_index;
+
+  double ep_time = cycle_time - last_total_time;
+  auto &next_point = transformed_traj.points[next_point_index];
+
+  // interpolated point between last traversed and next trajectory points
+  auto current_point = *last_point;
+
+  double last_point_time = current_point.time_from_start.toSec();
+  double next_point_time = next_point.time_from_start.toSec();
+
+  // ROS_INFO(
+  //     "n-1 x=%.2f y=%.2f theta=%.2f lin=%.2f ang=%.2f time=%.2f",
+  //     last_point.transform.translation.x, last_point.transform.translation.y,
+  //     tf::getYaw(last_point.transform.rotation), last_point.velocity.linear.x,
+  //     last_point.velocity.angular.z, last_point_time);
+  // ROS_INFO(
+  //     "n+1 x=%.2f y=%.2f theta=%.2f lin=%.2f ang=%.2f time=%.2f ep=%.2f",
+  //     next_point.transform.translation.x, next_point.transform.translation.y,
+  //     tf::getYaw(next_point.transform.rotation), next_point.velocity.linear.x,
+  //     next_point.velocity.angular.z, next_point_time, ep_time);
+
+  if (ep_time > EP_TIME_EPS) {
+    if (last_point_time >= 0.0 && next_point_time >= 0.0) {
+      // interpolate pose and velocity
+      double time_ratio =
+          std::min(ep_time / (next_point_time - last_point_time), 1.0);
+      current_point.transform.translation.x +=
+          (next_point.transform.translation.x -
+           current_point.transform.translation.x) *
+          time_ratio;
+      current_point.transform.translation.y +=
+          (next_point.transform.translation.y -
+           current_point.transform.translation.y) *
+          time_ratio;
+      current_point.transform.rotation = tf::createQuaternionMsgFromYaw(
+          tf::getYaw(current_point.transform.rotation) +
+          angles::shortest_angular_distance(
+              tf::getYaw(current_point.transform.rotation),
+              tf::getYaw(next_point.transform.rotation)) *
+              time_ratio);
+      current_point.velocity.linear.x +=
+          (next_point.velocity.linear.x - current_point.velocity.linear.x) *
+          time_ratio;
+      current_point.velocity.angular.z +=
+          (next_point.velocity.angular.z - current_point.velocity.angular.z) *
+          time_ratio;
+      current_point.time_from_start.fromSec(
+          current_point.time_from_start.toSec() +
+          (next_point.time_from_start.toSec() -
+           current_point.time_from_start.toSec()) *
+              time_ratio);
+      // ROS_INFO("tr=%.2f", time_ratio);
+
+      // // here we first get interpolated velocity linear_dist =
+      // std::hypot(next_point.transform.translation.x -
+      //                last_point.transform.translation.x,
+      //            next_point.transform.translation.y -
+      //                last_point.transform.translation.y);
+      // last_point.velocity.linear.x +=
+      //     (next_point.velocity.linear.x - last_point.velocity.linear.x) *
+      //     ep_time;
+      // last_point.velocity.angular.z +=
+      //     (next_point.velocity.angular.z - last_point.velocity.angular.z) *
+      //     ep_time;
+      // double can_lin_dist = last_point.velocity.linear.x * ep_time;
+      // double ratio_lin_dist = std::min(can_lin_dist / linear_dist, 1.0);
+
+      // last_point.transform.translation.x +=
+      //     (next_point.transform.translation.x -
+      //      last_point.transform.translation.x) *
+      //     ratio_lin_dist;
+      // last_point.transform.translation.y +=
+      //     (next_point.transform.translation.y -
+      //      last_point.transform.translation.y) *
+      //     ratio_lin_dist;
+
+      // angular_dist = angles::shortest_angular_distance(
+      //     tf::getYaw(last_point.transform.rotation),
+      //     tf::getYaw(next_point.transform.rotation));
+      // double can_ang_dist = next_point.velocity.angular.z * ep_time;
+      // double ratio_ang_dist =
+      //     std::min(can_ang_dist / std::abs(angular_dist), 1.0);
+      // last_point.transform.rotation = tf::createQuaternionMsgFromYaw(
+      //     tf::getYaw(last_point.transform.rotation) +
+      //     (angular_dist * ratio_ang_dist));
+    } else {
+      // assuming maximum velocities
+      linear_dist = std::hypot(next_point.transform.translation.x -
+                                   current_point.transform.translation.x,
+                               next_point.transform.translation.y -
+                                   current_point.transform.translation.y);
+      double can_lin_dist = last_config_.max_linear_vel * ep_time;
+      double ratio_lin_dist = std::min(can_lin_dist / linear_dist, 1.0);
+      current_point.transform.translation.x +=
+          (next_point.transform.translation.x -
+           current_point.transform.translation.x) *
+          ratio_lin_dist;
+      current_point.transform.translation.y +=
+          (next_point.transform.translation.y -
+           current_point.transform.translation.y) *
+          ratio_lin_dist;
+
+      angular_dist = angles::shortest_angular_distance(
+          tf::getYaw(current_point.transform.rotation),
+          tf::getYaw(next_point.transform.rotation));
+      double can_ang_dist = last_config_.max_angular_vel * ep_time;
+      double ratio_ang_dist =
+          std::min(can_ang_dist / std::abs(angular_dist), 1.0);
+      current_point.transform.rotation = tf::createQuaternionMsgFromYaw(
+          tf::getYaw(current_point.transform.rotation) +
+          (angular_dist * ratio_ang_dist));
+      // ROS_INFO("ad=%.2f, cad=%.2f, rad=%.2f", angular_dist, can_ang_dist,
+      //          ratio_ang_dist);
+
+      // we calculate velocities from distance to last updated point
+      linear_dist = std::hypot(current_point.transform.translation.x -
+                                   last_traj_point.transform.translation.x,
+                               current_point.transform.translation.y -
+                                   last_traj_point.transform.translation.y);
+      current_point.velocity.linear.x = linear_dist / cycle_time;
+      angular_dist = tf::getYaw(current_point.transform.rotation) -
+                     tf::getYaw(last_traj_point.transform.rotation);
+      current_point.velocity.angular.z = angular_dist / cycle_time;
+
+      current_point.time_from_start.fromSec(-1.0);
+    }
   }
 
-  publishPlansFromTrajs(transformed_trajs);
-  return true;
+  // ROS_INFO(
+  //     "new x=%.2f y=%.2f theta=%.2f lin=%.2f ang=%.2f time=%.2f\n",
+  //     last_point.transform.translation.x, last_point.transform.translation.y,
+  //     tf::getYaw(last_point.transform.rotation), last_point.velocity.linear.x,
+  //     last_point.velocity.angular.z, last_point.time_from_start.toSec());
+
+  humans_.storePoint(slot, current_point);
+  return STEP_MOVED;
 }
 
 bool TeleportController::areGoalsReached(
@@ -406,205 +479,235 @@ bool TeleportController::areGoalsReached(
     return false;
   }
 
-  reached_humans = reached_goals_;
+  reached_humans.clear();
+  for (size_t slot = humans_.reached.find_first();
+       slot != boost::dynamic_bitset<>::npos;
+       slot = humans_.reached.find_next(slot)) {
+    reached_humans.push_back(humans_.ids[slot]);
+  }
   return true;
 }
 
-bool TeleportController::transformPlansAndTrajs(
-    const move_humans::map_pose_vector &plans,
-    const move_humans::map_trajectory &trajs,
-    move_humans::map_trajectory &transformed_trajs) {
-  transformed_trajs.clear();
+bool TeleportController::removeHumans(const move_humans::id_vector &human_ids) {
+  if (!isInitialized()) {
+    ROS_ERROR_NAMED(NODE_NAME, "This controller has not been initialized");
+    return false;
+  }
 
-  for (auto &plan_kv : plans) {
-    auto &human_id = plan_kv.first;
-    auto &plan = plan_kv.second;
+  for (auto human_id : human_ids) {
+    humans_.remove(human_id);
+  }
+  return true;
+}
 
-    if (plan.empty()) {
-      ROS_ERROR_NAMED(NODE_NAME, "Received empty plan for human %ld", human_id);
+bool TeleportController::transformPlansAndTrajs() {
+  bool any_transformed = false;
+  // frame transforms are looked up at most once per cycle
+  frame_transforms_.clear();
+  for (size_t slot = 0; slot < humans_.size(); slot++) {
+    if (!humans_.has_motion[slot] || humans_.reached[slot]) {
       continue;
     }
-
-    if (plan[0].header.frame_id == "") {
-      ROS_ERROR_NAMED(NODE_NAME, "Plan frame is empty for human %ld", human_id);
-      continue;
+    if (humans_.transformed[slot]) {
+      ROS_DEBUG_NAMED(NODE_NAME,
+                      "Giving pre-transformed trajectory for human %ld",
+                      humans_.ids[slot]);
+    } else {
+      humans_.transformed[slot] =
+          humans_.from_traj[slot] ? transformTraj(slot) : transformPlan(slot);
+      if (humans_.transformed[slot]) {
+        humans_.packed_trajs[slot].assign(humans_.trajs[slot]);
+      }
     }
+    any_transformed |= humans_.transformed[slot];
+  }
+  return any_transformed;
+}
 
-    if (std::find(reached_goals_.begin(), reached_goals_.end(), human_id) !=
-        reached_goals_.end()) {
-      continue;
-    }
+bool TeleportController::transformPlan(size_t slot) {
+  auto human_id = humans_.ids[slot];
+  auto &plan = humans_.plans[slot];
+  auto &transformed_traj = humans_.trajs[slot];
 
-    auto transformed_traj_it = last_transformed_trajs_.find(human_id);
-    if (transformed_traj_it != last_transformed_trajs_.end()) {
-      transformed_trajs[human_id] = transformed_traj_it->second;
-      ROS_DEBUG_NAMED(
-          NODE_NAME,
-          "Giving pre-transformed trajectory (from plan) for human %ld",
-          human_id);
-      continue;
+  if (plan.empty()) {
+    ROS_ERROR_NAMED(NODE_NAME, "Received empty plan for human %ld", human_id);
+    return false;
+  }
+
+  if (plan[0].header.frame_id == "") {
+    ROS_ERROR_NAMED(NODE_NAME, "Plan frame is empty for human %ld", human_id);
+    return false;
+  }
+
+  transformed_traj = hanp_msgs::Trajectory();
+  transformed_traj.points.resize(plan.size());
+  if (plan[0].header.frame_id != controller_frame_) {
+    auto frame_transform = getFrameTransform(plan[0].header.frame_id, false);
+    if (!frame_transform) {
+      return false;
     }
 
-    if (plan[0].header.frame_id != controller_frame_) {
-      ROS_INFO("plan %s controller %s", plan[0].header.frame_id.c_str(),
-               controller_frame_.c_str());
-      try {
-        tf::StampedTransform plan_to_controller_transform;
-        tf_->waitForTransform(controller_frame_, plan[0].header.frame_id,
-                              ros::Time(0), ros::Duration(0.5));
-        tf_->lookupTransform(controller_frame_, plan[0].header.frame_id,
-                             ros::Time(0), plan_to_controller_transform);
-
-        tf::Transform tf_trans;
-        hanp_msgs::Trajectory transformed_traj;
-        transformed_traj.header.stamp = plan_to_controller_transform.stamp_;
-        transformed_traj.header.frame_id = controller_frame_;
-        for (auto &pose : plan) {
-          hanp_msgs::TrajectoryPoint traj_point;
-          traj_point.transform.translation.x = pose.pose.position.x;
-          traj_point.transform.translation.y = pose.pose.position.y;
-          traj_point.transform.translation.z = pose.pose.position.z;
-          traj_point.transform.rotation = pose.pose.orientation;
-          tf::transformMsgToTF(traj_point.transform, tf_trans);
-          tf_trans = plan_to_controller_transform * tf_trans;
-          tf::transformTFToMsg(tf_trans, traj_point.transform);
-          traj_point.time_from_start.fromSec(-1.0);
-          transformed_traj.points.push_back(traj_point);
-        }
-        transformed_trajs[human_id] = transformed_traj;
-        last_transformed_trajs_[human_id] = transformed_traj;
-        ROS_DEBUG_NAMED(
-            NODE_NAME,
-            "Giving new transformed trajectory (from plan) for human %ld",
-            human_id);
-      } catch (tf::LookupException &ex) {
-        ROS_ERROR_NAMED(NODE_NAME, "No Transform available Error: %s\n",
-                        ex.what());
-        continue;
-      } catch (tf::ConnectivityException &ex) {
-        ROS_ERROR_NAMED(NODE_NAME, "Connectivity Error: %s\n", ex.what());
-        continue;
-      } catch (tf::ExtrapolationException &ex) {
-        ROS_ERROR_NAMED(NODE_NAME, "Extrapolation Error: %s\n", ex.what());
-        continue;
-      }
-    } else {
-      hanp_msgs::Trajectory transformed_traj;
-      for (auto &pose : plan) {
-        hanp_msgs::TrajectoryPoint traj_point;
-        traj_point.transform.translation.x = pose.pose.position.x;
-        traj_point.transform.translation.y = pose.pose.position.y;
-        traj_point.transform.translation.z = pose.pose.position.z;
-        traj_point.transform.rotation = pose.pose.orientation;
-        traj_point.time_from_start.fromSec(-1.0);
-        transformed_traj.points.push_back(traj_point);
-      }
-      transformed_trajs[human_id] = transformed_traj;
-      last_transformed_trajs_[human_id] = transformed_traj;
-      ROS_DEBUG_NAMED(NODE_NAME,
-                     "Giving converted trajectory (from plan) for human %ld",
-                     human_id);
+    transformed_traj.header.stamp = frame_transform->stamp;
+    transformed_traj.header.frame_id = controller_frame_;
+    for (size_t i = 0; i < plan.size(); i++) {
+      auto &traj_point = transformed_traj.points[i];
+      frame_transform->apply(plan[i].pose.position, plan[i].pose.orientation,
+                             traj_point.transform);
+      traj_point.time_from_start.fromSec(-1.0);
+    }
+    ROS_DEBUG_NAMED(
+        NODE_NAME,
+        "Giving new transformed trajectory (from plan) for human %ld",
+        human_id);
+  } else {
+    for (size_t i = 0; i < plan.size(); i++) {
+      auto &pose = plan[i].pose;
+      auto &traj_point = transformed_traj.points[i];
+      traj_point.transform.translation.x = pose.position.x;
+      traj_point.transform.translation.y = pose.position.y;
+      traj_point.transform.translation.z = pose.position.z;
+      traj_point.transform.rotation = pose.orientation;
+      traj_point.time_from_start.fromSec(-1.0);
     }
+    ROS_DEBUG_NAMED(NODE_NAME,
+                    "Giving converted trajectory (from plan) for human %ld",
+                    human_id);
   }
+  return true;
+}
 
-  for (auto &traj_kv : trajs) {
-    auto &human_id = traj_kv.first;
-    auto &traj = traj_kv.second;
+bool TeleportController::transformTraj(size_t slot) {
+  auto human_id = humans_.ids[slot];
+  auto &traj = humans_.source_trajs[slot];
+  auto &transformed_traj = humans_.trajs[slot];
 
-    if (traj.points.empty()) {
-      ROS_ERROR_NAMED(NODE_NAME, "Received empty trajectory for human %ld",
-                      human_id);
-      continue;
-    }
+  if (traj.points.empty()) {
+    ROS_ERROR_NAMED(NODE_NAME, "Received empty trajectory for human %ld",
+                    human_id);
+    return false;
+  }
 
-    if (traj.header.frame_id == "") {
-      ROS_ERROR_NAMED(NODE_NAME, "Plan frame is empty for human %ld", human_id);
-      continue;
-    }
+  if (traj.header.frame_id == "") {
+    ROS_ERROR_NAMED(NODE_NAME, "Plan frame is empty for human %ld", human_id);
+    return false;
+  }
 
-    if (std::find(reached_goals_.begin(), reached_goals_.end(), human_id) !=
-        reached_goals_.end()) {
-      continue;
+  if (traj.header.frame_id != controller_frame_) {
+    auto frame_transform = getFrameTransform(traj.header.frame_id, true);
+    if (!frame_transform) {
+      return false;
     }
 
-    auto transformed_traj_it = last_transformed_trajs_.find(human_id);
-    if (transformed_traj_it != last_transformed_trajs_.end()) {
-      transformed_trajs[human_id] = transformed_traj_it->second;
-      ROS_DEBUG_NAMED(
-          NODE_NAME,
-          "Giving pre-transformed trajectory (from traj) for human %ld",
-          human_id);
-      continue;
+    auto &frame_twist = frame_transform->twist;
+    transformed_traj = hanp_msgs::Trajectory();
+    transformed_traj.points.resize(traj.points.size());
+    transformed_traj.header.stamp = frame_transform->stamp;
+    transformed_traj.header.frame_id = controller_frame_;
+    for (size_t i = 0; i < traj.points.size(); i++) {
+      auto &traj_point = traj.points[i];
+      auto &tr_traj_point = transformed_traj.points[i];
+      frame_transform->apply(traj_point.transform.translation,
+                             traj_point.transform.rotation,
+                             tr_traj_point.transform);
+
+      tr_traj_point.velocity.linear.x =
+          traj_point.velocity.linear.x - frame_twist.linear.x;
+      tr_traj_point.velocity.linear.y =
+          traj_point.velocity.linear.y - frame_twist.linear.y;
+      tr_traj_point.velocity.angular.z =
+          traj_point.velocity.angular.z - frame_twist.angular.z;
+
+      tr_traj_point.time_from_start = traj_point.time_from_start;
     }
+    ROS_DEBUG_NAMED(NODE_NAME,
+                    "Giving transformed trajectory (from traj) for human %ld",
+                    human_id);
+  } else {
+    // already in controller frame, the source is not needed anymore
+    transformed_traj.header = traj.header;
+    transformed_traj.points.swap(traj.points);
+    traj.points.clear();
+    ROS_DEBUG_NAMED(NODE_NAME,
+                    "Giving converted trajectory (from traj) for human %ld",
+                    human_id);
+  }
+  return true;
+}
 
-    if (traj.header.frame_id != controller_frame_) {
+const TeleportController::FrameTransform *
+TeleportController::getFrameTransform(const std::string &frame,
+                                      bool with_twist) {
+  auto &frame_transform = frame_transforms_[frame];
+
+  if (!frame_transform.looked_up) {
+    frame_transform.looked_up = true;
+    std::string error;
+    if (!tf_->canTransform(controller_frame_, frame, ros::Time(0), &error)) {
+      ROS_ERROR_NAMED(NODE_NAME, "No Transform available from %s to %s: %s",
+                      frame.c_str(), controller_frame_.c_str(),
+                      error.c_str());
+    } else {
       try {
-        tf::StampedTransform traj_to_controller_transform;
-        tf_->waitForTransform(controller_frame_, traj.header.frame_id,
-                              ros::Time(0), ros::Duration(0.5));
-        tf_->lookupTransform(controller_frame_, traj.header.frame_id,
-                             ros::Time(0), traj_to_controller_transform);
-        geometry_msgs::Twist traj_vel_in_controller_frame;
-        tf_->lookupTwist(controller_frame_, traj.header.frame_id, ros::Time(0),
-                         ros::Duration(0.1), traj_vel_in_controller_frame);
-
-        tf::Transform tf_trans;
-        hanp_msgs::Trajectory transformed_traj;
-        transformed_traj.header.stamp = traj_to_controller_transform.stamp_;
-        transformed_traj.header.frame_id = controller_frame_;
-        for (auto &traj_point : traj.points) {
-          hanp_msgs::TrajectoryPoint tr_traj_point;
-          tf::transformMsgToTF(traj_point.transform, tf_trans);
-          tf_trans = traj_to_controller_transform * tf_trans;
-          tf::transformTFToMsg(tf_trans, tr_traj_point.transform);
-
-          tr_traj_point.velocity.linear.x =
-              traj_point.velocity.linear.x -
-              traj_vel_in_controller_frame.linear.x;
-          tr_traj_point.velocity.linear.y =
-              traj_point.velocity.linear.y -
-              traj_vel_in_controller_frame.linear.y;
-          tr_traj_point.velocity.angular.z =
-              traj_point.velocity.angular.z -
-              traj_vel_in_controller_frame.angular.z;
-
-          tr_traj_point.time_from_start = traj_point.time_from_start;
-          transformed_traj.points.push_back(tr_traj_point);
-        }
-        transformed_trajs[human_id] = transformed_traj;
-        last_transformed_trajs_[human_id] = transformed_traj;
-        ROS_DEBUG_NAMED(
-            NODE_NAME,
-            "Giving transformed trajectory (from traj) for human %ld",
-            human_id);
+        tf::StampedTransform frame_to_controller_transform;
+        tf_->lookupTransform(controller_frame_, frame, ros::Time(0),
+                             frame_to_controller_transform);
+        frame_transform.set(frame_to_controller_transform);
       } catch (tf::LookupException &ex) {
         ROS_ERROR_NAMED(NODE_NAME, "No Transform available Error: %s\n",
                         ex.what());
-        continue;
       } catch (tf::ConnectivityException &ex) {
         ROS_ERROR_NAMED(NODE_NAME, "Connectivity Error: %s\n", ex.what());
-        continue;
       } catch (tf::ExtrapolationException &ex) {
         ROS_ERROR_NAMED(NODE_NAME, "Extrapolation Error: %s\n", ex.what());
-        continue;
       }
-    } else {
-      ROS_INFO("givng old traj for human %ld", human_id);
-      transformed_trajs[human_id] = traj;
-      last_transformed_trajs_[human_id] = traj;
-      ROS_DEBUG_NAMED(NODE_NAME,
-                     "Giving converted trajectory (from traj) for human %ld",
-                     human_id);
     }
   }
 
-  return !transformed_trajs.empty();
+  if (frame_transform.valid && with_twist && !frame_transform.twist_looked_up) {
+    frame_transform.twist_looked_up = true;
+    try {
+      tf_->lookupTwist(controller_frame_, frame, ros::Time(0),
+                       ros::Duration(0.1), frame_transform.twist);
+      frame_transform.has_twist = true;
+    } catch (tf::TransformException &ex) {
+      ROS_ERROR_NAMED(NODE_NAME, "Twist lookup Error: %s\n", ex.what());
+    }
+  }
+
+  if (!frame_transform.valid || (with_twist && !frame_transform.has_twist)) {
+    return NULL;
+  }
+  return &frame_transform;
+}
+
+void TeleportController::FrameTransform::set(
+    const tf::StampedTransform &transform) {
+  stamp = transform.stamp_;
+  x = transform.getOrigin().x();
+  y = transform.getOrigin().y();
+  z = transform.getOrigin().z();
+  double yaw = tf::getYaw(transform.getRotation());
+  cos_yaw = std::cos(yaw);
+  sin_yaw = std::sin(yaw);
+  cos_half_yaw = std::cos(yaw / 2.0);
+  sin_half_yaw = std::sin(yaw / 2.0);
+  valid = true;
+}
+
+void TeleportController::FrameTransform::applyRotation(
+    const geometry_msgs::Quaternion &rotation,
+    geometry_msgs::Quaternion &transformed) const {
+  // product with the quaternion of a rotation around z
+  transformed.x = cos_half_yaw * rotation.x - sin_half_yaw * rotation.y;
+  transformed.y = cos_half_yaw * rotation.y + sin_half_yaw * rotation.x;
+  transformed.z = cos_half_yaw * rotation.z + sin_half_yaw * rotation.w;
+  transformed.w = cos_half_yaw * rotation.w - sin_half_yaw * rotation.z;
 }
 
 bool TeleportController::getProjectedPose(
-    const hanp_msgs::Trajectory &traj, const size_t begin_index,
-    const geometry_msgs::Vector3 &pose, geometry_msgs::Vector3 &projected_pose,
-    size_t &next_pose_index) {
+    const hanp_msgs::Trajectory &traj, const PackedPoints &packed_traj,
+    const size_t begin_index, const geometry_msgs::Vector3 &pose,
+    geometry_msgs::Vector3 &projected_pose, size_t &next_pose_index) {
   if (begin_index >= traj.points.size()) {
     ROS_ERROR_NAMED(NODE_NAME,
                     "Out of bound index provided to getProjectedPoint");
@@ -617,23 +720,15 @@ bool TeleportController::getProjectedPose(
     return true;
   }
 
-  // get the point with the smallest distance from start index
-  double x_diff, y_diff, sq_diff,
-      smallest_sq_diff = std::numeric_limits<double>::max();
-  auto np_index = begin_index;
-  // size_t np_index = 0;
-  while (np_index < traj.points.size()) {
-    x_diff = traj.points[np_index].transform.translation.x - pose.x;
-    y_diff = traj.points[np_index].transform.translation.y - pose.y;
-    sq_diff = x_diff * x_diff + y_diff * y_diff;
-    if (sq_diff > smallest_sq_diff) {
-      break;
-    } else {
-      smallest_sq_diff = sq_diff;
-      np_index++;
-    }
+  // get the point with the smallest distance from start index, within the
+  // configured window of points
+  size_t end_index = traj.points.size();
+  if (last_config_.projection_window > 0) {
+    end_index = std::min(
+        end_index, begin_index + (size_t)last_config_.projection_window + 1);
   }
-  np_index--;
+  auto np_index = nearestApproach(packed_traj.x.data(), packed_traj.y.data(),
+                                  begin_index, end_index, pose.x, pose.y);
 
   // return projected point on line between nearest point and point next ot it
   if (np_index == (traj.points.size() - 1)) {
@@ -672,35 +767,56 @@ bool TeleportController::projectPoint(const geometry_msgs::Vector3 &line_point1,
   return (val_dp > 0 && val_dp < lene1_sq);
 }
 
-void TeleportController::publishPlansFromTrajs(
-    const move_humans::map_trajectory &trajs) {
-  if (!last_config_.publish_plans) {
+void TeleportController::publishPlansFromTrajs() {
+  auto now = ros::Time::now();
+  if (!last_config_.publish_plans ||
+      !plans_throttle_.due(plans_pub_, last_config_.plans_publish_rate, now)) {
     return;
   }
 
-  auto now = ros::Time::now();
-  hanp_msgs::HumanPathArray human_path_array;
-  for (auto &traj_kv : trajs) {
-    if (!traj_kv.second.points.empty()) {
-      hanp_msgs::HumanPath human_path;
-      human_path.header.stamp = now;
-      human_path.header.frame_id = controller_frame_;
-      human_path.id = traj_kv.first;
-      human_path.path.header.stamp = now;
-      human_path.path.header.frame_id = controller_frame_;
-      for (auto &traj_point : traj_kv.second.points) {
-        geometry_msgs::PoseStamped pose;
-        pose.header.stamp = now;
-        pose.header.frame_id = controller_frame_;
-        pose.pose.position.x = traj_point.transform.translation.x;
-        pose.pose.position.y = traj_point.transform.translation.y;
-        pose.pose.position.z = traj_point.transform.translation.z;
-        pose.pose.orientation = traj_point.transform.rotation;
-        human_path.path.poses.push_back(pose);
-      }
-      human_path_array.paths.push_back(human_path);
+  // paths are rebuilt in place so that their buffers are reused
+  auto &human_path_array = plans_msg_;
+  size_t path_count = 0;
+  for (size_t slot = 0; slot < humans_.size(); slot++) {
+    auto &traj = humans_.trajs[slot];
+    size_t cursor = humans_.cursors[slot];
+    if (!humans_.has_motion[slot] || !humans_.transformed[slot] ||
+        humans_.reached[slot] || cursor >= traj.points.size()) {
+      continue;
+    }
+
+    // remaining path is the current pose followed by untraversed points
+    if (path_count == human_path_array.paths.size()) {
+      human_path_array.paths.emplace_back();
+    }
+    auto &human_path = human_path_array.paths[path_count++];
+    human_path.path.poses.clear();
+    human_path.header.stamp = now;
+    human_path.header.frame_id = controller_frame_;
+    human_path.id = humans_.ids[slot];
+    human_path.path.header.stamp = now;
+    human_path.path.header.frame_id = controller_frame_;
+    human_path.path.poses.reserve(traj.points.size() - cursor + 1);
+    geometry_msgs::PoseStamped pose;
+    pose.header.stamp = now;
+    pose.header.frame_id = controller_frame_;
+    if (humans_.has_state[slot]) {
+      pose.pose.position.x = humans_.x[slot];
+      pose.pose.position.y = humans_.y[slot];
+      pose.pose.orientation =
+          tf::createQuaternionMsgFromYaw(humans_.yaw[slot]);
+      human_path.path.poses.push_back(pose);
+    }
+    for (size_t i = cursor; i < traj.points.size(); i++) {
+      auto &traj_point = traj.points[i];
+      pose.pose.position.x = traj_point.transform.translation.x;
+      pose.pose.position.y = traj_point.transform.translation.y;
+      pose.pose.position.z = traj_point.transform.translation.z;
+      pose.pose.orientation = traj_point.transform.rotation;
+      human_path.path.poses.push_back(pose);
     }
   }
+  human_path_array.paths.resize(path_count);
   if (!human_path_array.paths.empty()) {
     human_path_array.header.stamp = now;
     human_path_array.header.frame_id = controller_frame_;